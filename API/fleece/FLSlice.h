@@ -162,8 +162,60 @@ static inline FLSliceResult FLSliceResult_CreateWith(const void *bytes, size_t s
 }
 
 
+/** A function that frees an external buffer adopted by \ref FLSliceResult_Adopt. */
+typedef void (*FLBufferDeallocator)(void *context, void *buf);
+
+/** The number of bytes in front of a buffer that \ref FLSliceResult_Adopt uses for its header. */
+#define kFLSliceAdoptHeadroom 32
+
+/** Creates an FLSliceResult that uses an externally allocated buffer without copying it, for
+    example to hand data received by a network stack to Fleece. When the last reference to it is
+    released, `dealloc(context, buf)` is called.
+    The ref-count is stored in front of the data, so the \ref kFLSliceAdoptHeadroom bytes before
+    `buf` must be part of the same allocation and otherwise unused until `dealloc` is called.
+    `buf` must be 8-byte aligned. */
+FLSliceResult FLSliceResult_Adopt(void *buf NONNULL, size_t size,
+                                  FLBufferDeallocator NONNULL dealloc, void *context) FLAPI;
+
+
+/** Statistics of the buffer pool; see \ref FLBufferPool_SetEnabled. */
+typedef struct {
+    uint64_t allocations;   ///< Buffers of up to 16KB allocated while the pool was enabled
+    uint64_t poolHits;      ///< ... of which reused a cached buffer instead of calling malloc
+    uint64_t bytesCached;   ///< Memory currently held in the pool's caches
+    uint64_t adopted;       ///< External buffers adopted with \ref FLSliceResult_Adopt
+} FLBufferPoolStats;
+
+/** Turns the buffer pool on or off; it's off by default.
+    While it's on, buffers of up to 16KB (for FLSliceResult, alloc_slice, and everything that uses
+    them) come from per-thread caches of power-of-two size classes instead of `malloc`, which is
+    much faster when many short-lived buffers are allocated and freed. The cost is memory: sizes
+    are rounded up, and freed buffers are kept for reuse (up to 64KB per size class per thread,
+    plus 1MB per size class shared between threads.)
+    Turning the pool off frees the cached buffers of the calling thread and the shared cache. */
+void FLBufferPool_SetEnabled(bool enabled) FLAPI;
+
+/** Gets the buffer pool's statistics, totalled over all threads. */
+void FLBufferPool_GetStats(FLBufferPoolStats* NONNULL) FLAPI;
+
+/** Frees the buffers cached by the calling thread and the shared cache. */
+void FLBufferPool_Trim(void) FLAPI;
+
+
+/** Turns thread-confined mode on or off for the calling thread, and returns the previous setting.
+    It's off by default.
+    While it's on, buffers (FLSliceResult, alloc_slice) and ref-counted objects (documents,
+    mutable collections, shared keys...) created on this thread use non-atomic reference counts,
+    which are cheaper to retain and release. Such buffers and objects must never be retained or
+    released by any other thread, even after the mode is turned off. Objects created on other
+    threads or while the mode is off are unaffected, so it's fine to use a long-lived shared
+    object, like an FLSharedKeys, in thread-confined mode. */
+bool FL_SetThreadConfined(bool confined) FLAPI;
+
+
 void _FLBuf_Retain(const void*) FLAPI;   // internal; do not call
 void _FLBuf_Release(const void*) FLAPI;  // internal; do not call
+bool _FLBuf_IsThreadConfined(const void*) FLAPI;  // internal; do not call
 
 /** Increments the ref-count of a FLSliceResult. */
 static inline FLSliceResult FLSliceResult_Retain(FLSliceResult s) FLAPI {
@@ -171,6 +171,68 @@ extern "C" {
     FLDoc FLValue_FindDoc(FLValue) FLAPI FLPURE;
 
 
+    /** @} */
+    /** \name FLDocCache
+         @{
+            An FLDocCache is a thread-safe, bounded cache of FLDocs, for data that's loaded over
+            and over. Getting a cached document skips validating its data, and all callers share
+            the same FLDoc. Documents are looked up by their data, or by a key of your choosing.
+            When the cache is full, the least recently used documents are evicted.
+            Every FLDoc returned by these functions must be released by the caller.
+     */
+
+#ifndef FL_IMPL
+    typedef struct _FLDocCache*    FLDocCache;      ///< A reference to a document cache.
+#endif
+
+    /** Statistics of an FLDocCache. */
+    typedef struct {
+        uint64_t hits;              ///< Lookups that found a document
+        uint64_t misses;            ///< Lookups that didn't, including ones that added one
+        uint64_t evictions;         ///< Documents evicted to make room for others
+        size_t   count;             ///< Number of documents in the cache
+        size_t   bytes;             ///< Total size of their data and keys
+        size_t   maxBytes;          ///< The limit on `bytes`
+    } FLDocCacheStats;
+
+    /** Creates a document cache.
+        @param maxBytes  The maximum total size of the cached data and keys.
+        @param maxDocs  The maximum number of documents cached. */
+    FLDocCache FLDocCache_New(size_t maxBytes, size_t maxDocs) FLAPI;
+
+    /** Returns a process-wide document cache, with a 16MB limit. Don't release it. */
+    FLDocCache FLDocCache_GetShared(void) FLAPI;
+
+    FLDocCache FLDocCache_Retain(FLDocCache) FLAPI;
+    void FLDocCache_Release(FLDocCache) FLAPI;
+
+    /** Like \ref FLDoc_FromResultData (without extern data), but returns the cached FLDoc if
+        the same data was cached before with the same FLSharedKeys, else caches the new one.
+        Returns NULL if the data isn't valid Fleece. */
+    FLDoc FLDocCache_FromResultData(FLDocCache NONNULL, FLSliceResult data, FLTrust,
+                                    FLSharedKeys) FLAPI;
+
+    /** Returns the FLDoc cached under a key by \ref FLDocCache_Add, or NULL. */
+    FLDoc FLDocCache_Find(FLDocCache NONNULL, FLSlice key) FLAPI;
+
+    /** Creates an FLDoc from the data and caches it under the key, replacing any different one
+        cached there. Returns NULL if the data isn't valid Fleece. */
+    FLDoc FLDocCache_Add(FLDocCache NONNULL, FLSlice key, FLSliceResult data, FLTrust,
+                         FLSharedKeys) FLAPI;
+
+    /** Removes the FLDoc cached under the key, if any. */
+    bool FLDocCache_Remove(FLDocCache NONNULL, FLSlice key) FLAPI;
+
+    /** Removes all documents from the cache. */
+    void FLDocCache_Clear(FLDocCache NONNULL) FLAPI;
+
+    /** Changes the maximum total size of the cached data, evicting documents if necessary. */
+    void FLDocCache_SetMaxBytes(FLDocCache NONNULL, size_t maxBytes) FLAPI;
+
+    /** Gets the cache's hit, miss and eviction counts, and its memory use. */
+    void FLDocCache_GetStats(FLDocCache NONNULL, FLDocCacheStats *outStats NONNULL) FLAPI;
+
+
     /** @} */
     /** \name Parsing And Converting Values Directly
      @{ */
@@ -184,6 +246,13 @@ extern "C" {
         You can then call FLValue_FromData (in kFLTrusted mode) to get the root as a Value. */
     FLSliceResult FLData_ConvertJSON(FLSlice json, FLError *outError) FLAPI;
 
+    /** Returns a standalone Fleece-encoded copy of a Value and everything it contains, suitable
+        for \ref FLValue_FromData. If the Value is a collection in an existing document, its data
+        is copied as-is, which is much faster than re-encoding it with an FLEncoder.
+        Dictionaries using shared keys still need the same FLSharedKeys to be read.
+        Returns null on error. */
+    FLSliceResult FLValue_Extract(FLValue) FLAPI;
+
     /** Produces a human-readable dump of the Value encoded in the data.
         This is only useful if you already know, or want to learn, the encoding format. */
     FLStringResult FLData_Dump(FLSlice data) FLAPI;
@@ -296,6 +365,10 @@ extern "C" {
     /** Returns true if the value is non-NULL and represents a 64-bit floating-point number. */
     bool FLValue_IsDouble(FLValue) FLAPI;
 
+    /** Returns true if the value is a binary timestamp, as written by FLEncoder_WriteTimestamp.
+        (Its type is still kFLNumber; FLValue_AsTimestamp reads it without any parsing.) */
+    bool FLValue_IsTimestamp(FLValue) FLAPI FLPURE;
+
     /** Returns a value coerced to boolean. This will be true unless the value is NULL (undefined),
         null, false, or zero. */
     bool FLValue_AsBool(FLValue) FLAPI FLPURE;
@@ -336,6 +409,12 @@ extern "C" {
     /** Returns the exact contents of a data value, or null for all other types. */
     FLSlice FLValue_AsData(FLValue) FLAPI FLPURE;
 
+    /** Returns the contents of a string or data value, or null for all other types.
+        If the value is a data value that references a blob in the BlobStore of the Doc containing
+        it, returns the blob's contents instead. `outIsString` (if non-NULL) is set to whether the
+        contents are a string. Unlike the other accessors, this may look up the BlobStore. */
+    FLSlice FLValue_ResolveBlob(FLValue, bool *outIsString) FLAPI;
+
     /** If a FLValue represents an array, returns it cast to FLArray, else NULL. */
     FLArray FLValue_AsArray(FLValue) FLAPI FLPURE;
 
@@ -412,6 +491,17 @@ extern "C" {
     /** Returns an value at an array index, or NULL if the index is out of range. */
     FLValue FLArray_Get(FLArray, uint32_t index) FLAPI FLPURE;
 
+    /** Copies up to `count` items of an array, starting at index `start`, to `out` as integers,
+        and returns the number copied. Items that aren't numbers are copied as 0.
+        This is fastest with typed arrays written by FLEncoder_WriteIntArray or
+        FLEncoder_WriteInt32Array, which are read without looking at each item. */
+    uint32_t FLArray_GetInts(FLArray, uint32_t start, uint32_t count, int64_t *out) FLAPI;
+
+    /** Copies up to `count` items of an array, starting at index `start`, to `out` as doubles,
+        and returns the number copied. Items that aren't numbers are copied as 0.
+        This is fastest with arrays written by the `FLEncoder_Write...Array` functions. */
+    uint32_t FLArray_GetDoubles(FLArray, uint32_t start, uint32_t count, double *out) FLAPI;
+
     FLEECE_PUBLIC extern const FLArray kFLEmptyArray;
 
     /** \name Array iteration
@@ -701,6 +791,32 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
     FLValue FLDict_GetWithKey(FLDict, FLDictKey* NONNULL) FLAPI;
 
 
+    /** The type of the values in an FLColumn. */
+    typedef enum {
+        kFLColumnInt,       ///< `values` is an array of int64_t
+        kFLColumnDouble,    ///< `values` is an array of double
+        kFLColumnString,    ///< `values` is an array of FLSlice (strings or data; not copied)
+    } FLColumnType;
+
+    /** An output column for \ref FLArray_GatherColumns: one property read from every row. */
+    typedef struct {
+        FLDictKey *key;     ///< The property to read from each row
+        FLColumnType type;  ///< The type of `values`
+        void *values;       ///< Output array with room for `count` values
+        uint8_t *valid;     ///< Optional bitmap with room for `count` bits; bit i (LSB first)
+                            ///< is set if row i had a value of the column's type.
+    } FLColumn;
+
+    /** Reads properties from a range of an array of dicts into typed columns, in one pass over
+        the rows. This is much faster than iterating the array and looking up each key, since
+        each key's shared-key ID and position are reused from row to row.
+        Rows that lack a value of a column's type (or aren't dicts) get 0 or a null slice, and
+        a clear bit in the `valid` bitmap.
+        @return  The number of rows read, which is less than `count` if the array ends first. */
+    uint32_t FLArray_GatherColumns(FLArray, uint32_t start, uint32_t count,
+                                   FLColumn columns[], size_t nColumns) FLAPI;
+
+
     //////// MUTABLE DICT
 
 
@@ -946,6 +1062,18 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
         \ref FLSharedKeys_WriteState. */
     bool FLSharedKeys_LoadState(FLSharedKeys, FLValue) FLAPI;
 
+    /** Returns the current keys encoded as a compact, immutable "key tree" image. This can be
+        saved (e.g. to a file) and later passed to \ref FLSharedKeys_LoadKeyTree. */
+    FLSliceResult FLSharedKeys_GetKeyTreeData(FLSharedKeys NONNULL) FLAPI;
+
+    /** Loads an empty FLSharedKeys from a key tree image created by
+        \ref FLSharedKeys_GetKeyTreeData. The keys are looked up directly in the image, without
+        copying it or building an index, so this takes constant time.
+        @warning  The image is not copied; its memory (which may be memory-mapped) must remain
+                  valid and unchanged until the FLSharedKeys is freed.
+        @return  True on success, false if the image is invalid or the FLSharedKeys wasn't empty. */
+    bool FLSharedKeys_LoadKeyTree(FLSharedKeys NONNULL, FLSlice image, FLError* outError) FLAPI;
+
     /** Maps a key string to a number in the range [0...2047], or returns -1 if it isn't mapped.
         If the key doesn't already have a mapping, and the `add` flag is true,
         a new mapping is assigned and returned.
@@ -1014,6 +1142,12 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
                                        size_t reserveSize,
                                        bool uniqueStrings) FLAPI;
 
+    /** Returns a Fleece encoder from a per-thread pool of idle encoders, or a new one if there
+        are none. It behaves just like one from \ref FLEncoder_New, but it keeps the buffers it
+        allocated for earlier documents, which makes encoding small documents faster.
+        FLEncoder_Free returns it to the pool. */
+    FLEncoder FLEncoder_NewPooled(void) FLAPI;
+
     /** Creates a new Fleece encoder that writes to a file, not to memory. */
     FLEncoder FLEncoder_NewWritingToFile(FILE* NONNULL, bool uniqueStrings) FLAPI;
 
@@ -1023,6 +1157,17 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
     /** Tells the encoder to use a shared-keys mapping when encoding dictionary keys. */
     void FLEncoder_SetSharedKeys(FLEncoder NONNULL, FLSharedKeys) FLAPI;
 
+    /** If true, FLEncoder_WriteDateString writes binary timestamps (see FLEncoder_WriteTimestamp)
+        instead of ISO-8601 strings. Has no effect on a JSON encoder. */
+    void FLEncoder_SetBinaryTimestamps(FLEncoder NONNULL, bool) FLAPI;
+
+    /** Adds a "hot" path, like `address.city`, naming a property that readers access often.
+        When FLEncoder_WriteValue writes a document's root, it lays out the values on hot paths
+        together next to the root, and the rest before them, which improves memory locality
+        for readers. Has no effect on a JSON encoder.
+        @return  True on success, false if the path is invalid. */
+    bool FLEncoder_AddHotPath(FLEncoder NONNULL, FLString path, FLError *outError) FLAPI;
+
     /** Associates an arbitrary user-defined value with the encoder. */
     void FLEncoder_SetExtraInfo(FLEncoder NONNULL, void *info) FLAPI;
 
@@ -1110,6 +1255,15 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
         written as an integer, and 123.75 as a float.) */
     bool FLEncoder_WriteDouble(FLEncoder NONNULL, double) FLAPI;
 
+    /** Writes an array of numbers to an encoder as a typed array: a packed run of same-size
+        numbers, without pointers, that FLArray_GetInts / FLArray_GetDoubles read in bulk.
+        Otherwise it's an ordinary array of numbers, though readers from before typed arrays
+        existed see it as data. */
+    bool FLEncoder_WriteIntArray(FLEncoder NONNULL, const int64_t *values, size_t count) FLAPI;
+    bool FLEncoder_WriteInt32Array(FLEncoder NONNULL, const int32_t *values, size_t count) FLAPI;
+    bool FLEncoder_WriteFloatArray(FLEncoder NONNULL, const float *values, size_t count) FLAPI;
+    bool FLEncoder_WriteDoubleArray(FLEncoder NONNULL, const double *values, size_t count) FLAPI;
+
     /** Writes a string to an encoder. The string must be UTF-8-encoded and must not contain any
         zero bytes.
         @warning Do _not_ use this to write a dictionary key; use FLEncoder_WriteKey instead. */
@@ -1124,6 +1278,15 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
         @return  True on success, false on error. */
     bool FLEncoder_WriteDateString(FLEncoder NONNULL encoder, FLTimestamp ts, bool asUTC) FLAPI;
 
+    /** Writes a timestamp to an encoder in a compact binary form: a 64-bit float flagged as a
+        date. FLValue_AsTimestamp reads it without parsing, and it's converted to JSON as an
+        ISO-8601 UTC string. Older readers see it as a number, which they also accept as a
+        timestamp. A JSON encoder writes an ISO-8601 UTC string.
+        @param encoder  The encoder to write to.
+        @param ts  The timestamp (milliseconds since Unix epoch 1-1-1970).
+        @return  True on success, false on error. */
+    bool FLEncoder_WriteTimestamp(FLEncoder NONNULL encoder, FLTimestamp ts) FLAPI;
+
     /** Writes a binary data value (a blob) to an encoder. This can contain absolutely anything
         including null bytes.
         If the encoder is generating JSON, the blob will be written as a base64-encoded string. */
@@ -1195,6 +1358,10 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
         array.) */
     bool FLEncoder_ConvertJSON(FLEncoder NONNULL, FLSlice json) FLAPI;
 
+    /** Parses JSON5 <https://json5.org> data and writes the object(s) to the encoder, like
+        \ref FLEncoder_ConvertJSON. This is faster than converting the JSON5 to JSON first. */
+    bool FLEncoder_ConvertJSON5(FLEncoder NONNULL, FLSlice json5) FLAPI;
+
     /** @} */
     /** \name Finishing up
          @{ */
@@ -1283,6 +1450,46 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
                                    FLEncoder encoder) FLAPI;
 
 
+    //////// RUNTIME STATISTICS
+
+
+    /** @} */
+    /** \defgroup FLStats   Runtime Statistics
+        @{
+        Counters of activity in the encoder and lookup hot paths, for monitoring the library
+        under production load. They're available in release builds, but are off by default, when
+        they cost nothing but a predictable branch; call `FLStats_SetEnabled` to turn them on.
+        Each thread updates its own counters, and `FLStats_Get` sums them up. */
+
+    typedef struct {
+        uint64_t bytesEncoded;          ///< Fleece bytes written by encoders
+        uint64_t stringsDeduplicated;   ///< Strings encoded as pointers to an earlier copy
+        uint64_t narrowCollections;     ///< Arrays/dicts encoded with 2-byte items
+        uint64_t wideCollections;       ///< Arrays/dicts encoded with 4-byte items
+        uint64_t dictLookups;           ///< Binary searches of dict keys
+        uint64_t dictComparisons;       ///< Key comparisons made during those searches
+        uint64_t sharedKeyLookups;      ///< Lookups of strings in FLSharedKeys
+        uint64_t sharedKeyHits;         ///< Lookups that found the string
+        uint64_t docRegistrations;      ///< FLDocs (and other scopes) registered
+        uint64_t validations;           ///< Untrusted Fleece data validated
+        uint64_t validatedBytes;        ///< Total size of the data validated
+        uint64_t validateNanos;         ///< Total time spent validating, in nanoseconds
+    } FLStats;
+
+    /** Stores the totals of all threads' counters, since the process started or
+        `FLStats_Reset` was last called. */
+    void FLStats_Get(FLStats* NONNULL) FLAPI;
+
+    /** Resets the totals returned by `FLStats_Get` to zero. */
+    void FLStats_Reset(void) FLAPI;
+
+    /** Turns collection of statistics on or off. It's off by default. */
+    void FLStats_SetEnabled(bool enabled) FLAPI;
+
+    /** Returns true if statistics are being collected. */
+    bool FLStats_IsEnabled(void) FLAPI;
+
+
     //////// VALUE SLOTS
 
 
@@ -52,6 +52,7 @@ namespace fleece {
         inline bool isInteger() const;
         inline bool isUnsigned() const;
         inline bool isDouble() const;
+        inline bool isTimestamp() const;
         inline bool isMutable() const;
 
         inline bool asBool() const;
@@ -62,6 +63,7 @@ namespace fleece {
         inline slice asString() const;
         inline FLTimestamp asTimestamp() const;
         inline slice asData() const;
+        inline slice resolveBlob(bool *outIsString =nullptr) const;
         inline Array asArray() const;
         inline Dict asDict() const;
 
@@ -72,6 +74,9 @@ namespace fleece {
         inline std::string toJSONString() const         {return std::string(toJSON());}
         inline alloc_slice toJSON5() const              {return toJSON(true);}
 
+        /** Returns standalone Fleece data containing this value; see \ref FLValue_Extract. */
+        inline alloc_slice extract() const              {return FLValue_Extract(_val);}
+
         explicit operator bool() const                  {return _val != nullptr;}
         bool operator! () const                         {return _val == nullptr;}
         bool operator== (Value v) const                 {return _val == v._val;}
@@ -130,6 +135,14 @@ namespace fleece {
         inline bool empty() const;
         inline Value get(uint32_t index) const;
 
+        /** Bulk accessors; see FLArray_GetInts and FLArray_GetDoubles. */
+        inline uint32_t getInts(uint32_t start, uint32_t count, int64_t *out) const;
+        inline uint32_t getDoubles(uint32_t start, uint32_t count, double *out) const;
+
+        /** Reads properties of an array of dicts into columns; see FLArray_GatherColumns. */
+        inline uint32_t gatherColumns(uint32_t start, uint32_t count,
+                                      FLColumn columns[], size_t nColumns) const;
+
         inline Value operator[] (int index) const       {return get(index);}
         inline Value operator[] (const KeyPath &kp) const {return Value::operator[](kp);}
 
@@ -210,6 +223,7 @@ namespace fleece {
             alloc_slice _str;
             FLDictKey _key;
             friend class Dict;
+            friend struct Column;
         };
 
         inline Value get(Key &key) const;
@@ -336,6 +350,8 @@ namespace fleece {
         bool loadState(slice data)                          {return FLSharedKeys_LoadStateData(_sk, data);}
         bool loadState(Value state)                         {return FLSharedKeys_LoadState(_sk, state);}
         alloc_slice stateData() const                       {return FLSharedKeys_GetStateData(_sk);}
+        bool loadKeyTree(slice image, FLError *err =nullptr){return FLSharedKeys_LoadKeyTree(_sk, image, err);}
+        alloc_slice keyTreeData() const                     {return FLSharedKeys_GetKeyTreeData(_sk);}
         inline void writeState(const Encoder &enc);
         unsigned count() const                              {return FLSharedKeys_Count(_sk);}
         void revertToCount(unsigned count)                  {FLSharedKeys_RevertToCount(_sk, count);}
@@ -436,6 +452,9 @@ namespace fleece {
 
         explicit Encoder(SharedKeys sk)                 :Encoder() {setSharedKeys(sk);}
 
+        /// Returns an encoder from the calling thread's pool; see \ref FLEncoder_NewPooled.
+        static Encoder pooled()                         {return Encoder(FLEncoder_NewPooled());}
+
         explicit Encoder(FLEncoder enc)                 :_enc(enc) { }
         Encoder(Encoder&& enc)                          :_enc(enc._enc) {enc._enc = nullptr;}
 
@@ -444,6 +463,8 @@ namespace fleece {
         ~Encoder()                                      {FLEncoder_Free(_enc);}
 
         void setSharedKeys(SharedKeys sk)               {FLEncoder_SetSharedKeys(_enc, sk);}
+        void setBinaryTimestamps(bool b)                {FLEncoder_SetBinaryTimestamps(_enc, b);}
+        bool addHotPath(slice path, FLError *err =nullptr) {return FLEncoder_AddHotPath(_enc, path, err);}
 
         inline void amend(slice base, bool reuseStrings =false, bool externPointers =false);
         slice base() const                              {return FLEncoder_GetBase(_enc);}
@@ -459,13 +480,19 @@ namespace fleece {
         inline bool writeUInt(uint64_t);
         inline bool writeFloat(float);
         inline bool writeDouble(double);
+        inline bool writeTypedArray(const int64_t *values, size_t count);
+        inline bool writeTypedArray(const int32_t *values, size_t count);
+        inline bool writeTypedArray(const float *values, size_t count);
+        inline bool writeTypedArray(const double *values, size_t count);
         inline bool writeString(slice);
         inline bool writeString(const char *s)          {return writeString(slice(s));}
         inline bool writeString(std::string s)          {return writeString(slice(s));}
         inline bool writeDateString(FLTimestamp, bool asUTC =true);
+        inline bool writeTimestamp(FLTimestamp);
         inline bool writeData(slice);
         inline bool writeValue(Value);
         inline bool convertJSON(slice_NONNULL);
+        inline bool convertJSON5(slice_NONNULL);
 
         inline bool beginArray(size_t reserveCount =0);
         inline bool endArray();
@@ -560,6 +587,13 @@ namespace fleece {
     };
 
 
+    /** An output column for Array::gatherColumns. */
+    struct Column : public FLColumn {
+        Column(Dict::Key &k, FLColumnType t, void *vals, uint8_t *validBits =nullptr)
+        :FLColumn{&k._key, t, vals, validBits} { }
+    };
+
+
     /** Support for generating and applying JSON-format deltas/diffs between two Fleece values. */
     class JSONDelta {
     public:
@@ -575,6 +609,25 @@ namespace fleece {
     };
 
 
+    /** Runtime statistics of the encoder and lookup hot paths; see \ref FLStats. */
+    struct Stats : public FLStats {
+        Stats()                                 {FLStats_Get(this);}
+        static void reset()                     {FLStats_Reset();}
+        static void setEnabled(bool enabled)    {FLStats_SetEnabled(enabled);}
+        static bool isEnabled()                 {return FLStats_IsEnabled();}
+
+        double sharedKeyHitRate() const {
+            return sharedKeyLookups ? sharedKeyHits / double(sharedKeyLookups) : 0.0;
+        }
+        double comparisonsPerLookup() const {
+            return dictLookups ? dictComparisons / double(dictLookups) : 0.0;
+        }
+        double validateNanosPerByte() const {
+            return validatedBytes ? validateNanos / double(validatedBytes) : 0.0;
+        }
+    };
+
+
     //////// DEPRECATED:
 
 
@@ -607,6 +660,7 @@ namespace fleece {
     inline bool Value::isInteger() const        {return FLValue_IsInteger(_val);}
     inline bool Value::isUnsigned() const       {return FLValue_IsUnsigned(_val);}
     inline bool Value::isDouble() const         {return FLValue_IsDouble(_val);}
+    inline bool Value::isTimestamp() const      {return FLValue_IsTimestamp(_val);}
     inline bool Value::isMutable() const        {return FLValue_IsMutable(_val);}
 
     inline bool Value::asBool() const           {return FLValue_AsBool(_val);}
@@ -617,6 +671,7 @@ namespace fleece {
     inline FLTimestamp Value::asTimestamp() const {return FLValue_AsTimestamp(_val);}
     inline slice Value::asString() const        {return FLValue_AsString(_val);}
     inline slice Value::asData() const          {return FLValue_AsData(_val);}
+    inline slice Value::resolveBlob(bool *outIsString) const {return FLValue_ResolveBlob(_val, outIsString);}
     inline Array Value::asArray() const         {return FLValue_AsArray(_val);}
     inline Dict Value::asDict() const           {return FLValue_AsDict(_val);}
 
@@ -635,6 +690,16 @@ namespace fleece {
     inline uint32_t Array::count() const        {return FLArray_Count(*this);}
     inline bool Array::empty() const            {return FLArray_IsEmpty(*this);}
     inline Value Array::get(uint32_t i) const   {return FLArray_Get(*this, i);}
+    inline uint32_t Array::getInts(uint32_t start, uint32_t count, int64_t *out) const {
+        return FLArray_GetInts(*this, start, count, out);
+    }
+    inline uint32_t Array::getDoubles(uint32_t start, uint32_t count, double *out) const {
+        return FLArray_GetDoubles(*this, start, count, out);
+    }
+    inline uint32_t Array::gatherColumns(uint32_t start, uint32_t count,
+                                         FLColumn columns[], size_t nColumns) const {
+        return FLArray_GatherColumns(*this, start, count, columns, nColumns);
+    }
 
     inline Array::iterator::iterator(Array a)   {FLArrayIterator_Begin(a, this);}
     inline Value Array::iterator::value() const {return FLArrayIterator_GetValue(this);}
@@ -666,12 +731,26 @@ namespace fleece {
     inline bool Encoder::writeUInt(uint64_t n)  {return FLEncoder_WriteUInt(_enc, n);}
     inline bool Encoder::writeFloat(float n)    {return FLEncoder_WriteFloat(_enc, n);}
     inline bool Encoder::writeDouble(double n)  {return FLEncoder_WriteDouble(_enc, n);}
+    inline bool Encoder::writeTypedArray(const int64_t *v, size_t n) {
+        return FLEncoder_WriteIntArray(_enc, v, n);
+    }
+    inline bool Encoder::writeTypedArray(const int32_t *v, size_t n) {
+        return FLEncoder_WriteInt32Array(_enc, v, n);
+    }
+    inline bool Encoder::writeTypedArray(const float *v, size_t n) {
+        return FLEncoder_WriteFloatArray(_enc, v, n);
+    }
+    inline bool Encoder::writeTypedArray(const double *v, size_t n) {
+        return FLEncoder_WriteDoubleArray(_enc, v, n);
+    }
     inline bool Encoder::writeString(slice s)   {return FLEncoder_WriteString(_enc, s);}
     inline bool Encoder::writeDateString(FLTimestamp ts, bool asUTC)
                                                 {return FLEncoder_WriteDateString(_enc, ts, asUTC);}
+    inline bool Encoder::writeTimestamp(FLTimestamp ts) {return FLEncoder_WriteTimestamp(_enc, ts);}
     inline bool Encoder::writeData(slice data){return FLEncoder_WriteData(_enc, data);}
     inline bool Encoder::writeValue(Value v)    {return FLEncoder_WriteValue(_enc, v);}
     inline bool Encoder::convertJSON(slice_NONNULL j) {return FLEncoder_ConvertJSON(_enc, j);}
+    inline bool Encoder::convertJSON5(slice_NONNULL j) {return FLEncoder_ConvertJSON5(_enc, j);}
     inline bool Encoder::beginArray(size_t rsv) {return FLEncoder_BeginArray(_enc, rsv);}
     inline bool Encoder::endArray()             {return FLEncoder_EndArray(_enc);}
     inline bool Encoder::beginDict(size_t rsv)  {return FLEncoder_BeginDict(_enc, rsv);}
@@ -429,6 +429,10 @@ namespace fleece {
         static void retain(slice s) noexcept                {((alloc_slice*)&s)->retain();}
         static void release(slice s) noexcept               {((alloc_slice*)&s)->release();}
 
+        /** True if the buffer was allocated in thread-confined mode (see FL_SetThreadConfined),
+            so it must not be retained or released by any other thread. */
+        bool isThreadConfined() const noexcept              {return _FLBuf_IsThreadConfined(buf);}
+
     private:
         void assignFrom(pure_slice s)                       {set(s.buf, s.size);}
     };
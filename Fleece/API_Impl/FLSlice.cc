@@ -22,7 +22,11 @@
 #include <algorithm>
 #include <atomic>
 #include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
 #include "betterassert.hh"
+#include "RefCounted.hh"
 
 // Both headers declare a `wyrand()` function, so use namespaces to prevent collision.
 namespace fleece::wyhash {
@@ -109,42 +113,317 @@ namespace fleece {
 #endif
 
 
+    // Values of sharedBuffer::_sizeClass besides pool size classes (which are 1...kNumSizeClasses)
+    static constexpr uint16_t kMallocBuffer = 0, kExternalBuffer = 0xFFFF;
+
+
     // The heap-allocated buffer that an alloc_slice points to.
     // It's ref-counted; every alloc_slice manages retaining/releasing its sharedBuffer.
+    // `_sizeClass` records where the memory came from: malloc, a buffer pool size class, or an
+    // external owner (see FLSliceResult_Adopt.) `_threadConfined` is set if it was created in
+    // thread-confined mode; then `_refCount` is only accessed by one thread, so it's updated
+    // without atomic read-modify-write operations. The mode is captured when the buffer is
+    // allocated, so shared objects that keep a caller's buffer (DocCache, SharedKeys) copy it if
+    // `_FLBuf_IsThreadConfined` says it's confined.
+    // The header is a multiple of 8 bytes, so `_buf` has the same alignment as the header.
     struct sharedBuffer {
         std::atomic<uint32_t> _refCount {1};
+        uint16_t _sizeClass {kMallocBuffer};
+        bool _threadConfined {tThreadConfined};
+        uint8_t _reserved {0};
 #if FL_DETECT_COPIES
+        uint32_t _padding;
         static constexpr uint32_t kMagic = 0xdecade55;
         uint32_t const _magic {kMagic};
 #endif
         uint8_t _buf[4];
 
-        static inline void* operator new(size_t basicSize, size_t bufferSize) noexcept {
-            return malloc(basicSize - sizeof(sharedBuffer::_buf) + bufferSize);
-        }
-
-        static inline void operator delete(void *self) {
-            assert_precondition(isHeapAligned(self));
-            free(self);
-        }
+        static sharedBuffer* create(size_t bufferSize) noexcept;
+        void destroy() noexcept;
 
         __hot
         inline void retain() noexcept {
             assert_precondition(isHeapAligned(this));
-            ++_refCount;
+            if (_threadConfined)
+                _refCount.store(_refCount.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_relaxed);
+            else
+                ++_refCount;
         }
 
         __hot
         inline void release() noexcept {
             assert_precondition(isHeapAligned(this));
-            if (--_refCount == 0)
-                delete this;
+            uint32_t newRef;
+            if (_threadConfined) {
+                newRef = _refCount.load(std::memory_order_relaxed) - 1;
+                _refCount.store(newRef, std::memory_order_relaxed);
+            } else {
+                newRef = --_refCount;
+            }
+            if (newRef == 0)
+                destroy();
         }
     };
 
+    static constexpr size_t kHeaderSize = offsetof(sharedBuffer, _buf);
+
     __hot FLPURE
     static sharedBuffer* bufferFromBuf(const void *buf) noexcept {
-        return (sharedBuffer*)((uint8_t*)buf  - offsetof(sharedBuffer, _buf));
+        return (sharedBuffer*)((uint8_t*)buf  - kHeaderSize);
+    }
+
+
+    // Stored just before the sharedBuffer header of an adopted external buffer.
+    struct externalInfo {
+        FLBufferDeallocator dealloc;
+        void*               context;
+    };
+
+    static_assert(sizeof(externalInfo) + kHeaderSize <= kFLSliceAdoptHeadroom,
+                  "kFLSliceAdoptHeadroom is too small");
+
+
+#pragma mark - BUFFER POOL:
+
+
+    // An opt-in allocator for sharedBuffers, with power-of-two size classes from 32 bytes to
+    // 16KB (including the header.) Each thread keeps free blocks of each class in its own cache,
+    // so allocating and freeing don't need locks; threads whose cache overflows or runs dry
+    // exchange blocks with a shared central cache.
+    namespace pool {
+        using namespace std;
+
+        static constexpr unsigned kNumSizeClasses = 10;
+        static constexpr size_t kMinBlockSize = 32;
+        static constexpr size_t kMaxBlockSize = kMinBlockSize << (kNumSizeClasses - 1);
+        static constexpr size_t kMaxThreadCachedBytes  =   64 * 1024;   // per size class
+        static constexpr size_t kMaxCentralCachedBytes = 1024 * 1024;   // per size class
+
+        static atomic<bool>     sEnabled {false};
+        static atomic<uint64_t> sAdopted {0};
+
+        static inline size_t blockSize(unsigned cls)      {return kMinBlockSize << (cls - 1);}
+
+        static inline size_t maxThreadCount(unsigned cls) {
+            return std::max(size_t(4), kMaxThreadCachedBytes / blockSize(cls));
+        }
+
+        // The size class of the smallest block that holds `size` bytes, or 0 if it's too big.
+        static inline unsigned sizeClassFor(size_t size) {
+            if (size > kMaxBlockSize)
+                return 0;
+            unsigned cls = 1;
+            for (size_t block = kMinBlockSize; block < size; block <<= 1)
+                ++cls;
+            return cls;
+        }
+
+        // Adds to a counter written only by its own thread (see Stats.hh for the reasoning.)
+        template <class T>
+        static inline void bump(atomic<T> &counter, T n) {
+            counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+        }
+
+
+        struct FreeList {
+            struct Block {Block *next;};
+            Block* _head {nullptr};
+            size_t _count {0};
+
+            void push(void *block) {
+                auto b = (Block*)block;
+                b->next = _head;
+                _head = b;
+                ++_count;
+            }
+
+            void* pop() {
+                Block *b = _head;
+                _head = b->next;
+                --_count;
+                return b;
+            }
+
+            void freeAll() {
+                while (_count > 0)
+                    ::free(pop());
+            }
+        };
+
+
+        // A thread's cache. Only its own thread touches the free lists; the counters are atomic
+        // so that FLBufferPool_GetStats can read them from other threads.
+        struct ThreadCache {
+            FreeList                lists[kNumSizeClasses + 1];       // indexed by size class
+            atomic<uint64_t>        allocations {0}, hits {0};
+            atomic<int64_t>         bytesCached {0};
+        };
+
+
+        // Shared state: the central cache, and the thread caches, for collecting stats.
+        struct Central {
+            mutex                   _mutex;
+            FreeList                lists[kNumSizeClasses + 1];
+            size_t                  bytesCached {0};
+            vector<ThreadCache*>    threads;
+            uint64_t                exitedAllocations {0}, exitedHits {0};
+
+            // Moves up to `n` blocks from `src` to the central list, and frees any that don't fit.
+            void take(FreeList &src, unsigned cls, size_t n) {
+                size_t maxCount = kMaxCentralCachedBytes / blockSize(cls);
+                lock_guard<mutex> lock(_mutex);
+                for (; n > 0 && src._count > 0; --n) {
+                    if (lists[cls]._count < maxCount) {
+                        lists[cls].push(src.pop());
+                        bytesCached += blockSize(cls);
+                    } else {
+                        ::free(src.pop());
+                    }
+                }
+            }
+
+            // Moves up to `n` blocks from the central list to `dst`; returns the number moved.
+            size_t give(FreeList &dst, unsigned cls, size_t n) {
+                lock_guard<mutex> lock(_mutex);
+                size_t moved = 0;
+                for (; moved < n && lists[cls]._count > 0; ++moved)
+                    dst.push(lists[cls].pop());
+                bytesCached -= moved * blockSize(cls);
+                return moved;
+            }
+        };
+
+        // Deliberately leaked, since threads may exit after static destructors have run.
+        static Central& central() {
+            static Central *sCentral = new Central;
+            return *sCentral;
+        }
+
+
+        static thread_local ThreadCache* tCache = nullptr;    // current thread's cache
+        static thread_local bool tCacheGone = false;          // true once the cache is destroyed
+
+        // A thread-local object that owns the thread's cache, and gives its blocks to the
+        // central cache when the thread exits.
+        struct ThreadCacheOwner {
+            ThreadCache cache;
+
+            ThreadCacheOwner() {
+                Central &c = central();
+                lock_guard<mutex> lock(c._mutex);
+                c.threads.push_back(&cache);
+            }
+
+            ~ThreadCacheOwner() {
+                Central &c = central();
+                for (unsigned cls = 1; cls <= kNumSizeClasses; ++cls)
+                    c.take(cache.lists[cls], cls, SIZE_MAX);
+                lock_guard<mutex> lock(c._mutex);
+                c.exitedAllocations += cache.allocations;
+                c.exitedHits += cache.hits;
+                c.threads.erase(find(c.threads.begin(), c.threads.end(), &cache));
+                tCache = nullptr;
+                tCacheGone = true;
+            }
+        };
+
+        // Returns the current thread's cache, or null if the thread is exiting.
+        static ThreadCache* threadCache() {
+            if (_usuallyTrue(tCache != nullptr))
+                return tCache;
+            if (tCacheGone)
+                return nullptr;
+            static thread_local ThreadCacheOwner sOwner;
+            tCache = &sOwner.cache;
+            return tCache;
+        }
+
+
+        // Returns a block of size class `cls`.
+        static void* allocate(unsigned cls) {
+            ThreadCache *cache = threadCache();
+            if (!cache)
+                return malloc(blockSize(cls));
+            bump(cache->allocations, uint64_t(1));
+            FreeList &list = cache->lists[cls];
+            if (list._count == 0) {
+                size_t n = central().give(list, cls, maxThreadCount(cls) / 2);
+                bump(cache->bytesCached, int64_t(n * blockSize(cls)));
+            }
+            if (list._count == 0)
+                return malloc(blockSize(cls));
+            bump(cache->hits, uint64_t(1));
+            bump(cache->bytesCached, -int64_t(blockSize(cls)));
+            return list.pop();
+        }
+
+
+        // Frees a block of size class `cls` into the current thread's cache.
+        static void deallocate(void *block, unsigned cls) {
+            ThreadCache *cache = sEnabled.load(memory_order_relaxed) ? threadCache() : nullptr;
+            if (!cache) {
+                ::free(block);
+                return;
+            }
+            FreeList &list = cache->lists[cls];
+            if (list._count >= maxThreadCount(cls)) {
+                size_t n = list._count / 2;
+                central().take(list, cls, n);
+                bump(cache->bytesCached, -int64_t(n * blockSize(cls)));
+            }
+            list.push(block);
+            bump(cache->bytesCached, int64_t(blockSize(cls)));
+        }
+
+
+        // Frees the blocks in the current thread's cache and the central cache.
+        static void trim() {
+            if (ThreadCache *cache = tCache; cache) {
+                for (unsigned cls = 1; cls <= kNumSizeClasses; ++cls)
+                    cache->lists[cls].freeAll();
+                cache->bytesCached.store(0, memory_order_relaxed);
+            }
+            Central &c = central();
+            lock_guard<mutex> lock(c._mutex);
+            for (unsigned cls = 1; cls <= kNumSizeClasses; ++cls)
+                c.lists[cls].freeAll();
+            c.bytesCached = 0;
+        }
+    }
+
+
+    sharedBuffer* sharedBuffer::create(size_t bufferSize) noexcept {
+        size_t size = kHeaderSize + bufferSize;
+        unsigned sizeClass = kMallocBuffer;
+        void *mem;
+        if (pool::sEnabled.load(std::memory_order_relaxed)
+                && (sizeClass = pool::sizeClassFor(size)) != 0)
+            mem = pool::allocate(sizeClass);
+        else
+            mem = malloc(size);
+        if (!mem)
+            return nullptr;
+        auto sb = new (mem) sharedBuffer;
+        sb->_sizeClass = uint16_t(sizeClass);
+        return sb;
+    }
+
+
+    void sharedBuffer::destroy() noexcept {
+        switch (_sizeClass) {
+            case kMallocBuffer:
+                free(this);
+                break;
+            case kExternalBuffer: {
+                auto info = (externalInfo*)this - 1;
+                info->dealloc(info->context, _buf);
+                break;
+            }
+            default:
+                pool::deallocate(this, _sizeClass);
+                break;
+        }
     }
 
 }
@@ -154,7 +433,7 @@ using namespace fleece;
 
 __hot
 FLSliceResult FLSliceResult_New(size_t size) noexcept {
-    auto sb = new (size) sharedBuffer;
+    auto sb = sharedBuffer::create(size);
     if (!sb)
         return {};
     return {&sb->_buf, size};
@@ -169,11 +448,11 @@ FLSliceResult FLSlice_Copy(FLSlice s) noexcept {
     // Warn if s appears to be the buffer of an existing alloc_slice:
     if (s.buf && isHeapAligned(s.buf)
         && ((size_t)s.buf & 0xFFF) >= 4   // reading another VM page may crash
-        && ((const uint32_t*)s.buf)[-1] == kMagic) {
+        && ((const uint32_t*)s.buf)[-1] == sharedBuffer::kMagic) {
         fprintf(stderr, "$$$$$ Copying existing alloc_slice at {%p, %zu}\n", s.buf, s.size);
     }
 #endif
-    auto sb = new (s.size) sharedBuffer;
+    auto sb = sharedBuffer::create(s.size);
     if (!sb)
         return {};
     ::memcpy(&sb->_buf, s.buf, s.size);     // we know s.buf and sb->_buf are non-null
@@ -181,6 +460,22 @@ FLSliceResult FLSlice_Copy(FLSlice s) noexcept {
 }
 
 
+FLSliceResult FLSliceResult_Adopt(void *buf, size_t size,
+                                  FLBufferDeallocator dealloc, void *context) noexcept
+{
+    precondition(buf != nullptr && dealloc != nullptr);
+    auto sb = bufferFromBuf(buf);
+    precondition(isHeapAligned(sb));
+    auto info = (externalInfo*)sb - 1;
+    info->dealloc = dealloc;
+    info->context = context;
+    new (sb) sharedBuffer;
+    sb->_sizeClass = kExternalBuffer;
+    ++pool::sAdopted;
+    return {buf, size};
+}
+
+
 __hot
 void _FLBuf_Retain(const void *buf) noexcept {
     if (buf)
@@ -195,6 +490,44 @@ void _FLBuf_Release(const void *buf) noexcept {
 }
 
 
+bool _FLBuf_IsThreadConfined(const void *buf) noexcept {
+    return buf && bufferFromBuf(buf)->_threadConfined;
+}
+
+
+void FLBufferPool_SetEnabled(bool enabled) noexcept {
+    pool::sEnabled = enabled;
+    if (!enabled)
+        pool::trim();
+}
+
+
+void FLBufferPool_GetStats(FLBufferPoolStats *stats) noexcept {
+    pool::Central &c = pool::central();
+    std::lock_guard<std::mutex> lock(c._mutex);
+    stats->allocations = c.exitedAllocations;
+    stats->poolHits = c.exitedHits;
+    int64_t bytesCached = int64_t(c.bytesCached);
+    for (pool::ThreadCache *t : c.threads) {
+        stats->allocations += t->allocations.load(std::memory_order_relaxed);
+        stats->poolHits += t->hits.load(std::memory_order_relaxed);
+        bytesCached += t->bytesCached.load(std::memory_order_relaxed);
+    }
+    stats->bytesCached = uint64_t(std::max(bytesCached, int64_t(0)));
+    stats->adopted = pool::sAdopted;
+}
+
+
+void FLBufferPool_Trim(void) noexcept {
+    pool::trim();
+}
+
+
+bool FL_SetThreadConfined(bool confined) noexcept {
+    return std::exchange(tThreadConfined, confined);
+}
+
+
 void FL_WipeMemory(void *buf, size_t size) noexcept {
     if (size > 0) {
 #if defined(_MSC_VER)
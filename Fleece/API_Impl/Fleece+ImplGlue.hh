@@ -23,6 +23,7 @@
 #include "Path.hh"
 #include "DeepIterator.hh"
 #include "Doc.hh"
+#include "DocCache.hh"
 #include "FleeceException.hh"
 #include <memory>
 
@@ -46,6 +47,7 @@ typedef SharedKeys*     FLSharedKeys;
 typedef Path*           FLKeyPath;
 typedef DeepIterator*   FLDeepIterator;
 typedef const Doc*      FLDoc;
+typedef DocCache*       FLDocCache;
 
 #define FL_IMPL         // Prevents redefinition of the above types
 
@@ -64,6 +66,7 @@ namespace fleece { namespace impl {
     struct FLEncoderImpl {
         FLError errorCode {::kFLNoError};
         const bool ownsFleeceEncoder {true};
+        bool pooled {false};        // Created by FLEncoder_NewPooled; Free returns it to the pool
         std::string errorMessage;
         std::unique_ptr<Encoder> fleeceEncoder;
         std::unique_ptr<JSONEncoder> jsonEncoder;
@@ -125,6 +128,16 @@ namespace fleece { namespace impl {
             errorCode = ::kFLNoError;
             extraInfo = nullptr;
         }
+
+        // Restores the state of a new Fleece encoder, before returning it to the pool.
+        void resetToDefaults() {
+            fleeceEncoder->resetToDefaults();
+            if (jsonConverter)
+                jsonConverter->reset();
+            errorCode = ::kFLNoError;
+            errorMessage.clear();
+            extraInfo = nullptr;
+        }
     };
 
     #define ENCODER_DO(E, METHOD) \
@@ -22,6 +22,9 @@
 #include "JSONDelta.hh"
 #include "fleece/Fleece.h"
 #include "JSON5.hh"
+#include "JSON5Converter.hh"
+#include "Stats.hh"
+#include "Columns.hh"
 #include "betterassert.hh"
 
 
@@ -77,6 +80,7 @@ FLValueType FLValue_GetType(FLValue v) FLAPI {
 bool FLValue_IsInteger(FLValue v)          FLAPI {return v && v->isInteger();}
 bool FLValue_IsUnsigned(FLValue v)         FLAPI {return v && v->isUnsigned();}
 bool FLValue_IsDouble(FLValue v)           FLAPI {return v && v->isDouble();}
+bool FLValue_IsTimestamp(FLValue v)        FLAPI {return v && v->isTimestamp();}
 bool FLValue_AsBool(FLValue v)             FLAPI {return v && v->asBool();}
 int64_t FLValue_AsInt(FLValue v)           FLAPI {return v ? v->asInt() : 0;}
 uint64_t FLValue_AsUnsigned(FLValue v)     FLAPI {return v ? v->asUnsigned() : 0;}
@@ -84,6 +88,14 @@ float FLValue_AsFloat(FLValue v)           FLAPI {return v ? v->asFloat() : 0.0f
 double FLValue_AsDouble(FLValue v)         FLAPI {return v ? v->asDouble() : 0.0;}
 FLString FLValue_AsString(FLValue v)       FLAPI {return v ? (FLString)v->asString() : kFLSliceNull;}
 FLSlice FLValue_AsData(FLValue v)          FLAPI {return v ? (FLSlice)v->asData() : kFLSliceNull;}
+FLSlice FLValue_ResolveBlob(FLValue v, bool *outIsString) FLAPI {
+    if (!v) {
+        if (outIsString)
+            *outIsString = false;
+        return kFLSliceNull;
+    }
+    return v->resolveBlob(outIsString);
+}
 FLArray FLValue_AsArray(FLValue v)         FLAPI {return v ? v->asArray() : nullptr;}
 FLDict FLValue_AsDict(FLValue v)           FLAPI {return v ? v->asDict() : nullptr;}
 FLTimestamp FLValue_AsTimestamp(FLValue v) FLAPI {return v ? v->asTimestamp() : FLTimestampNone;}
@@ -181,6 +193,16 @@ FLStringResult FLJSON5_ToJSON(FLString json5,
 }
 
 
+FLSliceResult FLValue_Extract(FLValue v) FLAPI {
+    if (!v)
+        return {nullptr, 0};
+    try {
+        return toSliceResult(Encoder::extract(v));
+    } catchError(nullptr)
+    return {nullptr, 0};
+}
+
+
 FLSliceResult FLData_Dump(FLSlice data) FLAPI {
     try {
         return toSliceResult(alloc_slice(Value::dump(data)));
@@ -196,6 +218,14 @@ uint32_t FLArray_Count(FLArray a)                    FLAPI {return a ? a->count(
 bool FLArray_IsEmpty(FLArray a)                      FLAPI {return a ? a->empty() : true;}
 FLValue FLArray_Get(FLArray a, uint32_t index)       FLAPI {return a ? a->get(index) : nullptr;}
 
+uint32_t FLArray_GetInts(FLArray a, uint32_t start, uint32_t count, int64_t *out) FLAPI {
+    return a ? a->getInts(start, count, out) : 0;
+}
+
+uint32_t FLArray_GetDoubles(FLArray a, uint32_t start, uint32_t count, double *out) FLAPI {
+    return a ? a->getDoubles(start, count, out) : 0;
+}
+
 void FLArrayIterator_Begin(FLArray a, FLArrayIterator* i) FLAPI {
     static_assert(sizeof(FLArrayIterator) >= sizeof(Array::iterator),"FLArrayIterator is too small");
     new (i) Array::iterator(a);
@@ -344,6 +374,16 @@ FLValue FLDict_GetWithKey(FLDict d, FLDictKey *k) FLAPI {
     return d->get(key);
 }
 
+uint32_t FLArray_GatherColumns(FLArray a, uint32_t start, uint32_t count,
+                               FLColumn columns[], size_t nColumns) FLAPI
+{
+    static_assert(sizeof(FLColumn) == sizeof(Column), "FLColumn doesn't match Column");
+    static_assert(offsetof(FLColumn, valid) == offsetof(Column, valid),
+                  "FLColumn doesn't match Column");
+    static_assert(int(kFLColumnString) == int(Column::kString), "FLColumnType doesn't match");
+    return gatherColumns(a, start, count, (Column*)columns, nColumns);
+}
+
 
 static FLMutableDict _newMutableDict(FLDict d, FLCopyFlags flags) noexcept {
     try {
@@ -401,6 +441,18 @@ void FLSharedKeys_WriteState(FLSharedKeys sk, FLEncoder e) FLAPI {
     sk->writeState(*e->fleeceEncoder);
 }
 
+FLSliceResult FLSharedKeys_GetKeyTreeData(FLSharedKeys sk) FLAPI {
+    return toSliceResult(sk->keyTreeData());
+}
+
+bool FLSharedKeys_LoadKeyTree(FLSharedKeys sk, FLSlice image, FLError *outError) FLAPI {
+    try {
+        sk->loadFromKeyTree(slice(image));
+        return true;
+    } catchError(outError)
+    return false;
+}
+
 int FLSharedKeys_Encode(FLSharedKeys sk, FLString keyStr, bool add) FLAPI {
     int intKey;
     if (!(add ? sk->encodeAndAdd(keyStr, intKey) : sk->encode(keyStr, intKey)))
@@ -544,11 +596,77 @@ FLEncoder FLEncoder_NewWritingToFile(FILE *outputFile, bool uniqueStrings) FLAPI
     return new FLEncoderImpl(outputFile, uniqueStrings);
 }
 
+namespace {
+    // Set when the current thread's EncoderPool has been destructed at thread exit. (Unlike the
+    // pool, this is trivially destructible, so it's still safe to read after that.)
+    thread_local bool tEncoderPoolDestroyed = false;
+
+    // Per-thread cache of idle encoders, used by FLEncoder_NewPooled. It's fine to use in
+    // thread-confined mode: the pool is only touched by its own thread, and an idle encoder
+    // holds no ref-counted objects or buffers, since resetToDefaults releases them.
+    class EncoderPool {
+    public:
+        static constexpr size_t kMaxEncoders = 4;
+        static constexpr size_t kMaxRetainedMemory = 256 * 1024;    // per encoder
+
+        ~EncoderPool() {
+            tEncoderPoolDestroyed = true;
+            while (_count > 0)
+                delete _encoders[--_count];
+        }
+
+        FLEncoderImpl* acquire() {
+            if (_count > 0)
+                return _encoders[--_count];
+            auto e = new FLEncoderImpl(kFLEncodeFleece);
+            e->pooled = true;
+            e->fleeceEncoder->limitRetainedMemory(kMaxRetainedMemory);
+            return e;
+        }
+
+        bool release(FLEncoderImpl *e) noexcept {
+            if (_count >= kMaxEncoders)
+                return false;
+            try {
+                e->resetToDefaults();
+            } catch (...) {
+                return false;
+            }
+            _encoders[_count++] = e;
+            return true;
+        }
+
+    private:
+        FLEncoderImpl* _encoders[kMaxEncoders];
+        size_t _count {0};
+    };
+
+    thread_local EncoderPool tEncoderPool;
+
+    // Returns the current thread's pool, or null if it's been destructed. (Other thread-local
+    // destructors may create and free encoders after that, and mustn't touch the dead pool.)
+    static EncoderPool* currentEncoderPool() {
+        if (_usuallyFalse(tEncoderPoolDestroyed))
+            return nullptr;
+        return &tEncoderPool;
+    }
+}
+
+FLEncoder FLEncoder_NewPooled(void) FLAPI {
+    if (EncoderPool *pool = currentEncoderPool())
+        return pool->acquire();
+    return new FLEncoderImpl(kFLEncodeFleece);
+}
+
 void FLEncoder_Reset(FLEncoder e) FLAPI {
     e->reset();
 }
 
 void FLEncoder_Free(FLEncoder e) FLAPI {
+    if (e && e->pooled) {
+        if (EncoderPool *pool = currentEncoderPool(); pool && pool->release(e))
+            return;
+    }
     delete e;
 }
 
@@ -557,6 +675,20 @@ void FLEncoder_SetSharedKeys(FLEncoder e, FLSharedKeys sk) FLAPI {
         e->fleeceEncoder->setSharedKeys(sk);
 }
 
+void FLEncoder_SetBinaryTimestamps(FLEncoder e, bool binary) FLAPI {
+    if (e->isFleece())
+        e->fleeceEncoder->binaryTimestamps(binary);
+}
+
+bool FLEncoder_AddHotPath(FLEncoder e, FLString path, FLError *outError) FLAPI {
+    try {
+        if (e->isFleece())
+            e->fleeceEncoder->addHotPath(path);
+        return true;
+    } catchError(outError)
+    return false;
+}
+
 void FLEncoder_SuppressTrailer(FLEncoder e) FLAPI {
     if (e->isFleece())
         e->fleeceEncoder->suppressTrailer();
@@ -604,9 +736,24 @@ bool FLEncoder_WriteInt(FLEncoder e, int64_t i)    FLAPI {ENCODER_TRY(e, writeIn
 bool FLEncoder_WriteUInt(FLEncoder e, uint64_t u)  FLAPI {ENCODER_TRY(e, writeUInt(u));}
 bool FLEncoder_WriteFloat(FLEncoder e, float f)    FLAPI {ENCODER_TRY(e, writeFloat(f));}
 bool FLEncoder_WriteDouble(FLEncoder e, double d)  FLAPI {ENCODER_TRY(e, writeDouble(d));}
+
+bool FLEncoder_WriteIntArray(FLEncoder e, const int64_t *v, size_t n) FLAPI {
+    ENCODER_TRY(e, writeTypedArray(v, n));
+}
+bool FLEncoder_WriteInt32Array(FLEncoder e, const int32_t *v, size_t n) FLAPI {
+    ENCODER_TRY(e, writeTypedArray(v, n));
+}
+bool FLEncoder_WriteFloatArray(FLEncoder e, const float *v, size_t n) FLAPI {
+    ENCODER_TRY(e, writeTypedArray(v, n));
+}
+bool FLEncoder_WriteDoubleArray(FLEncoder e, const double *v, size_t n) FLAPI {
+    ENCODER_TRY(e, writeTypedArray(v, n));
+}
 bool FLEncoder_WriteString(FLEncoder e, FLSlice s) FLAPI {ENCODER_TRY(e, writeString(s));}
 bool FLEncoder_WriteDateString(FLEncoder e, FLTimestamp ts, bool asUTC)
                                                    FLAPI {ENCODER_TRY(e, writeDateString(ts,asUTC));}
+bool FLEncoder_WriteTimestamp(FLEncoder e, FLTimestamp ts)
+                                                   FLAPI {ENCODER_TRY(e, writeTimestamp(ts));}
 bool FLEncoder_WriteData(FLEncoder e, FLSlice d)   FLAPI {ENCODER_TRY(e, writeData(d));}
 bool FLEncoder_WriteRaw(FLEncoder e, FLSlice r)    FLAPI {ENCODER_TRY(e, writeRaw(r));}
 bool FLEncoder_WriteValue(FLEncoder e, FLValue v)  FLAPI {ENCODER_TRY(e, writeValue(v));}
@@ -647,6 +794,28 @@ bool FLEncoder_ConvertJSON(FLEncoder e, FLSlice json) FLAPI {
     return false;
 }
 
+bool FLEncoder_ConvertJSON5(FLEncoder e, FLSlice json5) FLAPI {
+    if (!e->hasError()) {
+        try {
+            if (e->isFleece()) {
+                JSON5Converter jc(*e->fleeceEncoder);
+                if (jc.encodeJSON5(json5)) {
+                    return true;
+                } else {
+                    e->errorCode = (FLError)jc.errorCode();
+                    e->errorMessage = jc.errorMessage();
+                }
+            } else {
+                e->jsonEncoder->writeJSON(ConvertJSON5(std::string(slice(json5))));
+                return true;
+            }
+        } catch (const std::exception &x) {
+            e->recordException(x);
+        }
+    }
+    return false;
+}
+
 FLError FLEncoder_GetError(FLEncoder e) FLAPI {
     return (FLError)e->errorCode;
 }
@@ -746,6 +915,44 @@ bool FLDoc_SetAssociated(FLDoc doc, void *pointer, const char *type) FLAPI {
 }
 
 
+FLDocCache FLDocCache_New(size_t maxBytes, size_t maxDocs) FLAPI {
+    return retain(new DocCache(maxBytes, maxDocs));
+}
+
+FLDocCache FLDocCache_GetShared(void) FLAPI             {return DocCache::shared();}
+FLDocCache FLDocCache_Retain(FLDocCache cache)          FLAPI {return retain(cache);}
+void FLDocCache_Release(FLDocCache cache)               FLAPI {release(cache);}
+
+FLDoc FLDocCache_FromResultData(FLDocCache cache, FLSliceResult data, FLTrust trust,
+                                FLSharedKeys sk) FLAPI
+{
+    return retain(cache->get(alloc_slice(data), (Doc::Trust)trust, sk));
+}
+
+FLDoc FLDocCache_Find(FLDocCache cache, FLSlice key) FLAPI {
+    return retain(cache->find(key));
+}
+
+FLDoc FLDocCache_Add(FLDocCache cache, FLSlice key, FLSliceResult data, FLTrust trust,
+                     FLSharedKeys sk) FLAPI
+{
+    return retain(cache->add(key, alloc_slice(data), (Doc::Trust)trust, sk));
+}
+
+bool FLDocCache_Remove(FLDocCache cache, FLSlice key)   FLAPI {return cache->remove(key);}
+void FLDocCache_Clear(FLDocCache cache)                 FLAPI {cache->clear();}
+
+void FLDocCache_SetMaxBytes(FLDocCache cache, size_t maxBytes) FLAPI {
+    cache->setMaxBytes(maxBytes);
+}
+
+void FLDocCache_GetStats(FLDocCache cache, FLDocCacheStats *outStats) FLAPI {
+    auto stats = cache->stats();
+    *outStats = {stats.hits, stats.misses, stats.evictions, stats.count, stats.bytes,
+                 cache->maxBytes()};
+}
+
+
 #pragma mark - DELTA COMPRESSION
 
 
@@ -789,3 +996,33 @@ bool FLEncodeApplyingJSONDelta(FLValue old, FLSlice jsonDelta, FLEncoder encoder
         return false;
     }
 }
+
+
+void FLStats_Get(FLStats *out) FLAPI {
+    using namespace stats;
+    impl::Stats s = impl::Stats::get();
+    out->bytesEncoded = s[kBytesEncoded];
+    out->stringsDeduplicated = s[kStringsDeduplicated];
+    out->narrowCollections = s[kNarrowCollections];
+    out->wideCollections = s[kWideCollections];
+    out->dictLookups = s[kDictLookups];
+    out->dictComparisons = s[kDictComparisons];
+    out->sharedKeyLookups = s[kSharedKeyLookups];
+    out->sharedKeyHits = s[kSharedKeyHits];
+    out->docRegistrations = s[kScopesRegistered];
+    out->validations = s[kValidations];
+    out->validatedBytes = s[kValidatedBytes];
+    out->validateNanos = s[kValidateNanos];
+}
+
+void FLStats_Reset(void) FLAPI {
+    impl::Stats::reset();
+}
+
+void FLStats_SetEnabled(bool enabled) FLAPI {
+    impl::Stats::setEnabled(enabled);
+}
+
+bool FLStats_IsEnabled(void) FLAPI {
+    return impl::Stats::isEnabled();
+}
@@ -20,8 +20,11 @@
 #include "MutableArray.hh"
 #include "HeapDict.hh"
 #include "Internal.hh"
+#include "Endian.hh"
 #include "PlatformCompat.hh"
 #include "varint.hh"
+#include <algorithm>
+#include <type_traits>
 
 
 namespace fleece { namespace impl {
@@ -37,6 +40,12 @@ namespace fleece { namespace impl {
             _first = nullptr;
             _width = kNarrow;
             _count = 0;
+        } else if (_usuallyFalse(v->tag() == kBinaryTag)) {
+            // Typed array: the items are Values of the same size, stored inline:
+            slice items = v->getStringBytes();
+            _first = (const Value*)items.buf;
+            _width = uint8_t(typedArrayItemSize(items[0]));
+            _count = uint32_t(items.size / _width);
         } else if (_usuallyTrue(!v->isMutable())) {
             // Normal immutable case:
             _first = (const Value*)(&v->_byte[2]);
@@ -64,14 +73,15 @@ namespace fleece { namespace impl {
                 _count = mutArray->count() / 2;
             }
             _first = _count ? (const Value*)mutArray->first() : nullptr;
-            _width = sizeof(ValueSlot);
+            static_assert(sizeof(ValueSlot) == kMutableWidth);
+            _width = kMutableWidth;
         }
     }
 
     __hot
     const Value* Array::impl::deref(const Value *v) const noexcept {
-        if (_usuallyFalse(isMutableArray()))
-            return ((ValueSlot*)v)->asValue();
+        if (_usuallyFalse(_width > kWide))
+            return isMutableArray() ? ((ValueSlot*)v)->asValue() : v;
         return v->deref(_width == kWide);
     }
 
@@ -83,8 +93,10 @@ namespace fleece { namespace impl {
             return offsetby(_first, kNarrow * index)->deref<false>();
         else if (_usuallyTrue(_width == kWide))
             return offsetby(_first, kWide   * index)->deref<true>();
-        else
+        else if (isMutableArray())
             return ((ValueSlot*)_first + index)->asValue();
+        else
+            return offsetby(_first, _width * index);
     }
 
     const Value* Array::impl::firstValue() const noexcept {
@@ -135,6 +147,104 @@ namespace fleece { namespace impl {
         return isMutable() ? (MutableArray*)this : nullptr;
     }
 
+
+
+#pragma mark - BULK ACCESSORS:
+
+
+    // Layout of the items of a typed array, as written by Encoder::writeTypedArray.
+    struct TypedLayout {
+        uint8_t header;     // First byte of each Value
+        uint8_t stride;     // Size of each Value
+        uint8_t offset;     // Offset of the little-endian number within the Value
+    };
+
+    static constexpr TypedLayout kInt32Items  {(kIntTag   << 4) | 3,    6, 1};
+    static constexpr TypedLayout kInt64Items  {(kIntTag   << 4) | 7,   10, 1};
+    static constexpr TypedLayout kFloatItems  {(kFloatTag << 4),        6, 2};
+    static constexpr TypedLayout kDoubleItems {(kFloatTag << 4) | 0x08, 10, 2};
+
+    // Reads a little-endian number of type SRC from each item of a typed array.
+    template <class SRC, class DST>
+    __hot
+    static void gatherTypedItems(const Value *first, const TypedLayout &layout,
+                                 uint32_t count, DST *out) noexcept
+    {
+        using bits_t = typename std::conditional<sizeof(SRC) == 8, uint64_t, uint32_t>::type;
+        auto src = (const uint8_t*)first + layout.offset;
+        for (uint32_t i = 0; i < count; ++i, src += layout.stride) {
+            bits_t bits;
+            memcpy(&bits, src, sizeof(bits));
+            bits = bits_t(sizeof(bits) == 8 ? endian::decLittle64(bits)
+                                            : endian::decLittle32(uint32_t(bits)));
+            SRC n;
+            memcpy(&n, &bits, sizeof(n));
+            out[i] = DST(n);
+        }
+    }
+
+    // Reads the items of a typed array, returning false if they can't be converted to T here.
+    template <class T>
+    static bool getTypedItems(const Value *first, uint32_t count, T *out) noexcept {
+        switch (*(const uint8_t*)first) {
+            case kInt64Items.header:
+                gatherTypedItems<int64_t>(first, kInt64Items, count, out);
+                return true;
+            case kInt32Items.header:
+                gatherTypedItems<int32_t>(first, kInt32Items, count, out);
+                return true;
+            case kDoubleItems.header:
+                if (!std::is_floating_point<T>::value)
+                    return false;   // don't convert floats to ints here; asInt() has its own rules
+                gatherTypedItems<double>(first, kDoubleItems, count, out);
+                return true;
+            case kFloatItems.header:
+                if (!std::is_floating_point<T>::value)
+                    return false;
+                gatherTypedItems<float>(first, kFloatItems, count, out);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    template <class T>
+    uint32_t Array::getNumbers(uint32_t start, uint32_t count, T *out) const noexcept {
+        if (_usuallyFalse(isMutable())) {
+            auto heap = heapArray();
+            count = std::min(count, heap->count() - std::min(start, heap->count()));
+            for (uint32_t i = 0; i < count; ++i) {
+                auto v = heap->get(start + i);
+                out[i] = std::is_floating_point<T>::value ? T(v->asDouble()) : T(v->asInt());
+            }
+            return count;
+        }
+
+        impl a(this);
+        if (start >= a._count)
+            return 0;
+        count = std::min(count, a._count - start);
+        auto first = offsetby(a._first, start * a._width);
+        if (_usuallyTrue(a.isTypedArray()) && getTypedItems(first, count, out))
+            return count;
+
+        // Not a typed array; read each Value:
+        for (uint32_t i = 0; i < count; ++i) {
+            auto v = a.deref(offsetby(first, i * a._width));
+            out[i] = std::is_floating_point<T>::value ? T(v->asDouble()) : T(v->asInt());
+        }
+        return count;
+    }
+
+    uint32_t Array::getInts(uint32_t start, uint32_t count, int64_t *out) const noexcept {
+        return getNumbers(start, count, out);
+    }
+
+    uint32_t Array::getDoubles(uint32_t start, uint32_t count, double *out) const noexcept {
+        return getNumbers(start, count, out);
+    }
+
+
     EVEN_ALIGNED static constexpr Array kEmptyArrayInstance;
     const Array* const Array::kEmpty = &kEmptyArrayInstance;
 
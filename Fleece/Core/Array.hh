@@ -31,7 +31,8 @@ namespace fleece { namespace impl {
         struct impl {
             const Value* _first;
             uint32_t _count;
-            uint8_t _width;
+            uint8_t _width;             // 2 or 4 (pointers or inline Values); 8 (ValueSlots of
+                                        // a mutable array); 6 or 10 (Values of a typed array)
 
             impl(const Value*) noexcept;
             const Value* second() const noexcept FLPURE      {return offsetby(_first, _width);}
@@ -40,7 +41,10 @@ namespace fleece { namespace impl {
             const Value* operator[] (unsigned index) const noexcept FLPURE;
             size_t indexOf(const Value *v) const noexcept FLPURE;
             void offset(uint32_t n);
-            bool isMutableArray() const noexcept FLPURE      {return _width > 4;}
+            bool isMutableArray() const noexcept FLPURE      {return _width == kMutableWidth;}
+            bool isTypedArray() const noexcept FLPURE        {return _width > internal::kWide
+                                                                     && !isMutableArray();}
+            static constexpr uint8_t kMutableWidth = 8;
         };
 
     public:
@@ -55,6 +59,17 @@ namespace fleece { namespace impl {
             iterator and use its sequential or random-access accessors. */
         const Value* get(uint32_t index) const noexcept FLPURE;
 
+        /** Copies up to `count` items, starting at index `start`, to `out` as integers.
+            Returns the number of items copied, which is less than `count` if the array ends
+            first. Items that aren't numbers are copied as 0.
+            Typed arrays (see `Encoder::writeTypedArray`) are read in a tight loop, without
+            having to look at each item. */
+        uint32_t getInts(uint32_t start, uint32_t count, int64_t *out) const noexcept;
+
+        /** Copies up to `count` items, starting at index `start`, to `out` as doubles.
+            Same behavior as `getInts`. */
+        uint32_t getDoubles(uint32_t start, uint32_t count, double *out) const noexcept;
+
         /** If this array is mutable, returns the equivalent MutableArray*, else returns nullptr. */
         MutableArray* asMutable() const FLPURE;
 
@@ -71,10 +86,15 @@ namespace fleece { namespace impl {
         internal::HeapArray* heapArray() const;
 
     private:
+        template <class T>
+        uint32_t getNumbers(uint32_t start, uint32_t count, T *out) const noexcept;
+
         friend class Value;
         friend class ArrayIterator;
         friend class Dict;
         friend class DictIterator;
+        friend class CompressedDoc;
+        friend class Encoder;
         template <bool WIDE> friend struct dictImpl;
         friend class internal::HeapArray;
     };
@@ -0,0 +1,83 @@
+//
+// BlobStore.cc
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#include "BlobStore.hh"
+#include "Doc.hh"
+#include <string.h>
+
+namespace fleece { namespace impl {
+
+    static constexpr uint8_t kMagic[3] = {0xFF, 'B', 'R'};
+
+
+    void MemoryBlobStore::put(const Digest &digest, slice content) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto [i, isNew] = _blobs.emplace(std::string(digest.asSlice()), nullslice);
+        if (isNew) {
+            i->second = alloc_slice(content);
+            _bytesStored += content.size;
+        }
+    }
+
+
+    slice MemoryBlobStore::get(const Digest &digest) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto i = _blobs.find(std::string(digest.asSlice()));
+        return (i != _blobs.end()) ? slice(i->second) : slice();
+    }
+
+
+    size_t MemoryBlobStore::count() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _blobs.size();
+    }
+
+
+    size_t MemoryBlobStore::bytesStored() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _bytesStored;
+    }
+
+
+    bool BlobRef::decode(slice data, BlobRef &ref) noexcept {
+        if (data.size < 4 + 1 + SHA256::kDigestSize || memcmp(data.buf, kMagic, 3) != 0)
+            return false;
+        if (data[3] == 's')
+            ref.isString = true;
+        else if (data[3] == 'd')
+            ref.isString = false;
+        else
+            return false;
+        data.moveStart(4);
+        size_t n = GetUVarInt(data, &ref.length);
+        if (n == 0 || data.size - n != SHA256::kDigestSize)
+            return false;
+        memcpy(ref.digest.bytes, data.offset(n), SHA256::kDigestSize);
+        return true;
+    }
+
+
+    size_t BlobRef::encode(void *buf) const noexcept {
+        auto out = (uint8_t*)buf;
+        memcpy(out, kMagic, 3);
+        out[3] = isString ? 's' : 'd';
+        size_t pos = 4 + PutUVarInt(&out[4], length);
+        memcpy(&out[pos], digest.bytes, SHA256::kDigestSize);
+        return pos + SHA256::kDigestSize;
+    }
+
+
+    slice BlobRef::resolve(const Value *value) const noexcept {
+        BlobStore *store = Scope::blobStore(value);
+        if (!store)
+            return nullslice;
+        slice content = store->get(digest);
+        if (content.size != length)
+            return nullslice;
+        return content;
+    }
+
+} }
@@ -0,0 +1,87 @@
+//
+// BlobStore.hh
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "RefCounted.hh"
+#include "SHA256.hh"
+#include "varint.hh"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace fleece { namespace impl {
+    class Value;
+
+
+    /** A content-addressed table of large strings and binary data, shared between documents.
+
+        An Encoder with a BlobStore (see `Encoder::setBlobStore`) writes any string or data value
+        at least as large as its threshold into the store, and writes only a compact reference to
+        it -- its kind, length and SHA-256 digest -- into the document. A Value in a Doc whose
+        Scope has a BlobStore (see `Scope::setBlobStore`) can resolve such references: the
+        reference itself is an ordinary Data value, but `Value::resolveBlob` returns the content
+        it refers to. (JSON encoding and copying into another Encoder use resolveBlob too.)
+
+        Subclass this to keep the content elsewhere, such as in a database or on disk. */
+    class BlobStore : public RefCounted {
+    public:
+        using Digest = SHA256::Digest;
+
+        /** Stores content under its digest. Storing the same content again should be a no-op. */
+        virtual void put(const Digest&, slice content) =0;
+
+        /** Returns the content with the given digest, or a null slice if it's not available.
+            The memory it points to must remain valid as long as the BlobStore exists. */
+        virtual slice get(const Digest&) const =0;
+    };
+
+
+    /** A thread-safe BlobStore that keeps its content in memory. */
+    class MemoryBlobStore : public BlobStore {
+    public:
+        void put(const Digest&, slice content) override;
+        slice get(const Digest&) const override;
+
+        /** The number of distinct blobs stored. */
+        size_t count() const;
+
+        /** The total size of the distinct blobs stored. */
+        size_t bytesStored() const;
+
+    private:
+        mutable std::mutex _mutex;
+        std::unordered_map<std::string, alloc_slice> _blobs;    // Keyed by digest bytes
+        size_t _bytesStored {0};
+    };
+
+
+    /** A reference to a string or data value in a BlobStore, as stored in a document.
+        It's encoded as a Data value, so readers without the BlobStore still see valid Fleece:
+            FF 'B' 'R' kind  length (varint)  digest (32 bytes)
+        where `kind` is 's' for a string or 'd' for data. It's only treated as a reference if the
+        Value's Scope has a BlobStore containing the content; otherwise it's plain data. An
+        Encoder with a BlobStore puts any data that looks like a reference in the store as well,
+        so that it reads back as that data. */
+    struct BlobRef {
+        bool isString;
+        uint64_t length;
+        BlobStore::Digest digest;
+
+        static constexpr size_t kMaxEncodedSize = 4 + kMaxVarintLen64 + SHA256::kDigestSize;
+
+        /** Parses the contents of a Data value as a reference, returning false if it isn't one. */
+        static bool decode(slice data, BlobRef &ref) noexcept;
+
+        /** Encodes this reference into `buf`, which must have room for `kMaxEncodedSize` bytes.
+            Returns the number of bytes written. */
+        size_t encode(void *buf) const noexcept;
+
+        /** Looks up the content in the BlobStore of the Scope containing `value`. Returns a null
+            slice if there's no BlobStore, or it doesn't have the content. */
+        slice resolve(const Value* NONNULL value) const noexcept;
+    };
+
+} }
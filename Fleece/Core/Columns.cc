@@ -0,0 +1,134 @@
+//
+// Columns.cc
+//
+// Copyright © 2020 Couchbase. All rights reserved.
+//
+
+#include "Columns.hh"
+#include "PlatformCompat.hh"
+#include <algorithm>
+#include <string.h>
+
+namespace fleece { namespace impl {
+
+    // Rows are processed in blocks: each column is filled in for the whole block, which keeps the
+    // per-column state and the type dispatch out of the inner loop while the rows are in the
+    // cache. The next block's rows are prefetched before the current block is processed, so
+    // they arrive while it's being worked on.
+    static constexpr uint32_t kBlockSize = 64;
+
+
+    static inline bool isNumeric(const Value *value) {
+        auto type = value->type();
+        return type == kNumber || type == kBoolean;
+    }
+
+    static inline void setValid(uint8_t *bitmap, uint32_t row) {
+        bitmap[row >> 3] |= uint8_t(1 << (row & 7));
+    }
+
+    // Resolving the array's pointers doesn't read the rows, so this doesn't wait on memory.
+    static inline void prefetchRows(const Array::iterator &iter, const Value* rows[], uint32_t n) {
+        for (uint32_t i = 0; i < n; ++i) {
+            rows[i] = iter[i];
+            PREFETCH(rows[i]);
+        }
+    }
+
+
+    __hot
+    static void gatherInts(Column &col, uint32_t firstRow, const Dict* dicts[], uint32_t n) {
+        Dict::key &key = *col.key;
+        int64_t *out = (int64_t*)col.values + firstRow;
+        for (uint32_t i = 0; i < n; ++i) {
+            const Value *value = dicts[i] ? dicts[i]->get(key) : nullptr;
+            if (value && (_usuallyTrue(value->isInteger()) || isNumeric(value))) {
+                out[i] = value->asInt();
+                if (col.valid)
+                    setValid(col.valid, firstRow + i);
+            } else {
+                out[i] = 0;
+            }
+        }
+    }
+
+    __hot
+    static void gatherDoubles(Column &col, uint32_t firstRow, const Dict* dicts[], uint32_t n) {
+        Dict::key &key = *col.key;
+        double *out = (double*)col.values + firstRow;
+        for (uint32_t i = 0; i < n; ++i) {
+            const Value *value = dicts[i] ? dicts[i]->get(key) : nullptr;
+            if (value && (_usuallyTrue(value->isDouble()) || isNumeric(value))) {
+                out[i] = value->asDouble();
+                if (col.valid)
+                    setValid(col.valid, firstRow + i);
+            } else {
+                out[i] = 0.0;
+            }
+        }
+    }
+
+    __hot
+    static void gatherStrings(Column &col, uint32_t firstRow, const Dict* dicts[], uint32_t n) {
+        Dict::key &key = *col.key;
+        slice *out = (slice*)col.values + firstRow;
+        for (uint32_t i = 0; i < n; ++i) {
+            const Value *value = dicts[i] ? dicts[i]->get(key) : nullptr;
+            slice s;
+            if (value) {
+                s = value->asString();
+                if (_usuallyFalse(!s.buf))
+                    s = value->asData();
+                if (s.buf && col.valid)
+                    setValid(col.valid, firstRow + i);
+            }
+            out[i] = s;
+        }
+    }
+
+
+    __hot
+    uint32_t gatherColumns(const Array *array, uint32_t start, uint32_t count,
+                           Column columns[], size_t nColumns)
+    {
+        uint32_t total = array ? array->count() : 0;
+        if (start >= total)
+            return 0;
+        count = std::min(count, total - start);
+
+        for (size_t c = 0; c < nColumns; ++c) {
+            if (columns[c].valid)
+                memset(columns[c].valid, 0, (count + 7) / 8);
+        }
+
+        // Dict::key caches the shared-key ID and the index at which the key was last found, so
+        // after the first row, lookups in same-schema Dicts don't need to touch the SharedKeys
+        // or binary-search.
+        const Value* rows[2][kBlockSize];       // Current and next block, alternately
+        const Dict* dicts[kBlockSize];
+        Array::iterator iter(array);
+        iter += start;
+        prefetchRows(iter, rows[0], std::min(kBlockSize, count));
+        unsigned cur = 0;
+        for (uint32_t firstRow = 0; firstRow < count; firstRow += kBlockSize, cur ^= 1) {
+            uint32_t n = std::min(kBlockSize, count - firstRow);
+            uint32_t nextRow = firstRow + n;
+            if (nextRow < count) {
+                iter += n;
+                prefetchRows(iter, rows[cur ^ 1], std::min(kBlockSize, count - nextRow));
+            }
+            for (uint32_t i = 0; i < n; ++i)
+                dicts[i] = rows[cur][i]->asDict();
+
+            for (size_t c = 0; c < nColumns; ++c) {
+                switch (columns[c].type) {
+                    case Column::kInt:    gatherInts(columns[c], firstRow, dicts, n); break;
+                    case Column::kDouble: gatherDoubles(columns[c], firstRow, dicts, n); break;
+                    case Column::kString: gatherStrings(columns[c], firstRow, dicts, n); break;
+                }
+            }
+        }
+        return count;
+    }
+
+} }
@@ -0,0 +1,40 @@
+//
+// Columns.hh
+//
+// Copyright © 2020 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "Dict.hh"
+
+namespace fleece { namespace impl {
+
+    /** An output column for `gatherColumns`: one property read from every row. */
+    struct Column {
+        enum Type : int {
+            kInt,           // `values` is an array of int64_t
+            kDouble,        // `values` is an array of double
+            kString,        // `values` is an array of slice (strings or data, not copied)
+        };
+
+        Dict::key*  key;    // The property to read from each row
+        Type        type;   // The type of `values`
+        void*       values; // Output array, with room for `count` values
+        uint8_t*    valid;  // Optional output bitmap, with room for `count` bits
+    };
+
+
+    /** Reads properties from a range of an Array of Dicts (a "record batch") into typed columns,
+        in a single pass over the rows.
+
+        For each row, every column's `values[i]` is set from the Dict's value for the column's key.
+        If `valid` isn't null, bit `i` (LSB first, i.e. `valid[i/8] & (1 << (i%8))`) is set if the
+        row had a value of the column's type -- a number or boolean for numeric columns, a string
+        or data for string columns. Rows that don't, or that aren't Dicts, get 0 or nullslice.
+
+        Each key's shared-key ID is looked up once and reused for all rows.
+        @return  The number of rows read, which is less than `count` if the array ends first. */
+    uint32_t gatherColumns(const Array*, uint32_t start, uint32_t count,
+                           Column columns[], size_t nColumns);
+
+} }
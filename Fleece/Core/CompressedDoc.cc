@@ -0,0 +1,203 @@
+//
+// CompressedDoc.cc
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#include "CompressedDoc.hh"
+#include "Array.hh"
+#include "Path.hh"
+#include "Pointer.hh"
+#include "Endian.hh"
+#include "FleeceException.hh"
+#include "LZ4.hh"
+#include <algorithm>
+#include <string.h>
+
+namespace fleece { namespace impl {
+    using namespace internal;
+
+    static constexpr uint8_t  kMagic[4]     = {'F', 'L', 'Z', '1'};
+    static constexpr size_t   kHeaderSize   = 12;
+    static constexpr uint32_t kStoredFlag   = 0x80000000;
+    static constexpr size_t   kMaxHeaderLen = 16;       // Max size of a Value's type & length info
+
+    static inline uint32_t readLE32(const void *p) {
+        uint32_t n;
+        memcpy(&n, p, 4);
+        return endian::decLittle32(n);
+    }
+
+    static inline void writeLE32(void *p, uint32_t n) {
+        n = endian::encLittle32(n);
+        memcpy(p, &n, 4);
+    }
+
+
+    alloc_slice CompressedDoc::compress(slice data, size_t blockSize) {
+        throwIf(blockSize < kNarrow || blockSize % kNarrow || blockSize >= kStoredFlag,
+                InvalidData, "invalid block size");
+        throwIf(data.size == 0 || data.size % kNarrow, InvalidData, "invalid Fleece data");
+        throwIf(data.size > UINT32_MAX, MemoryError, "data too large to compress");
+        size_t nBlocks = (data.size + blockSize - 1) / blockSize;
+        size_t blocksPos = kHeaderSize + 4 * nBlocks;
+        alloc_slice result(blocksPos + lz4::maxCompressedSize(data.size) + 16 * nBlocks);
+        auto out = (uint8_t*)result.buf;
+
+        memcpy(out, kMagic, 4);
+        writeLE32(&out[4], uint32_t(data.size));
+        writeLE32(&out[8], uint32_t(blockSize));
+        size_t pos = blocksPos;
+        for (size_t i = 0; i < nBlocks; ++i) {
+            slice block = data.from(i * blockSize);
+            block.setSize(std::min(block.size, blockSize));
+            size_t size = lz4::compress(block, &out[pos], block.size - 1);
+            uint32_t entry = uint32_t(size);
+            if (size == 0) {
+                // Incompressible; store it as-is:
+                memcpy(&out[pos], block.buf, block.size);
+                size = block.size;
+                entry = uint32_t(size) | kStoredFlag;
+            }
+            writeLE32(&out[kHeaderSize + 4 * i], entry);
+            pos += size;
+        }
+        result.shorten(pos);
+        return result;
+    }
+
+
+    bool CompressedDoc::isCompressed(slice data) noexcept {
+        return data.size >= kHeaderSize && memcmp(data.buf, kMagic, 4) == 0;
+    }
+
+
+    size_t CompressedDoc::dataSize(slice container) {
+        throwIf(!isCompressed(container), InvalidData, "not a compressed Fleece container");
+        size_t size = readLE32(offsetby(container.buf, 4));
+        throwIf(size == 0 || size % kNarrow, InvalidData, "invalid compressed Fleece header");
+        return size;
+    }
+
+
+    CompressedDoc::CompressedDoc(const alloc_slice &container, SharedKeys *sk)
+    :Scope(alloc_slice(dataSize(container)), sk)
+    ,_container(container)
+    {
+        _fillsLazily = true;
+        slice data = this->data();
+        _blockSize = readLE32(offsetby(container.buf, 8));
+        throwIf(_blockSize < kNarrow || _blockSize % kNarrow,
+                InvalidData, "invalid compressed Fleece header");
+
+        // Read the block table:
+        size_t nBlocks = (data.size + _blockSize - 1) / _blockSize;
+        size_t pos = kHeaderSize + 4 * nBlocks;
+        throwIf(pos > container.size, InvalidData, "truncated compressed Fleece");
+        _blocks.reserve(nBlocks);
+        for (size_t i = 0; i < nBlocks; ++i) {
+            uint32_t entry = readLE32(offsetby(container.buf, kHeaderSize + 4 * i));
+            size_t size = entry & ~kStoredFlag;
+            bool stored = (entry & kStoredFlag) != 0;
+            size_t blockLen = std::min(_blockSize, data.size - i * _blockSize);
+            throwIf(pos + size > container.size || (stored && size != blockLen),
+                    InvalidData, "truncated compressed Fleece");
+            _blocks.push_back({slice(offsetby(container.buf, pos), size), stored, false});
+            pos += size;
+        }
+
+        // Find the root from the trailer, which is a narrow pointer, possibly to a wide one:
+        load(offsetby(data.end(), -std::min(data.size, size_t(kWide + kNarrow))),
+             std::min(data.size, size_t(kWide + kNarrow)));
+        auto trailer = (const Value*)offsetby(data.end(), -kNarrow);
+        if (!trailer->isPointer()) {
+            throwIf(data.size != kNarrow, InvalidData, "invalid Fleece trailer");
+            _root = trailer;
+        } else {
+            _root = trailer->_asPointer()->deref(false);
+            if (_root == offsetby(trailer, -kWide) && _root->isPointer())
+                _root = _root->_asPointer()->deref(true);
+            throwIf(_root < data.buf || _root >= trailer, InvalidData, "invalid Fleece trailer");
+            load(_root, kNarrow);       // the root's block may not be loaded yet
+            throwIf(_root->isPointer(), InvalidData, "invalid Fleece trailer");
+        }
+    }
+
+
+    const Value* CompressedDoc::root() {
+        return get(Path());
+    }
+
+
+    const Value* CompressedDoc::get(const Path &path) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const Value *value = _root;
+        for (auto &element : path.path()) {
+            loadValue(value, false);
+            value = element.eval(value);
+            if (!value)
+                return nullptr;
+        }
+        loadValue(value, true);
+        return value;
+    }
+
+
+    size_t CompressedDoc::blocksLoaded() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return std::count_if(_blocks.begin(), _blocks.end(), [](auto &b) {return b.loaded;});
+    }
+
+
+    // Decompresses the blocks that overlap a range of the data, if they aren't already.
+    void CompressedDoc::load(const void *start, size_t size) {
+        slice data = this->data();
+        throwIf(start < data.buf || offsetby(start, size) > data.end(),
+                InvalidData, "Fleece pointer out of range");
+        size_t begin = (uint8_t*)start - (uint8_t*)data.buf;
+        for (size_t i = begin / _blockSize; i * _blockSize < begin + size; ++i) {
+            Block &block = _blocks[i];
+            if (block.loaded)
+                continue;
+            void *dst = (void*)data.offset(i * _blockSize);
+            size_t blockLen = std::min(_blockSize, data.size - i * _blockSize);
+            if (block.stored)
+                memcpy(dst, block.compressed.buf, blockLen);
+            else if (!lz4::decompress(block.compressed, dst, blockLen))
+                FleeceException::_throw(InvalidData, "corrupt compressed Fleece block");
+            block.loaded = true;
+        }
+    }
+
+
+    // Decompresses a Value. If it's a collection, also decompresses its dict keys, and if `deep`
+    // is true, everything else it contains.
+    void CompressedDoc::loadValue(const Value *value, bool deep) {
+        size_t available = (uint8_t*)data().end() - (uint8_t*)value;
+        load(value, std::min(available, kMaxHeaderLen));
+        auto tag = value->tag();
+        if (tag < kArrayTag) {
+            load(value, value->dataSize());
+            return;
+        }
+        Array::impl items(value);
+        bool isDict = (tag == kDictTag);
+        uint32_t count = items._count * (isDict ? 2 : 1);
+        load(value, (uint8_t*)offsetby(items._first, count * items._width) - (uint8_t*)value);
+        bool wide = (items._width == kWide);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (deep || (isDict && (i & 1) == 0))
+                loadItem(offsetby(items._first, i * items._width), wide, true);
+        }
+    }
+
+
+    void CompressedDoc::loadItem(const Value *item, bool wide, bool deep) {
+        if (!item->isPointer())
+            return;                 // inline, so it's already loaded
+        auto ptr = item->_asPointer();
+        throwIf(ptr->isExternal(), InvalidData, "compressed Fleece can't have extern pointers");
+        loadValue(ptr->deref(wide), deep);
+    }
+
+} }
@@ -0,0 +1,78 @@
+//
+// CompressedDoc.hh
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "Doc.hh"
+#include <mutex>
+#include <vector>
+
+namespace fleece { namespace impl {
+    class Path;
+
+
+    /** A Fleece document stored in a compressed container, which is decompressed lazily: looking
+        up a value decompresses only the blocks that the lookup and the value itself occupy.
+
+        The container consists of a header followed by the Fleece data, split into fixed-size
+        blocks that are LZ4-compressed independently:
+            "FLZ1"
+            uint32 (LE) size of the Fleece data
+            uint32 (LE) block size
+            uint32 (LE) compressed size of each block; high bit set if stored uncompressed
+            compressed blocks...
+
+        Fleece pointers are plain memory offsets, so the Values returned are in a buffer the size
+        of the whole document, in which only the blocks needed so far have been decompressed.
+        Each Value returned has been decompressed along with everything it contains, but other
+        parts of the document may not have been, so don't navigate outside it.
+
+        The data isn't validated, since that would require decompressing all of it; decompression
+        itself is safe even with corrupt input, but only open data you trust. */
+    class CompressedDoc : public RefCounted, public Scope {
+    public:
+        static constexpr size_t kDefaultBlockSize = 16 * 1024;
+
+        /** Compresses Fleece data into a container. */
+        static alloc_slice compress(slice fleeceData, size_t blockSize =kDefaultBlockSize);
+
+        /** Returns true if the data looks like a compressed container. */
+        static bool isCompressed(slice data) noexcept;
+
+        /** Opens a container. Throws InvalidData if its header or block table is invalid. */
+        explicit CompressedDoc(const alloc_slice &container, SharedKeys* =nullptr);
+
+        /** Returns the root Value, decompressing the entire document. */
+        const Value* root();
+
+        /** Returns the value at a path from the root, decompressing only the blocks needed,
+            or null if there's no such value. */
+        const Value* get(const Path&);
+
+        size_t blockCount() const                           {return _blocks.size();}
+
+        /** The number of blocks that have been decompressed so far. */
+        size_t blocksLoaded() const;
+
+    private:
+        struct Block {
+            slice compressed;
+            bool stored;            // True if not actually compressed
+            bool loaded;
+        };
+
+        static size_t dataSize(slice container);
+        void load(const void *start, size_t size);
+        void loadValue(const Value* NONNULL, bool deep);
+        void loadItem(const Value* NONNULL item, bool wide, bool deep);
+
+        alloc_slice const   _container;
+        size_t              _blockSize;
+        std::vector<Block>  _blocks;
+        const Value*        _root {nullptr};
+        mutable std::mutex  _mutex;
+    };
+
+} }
@@ -22,6 +22,7 @@
 #include "Doc.hh"
 #include "Internal.hh"
 #include "PlatformCompat.hh"
+#include "Stats.hh"
 #include <atomic>
 #include <string>
 #include "betterassert.hh"
@@ -125,13 +126,13 @@ namespace fleece { namespace impl {
             if (_usuallyTrue(sharedKeys != nullptr)) {
                 // Look for a numeric key first:
                 if (_usuallyTrue(keyToFind._hasNumericKey))
-                    return get(keyToFind._numericKey);
+                    return getNumeric(keyToFind);
                 // Key was not registered last we checked; see if dict contains any new keys:
                 if (_usuallyFalse(_count == 0))
                     return nullptr;
                 if (lookupSharedKey(keyToFind._rawString, sharedKeys, keyToFind._numericKey)) {
                     keyToFind._hasNumericKey = true;
-                    return get(keyToFind._numericKey);
+                    return getNumeric(keyToFind);
                 }
             }
 
@@ -188,30 +189,67 @@ namespace fleece { namespace impl {
         template <class T, class CMP>
         __hot
         inline const Value* search(T target, CMP comparator) const {
-            const Value *begin = _first;
+            const Value *begin = _first, *found = nullptr;
             size_t n = _count;
+            unsigned comparisons = 0;
             while (n > 0) {
                 size_t mid = n >> 1;
                 const Value *midVal = offsetby(begin, mid * 2*kWidth);
                 int cmp = comparator(target, midVal);
-                if (_usuallyFalse(cmp == 0))
-                    return midVal;
-                else if (cmp < 0)
+                ++comparisons;
+                if (_usuallyFalse(cmp == 0)) {
+                    found = midVal;
+                    break;
+                } else if (cmp < 0)
                     n = mid;
                 else {
                     begin = offsetby(midVal, 2*kWidth);
                     n -= mid + 1;
                 }
             }
-            return nullptr;
+            recordLookup(comparisons);
+            return found;
+        }
+
+        // Records a lookup, and the key comparisons it made, in the runtime stats.
+        static void recordLookup(unsigned comparisons) noexcept {
+            if (_usuallyFalse(stats::enabled())) {
+                stats::add(stats::kDictLookups);
+                stats::add(stats::kDictComparisons, comparisons);
+            }
+        }
+
+        // Looks up a Dict::key's numeric key. Dicts with the same schema usually have the key at
+        // the same index, so first check the index where it was last found.
+        __hot
+        const Value* getNumeric(Dict::key &keyToFind) const noexcept {
+            int numericKey = keyToFind._numericKey;
+            if (keyToFind._hint < _count) {
+                const Value *key = offsetby(_first, keyToFind._hint * 2 * kWidth);
+                if (compareKeys(numericKey, key) == 0) {
+                    recordLookup(1);
+                    return finishGet(key, numericKey);
+                }
+                stats::add(stats::kDictComparisons);    // the search below counts the lookup
+            }
+            auto key = search(numericKey, [](int target, const Value *val) {
+                countComparison();
+                return compareKeys(target, val);
+            });
+            if (key)
+                keyToFind._hint = (uint32_t)indexOf(key) / 2;
+            return finishGet(key, numericKey);
         }
 
         __hot
         const Value* findKeyByHint(Dict::key &keyToFind) const {
             if (keyToFind._hint < _count) {
                 const Value *key  = offsetby(_first, keyToFind._hint * 2 * kWidth);
-                if (compareKeys(keyToFind._rawString, key) == 0)
+                if (compareKeys(keyToFind._rawString, key) == 0) {
+                    recordLookup(1);
                     return key;
+                }
+                stats::add(stats::kDictComparisons);    // a search will count the lookup
             }
             return nullptr;
         }
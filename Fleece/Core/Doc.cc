@@ -17,10 +17,12 @@
 //
 
 #include "Doc.hh"
+#include "BlobStore.hh"
 #include "SharedKeys.hh"
 #include "Pointer.hh"
 #include "JSONConverter.hh"
 #include "FleeceException.hh"
+#include "Stats.hh"
 #include "MutableDict.hh"
 #include "MutableArray.hh"
 #include <algorithm>
@@ -57,6 +59,9 @@ namespace fleece { namespace impl {
     // Mutex for access to `sMemoryMap`
     static mutex sMutex;
 
+    // Number of Scopes with a BlobStore; while it's zero, Values needn't look for one.
+    static atomic<unsigned> sBlobStoreScopes {0};
+
 
     Scope::Scope(slice data, SharedKeys *sk, slice destination) noexcept
     :_sk(sk)
@@ -79,6 +84,7 @@ namespace fleece { namespace impl {
 
     Scope::Scope(const Scope &parentScope, slice subData) noexcept
     :_sk(parentScope.sharedKeys())
+    ,_blobStore(parentScope.blobStore())
     ,_externDestination(parentScope.externDestination())
     ,_data(subData)
     ,_alloced(parentScope._alloced)
@@ -87,11 +93,15 @@ namespace fleece { namespace impl {
         _unregistered.test_and_set();
         if (subData)
             assert_precondition(parentScope.data().containsAddressRange(subData));
+        if (_blobStore)
+            ++sBlobStoreScopes;
     }
 
 
     Scope::~Scope() {
         unregister();
+        if (_blobStore)
+            --sBlobStoreScopes;
     }
 
 
@@ -150,6 +160,7 @@ namespace fleece { namespace impl {
 
         sMemoryMap->insert(iter, entry);
         _unregistered.clear();
+        stats::add(stats::kScopesRegistered);
     }
 
 
@@ -157,7 +168,7 @@ namespace fleece { namespace impl {
         if (!_unregistered.test_and_set()) {            // this is atomic
 #if DEBUG
             // Assert that the data hasn't been changed since I was created:
-            if (_data.size < 1e6 && _data.hash() != _dataHash)
+            if (_data.size < 1e6 && !_fillsLazily && _data.hash() != _dataHash)
                 FleeceException::_throw(InternalError,
                     "Memory range (%p .. %p) was altered while Scope %p (sk=%p) was active. "
                     "This usually means the Scope's data was freed/invalidated before the Scope "
@@ -226,6 +237,31 @@ namespace fleece { namespace impl {
     }
 
 
+    BlobStore* Scope::blobStore() const {
+        lock_guard<mutex> lock(sMutex);
+        return _blobStore;
+    }
+
+
+    void Scope::setBlobStore(BlobStore *store) {
+        lock_guard<mutex> lock(sMutex);
+        if (store && !_blobStore)
+            ++sBlobStoreScopes;
+        else if (!store && _blobStore)
+            --sBlobStoreScopes;
+        _blobStore = store;
+    }
+
+
+    /*static*/ BlobStore* Scope::blobStore(const Value *v) noexcept {
+        if (_usuallyTrue(sBlobStoreScopes.load(memory_order_acquire) == 0))
+            return nullptr;
+        lock_guard<mutex> lock(sMutex);
+        auto scope = _containing(v);
+        return scope ? scope->_blobStore.get() : nullptr;
+    }
+
+
     const Value* Scope::resolveExternPointerTo(const void* dst) const noexcept {
         dst = offsetby(dst, (char*)_externDestination.end() - (char*)_data.buf);
         if (_usuallyFalse(!_externDestination.containsAddress(dst)))
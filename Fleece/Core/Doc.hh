@@ -12,6 +12,7 @@
 #include <utility>
 
 namespace fleece { namespace impl {
+    class BlobStore;
     class SharedKeys;
     class Value;
     namespace internal {
@@ -43,9 +44,17 @@ namespace fleece { namespace impl {
         SharedKeys* sharedKeys() const FLPURE          {return _sk;}
         slice externDestination() const FLPURE         {return _externDestination;}
 
+        /** The BlobStore used to resolve references to out-of-line strings and data in this
+            Fleece data (see BlobStore.hh), or null. */
+        BlobStore* blobStore() const;
+
+        /** Sets the BlobStore. This should be called before any Values are accessed. */
+        void setBlobStore(BlobStore*);
+
         // For internal use:
 
         static SharedKeys* sharedKeys(const Value* NONNULL v) noexcept;
+        static BlobStore* blobStore(const Value* NONNULL v) noexcept;
         const Value* resolveExternPointerTo(const void* NONNULL) const noexcept;
         static const Value* resolvePointerFrom(const internal::Pointer* NONNULL src,
                                                const void* NONNULL dst) noexcept;
@@ -63,6 +72,7 @@ namespace fleece { namespace impl {
         void registr() noexcept;
 
         Retained<SharedKeys> _sk;                       // SharedKeys used for this Fleece data
+        Retained<BlobStore> _blobStore;                 // Resolves out-of-line strings & data
         slice const         _externDestination;         // Extern ptr destination for this data
         slice const         _data;                      // The memory range I represent
         alloc_slice const   _alloced;                   // Retains data if it's an alloc_slice
@@ -72,6 +82,7 @@ namespace fleece { namespace impl {
 #endif
     protected:
         bool                _isDoc {false};             // True if I am a field of a Doc
+        bool                _fillsLazily {false};       // True if _data is filled in after registering
         friend class Doc;
     };
 
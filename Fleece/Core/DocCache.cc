@@ -0,0 +1,434 @@
+//
+// DocCache.cc
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#include "DocCache.hh"
+#include "SharedKeys.hh"
+#include <mutex>
+#include <vector>
+#include <string.h>
+#include "betterassert.hh"
+
+namespace fleece { namespace impl {
+    using namespace std;
+
+    static constexpr unsigned kMaxShards = 16;
+    static constexpr size_t kMinDocsPerShard = 64;
+
+
+    static inline bool sameData(slice a, slice b) noexcept {
+        return a.size == b.size && (a.buf == b.buf || memcmp(a.buf, b.buf, a.size) == 0);
+    }
+
+
+    struct DocCache::Entry {
+        Entry(uint32_t h, slice k, Retained<Doc> d, bool v)
+        :hash(h), key(k), doc(move(d)), size(doc->data().size + k.size), validated(v) { }
+
+        // Returns true if the data is known to be valid, validating it if necessary.
+        bool validate(Doc::Trust trust) noexcept {
+            if (trust == Doc::kUntrusted && !validated.load(memory_order_acquire)) {
+                if (!Value::fromData(doc->data()))
+                    return false;
+                validated.store(true, memory_order_release);
+            }
+            return true;
+        }
+
+        uint32_t const      hash;               // Hash of the key, or of the data if no key
+        alloc_slice const   key;                // The caller's key, or null if keyed by data
+        Retained<Doc> const doc;                // The cached Doc
+        size_t const        size;               // Bytes counted against the memory limit
+        atomic<bool>        referenced {true};  // Set by lookups, cleared by the CLOCK hand
+        atomic<bool>        validated;          // True if the data is known to be valid
+    };
+
+
+    // A shard is an open hash table (linear probing) of Entry pointers. Writers hold `_mutex`.
+    // Entries removed from the table are filled in by backward shifting, not tombstones; a lookup
+    // racing with that may miss an entry, which only costs the caller a trip through the locked
+    // path.
+    //
+    // Lookups don't lock. Removed Entries are freed by epoch-based reclamation: a lookup counts
+    // itself in `_readers[epoch & 1]` while it looks at Entries, and removed Entries go on the
+    // current epoch's `_retired` list. Once no lookups of the other parity remain, that list
+    // (from the previous epoch) is freed and the epoch advances, so new lookups are counted
+    // separately from the ones that might still see the newly retired Entries. The last lookup to
+    // leave an epoch does this, as do writers, so Entries get freed even if lookups always
+    // overlap.
+    //
+    // The counter checks are read-modify-writes, so they read the latest count: either a lookup's
+    // increment comes after the check, and synchronizes with it, so that lookup sees the Entry
+    // already gone from the table; or the check sees the lookup.
+    class alignas(64) DocCache::Shard {
+    public:
+        Shard() =default;
+
+        ~Shard() {
+            for (unsigned i = 0; i <= _mask; ++i)
+                delete _slots[i].load(memory_order_relaxed);
+            for (auto &retired : _retired) {
+                for (Entry *entry : retired)
+                    delete entry;
+            }
+        }
+
+        void init(unsigned tableSize, size_t maxCount, size_t maxBytes) {
+            _slots.reset(new atomic<Entry*>[tableSize]);
+            for (unsigned i = 0; i < tableSize; ++i)
+                _slots[i].store(nullptr, memory_order_relaxed);
+            _mask = tableSize - 1;
+            _maxCount = maxCount;
+            _maxBytes = maxBytes;
+        }
+
+        // Looks up a matching Entry without locking. If there is one, returns true and sets
+        // `outDoc` to its Doc, or to null if the trust level requires validation and it fails.
+        template <class MATCH>
+        bool find(uint32_t hash, Doc::Trust trust, MATCH match, Retained<Doc> &outDoc) {
+            unsigned parity = beginRead();
+            Entry *entry = lookup(hash, match);
+            if (entry) {
+                entry->referenced.store(true, memory_order_relaxed);
+                if (entry->validate(trust))
+                    outDoc = entry->doc;
+                _hits.fetch_add(1, memory_order_relaxed);
+            }
+            endRead(parity);
+            return entry != nullptr;
+        }
+
+        // Registers a lookup in progress; returns the parity to pass to `endRead`.
+        unsigned beginRead() noexcept {
+            unsigned parity = _epoch.load(memory_order_acquire) & 1;
+            _readers[parity].fetch_add(1, memory_order_acquire);
+            return parity;
+        }
+
+        void endRead(unsigned parity) {
+            if (_readers[parity].fetch_sub(1, memory_order_release) == 1
+                    && _retiredCount.load(memory_order_relaxed) > 0) {
+                lock_guard<mutex> lock(_mutex);
+                reclaim();
+            }
+        }
+
+        void missed()       {_misses.fetch_add(1, memory_order_relaxed);}
+
+        // Adds an Entry, replacing a matching one unless it has the same Doc contents, in which
+        // case that one is kept. Returns the Doc of the Entry that ends up in the cache (or of
+        // the new one, if it's too big to be cached.)
+        template <class MATCH>
+        Retained<Doc> insert(unique_ptr<Entry> entry, MATCH match) {
+            lock_guard<mutex> lock(_mutex);
+            unsigned index;
+            if (Entry *existing = lookup(entry->hash, match, &index)) {
+                if (existing->doc->sharedKeys() == entry->doc->sharedKeys()
+                        && sameData(existing->doc->data(), entry->doc->data())) {
+                    existing->referenced.store(true, memory_order_relaxed);
+                    if (entry->validated)
+                        existing->validated.store(true, memory_order_release);
+                    return existing->doc;
+                }
+                removeAt(index);
+            }
+
+            Retained<Doc> doc = entry->doc;
+            if (entry->size <= _maxBytes) {
+                while (_count > 0 && (_count >= _maxCount || _bytes + entry->size > _maxBytes))
+                    evictOne();
+                unsigned i = entry->hash & _mask;
+                while (_slots[i].load(memory_order_relaxed))
+                    i = (i + 1) & _mask;
+                ++_count;
+                _bytes += entry->size;
+                _slots[i].store(entry.release());
+            }
+            reclaim();
+            return doc;
+        }
+
+        template <class MATCH>
+        bool remove(uint32_t hash, MATCH match) {
+            lock_guard<mutex> lock(_mutex);
+            unsigned index;
+            if (!lookup(hash, match, &index))
+                return false;
+            removeAt(index);
+            reclaim();
+            return true;
+        }
+
+        void clear() {
+            lock_guard<mutex> lock(_mutex);
+            for (unsigned i = 0; i <= _mask; ++i) {
+                if (Entry *entry = _slots[i].exchange(nullptr))
+                    retire(entry);
+            }
+            _count = 0;
+            _bytes = 0;
+            reclaim();
+        }
+
+        void setMaxBytes(size_t maxBytes) {
+            lock_guard<mutex> lock(_mutex);
+            _maxBytes = maxBytes;
+            while (_count > 0 && _bytes > _maxBytes)
+                evictOne();
+            reclaim();
+        }
+
+        void addStats(Stats &stats) {
+            lock_guard<mutex> lock(_mutex);
+            stats.hits      += _hits.load(memory_order_relaxed);
+            stats.misses    += _misses.load(memory_order_relaxed);
+            stats.evictions += _evictions;
+            stats.count     += _count;
+            stats.bytes     += _bytes;
+            stats.retired   += _retiredCount.load(memory_order_relaxed);
+        }
+
+    private:
+        template <class MATCH>
+        Entry* lookup(uint32_t hash, MATCH match, unsigned *outIndex =nullptr) const {
+            unsigned i = hash & _mask;
+            for (unsigned n = 0; n <= _mask; ++n, i = (i + 1) & _mask) {
+                Entry *entry = _slots[i].load();
+                if (!entry)
+                    break;
+                if (entry->hash == hash && match(*entry)) {
+                    if (outIndex)
+                        *outIndex = i;
+                    return entry;
+                }
+            }
+            return nullptr;
+        }
+
+        // Evicts the first Entry at or after the CLOCK hand that hasn't been used since the
+        // hand last passed it.
+        void evictOne() {
+            for (;;) {
+                unsigned i = _clockHand;
+                _clockHand = (i + 1) & _mask;
+                Entry *entry = _slots[i].load(memory_order_relaxed);
+                if (entry && !entry->referenced.exchange(false, memory_order_relaxed)) {
+                    removeAt(i);
+                    ++_evictions;
+                    return;
+                }
+            }
+        }
+
+        void removeAt(unsigned i) {
+            Entry *removed = _slots[i].load(memory_order_relaxed);
+            --_count;
+            _bytes -= removed->size;
+            // Move later entries of the same probe sequence back into the gap, so that lookups
+            // can keep stopping at the first empty slot:
+            for (unsigned j = (i + 1) & _mask; ; j = (j + 1) & _mask) {
+                Entry *entry = _slots[j].load(memory_order_relaxed);
+                if (!entry)
+                    break;
+                unsigned home = entry->hash & _mask;
+                bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+                if (!stays) {
+                    _slots[i].store(entry);
+                    i = j;
+                }
+            }
+            _slots[i].store(nullptr);
+            retire(removed);
+        }
+
+        // Queues a removed Entry to be deleted when no lookup can be looking at it.
+        void retire(Entry *entry) {
+            _retired[_epoch.load(memory_order_relaxed) & 1].push_back(entry);
+            _retiredCount.fetch_add(1, memory_order_relaxed);
+        }
+
+        // Deletes the previous epoch's removed Entries once no lookup that might be looking at
+        // them is left, then starts a new epoch if the current one has removed Entries.
+        void reclaim() {
+            unsigned epoch = _epoch.load(memory_order_relaxed);
+            unsigned prev = (epoch + 1) & 1, cur = epoch & 1;
+            if (_readers[prev].fetch_add(0, memory_order_acq_rel) != 0)
+                return;
+            if (!_retired[prev].empty()) {
+                for (Entry *entry : _retired[prev])
+                    delete entry;
+                _retiredCount.fetch_sub(_retired[prev].size(), memory_order_relaxed);
+                _retired[prev].clear();
+            }
+            if (!_retired[cur].empty()) {
+                _epoch.store(epoch + 1, memory_order_release);
+                reclaim();          // Frees them now if no lookup that might see them is left
+            }
+        }
+
+        unique_ptr<atomic<Entry*>[]> _slots;    // The hash table
+        unsigned            _mask {0};          // Table size - 1
+        atomic<unsigned>    _epoch {0};         // Changed only by writers
+        atomic<int>         _readers[2] {};     // Lookups in progress, by epoch parity
+        atomic<size_t>      _retiredCount {0};  // Total size of _retired lists
+        atomic<uint64_t>    _hits {0}, _misses {0};
+        mutex               _mutex;             // Must be locked to change anything below
+        size_t              _maxCount {0}, _maxBytes {0};
+        size_t              _count {0}, _bytes {0};
+        uint64_t            _evictions {0};
+        unsigned            _clockHand {0};
+        vector<Entry*>      _retired[2];        // Removed entries waiting to be deleted, by epoch
+    };
+
+
+    DocCache::DocCache(size_t maxBytes, size_t maxDocs)
+    :RefCounted(false)          // a cache is for sharing between threads, so is never confined
+    ,_maxBytes(maxBytes)
+    ,_maxDocs(max(maxDocs, size_t(1)))
+    {
+        _shardCount = 1;
+        while (_shardCount < kMaxShards && _shardCount * kMinDocsPerShard < _maxDocs)
+            _shardCount *= 2;
+        size_t maxCount = (_maxDocs + _shardCount - 1) / _shardCount;
+        // Keep each table at most half full, so probe sequences stay short:
+        unsigned tableSize = 8;
+        while (tableSize < 2 * maxCount)
+            tableSize *= 2;
+        _shards.reset(new Shard[_shardCount]);
+        for (unsigned i = 0; i < _shardCount; ++i)
+            _shards[i].init(tableSize, maxCount, maxBytes / _shardCount);
+    }
+
+
+    DocCache::~DocCache() =default;
+
+
+    DocCache* DocCache::shared() {
+        static DocCache* const sShared = [] {
+            ThreadConfinedScope notConfined(false);
+            return retain(new DocCache());
+        }();
+        return sShared;
+    }
+
+
+    DocCache::Shard& DocCache::shardFor(uint32_t hash) const {
+        return _shards[(hash >> 24) & (_shardCount - 1)];
+    }
+
+
+    // Creates a Doc that can be shared with other threads, or returns null if the data's invalid.
+    // Must be called in non-confined mode. Thread-confined data is copied, since the Doc keeps it.
+    Retained<Doc> DocCache::newDoc(const alloc_slice &data, Doc::Trust trust, SharedKeys *sk) {
+        assert(!tThreadConfined);
+        alloc_slice docData = data;
+        if (_usuallyFalse(data.isThreadConfined()))
+            docData = alloc_slice(slice(data));
+        Retained<Doc> doc = new Doc(docData, trust, sk);
+        return doc->root() ? doc : nullptr;
+    }
+
+
+    Retained<Doc> DocCache::get(const alloc_slice &data, Doc::Trust trust, SharedKeys *sk) {
+        if (!data)
+            return nullptr;
+        uint32_t hash = data.hash();
+        auto matches = [&](const Entry &entry) {
+            return !entry.key && entry.doc->sharedKeys() == sk
+                              && sameData(entry.doc->data(), data);
+        };
+        Shard &shard = shardFor(hash);
+        Retained<Doc> doc;
+        if (shard.find(hash, trust, matches, doc))
+            return doc;
+        shard.missed();
+        // The new Doc, its data and its Entry are shared with other threads:
+        ThreadConfinedScope notConfined(false);
+        doc = newDoc(data, trust, sk);
+        if (!doc)
+            return nullptr;
+        return shard.insert(make_unique<Entry>(hash, nullslice, doc, trust == Doc::kUntrusted),
+                            matches);
+    }
+
+
+    Retained<Doc> DocCache::find(slice key) {
+        if (!key)
+            return nullptr;
+        uint32_t hash = key.hash();
+        Shard &shard = shardFor(hash);
+        Retained<Doc> doc;
+        if (!shard.find(hash, Doc::kTrusted, [&](const Entry &e) {return e.key == key;}, doc))
+            shard.missed();
+        return doc;
+    }
+
+
+    Retained<Doc> DocCache::add(slice key, const alloc_slice &data, Doc::Trust trust,
+                                SharedKeys *sk)
+    {
+        assert_precondition(key);
+        uint32_t hash = key.hash();
+        Shard &shard = shardFor(hash);
+        // If the same data is already cached under this key, just return it:
+        Retained<Doc> doc;
+        auto sameDoc = [&](const Entry &entry) {
+            return entry.key == key && entry.doc->sharedKeys() == sk
+                                    && sameData(entry.doc->data(), data);
+        };
+        if (shard.find(hash, trust, sameDoc, doc))
+            return doc;
+        shard.missed();
+        ThreadConfinedScope notConfined(false);   // (see `get`)
+        doc = newDoc(data, trust, sk);
+        if (!doc)
+            return nullptr;
+        return shard.insert(make_unique<Entry>(hash, key, doc, trust == Doc::kUntrusted),
+                            [&](const Entry &entry) {return entry.key == key;});
+    }
+
+
+    bool DocCache::remove(slice key) {
+        uint32_t hash = key.hash();
+        return shardFor(hash).remove(hash, [&](const Entry &entry) {return entry.key == key;});
+    }
+
+
+    void DocCache::clear() {
+        for (unsigned i = 0; i < _shardCount; ++i)
+            _shards[i].clear();
+    }
+
+
+    void DocCache::setMaxBytes(size_t maxBytes) {
+        _maxBytes = maxBytes;
+        for (unsigned i = 0; i < _shardCount; ++i)
+            _shards[i].setMaxBytes(maxBytes / _shardCount);
+    }
+
+
+    DocCache::Stats DocCache::stats() const {
+        Stats stats = { };
+        for (unsigned i = 0; i < _shardCount; ++i)
+            _shards[i].addStats(stats);
+        return stats;
+    }
+
+
+#ifndef NDEBUG
+    uint32_t DocCache::beginLookup() {
+        uint32_t parities = 0;
+        for (unsigned i = 0; i < _shardCount; ++i)
+            parities |= _shards[i].beginRead() << i;
+        return parities;
+    }
+
+    void DocCache::endLookup(uint32_t parities) {
+        for (unsigned i = 0; i < _shardCount; ++i)
+            _shards[i].endRead((parities >> i) & 1);
+    }
+#endif
+
+} }
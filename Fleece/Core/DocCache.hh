@@ -0,0 +1,109 @@
+//
+// DocCache.hh
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "Doc.hh"
+#include "RefCounted.hh"
+#include "fleece/slice.hh"
+#include <atomic>
+#include <memory>
+
+namespace fleece { namespace impl {
+
+    /** A thread-safe, bounded cache of Docs, for data that's loaded over and over. Getting a Doc
+        that's in the cache skips validating the data and registering a new Scope; all callers
+        share the same Doc. Docs can be looked up by their content, or by a key of the caller's
+        choosing (such as a document ID.)
+
+        The cache is split into shards, each with its own lock for insertions and evictions, but
+        lookups don't take any lock. When a shard is full, the least recently used Docs are
+        evicted, as approximated by the CLOCK algorithm. A Doc that's been evicted stays alive
+        as long as someone still retains it.
+
+        Cached Docs are shared between threads, so the cache creates them in non-confined mode
+        (see ThreadConfinedScope), and copies data that was allocated in thread-confined mode.
+        The cache itself is never thread-confined either, even if created in that mode. */
+    class DocCache : public RefCounted {
+    public:
+        static constexpr size_t kDefaultMaxBytes = 16 << 20;
+        static constexpr size_t kDefaultMaxDocs  = 4096;
+
+        /** Constructs a cache.
+            @param maxBytes  The maximum total size of the cached data (including keys.)
+                        A Doc larger than `maxBytes / shardCount()` is never cached.
+            @param maxDocs  The maximum number of Docs cached. This is fixed. */
+        explicit DocCache(size_t maxBytes =kDefaultMaxBytes, size_t maxDocs =kDefaultMaxDocs);
+
+        /** A process-wide cache with the default limits. */
+        static DocCache* shared();
+
+        /** Returns a Doc for the data, from the cache if equal data was cached with the same
+            SharedKeys, else by creating one and adding it. A cached Doc's data is not `data`
+            itself but the (equal) data it was created with.
+            Returns null if the data isn't valid Fleece. Untrusted data is validated only the first
+            time it's seen. */
+        Retained<Doc> get(const alloc_slice &data,
+                          Doc::Trust =Doc::kUntrusted,
+                          SharedKeys* =nullptr);
+
+        /** Returns the Doc cached under the key by \ref add, or null if there isn't one. */
+        Retained<Doc> find(slice key);
+
+        /** Creates a Doc for the data and caches it under the key, replacing any Doc with
+            different data already there. Returns the Doc, or null if the data isn't valid. */
+        Retained<Doc> add(slice key,
+                          const alloc_slice &data,
+                          Doc::Trust =Doc::kUntrusted,
+                          SharedKeys* =nullptr);
+
+        /** Removes the Doc cached under the key, if any. Returns true if there was one. */
+        bool remove(slice key);
+
+        /** Removes all Docs from the cache. */
+        void clear();
+
+        /** Changes the maximum total size of the cached data, evicting Docs if necessary. */
+        void setMaxBytes(size_t maxBytes);
+
+        size_t maxBytes() const FLPURE                  {return _maxBytes;}
+        size_t maxDocs() const FLPURE                   {return _maxDocs;}
+        unsigned shardCount() const FLPURE              {return _shardCount;}
+
+        struct Stats {
+            uint64_t hits;          // Lookups that found a Doc
+            uint64_t misses;        // Lookups that didn't, including `get`s that created a Doc
+            uint64_t evictions;     // Docs evicted to make room for others
+            size_t   count;         // Number of Docs in the cache
+            size_t   bytes;         // Total size of their data and keys
+            size_t   retired;       // Removed Docs not yet freed, as lookups may still see them
+        };
+
+        Stats stats() const;
+
+#ifndef NDEBUG
+        // For tests: simulates a lookup in progress in every shard, until `endLookup` is called
+        // with the returned value.
+        uint32_t beginLookup();
+        void endLookup(uint32_t);
+#endif
+
+    protected:
+        ~DocCache();
+
+    private:
+        struct Entry;
+        class Shard;
+
+        Shard& shardFor(uint32_t hash) const;
+        Retained<Doc> newDoc(const alloc_slice&, Doc::Trust, SharedKeys*);
+
+        std::atomic<size_t>         _maxBytes;      // Limit on total size of all shards
+        size_t const                _maxDocs;       // Limit on total count of all shards
+        unsigned                    _shardCount;    // Number of shards; a power of 2
+        std::unique_ptr<Shard[]>    _shards;        // The shards
+    };
+
+} }
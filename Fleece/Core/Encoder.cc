@@ -17,18 +17,23 @@
 //
 
 #include "Encoder.hh"
+#include "BlobStore.hh"
+#include "CompressedDoc.hh"
 #include "FleeceImpl.hh"
 #include "Pointer.hh"
 #include "SharedKeys.hh"
 #include "MutableDict.hh"
+#include "Path.hh"
 #include "Endian.hh"
 #include "varint.hh"
 #include "FleeceException.hh"
 #include "ParseDate.hh"
 #include "PlatformCompat.hh"
-#include "TempArray.hh"
+#include "Stats.hh"
 #include <algorithm>
 #include <cmath>
+#include <functional>
+#include <type_traits>
 #include <float.h>
 #include <stdlib.h>
 #include "betterassert.hh"
@@ -64,8 +69,8 @@ namespace fleece { namespace impl {
         // Initial state has a placeholder collection on the stack, which will contain the real
         // root value.
         resetStack();
-        _items->reset(kSpecialTag);
-        _items->reserve(1);
+        _items->reset(kSpecialTag, _scratch);
+        _items->reserve(_scratch, 1);
     }
 
     void Encoder::resetStack() {
@@ -77,17 +82,62 @@ namespace fleece { namespace impl {
         if (_items)
             _items->clear();
         _out.reset();
-        _strings.clear();
+        if (_maxRetainedMemory > 0) {
+            constexpr size_t kEntrySize = sizeof(StringTable::entry_t) + 1;  // +1 control byte
+            _strings.clearAndShrink(std::min(2 * _avgStringCount,
+                                             _maxRetainedMemory / kEntrySize));
+        } else {
+            _strings.clear();
+        }
         _stringStorage.reset();
         _writingKey = _blockedOnKey = false;
-        resetStack();
+        _coldValues.clear();
+        _usingColdValues = false;
+        _scratch.reset();
+        if (_maxRetainedMemory > 0)
+            _scratch.trim(_maxRetainedMemory);
+        init();
         setBase(nullslice);
     }
 
+    void Encoder::resetToDefaults() {
+        reset();
+        // Clear any collections left open by an unfinished encode, and an unusually deep stack:
+        if (_stack.size() > kMaxRetainedStackSize)
+            _stack.resize(kInitialStackSize);
+        _sharedKeys = nullptr;
+        setBlobStore(nullptr);
+        _uniqueStrings = true;
+        _binaryTimestamps = false;
+        _trailer = true;
+        clearHotPaths();
+        if (!_out.outputFile())
+            _out.setChunkAllocator(&ChunkAllocator::defaultAllocator());
+    }
+
+    // Called at the end of encoding if there's a limit on retained memory. Keeps moving averages
+    // of the output size and string count, and sets the buffers to keep only enough memory for
+    // a typical document, not for an occasional huge one.
+    void Encoder::adaptRetainedMemory() {
+        auto average = [](size_t avg, size_t sample) {
+            return avg ? (3 * avg + sample) / 4 : sample;
+        };
+        _avgOutputSize  = average(_avgOutputSize, _out.length());
+        _avgStringCount = average(_avgStringCount, _strings.count());
+        size_t maxOutput = std::min(2 * _avgOutputSize, _maxRetainedMemory);
+        _out.setMaxRetainedCapacity(maxOutput);
+        _stringStorage.setMaxRetainedCapacity(maxOutput);
+    }
+
     void Encoder::setSharedKeys(SharedKeys *s) {
         _sharedKeys = s;
     }
 
+    void Encoder::setBlobStore(BlobStore *store, size_t threshold) {
+        _blobStore = store;
+        _blobThreshold = store ? std::max(threshold, BlobRef::kMaxEncodedSize) : SIZE_MAX;
+    }
+
     void Encoder::setBase(slice base, bool markExternPointers, size_t cutoff) {
         throwIf(_base && base, EncodeError, "There's already a base");
         _base = base;
@@ -122,6 +172,9 @@ namespace fleece { namespace impl {
             _items->clear();
         }
         _out.flush();
+        stats::add(stats::kBytesEncoded, _out.length());
+        if (_maxRetainedMemory > 0)
+            adaptRetainedMemory();
         // Go to "finished" state, where stack is empty:
         _items = nullptr;
         _stackDepth = 0;
@@ -152,6 +205,11 @@ namespace fleece { namespace impl {
         return out;
     }
 
+    WriterChunks Encoder::finishChunks() {
+        end();
+        return _out.finishAsIOVecs();
+    }
+
     Retained<Doc> Encoder::finishDoc() {
         Retained<Doc> doc = new Doc(finish(),
                                     Doc::kTrusted,
@@ -160,6 +218,14 @@ namespace fleece { namespace impl {
         return doc;
     }
 
+    alloc_slice Encoder::finishCompressed(size_t blockSize) {
+        alloc_slice data = finish();
+        if (!data)
+            return data;
+        return CompressedDoc::compress(data, blockSize ? blockSize
+                                                       : CompressedDoc::kDefaultBlockSize);
+    }
+
     // Returns position in the stream of the next write. Pads stream to even pos if necessary.
     size_t Encoder::nextWritePos() {
         _out.padToEvenLength();
@@ -200,6 +266,171 @@ namespace fleece { namespace impl {
     }
 
 
+#pragma mark - EXTRACTING:
+
+
+    // Copies a Value and everything it references out of its document, as-is, for extract().
+    // A document's collections are written after their contents, and pointers always point
+    // backwards, so the collections reachable from a Value normally occupy a contiguous range
+    // ending at that Value, which can be copied verbatim. The exceptions are strings shared with
+    // (written by) earlier parts of the document; these are copied in front of the range, and
+    // the pointers to them are rewritten.
+    class Encoder::Extractor {
+    public:
+        explicit Extractor(slice bounds)
+        :_bounds(bounds)
+        { }
+
+        // Scans a collection, returning false if it can't be copied as-is.
+        bool scan(const Value *value) {
+            if (value->isMutable())
+                return false;
+            Array::impl items(value);
+            uint32_t count = items._count * (value->tag() == kDictTag ? 2 : 1);
+            auto itemsEnd = offsetby(items._first, count * items._width);
+            if (!_bounds.containsAddressRange(slice(value, itemsEnd)))
+                return false;
+            _start = std::min(_start, (const void*)value);
+            _end = std::max(_end, (const void*)itemsEnd);
+            _size += (uint8_t*)itemsEnd - (uint8_t*)value;
+
+            bool wide = (items._width == kWide);
+            for (uint32_t i = 0; i < count; ++i) {
+                auto item = offsetby(items._first, i * items._width);
+                if (!item->isPointer())
+                    continue;
+                auto ptr = item->_asPointer();
+                if (ptr->isExternal())
+                    return false;
+                const Value *target = ptr->deref(wide);
+                if (!_bounds.containsAddress(target) || target->isPointer())
+                    return false;       // Pointer to pointer isn't expected in a collection
+                if (target->tag() < kArrayTag) {
+                    size_t size = target->dataSize();
+                    if (!_bounds.containsAddressRange(slice(target, size)))
+                        return false;
+                    _pointers.push_back({ptr, target, wide});
+                    _size += size;
+                } else if (!scan(target)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Generates the output, or returns null if it wouldn't be worthwhile or possible.
+        alloc_slice copy(const Value *root) {
+            // Collect the leaves below the lowest collection, highest first:
+            smallVector<const Value*, 64> below;
+            for (auto &p : _pointers) {
+                if (p.target < _start)
+                    below.push_back(p.target);
+            }
+            std::sort(below.begin(), below.end(), std::greater<>());
+            below.erase(std::unique(below.begin(), below.end()), below.end());
+
+            // The ones written just before the lowest collection belong to the same subtree;
+            // extend the range down over them, as long as they're contiguous:
+            auto escapee = below.begin();
+            for (; escapee != below.end(); ++escapee) {
+                auto leaf = *escapee;
+                if ((uint8_t*)_start - ((uint8_t*)leaf + leaf->dataSize()) > 1)
+                    break;              // (a gap of 1 byte is just padding)
+                _start = leaf;
+            }
+
+            size_t rangeSize = (uint8_t*)_end - (uint8_t*)_start;
+            if (rangeSize > 2 * _size + 256)
+                return nullslice;       // The range contains too much unrelated data
+
+            // The rest are shared strings that escape the range; lay them out in front of it:
+            size_t nEscapees = below.end() - escapee;
+            smallVector<uint32_t, 64> escapeePos(nEscapees);
+            size_t prefixSize = 0;
+            for (size_t i = 0; i < nEscapees; ++i) {
+                escapeePos[i] = uint32_t(prefixSize);
+                prefixSize += escapee[i]->dataSize();
+                prefixSize += (prefixSize & 1);
+            }
+
+            // Allocate, leaving room for padding and a wide root pointer and trailer:
+            size_t rangePos = prefixSize;
+            size_t rootPos = rangePos + ((uint8_t*)root - (uint8_t*)_start);
+            size_t trailerPos = rangePos + rangeSize;
+            trailerPos += (trailerPos & 1);
+            alloc_slice result(trailerPos + kWide + kNarrow);
+            auto out = (uint8_t*)result.buf;
+
+            memset(out, 0, prefixSize);
+            for (size_t i = 0; i < nEscapees; ++i)
+                memcpy(&out[escapeePos[i]], escapee[i], escapee[i]->dataSize());
+            memcpy(&out[rangePos], _start, rangeSize);
+            if (rangePos + rangeSize < trailerPos)
+                out[trailerPos - 1] = 0;
+
+            // Point the pointers to escaped strings at their copies:
+            for (auto &p : _pointers) {
+                if (p.target >= _start)
+                    continue;
+                size_t pointerPos = rangePos + ((uint8_t*)p.pointer - (uint8_t*)_start);
+                auto e = std::lower_bound(escapee, below.end(), p.target, std::greater<>());
+                size_t offset = pointerPos - escapeePos[e - escapee];
+                if (!p.wide && offset > Pointer::kMaxNarrowOffset)
+                    return nullslice;
+                writePointer(&out[pointerPos], offset, (p.wide ? kWide : kNarrow));
+            }
+
+            // Write the root pointer, as Encoder::end does:
+            size_t offset = trailerPos - rootPos;
+            if (offset <= Pointer::kMaxNarrowOffset) {
+                writePointer(&out[trailerPos], offset, kNarrow);
+                result.shorten(trailerPos + kNarrow);
+            } else {
+                writePointer(&out[trailerPos], offset, kWide);
+                writePointer(&out[trailerPos + kWide], kWide, kNarrow);
+            }
+            return result;
+        }
+
+    private:
+        // Constructing a Pointer in place would clobber the following bytes if it's narrow,
+        // since a Value's initializer fills in all kWide bytes.
+        static void writePointer(uint8_t *dst, size_t offset, int width) {
+            Pointer ptr(offset, width);
+            memcpy(dst, &ptr, width);
+        }
+
+        struct PointerInfo {
+            const Pointer *pointer;     // Pointer in a collection
+            const Value *target;        // What it points to
+            bool wide;
+        };
+
+        slice const _bounds;                    // The data of the source document
+        const void* _start {(void*)UINTPTR_MAX};// Start of range spanned by collections
+        const void* _end {nullptr};             // End of that range
+        size_t _size {0};                       // Total size of Values found (may overcount)
+        smallVector<PointerInfo, 64> _pointers; // Every pointer to a leaf found in a collection
+    };
+
+
+    alloc_slice Encoder::extract(const Value *value) {
+        if (value->tag() >= kArrayTag && !value->isMutable()) {
+            if (auto scope = Scope::containing(value); scope) {
+                Extractor extractor(scope->data());
+                if (extractor.scan(value)) {
+                    if (alloc_slice result = extractor.copy(value); result)
+                        return result;
+                }
+            }
+        }
+        // Fall back to re-encoding:
+        Encoder enc;
+        enc.writeValue(value);
+        return enc.finish();
+    }
+
+
 #pragma mark - WRITING:
 
     // Adds an empty Value to the current collection's item list and returns a pointer to it.
@@ -213,7 +444,7 @@ namespace fleece { namespace impl {
                 _blockedOnKey = _writingKey = true;
         }
 
-        return (uint8_t*) _items->push_back_new();
+        return (uint8_t*) _items->push_back_new(_scratch);
     }
 
     // Writes blank space for a Value of the given size and returns a pointer to it.
@@ -303,6 +534,92 @@ namespace fleece { namespace impl {
         memcpy(&buf[2], &swapped, sizeof(swapped));
     }
 
+    // Encodes an item of a typed array: a number Value at its type's full size, so that all the
+    // items are the same size. See Array::getInts / getDoubles.
+    static inline void encodeTypedNumber(uint8_t *buf, int32_t n) {
+        buf[0] = uint8_t((kIntTag << 4) | (sizeof(n) - 1));
+        uint32_t le = endian::encLittle32(uint32_t(n));
+        memcpy(&buf[1], &le, sizeof(le));
+        buf[5] = 0;
+    }
+
+    static inline void encodeTypedNumber(uint8_t *buf, int64_t n) {
+        buf[0] = uint8_t((kIntTag << 4) | (sizeof(n) - 1));
+        uint64_t le = endian::encLittle64(uint64_t(n));
+        memcpy(&buf[1], &le, sizeof(le));
+        buf[9] = 0;
+    }
+
+    static inline void encodeTypedNumber(uint8_t *buf, float n) {
+        buf[0] = uint8_t(kFloatTag << 4);
+        buf[1] = 0;
+        endian::littleEndianFloat swapped = n;
+        memcpy(&buf[2], &swapped, sizeof(swapped));
+    }
+
+    static inline void encodeTypedNumber(uint8_t *buf, double n) {
+        buf[0] = uint8_t((kFloatTag << 4) | 0x08);
+        buf[1] = 0;
+        endian::littleEndianDouble swapped = n;
+        memcpy(&buf[2], &swapped, sizeof(swapped));
+    }
+
+    // Writes the numbers as a typed array whose items are ITEMs (see Value::isTypedArray.)
+    template <class ITEM, class T>
+    void Encoder::writeTypedItems(const T *values, size_t count) {
+        constexpr size_t kItemSize = 2 + sizeof(ITEM);     // Value size (rounded up to even)
+        size_t size = count * kItemSize;
+        throwIf(size > UINT32_MAX, MemoryError, "typed array too large");
+        // Pad the length varint with a redundant 0 byte, and to an odd size so that the items
+        // are at an even address:
+        byte length[kMaxVarintLen32 + 2];
+        size_t n = PutUVarInt(length, size);
+        do {
+            length[n - 1] |= 0x80;
+            length[n++] = 0;
+        } while ((n & 1) == 0);
+        byte *buf = placeValue<false>(kBinaryTag, 0x0F, 1 + n + size);
+        memcpy(&buf[1], length, n);
+        buf += 1 + n;
+        for (size_t i = 0; i < count; ++i, buf += kItemSize)
+            encodeTypedNumber(buf, ITEM(values[i]));
+    }
+
+    template <class T>
+    void Encoder::_writeTypedArray(const T *values, size_t count) {
+        if (count == 0) {
+            beginArray(0);
+            endArray();
+            return;
+        }
+        // Use 32-bit items if every number fits:
+        bool narrow = true;
+        if constexpr (std::is_floating_point<T>::value) {
+            for (size_t i = 0; i < count; ++i) {
+                throwIf(std::isnan(values[i]), InvalidData, "Can't write NaN");
+                narrow &= isFloatRepresentable(values[i]);
+            }
+            if (narrow)
+                writeTypedItems<float>(values, count);
+            else
+                writeTypedItems<double>(values, count);
+        } else {
+            if constexpr (sizeof(T) > sizeof(int32_t)) {
+                for (size_t i = 0; i < count; ++i)
+                    narrow &= (values[i] >= INT32_MIN && values[i] <= INT32_MAX);
+            }
+            if (narrow)
+                writeTypedItems<int32_t>(values, count);
+            else
+                writeTypedItems<int64_t>(values, count);
+        }
+    }
+
+    void Encoder::writeTypedArray(const int32_t *v, size_t n)   {_writeTypedArray(v, n);}
+    void Encoder::writeTypedArray(const int64_t *v, size_t n)   {_writeTypedArray(v, n);}
+    void Encoder::writeTypedArray(const float *v, size_t n)     {_writeTypedArray(v, n);}
+    void Encoder::writeTypedArray(const double *v, size_t n)    {_writeTypedArray(v, n);}
+
 #if 0
     bool Encoder::isIntRepresentable(float n) noexcept {
         return (n <= INT32_MAX && n >= INT32_MIN && n == floorf(n));
@@ -354,6 +671,10 @@ namespace fleece { namespace impl {
     // Returns the address where s got written to, if possible, just like writeData above.
     const void* Encoder::_writeString(slice s) {
         if (!_usuallyTrue(_uniqueStrings && s.size >= kNarrow && s.size <= kMaxSharedStringSize)) {
+            if (_usuallyFalse(s.size >= _blobThreshold) && !_writingKey) {
+                writeBlob(s, true);
+                return nullptr;
+            }
             // Not uniquing this string, so just write it:
             return writeData(kStringTag, s);
         }
@@ -372,6 +693,7 @@ namespace fleece { namespace impl {
                     if (stringVal < _baseMinUsed)
                         _baseMinUsed = stringVal;
                 }
+                stats::add(stats::kStringsDeduplicated);
 #ifndef NDEBUG
                 _numSavedStrings++;
 #endif
@@ -398,7 +720,35 @@ namespace fleece { namespace impl {
     }
 
     void Encoder::writeData(slice s) {
-        writeData(kBinaryTag, s);
+        // Data that happens to look like a BlobRef goes in the BlobStore too, so that a reader
+        // with the store can't mistake it for a reference:
+        if (BlobRef ref; _usuallyFalse(s.size >= _blobThreshold)
+                            || (_usuallyFalse(_blobStore != nullptr) && BlobRef::decode(s, ref)))
+            writeBlob(s, false);
+        else
+            writeData(kBinaryTag, s);
+    }
+
+    // Puts a large string or data in the BlobStore, and writes a reference to it.
+    void Encoder::writeBlob(slice s, bool isString) {
+        BlobRef ref {isString, s.size, SHA256::compute(s)};
+        _blobStore->put(ref.digest, s);
+        uint8_t buf[BlobRef::kMaxEncodedSize];
+        writeData(kBinaryTag, slice(buf, ref.encode(buf)));
+    }
+
+    // Copies a Data Value that decodes as `ref`. If my BlobStore has the content, copies the
+    // reference; else if the source's BlobStore has it, writes the content, so the new document
+    // is readable; otherwise it's just data.
+    void Encoder::writeBlobRef(const Value *value, const BlobRef &ref) {
+        if (_blobStore && _blobStore->get(ref.digest).size == ref.length)
+            writeData(kBinaryTag, value->getStringBytes());
+        else if (slice content = ref.resolve(value); !content.buf)
+            writeData(value->getStringBytes());
+        else if (ref.isString)
+            writeString(content);
+        else
+            writeData(content);
     }
 
 
@@ -430,10 +780,23 @@ namespace fleece { namespace impl {
 
 
     void Encoder::writeDateString(int64_t timestamp, bool asUTC) {
+        if (_binaryTimestamps && timestamp != kInvalidDate)
+            return writeTimestamp(timestamp);
         char str[kFormattedISO8601DateMaxSize];
         writeString(FormatISO8601Date(str, timestamp, asUTC));
     }
 
+    void Encoder::writeTimestamp(int64_t timestamp) {
+        // Past 2^53 a double can't represent every millisecond; that's ±285,000 years anyway.
+        constexpr int64_t kMaxExact = int64_t(1) << 53;
+        throwIf(timestamp < -kMaxExact || timestamp > kMaxExact, InvalidData,
+                "Timestamp out of range");
+        endian::littleEndianDouble swapped = double(timestamp);
+        auto buf = placeValue<false>(kFloatTag, 0x08 | kFloatTimestampFlag, 2 + sizeof(swapped));
+        buf[1] = 0;
+        memcpy(&buf[2], &swapped, sizeof(swapped));
+    }
+
 
 #pragma mark - WRITING VALUES:
 
@@ -481,6 +844,14 @@ namespace fleece { namespace impl {
                              const SharedKeys* &sk,
                              const WriteValueFunc *writeNestedValue)
     {
+        if (_usuallyFalse(_usingColdValues)) {
+            auto i = std::lower_bound(_coldValues.begin(), _coldValues.end(),
+                                      std::make_pair(value, size_t(0)));
+            if (i != _coldValues.end() && i->first == value) {
+                writePointer(ssize_t(i->second) - _base.size);
+                return;
+            }
+        }
         if (valueIsInBase(value) && !isNarrowValue(value)) {
             auto minVal = minUsed(value);
             if (minVal >= _baseCutoff) {
@@ -503,9 +874,18 @@ namespace fleece { namespace impl {
             case kStringTag:
                 writeString(value->asString());
                 break;
-            case kBinaryTag:
-                writeData(value->asData());
+            case kBinaryTag: {
+                if (_usuallyFalse(value->isTypedArray())) {
+                    size_t size = value->dataSize();
+                    memcpy(placeValue<false>(size), value, size);
+                    break;
+                }
+                if (BlobRef ref; _usuallyFalse(BlobRef::decode(value->getStringBytes(), ref)))
+                    writeBlobRef(value, ref);
+                else
+                    writeData(value->getStringBytes());
                 break;
+            }
             case kArrayTag: {
                 ++_copyingCollection;
                 auto iter = value->asArray()->begin();
@@ -546,11 +926,111 @@ namespace fleece { namespace impl {
 
 
     void Encoder::writeValue(const Value* NONNULL value, const WriteValueFunc *fn) {
+        if (_usuallyFalse(_hotPaths != nullptr) && _stackDepth == 1 && !fn && !_base
+                                                && !_usingColdValues) {
+            writeWithHotLayout(value);
+            return;
+        }
         const SharedKeys *sk = nullptr;
         writeValue(value, sk, fn);
     }
 
 
+#pragma mark - HOT PATHS:
+
+
+    Encoder::HotPathNode* Encoder::HotPathNode::child(slice k) {
+        for (auto &c : children)
+            if (c.key == k)
+                return &c;
+        return nullptr;
+    }
+
+    void Encoder::addHotPath(slice pathStr) {
+        Path path(pathStr);
+        if (!_hotPaths)
+            _hotPaths = std::make_unique<HotPathNode>();
+        HotPathNode *node = _hotPaths.get();
+        for (auto &element : path.path()) {
+            if (node->whole)
+                return;                         // already covered by a shorter path
+            if (!element.isKey())
+                continue;                       // array indexes are transparent
+            slice key = element.keyStr();
+            HotPathNode *child = node->child(key);
+            if (!child) {
+                node->children.emplace_back(alloc_slice(key));
+                child = &node->children.back();
+            }
+            node = child;
+        }
+        node->whole = true;
+        node->children.clear();
+    }
+
+    // Writes a Value in two passes. The first writes the values that aren't on a hot path, into
+    // a temporary array that's then discarded, remembering where they went. The second writes
+    // the Value as usual, except that those cold values become pointers back to the copies
+    // already written. So everything on the hot paths ends up together at the end of the data.
+    void Encoder::writeWithHotLayout(const Value *value) {
+        push(kArrayTag, 0);
+        writeColdValues(value, _hotPaths.get());
+        valueArray *items = _items;
+        pop();
+        _scratch.rewind(items->mark);
+        items->clear();
+
+        std::sort(_coldValues.begin(), _coldValues.end());
+        _usingColdValues = true;
+        const SharedKeys *sk = nullptr;
+        writeValue(value, sk, nullptr);
+        _usingColdValues = false;
+        _coldValues.clear();
+    }
+
+    // First pass of writeWithHotLayout: writes the cold values in a collection on a hot path.
+    void Encoder::writeColdValues(const Value *value, HotPathNode *hot) {
+        if (hot->whole || valueIsInBase(value))
+            return;
+        switch (value->tag()) {
+            case kArrayTag:
+                for (Array::iterator i(value->asArray()); i; ++i)
+                    writeColdValues(i.value(), hot);
+                break;
+            case kDictTag: {
+                auto writeProperty = [&](slice key, const Value *propValue) {
+                    if (HotPathNode *child = hot->child(key))
+                        writeColdValues(propValue, child);
+                    else
+                        writeColdValue(propValue);
+                };
+                auto dict = (const Dict*)value;
+                if (dict->isMutable()) {
+                    for (HeapDict::iterator i(dict->heapDict()); i; ++i)
+                        writeProperty(i.keyString(), i.value());
+                } else {
+                    for (Dict::iterator i(dict); i; ++i)
+                        writeProperty(i.keyString(), i.value());
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void Encoder::writeColdValue(const Value *value) {
+        if (value->tag() < kStringTag || valueIsInBase(value))
+            return;                             // scalars are small, and often inline
+        if (!value->isMutable() && isNarrowValue(value))
+            return;
+        writeValue(value, nullptr);
+        // (Not using lastValueWritten, which can't represent a value at offset 0.)
+        if (auto ptr = _items->back()._asPointer(); ptr->isPointer())
+            _coldValues.emplace_back(value, ptr->offset<true>());
+    }
+
+
 
 #pragma mark - POINTERS:
 
@@ -674,22 +1154,25 @@ namespace fleece { namespace impl {
 
     void Encoder::addedKey(FLSlice str) {
         // Note: str will be nullslice iff the key is numeric
-        _items->keys.push_back(str);
+        _items->keys.push_back(_scratch, str);
     }
 
     void Encoder::push(tags tag, size_t reserve) {
         if (_usuallyFalse(_stackDepth == 0))
             reset();                        // I'm being reused after finish(), so initialize
+        // Make room in the parent for the new collection's Value now, so that adding it in
+        // endCollection won't allocate from _scratch above the new collection's mark:
+        _items->reserveMore(_scratch);
         if (_usuallyFalse(_stackDepth >= _stack.size()))
             _stack.resize(2*_stackDepth);
         _items = &_stack[_stackDepth++];
-        _items->reset(tag);
+        _items->reset(tag, _scratch);
         if (reserve > 0) {
             if (_usuallyTrue(tag == kDictTag)) {
-                _items->reserve(2 * reserve);
-                _items->keys.reserve(reserve);
+                _items->reserve(_scratch, 2 * reserve);
+                _items->keys.reserve(_scratch, reserve);
             } else {
-                _items->reserve(reserve);
+                _items->reserve(_scratch, reserve);
             }
         }
     }
@@ -775,6 +1258,7 @@ namespace fleece { namespace impl {
             buf[1] = 0;
         }
 
+        stats::add(items->wide ? stats::kWideCollections : stats::kNarrowCollections);
 #ifndef NDEBUG
         if (items->wide) {
             _numWide++;
@@ -785,6 +1269,9 @@ namespace fleece { namespace impl {
         }
 #endif
 
+        // Free the items' storage, and that of any nested collections:
+        // (`items` will be reset when it's pushed again.)
+        _scratch.rewind(items->mark);
         items->clear();
     }
 
@@ -824,7 +1311,8 @@ namespace fleece { namespace impl {
         }
 
         // Construct an array that describes the permutation of item indices:
-        TempArray(indices, const FLSlice*, n);
+        // (These temporary arrays are freed when endCollection rewinds _scratch.)
+        auto indices = _scratch.alloc<const FLSlice*>(n);
         const FLSlice* base = &keys[0];
         for (unsigned i = 0; i < n; i++)
             indices[i] = base + i;
@@ -832,8 +1320,7 @@ namespace fleece { namespace impl {
         // indices[i] is now a pointer to the Value that should go at index i
 
         // Now rewrite items according to the permutation in indices:
-        TempArray(oldBuf, char, 2*n * sizeof(Value));
-        auto old = (Value*)oldBuf;
+        auto old = _scratch.alloc<Value>(2*n);
         memcpy(old, &items[0], 2*n * sizeof(Value));
         for (size_t i = 0; i < n; i++) {
             auto j = indices[i] - base;
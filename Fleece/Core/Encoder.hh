@@ -22,11 +22,16 @@
 #include "Writer.hh"
 #include "Doc.hh"
 #include "StringTable.hh"
+#include "ScratchArena.hh"
 #include "SmallVector.hh"
 #include "function_ref.hh"
+#include <memory>
+#include <vector>
 
 
 namespace fleece { namespace impl {
+    class BlobStore;
+    struct BlobRef;
     class SharedKeys;
     class key_t;
 
@@ -43,6 +48,24 @@ namespace fleece { namespace impl {
             each unique string only once. This saves space but makes the encoder slightly slower. */
         void uniqueStrings(bool b)      {_uniqueStrings = b;}
 
+        /** Sets the binaryTimestamps property. If true, writeDateString() writes a binary
+            timestamp (see writeTimestamp) instead of an ISO-8601 string. Default is false. */
+        void binaryTimestamps(bool b)   {_binaryTimestamps = b;}
+
+        /** Adds a "hot" path, like `address.city`, naming a property that readers access often.
+            (Array indexes in the path are ignored; the path applies to every item of an array.)
+            When writeValue copies a document's root, values that aren't on any hot path are
+            written first, so the hot properties and the collections leading to them end up
+            together at the end of the data, next to the root, and a reader touches fewer
+            pages and cache lines. This doesn't change the logical contents of the document.
+            It has no effect on values written piecemeal, nor on a writeValue with a callback,
+            nor when there's a base (see setBase).
+            @throws FleeceException with code PathSyntaxError if the path is invalid. */
+        void addHotPath(slice path);
+
+        /** Removes all hot paths added by addHotPath. */
+        void clearHotPaths()            {_hotPaths.reset();}
+
         /** Sets the base Fleece data that the encoded data will be (logically) appended to.
             Any writeValue() calls whose Value points into the base data will be written as
             pointers.
@@ -75,9 +98,31 @@ namespace fleece { namespace impl {
         /** Returns the encoded data as a Doc. This implicitly calls end(). */
         Retained<Doc> finishDoc();
 
+        /** Returns the encoded data in a block-compressed container, which can be opened with
+            CompressedDoc. A `blockSize` of 0 means the default. This implicitly calls end(). */
+        alloc_slice finishCompressed(size_t blockSize =0);
+
+        /** Returns the encoded data as a list of chunks, avoiding the copy that `finish` makes
+            to concatenate them. The caller takes ownership. This implicitly calls end(). */
+        WriterChunks finishChunks();
+
+        /** Sets the allocator of the output buffer's chunks, which could for example be a pool
+            of buffers reused across encodes. Must be called before writing anything. */
+        void setChunkAllocator(ChunkAllocator *a)   {_out.setChunkAllocator(a);}
+
         /** Resets the encoder so it can be used again. */
         void reset();
 
+        /** Resets the encoder to the state of a newly constructed one, including its options
+            (shared keys, unique strings, trailer, chunk allocator), but keeps the memory it's
+            allocated so that it can be reused without allocating again. */
+        void resetToDefaults();
+
+        /** Limits the memory an encoder keeps across resets. Normally its output buffer and
+            string table stay as big as the biggest document encoded so far; with a limit, the
+            amount kept adapts to the sizes of recent documents, up to about `maxBytes`. */
+        void limitRetainedMemory(size_t maxBytes)   {_maxRetainedMemory = maxBytes;}
+
         /////// Writing data:
 
         void writeNull();
@@ -89,10 +134,26 @@ namespace fleece { namespace impl {
         void writeFloat(float);
         void writeDouble(double);
 
+        /** Writes an array of numbers as a typed array: a packed run of numbers of the same size,
+            32-bit if they all fit, else 64-bit. Each takes 2 bytes more than the number itself
+            (it's a Value, so `Array::get` can return it) and there are no pointers, so it's
+            much smaller than writing the numbers one by one, unless they're small integers.
+            `Array::getInts` / `Array::getDoubles` read it in a tight loop. Otherwise it behaves
+            like an ordinary array of numbers, but readers older than this see it as Data. */
+        void writeTypedArray(const int32_t *values, size_t count);
+        void writeTypedArray(const int64_t *values, size_t count);
+        void writeTypedArray(const float *values, size_t count);
+        void writeTypedArray(const double *values, size_t count);
+
         void writeString(slice s)                           {(void)_writeString(s);}
 
         void writeDateString(int64_t timestamp, bool asUTC =true);
 
+        /** Writes a timestamp (milliseconds since 1/1/1970) as a double flagged as a date.
+            Value::asTimestamp reads it without any parsing, and converting it to JSON produces
+            an ISO-8601 UTC string; readers that predate the flag see an ordinary number. */
+        void writeTimestamp(int64_t timestamp);
+
         void writeData(slice s);
 
         void writeValue(const Value* NONNULL v)             {writeValue(v, nullptr);}
@@ -150,6 +211,13 @@ namespace fleece { namespace impl {
             strings will consult this object to possibly map the key to an integer. */
         void setSharedKeys(SharedKeys *s);
 
+        static constexpr size_t kDefaultBlobThreshold = 1024;
+
+        /** Associates a BlobStore with this Encoder. Strings and data at least `threshold` bytes
+            long (except dict keys) will be put in the store, and written as references to it.
+            The resulting data must be read by a Doc with the same BlobStore (see BlobStore.hh.) */
+        void setBlobStore(BlobStore*, size_t threshold =kDefaultBlobThreshold);
+
         //////// "<<" convenience operators;
 
         // Note: overriding <<(bool) would be dangerous due to implicit conversion
@@ -188,6 +256,14 @@ namespace fleece { namespace impl {
             first part as its `extern` reference. */
         alloc_slice snip();
 
+        /** Returns a standalone Fleece document containing a copy of `value` and everything it
+            references. Usually this copies the range of bytes spanned by the value as-is, plus
+            any strings it shares with earlier parts of its document, and writes a new root
+            pointer; that's much faster than re-encoding it with `writeValue`, which it falls
+            back to if the data isn't laid out suitably. Integer dict keys are left encoded with
+            the source document's SharedKeys, so the result should be opened with those. */
+        static alloc_slice extract(const Value* NONNULL value);
+
 #if 0
         static bool isIntRepresentable(float n) noexcept;
         static bool isIntRepresentable(double n) noexcept;
@@ -198,21 +274,40 @@ namespace fleece { namespace impl {
         using byte = uint8_t;
 
         static constexpr size_t kInitialStackSize = 4;
-        static constexpr size_t kInitialCollectionCapacity = 16;
+        static constexpr size_t kMaxRetainedStackSize = 32;
 
-        // Stores the pending values to be written to an in-progress array/dict
-        class valueArray : public smallVector<Value, kInitialCollectionCapacity> {
+        // Stores the pending values to be written to an in-progress array/dict. The storage comes
+        // from the Encoder's _scratch arena, which is rewound to `mark` when the collection ends.
+        class valueArray : public scratchVector<Value> {
         public:
             valueArray()                    =default;
-            void reset(internal::tags t)    {tag = t; wide = false; keys.clear();}
-            
+            void reset(internal::tags t, ScratchArena &arena) {
+                tag = t;
+                wide = false;
+                mark = arena.mark();
+                scratchVector<Value>::reset();
+                keys.reset();
+            }
+
             internal::tags tag;
             bool wide;
-            smallVector<FLSlice, kInitialCollectionCapacity> keys;
+            ScratchArena::Mark mark;
+            scratchVector<FLSlice> keys;
+        };
+
+        // A node of the tree of hot paths; its children are the hot properties of a dict.
+        struct HotPathNode {
+            alloc_slice key;
+            bool whole {false};                 // true if the entire subtree is hot
+            std::vector<HotPathNode> children;
+
+            explicit HotPathNode(alloc_slice k =nullslice)  :key(std::move(k)) { }
+            HotPathNode* child(slice key);
         };
 
         void init();
         void resetStack();
+        void adaptRetainedMemory();
         byte* placeItem();
         void addSpecial(int specialValue);
         template <bool canInline> byte* placeValue(size_t size);
@@ -224,8 +319,12 @@ namespace fleece { namespace impl {
         void writeSpecial(uint8_t special);
         void writeInt(uint64_t i, bool isShort, bool isUnsigned);
         void _writeFloat(float);
+        template <class T> void _writeTypedArray(const T *values, size_t count);
+        template <class ITEM, class T> void writeTypedItems(const T *values, size_t count);
         const void* writeData(internal::tags, slice s);
         const void* _writeString(slice);
+        void writeBlob(slice, bool isString);
+        void writeBlobRef(const Value* NONNULL, const BlobRef&);
         void addingKey();
         void addedKey(FLSlice str);
         void sortDict(valueArray &items);
@@ -237,8 +336,13 @@ namespace fleece { namespace impl {
         void writeKey(int);
         void writeValue(const Value* NONNULL, const WriteValueFunc*);
         void writeValue(const Value* NONNULL, const SharedKeys* &, const WriteValueFunc*);
+        void writeWithHotLayout(const Value* NONNULL);
+        void writeColdValues(const Value* NONNULL, HotPathNode* NONNULL);
+        void writeColdValue(const Value* NONNULL);
         const Value* minUsed(const Value *value);
 
+        class Extractor;
+
         Encoder(const Encoder&) = delete;
         Encoder& operator=(const Encoder&) = delete;
 
@@ -250,10 +354,14 @@ namespace fleece { namespace impl {
         valueArray *_items;          // Values of currently-open array/dict; == &_stack[_stackDepth-1]
         smallVector<valueArray, kInitialStackSize> _stack; // Stack of open arrays/dicts
         unsigned _stackDepth;        // Current depth of _stack
+        ScratchArena _scratch;       // Storage for _stack's items; reset per document
         PreallocatedStringTable<kInitialStringTableSize> _strings; // Maps strings to the offsets where they appear as values
         Writer _stringStorage;       // Backing store for strings in _strings
         bool _uniqueStrings {true};  // Should strings be uniqued before writing?
+        bool _binaryTimestamps {false}; // Should writeDateString write a binary timestamp?
         Retained<SharedKeys> _sharedKeys;  // Client-provided key-to-int mapping
+        Retained<BlobStore> _blobStore;    // Client-provided store for large strings/data
+        size_t _blobThreshold {SIZE_MAX};  // Min size of string/data to put in _blobStore
         slice _base;                 // Base Fleece data being appended to (if any)
         alloc_slice _ownedBase;      // If I allocated _base, it's stored here too to retain it
         const void* _baseCutoff {0}; // Lowest addr in _base that I can write a ptr to
@@ -263,12 +371,19 @@ namespace fleece { namespace impl {
         bool _blockedOnKey  {false}; // True if writes should be refused
         bool _trailer       {true};  // Write standard trailer at end?
         bool _markExternPtrs{false}; // Mark pointers outside encoded data as 'extern'
+        size_t _maxRetainedMemory {0};  // Limit on memory kept across resets (0 = no limit)
+        size_t _avgOutputSize {0};      // Moving average of output size, if limit is set
+        size_t _avgStringCount {0};     // Moving average of # of strings in _strings, ditto
+        std::unique_ptr<HotPathNode> _hotPaths;   // Tree of paths given to addHotPath
+        std::vector<std::pair<const Value*, size_t>> _coldValues; // Cold values already written, and their positions
+        bool _usingColdValues {false};  // Should writeValue look up values in _coldValues?
 
         friend class EncoderTests;
 #ifndef NDEBUG
     public: // Statistics for use in tests
         unsigned _numNarrow {0}, _numWide {0}, _narrowCount {0}, _wideCount {0},
                  _numSavedStrings {0};
+        size_t scratchChunkAllocations() const {return _scratch.chunkAllocations();}
 #endif
     };
 
@@ -29,10 +29,15 @@
 
  0000iiii iiiiiiii       small integer (12-bit, signed, range ±2048)
  0001uccc iiiiiiii...    long integer (u = unsigned?; ccc = byte count - 1) LE integer follows
- 0010s--- --------...    floating point (s = 0:float, 1:double). LE float data follows.
+ 0010s--t --------...    floating point (s = 0:float, 1:double). LE float data follows.
+                                t = timestamp: if 1 (and s = 1), the double is a date in
+                                milliseconds since 1/1/1970, written by Encoder::writeTimestamp
  0011ss-- --------       special (s = 0:null, 1:false, 2:true, 3:undefined)
  0100cccc ssssssss...    string (cccc is byte count, or if it’s 15 then count follows as varint)
  0101cccc dddddddd...    binary data (same as string)
+                                If cccc is 15 and the varint count ends with a redundant 0 byte,
+                                it's a typed array: the data is a run of numeric Values of the
+                                same size (6 or 10 bytes), starting at an even address
  0110wccc cccccccc...    array (c = 11-bit item count, if 2047 then count follows as varint;
                                 w = wide, if 1 then following values are 4 bytes wide, not 2)
  0111wccc cccccccc...    dictionary (same as array, but count refers to key/value pairs)
@@ -73,11 +78,28 @@ namespace fleece { namespace impl { namespace internal {
         kSpecialValueTrue       = 0x08,       // 1000
     };
 
+    // Flag in the low bits of a double's 1st byte that marks it as a timestamp:
+    static const uint8_t kFloatTimestampFlag = 0x01;
+
     // Min/max length of string that will be considered for sharing
     // (not part of the format, just a heuristic used by the encoder & Obj-C decoder)
     static const size_t kMinSharedStringSize =  2;
     static const size_t kMaxSharedStringSize = 15;
 
+    // Size of each item of a typed array whose first item starts with `header`; 0 if invalid.
+    static inline size_t typedArrayItemSize(uint8_t header) {
+        switch (header) {
+            case (kIntTag << 4) | 3:        // int32
+            case (kFloatTag << 4):          // float
+                return 6;
+            case (kIntTag << 4) | 7:        // int64
+            case (kFloatTag << 4) | 0x08:   // double
+                return 10;
+            default:
+                return 0;
+        }
+    }
+
     // Minimum array count that has to be stored outside the header
     static const uint32_t kLongArrayCount = 0x07FF;
 
@@ -0,0 +1,444 @@
+//
+// JSON5Converter.cc
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#include "JSON5Converter.hh"
+#include "NumConversion.hh"
+#include <limits>
+#include <string.h>
+
+namespace fleece { namespace impl {
+
+    static inline bool isDigit(char c)      {return c >= '0' && c <= '9';}
+
+    static inline bool isIdentifierStart(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$'
+            || (uint8_t)c >= 0x80;      // (non-ASCII letters aren't checked in detail)
+    }
+
+    static inline bool isIdentifierChar(char c)  {return isIdentifierStart(c) || isDigit(c);}
+
+    static inline int hexDigitValue(char c) {
+        if (c >= '0' && c <= '9')   return c - '0';
+        if (c >= 'a' && c <= 'f')   return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')   return c - 'A' + 10;
+        return -1;
+    }
+
+    static void appendUTF8(std::string &str, uint32_t c) {
+        if (c < 0x80) {
+            str += char(c);
+        } else if (c < 0x800) {
+            str += char(0xC0 | (c >> 6));
+            str += char(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            str += char(0xE0 | (c >> 12));
+            str += char(0x80 | ((c >> 6) & 0x3F));
+            str += char(0x80 | (c & 0x3F));
+        } else {
+            str += char(0xF0 | (c >> 18));
+            str += char(0x80 | ((c >> 12) & 0x3F));
+            str += char(0x80 | ((c >> 6) & 0x3F));
+            str += char(0x80 | (c & 0x3F));
+        }
+    }
+
+
+    bool JSON5Converter::encodeJSON5(slice json5) {
+        _start = _pos = (const char*)json5.buf;
+        _end = (const char*)json5.end();
+        _depth = 0;
+        _errorCode = NoError;
+        _errorMessage.clear();
+        _errorPos = 0;
+        try {
+            parseValue();
+            if (peekToken() != 0 || _pos < _end)
+                fail("unexpected characters after end of value");
+            return true;
+        } catch (const FleeceException &x) {
+            _errorCode = x.code;
+            _errorMessage = x.what();
+            _errorPos = _pos - _start;
+            return false;
+        }
+    }
+
+
+    /*static*/ alloc_slice JSON5Converter::convertJSON5(slice json5, SharedKeys *sk) {
+        Encoder enc;
+        enc.setSharedKeys(sk);
+        JSON5Converter cvt(enc);
+        throwIf(!cvt.encodeJSON5(json5), JSONError, cvt.errorMessage());
+        return enc.finish();
+    }
+
+
+    void JSON5Converter::fail(const char *error) {
+        FleeceException::_throw(JSONError, "JSON5 parse error: %s", error);
+    }
+
+
+    void JSON5Converter::parseValue() {
+        switch (peekToken()) {
+            case 'n':
+                if (!matchIdentifier("null"))
+                    fail("unknown identifier");
+                _encoder.writeNull();
+                break;
+            case 't':
+                if (!matchIdentifier("true"))
+                    fail("unknown identifier");
+                _encoder.writeBool(true);
+                break;
+            case 'f':
+                if (!matchIdentifier("false"))
+                    fail("unknown identifier");
+                _encoder.writeBool(false);
+                break;
+            case '-': case '+': case '.': case 'I': case 'N':
+            case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                parseNumber();
+                break;
+            case '"':
+            case '\'':
+                parseString(false);
+                break;
+            case '[':
+                parseCollection(false);
+                break;
+            case '{':
+                parseCollection(true);
+                break;
+            case 0:
+                fail(_pos < _end ? "invalid start of value" : "unexpected end of input");
+            default:
+                fail("invalid start of value");
+        }
+    }
+
+
+    // Consumes `ident` if the input continues with it as a complete identifier.
+    bool JSON5Converter::matchIdentifier(const char *ident) {
+        size_t len = strlen(ident);
+        if (size_t(_end - _pos) < len || memcmp(_pos, ident, len) != 0)
+            return false;
+        if (_pos + len < _end && isIdentifierChar(_pos[len]))
+            return false;
+        _pos += len;
+        return true;
+    }
+
+
+    void JSON5Converter::parseNumber() {
+        const char *start = _pos;
+        bool negative = false;
+        if (*_pos == '+' || *_pos == '-') {
+            negative = (*_pos == '-');
+            ++_pos;
+            if (*start == '+')
+                ++start;                        // ParseDouble doesn't accept a '+'
+        }
+        if (matchIdentifier("Infinity")) {
+            _encoder.writeDouble(negative ? -std::numeric_limits<double>::infinity()
+                                          :  std::numeric_limits<double>::infinity());
+            return;
+        } else if (matchIdentifier("NaN")) {
+            fail("NaN can't be stored in Fleece");
+        }
+        if (_end - _pos >= 2 && _pos[0] == '0' && (_pos[1] == 'x' || _pos[1] == 'X')) {
+            _pos += 2;
+            parseHexNumber(negative);
+            return;
+        }
+
+        // Scan the number, accumulating the integer part in case there's no fraction/exponent:
+        uint64_t n = 0;
+        bool overflow = false;
+        size_t nDigits = 0;
+        for (; _pos < _end && isDigit(*_pos); ++_pos, ++nDigits) {
+            unsigned digit = *_pos - '0';
+            if (n > (UINT64_MAX - digit) / 10)
+                overflow = true;
+            n = n * 10 + digit;
+        }
+        bool isFloat = false;
+        if (_pos < _end && *_pos == '.') {
+            isFloat = true;
+            for (++_pos; _pos < _end && isDigit(*_pos); ++_pos)
+                ++nDigits;
+        }
+        if (nDigits == 0)
+            fail("invalid number");
+        if (_pos < _end && (*_pos == 'e' || *_pos == 'E')) {
+            isFloat = true;
+            ++_pos;
+            if (_pos < _end && (*_pos == '+' || *_pos == '-'))
+                ++_pos;
+            if (_pos >= _end || !isDigit(*_pos))
+                fail("invalid number");
+            while (_pos < _end && isDigit(*_pos))
+                ++_pos;
+        }
+        if (_pos < _end && isIdentifierChar(*_pos))
+            fail("invalid number");
+
+        if (!isFloat && !overflow) {
+            if (!negative)
+                _encoder.writeUInt(n);
+            else if (n <= uint64_t(INT64_MAX))
+                _encoder.writeInt(-int64_t(n));
+            else if (n == uint64_t(INT64_MAX) + 1)
+                _encoder.writeInt(INT64_MIN);
+            else
+                _encoder.writeDouble(-double(n));
+        } else {
+            _encoder.writeDouble(ParseDouble(start, _pos - start));
+        }
+    }
+
+
+    void JSON5Converter::parseHexNumber(bool negative) {
+        uint64_t n = 0;
+        const char *digits = _pos;
+        for (int d; _pos < _end && (d = hexDigitValue(*_pos)) >= 0; ++_pos) {
+            if (n >> 60)
+                fail("hex number too large");
+            n = (n << 4) | d;
+        }
+        if (_pos == digits || (_pos < _end && isIdentifierChar(*_pos)))
+            fail("invalid hex number");
+        if (!negative)
+            _encoder.writeUInt(n);
+        else if (n <= uint64_t(INT64_MAX) + 1)
+            _encoder.writeInt(int64_t(0 - n));
+        else
+            fail("hex number too large");
+    }
+
+
+    void JSON5Converter::parseString(bool isKey) {
+        const char quote = *_pos++;
+        const char *start = _pos;
+
+        // Fast path: if there are no escapes, the string can be written directly from the input.
+        while (_pos < _end && *_pos != quote && *_pos != '\\' && *_pos != '\n' && *_pos != '\r')
+            ++_pos;
+        if (_pos < _end && *_pos == quote) {
+            slice str(start, _pos);
+            ++_pos;
+            if (isKey)
+                _encoder.writeKey(str);
+            else
+                _encoder.writeString(str);
+            return;
+        }
+
+        // Slow path: copy to the scratch buffer, decoding escapes:
+        _buffer.assign(start, _pos);
+        while (true) {
+            if (_pos >= _end)
+                fail("unterminated string");
+            char c = *_pos;
+            if (c == quote) {
+                ++_pos;
+                break;
+            } else if (c == '\\') {
+                ++_pos;
+                parseEscape();
+            } else if (c == '\n' || c == '\r') {
+                fail("unescaped newline in string");
+            } else {
+                _buffer += c;
+                ++_pos;
+            }
+        }
+        if (isKey)
+            _encoder.writeKey(slice(_buffer));
+        else
+            _encoder.writeString(slice(_buffer));
+    }
+
+
+    // Decodes an escape sequence (after the backslash) into `_buffer`.
+    void JSON5Converter::parseEscape() {
+        if (_pos >= _end)
+            fail("unterminated string");
+        char c = *_pos++;
+        switch (c) {
+            case 'b':   _buffer += '\b'; break;
+            case 'f':   _buffer += '\f'; break;
+            case 'n':   _buffer += '\n'; break;
+            case 'r':   _buffer += '\r'; break;
+            case 't':   _buffer += '\t'; break;
+            case 'v':   _buffer += '\v'; break;
+            case '0':
+                if (_pos < _end && isDigit(*_pos))
+                    fail("invalid escape sequence");
+                _buffer += '\0';
+                break;
+            case '\r':
+                if (_pos < _end && *_pos == '\n')
+                    ++_pos;
+                break;                          // line continuation
+            case '\n':
+                break;                          // line continuation
+            case 'x':
+            case 'u': {
+                auto readHex = [&](int nDigits) {
+                    uint32_t value = 0;
+                    for (int i = 0; i < nDigits; ++i) {
+                        int d = (_pos < _end) ? hexDigitValue(*_pos) : -1;
+                        if (d < 0)
+                            fail("invalid escape sequence");
+                        value = (value << 4) | d;
+                        ++_pos;
+                    }
+                    return value;
+                };
+                uint32_t uc = readHex(c == 'x' ? 2 : 4);
+                if (uc >= 0xD800 && uc < 0xDC00 && _end - _pos >= 6
+                        && _pos[0] == '\\' && _pos[1] == 'u') {
+                    // Surrogate pair:
+                    const char *save = _pos;
+                    _pos += 2;
+                    uint32_t lo = readHex(4);
+                    if (lo >= 0xDC00 && lo < 0xE000)
+                        uc = 0x10000 + ((uc - 0xD800) << 10) + (lo - 0xDC00);
+                    else
+                        _pos = save;
+                }
+                appendUTF8(_buffer, uc);
+                break;
+            }
+            default:
+                if (c >= '1' && c <= '9')
+                    fail("invalid escape sequence");
+                // Any other character, including quotes, backslash and U+2028/2029 line
+                // continuations (whose UTF-8 bytes are skipped below), escapes itself:
+                if (c == '\xE2' && _end - _pos >= 2 && _pos[0] == '\x80'
+                        && (_pos[1] == '\xA8' || _pos[1] == '\xA9')) {
+                    _pos += 2;
+                    break;
+                }
+                _buffer += c;
+                break;
+        }
+    }
+
+
+    void JSON5Converter::parseIdentifierKey() {
+        const char *start = _pos;
+        while (_pos < _end && isIdentifierChar(*_pos))
+            ++_pos;
+        if (_pos < _end && *_pos == '\\')
+            fail("escapes in unquoted keys are not supported");
+        _encoder.writeKey(slice(start, _pos));
+    }
+
+
+    void JSON5Converter::parseCollection(bool isDict) {
+        if (++_depth > kMaxDepth)
+            fail("arrays/objects nested too deeply");
+        ++_pos;     // skip open bracket/brace
+        const char closeBracket = (isDict ? '}' : ']');
+        if (isDict)
+            _encoder.beginDictionary();
+        else
+            _encoder.beginArray();
+
+        char c;
+        while (closeBracket != (c = peekToken())) {
+            if (isDict) {
+                if (c == '"' || c == '\'')
+                    parseString(true);
+                else if (isIdentifierStart(c))
+                    parseIdentifierKey();
+                else
+                    fail(c ? "invalid key" : "unexpected end of input");
+                if (peekToken() != ':')
+                    fail("expected ':' after key");
+                ++_pos;
+            }
+
+            parseValue();
+
+            c = peekToken();
+            if (c == ',')
+                ++_pos;
+            else if (c != closeBracket)
+                fail(c ? "unexpected token after array/object item" : "unexpected end of input");
+        }
+        ++_pos;     // skip close bracket/brace
+
+        if (isDict)
+            _encoder.endDictionary();
+        else
+            _encoder.endArray();
+        --_depth;
+    }
+
+
+    // Returns the next non-whitespace, non-comment character from the input, or 0 at the end.
+    // Consumes whitespace and comments, but not the character it returns.
+    char JSON5Converter::peekToken() {
+        while (_pos < _end) {
+            char c = *_pos;
+            switch (c) {
+                case ' ': case '\t': case '\n': case '\r': case '\v': case '\f':
+                    ++_pos;
+                    break;
+                case '/':
+                    skipComment();
+                    break;
+                case '\xC2':                    // U+00A0 no-break space
+                    if (_end - _pos >= 2 && _pos[1] == '\xA0') {
+                        _pos += 2;
+                        break;
+                    }
+                    return c;
+                case '\xE2':                    // U+2028, U+2029 line/paragraph separators
+                    if (_end - _pos >= 3 && _pos[1] == '\x80'
+                            && (_pos[2] == '\xA8' || _pos[2] == '\xA9')) {
+                        _pos += 3;
+                        break;
+                    }
+                    return c;
+                case '\xEF':                    // U+FEFF byte order mark
+                    if (_end - _pos >= 3 && _pos[1] == '\xBB' && _pos[2] == '\xBF') {
+                        _pos += 3;
+                        break;
+                    }
+                    return c;
+                default:
+                    return c;
+            }
+        }
+        return 0;
+    }
+
+
+    void JSON5Converter::skipComment() {
+        if (_end - _pos < 2)
+            fail("syntax error after '/'");
+        if (_pos[1] == '/') {
+            _pos += 2;
+            while (_pos < _end && *_pos != '\n' && *_pos != '\r')
+                ++_pos;
+        } else if (_pos[1] == '*') {
+            for (_pos += 2; ; ++_pos) {
+                if (_end - _pos < 2)
+                    fail("unterminated comment");
+                if (_pos[0] == '*' && _pos[1] == '/')
+                    break;
+            }
+            _pos += 2;
+        } else {
+            fail("syntax error after '/'");
+        }
+    }
+
+} }
@@ -0,0 +1,61 @@
+//
+// JSON5Converter.hh
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "Encoder.hh"
+#include "FleeceException.hh"
+#include "fleece/slice.hh"
+#include <string>
+
+namespace fleece { namespace impl {
+
+    /** Parses JSON5 <https://json5.org> and writes the values in it to a Fleece encoder.
+        Unlike \ref ConvertJSON5, this doesn't produce JSON text that then has to be parsed again;
+        strings and keys that don't contain escapes are written straight from the input. */
+    class JSON5Converter {
+    public:
+        explicit JSON5Converter(Encoder &e) noexcept    :_encoder(e) { }
+
+        /** Parses JSON5 data and writes the values to the encoder.
+            @return  True if parsing succeeded, false if the JSON5 is invalid. */
+        bool encodeJSON5(slice json5);
+
+        ErrorCode errorCode() const noexcept            {return _errorCode;}
+        const char* errorMessage() const noexcept       {return _errorMessage.c_str();}
+
+        /** Byte offset in input where error occurred */
+        size_t errorPos() const noexcept                {return _errorPos;}
+
+        /** Convenience method to convert JSON5 to Fleece data. Throws FleeceException on error. */
+        static alloc_slice convertJSON5(slice json5, SharedKeys *sk =nullptr);
+
+    private:
+        static constexpr unsigned kMaxDepth = 500;
+
+        void parseValue();
+        void parseNumber();
+        void parseHexNumber(bool negative);
+        void parseString(bool isKey);
+        void parseEscape();
+        void parseIdentifierKey();
+        void parseCollection(bool isDict);
+        bool matchIdentifier(const char *ident NONNULL);
+        char peekToken();
+        void skipComment();
+        [[noreturn]] void fail(const char *error NONNULL);
+
+        Encoder &_encoder;              // encoder to write to
+        const char *_start {nullptr};   // start of the input
+        const char *_pos {nullptr};     // current position in the input
+        const char *_end {nullptr};     // end of the input
+        unsigned _depth {0};            // nesting depth of arrays/dicts
+        std::string _buffer;            // scratch space for strings with escapes
+        ErrorCode _errorCode {NoError};
+        std::string _errorMessage;
+        size_t _errorPos {0};
+    };
+
+} }
@@ -114,8 +114,10 @@ namespace fleece { namespace impl {
     }
 
     void JSONConverter::writeDouble(struct jsonsl_state_st *state) {
+        // The input isn't NUL-terminated, so pass the remaining length; parsing stops at the
+        // end of the number.
         char *start = (char*)&_input[state->pos_begin];
-        _encoder.writeDouble(ParseDouble(start));
+        _encoder.writeDouble(ParseDouble(start, _input.size - state->pos_begin));
     }
 
     inline void JSONConverter::pop(struct jsonsl_state_st *state) {
@@ -123,8 +125,7 @@ namespace fleece { namespace impl {
             case JSONSL_T_SPECIAL: {
                 unsigned f = state->special_flags;
                 if (f & JSONSL_SPECIALf_FLOAT || f & JSONSL_SPECIALf_EXPONENT) {
-                    char *start = (char*)&_input[state->pos_begin];
-                    _encoder.writeDouble(ParseDouble(start));
+                    writeDouble(state);
                 } else if (f & JSONSL_SPECIALf_UNSIGNED) {
                     if (_usuallyTrue(state->pos_cur - state->pos_begin < 19)) {
                         _encoder.writeUInt(state->nelem);
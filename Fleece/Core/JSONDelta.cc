@@ -20,7 +20,7 @@
 #include "FleeceImpl.hh"
 #include "JSONEncoder.hh"
 #include "JSONConverter.hh"
-#include "JSON5.hh"
+#include "JSON5Converter.hh"
 #include "FleeceException.hh"
 #include "TempArray.hh"
 #include "diff_match_patch.hh"
@@ -236,15 +236,11 @@ namespace fleece { namespace impl {
 
     /*static*/ void JSONDelta::apply(const Value *old, slice jsonDelta, bool isJSON5, Encoder &enc) {
         assert_precondition(jsonDelta);
-        string json5;
-        if (isJSON5) {
-            json5 = ConvertJSON5(string(jsonDelta));
-            jsonDelta = slice(json5);
-        }
 
         // Parse JSON delta to Fleece using same SharedKeys as `old`:
         auto sk = old->sharedKeys();
-        alloc_slice fleeceData = JSONConverter::convertJSON(jsonDelta, sk);
+        alloc_slice fleeceData = isJSON5 ? JSON5Converter::convertJSON5(jsonDelta, sk)
+                                         : JSONConverter::convertJSON(jsonDelta, sk);
         Scope scope(fleeceData, sk);
         const Value *fleeceDelta = Value::fromTrustedData(fleeceData);
 
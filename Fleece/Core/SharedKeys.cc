@@ -19,6 +19,7 @@
 #include "SharedKeys.hh"
 #include "FleeceImpl.hh"
 #include "FleeceException.hh"
+#include "Stats.hh"
 
 
 #define LOCK(MUTEX)     lock_guard<mutex> _lock(MUTEX)
@@ -29,7 +30,8 @@ namespace fleece { namespace impl {
 
 
     SharedKeys::SharedKeys()
-    :_table(2047)
+    :RefCounted(false)          // shared by Docs and Encoders on any thread, so never confined
+    ,_table(2047)
     { }
 
 
@@ -93,11 +95,47 @@ namespace fleece { namespace impl {
     }
 
 
+    bool SharedKeys::loadFromKeyTree(slice image) {
+        return _loadFromKeyTree(KeyTree(image));
+    }
+
+
+    bool SharedKeys::loadFromKeyTree(alloc_slice image) {
+        if (_usuallyFalse(image.isThreadConfined())) {
+            // I keep the image, and may be released on another thread, so it can't be confined:
+            ThreadConfinedScope notConfined(false);
+            image = alloc_slice(slice(image));
+        }
+        return _loadFromKeyTree(KeyTree(move(image)));
+    }
+
+
+    bool SharedKeys::_loadFromKeyTree(KeyTree &&tree) {
+        throwIf(tree.count() > kMaxCount, InvalidData, "too many keys in KeyTree");
+        LOCK(_mutex);
+        throwIf(_count > 0, SharedKeysStateError, "can't load a KeyTree into non-empty SharedKeys");
+        _keyTree = move(tree);
+        _imageCount = _count = _keyTree.count();
+        return _count > 0;
+    }
+
+
+    alloc_slice SharedKeys::keyTreeData() const {
+        return KeyTree::encode(byKey());
+    }
+
+
+    // Returns the string for a known key. (Key tree ids are 1-based; keys are 0-based.)
+    slice SharedKeys::_keyAt(unsigned key) const {
+        return (key < _imageCount) ? _keyTree[key + 1] : _byKey[key];
+    }
+
+
     void SharedKeys::writeState(Encoder &enc) const {
         auto count = _count;
         enc.beginArray(count);
-        for (size_t key = 0; key < count; ++key)
-            enc.writeString(_byKey[key]);
+        for (unsigned key = 0; key < count; ++key)
+            enc.writeString(_keyAt(key));
         enc.endArray();
     }
 
@@ -110,9 +148,21 @@ namespace fleece { namespace impl {
 
 
     bool SharedKeys::encode(slice str, int &key) const {
+        // Is this string in the KeyTree image?
+        if (_imageCount > 0) {
+            unsigned id = _keyTree[str];
+            if (id > 0 && id <= _imageCount) {
+                stats::add(stats::kSharedKeyLookups);
+                stats::add(stats::kSharedKeyHits);
+                key = int(id - 1);
+                return true;
+            }
+        }
         // Is this string already encoded?
         auto entry = _table.find(str);
+        stats::add(stats::kSharedKeyLookups);
         if (_usuallyTrue(entry.key != nullslice)) {
+            stats::add(stats::kSharedKeyHits);
             key = entry.value;
             return true;
         }
@@ -170,6 +220,8 @@ namespace fleece { namespace impl {
         throwIf(key < 0, InvalidData, "key must be non-negative");
         if (_usuallyFalse(key >= kMaxCount))
             return nullslice;
+        if (unsigned(key) < _imageCount)
+            return _keyTree[unsigned(key) + 1];
         slice str = _byKey[key];
         if (_usuallyFalse(!str))
             return decodeUnknown(key);
@@ -183,13 +235,16 @@ namespace fleece { namespace impl {
 
         // Retry after refreshing:
         LOCK(_mutex);
-        return _byKey[key];
+        return _keyAt(key);
     }
 
 
     vector<slice> SharedKeys::byKey() const {
         LOCK(_mutex);
-        return vector<slice>(&_byKey[0], &_byKey[_count]);
+        vector<slice> keys(_count);
+        for (unsigned key = 0; key < _count; ++key)
+            keys[key] = _keyAt(key);
+        return keys;
     }
 
 
@@ -224,11 +279,13 @@ namespace fleece { namespace impl {
         }
 
         // (Iterating backwards helps the ConcurrentArena free up key space.)
-        for (int key = _count - 1; key >= int(toCount); --key) {
+        int firstTableKey = int(max(toCount, size_t(_imageCount)));
+        for (int key = _count - 1; key >= firstTableKey; --key) {
             _table.remove(_byKey[key]);
             _byKey[key] = nullslice;
         }
         _count = unsigned(toCount);
+        _imageCount = min(_imageCount, _count);
     }
 
 
@@ -280,6 +337,22 @@ namespace fleece { namespace impl {
     }
 
 
+    bool PersistentSharedKeys::loadFromKeyTree(slice image) {
+        if (!SharedKeys::loadFromKeyTree(image))
+            return false;
+        _committedPersistedCount = _persistedCount = count();
+        return true;
+    }
+
+
+    bool PersistentSharedKeys::loadFromKeyTree(alloc_slice image) {
+        if (!SharedKeys::loadFromKeyTree(move(image)))
+            return false;
+        _committedPersistedCount = _persistedCount = count();
+        return true;
+    }
+
+
     void PersistentSharedKeys::save() {
         if (changed()) {
             write(stateData());     // subclass hook
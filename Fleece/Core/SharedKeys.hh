@@ -19,6 +19,7 @@
 #pragma once
 #include "RefCounted.hh"
 #include "ConcurrentMap.hh"
+#include "KeyTree.hh"
 #include <array>
 #include <mutex>
 #include <vector>
@@ -66,7 +67,8 @@ namespace fleece { namespace impl {
         integer key, the Dict will look up a Scope responsible for its address, and get the
         SharedKeys instance from that Scope.
 
-        NOTE: This class is now thread-safe. */
+        NOTE: This class is now thread-safe, and instances are never thread-confined (see
+        ThreadConfinedScope), even if created in thread-confined mode. */
     class SharedKeys : public RefCounted {
     public:
         SharedKeys();
@@ -81,6 +83,23 @@ namespace fleece { namespace impl {
         alloc_slice stateData() const;
         void writeState(Encoder &enc) const;
 
+        /** Loads the keys from a KeyTree image, such as one created by `keyTreeData`, and
+            serves lookups of those keys directly out of the image, without copying it or building
+            any index; this takes constant time regardless of the number of keys.
+            The memory must remain valid and unchanged as long as this object exists.
+            More keys can be added afterwards, as usual.
+            Throws SharedKeysStateError if this object already has keys, or InvalidData if the
+            image is invalid or has too many keys.
+            @return  True if keys were added, false if the image is empty. */
+        virtual bool loadFromKeyTree(slice image);
+
+        /** Same as the other `loadFromKeyTree`, but retains the image. */
+        virtual bool loadFromKeyTree(alloc_slice image);
+
+        /** Returns the current keys encoded as a KeyTree image, which can be stored (e.g. in a
+            file) and later used with `loadFromKeyTree`. */
+        alloc_slice keyTreeData() const;
+
         /** Sets the maximum length of string that can be mapped. (Defaults to 16 bytes.) */
         void setMaxKeyLength(size_t m)          {_maxKeyLength = m;}
 
@@ -142,14 +161,18 @@ namespace fleece { namespace impl {
         bool _add(slice string, int &key);
         bool _isUnknownKey(int key) const FLPURE        {return (size_t)key >= _count;}
         slice decodeUnknown(int key) const;
+        slice _keyAt(unsigned key) const FLPURE;
+        bool _loadFromKeyTree(KeyTree&&);
 
         size_t _maxKeyLength {kDefaultMaxKeyLength};    // Max length of string I will add
         mutable std::mutex _mutex;
         unsigned _count {0};
+        unsigned _imageCount {0};                       // Number of keys served from _keyTree
         bool _inTransaction {true};                     // (for PersistentSharedKeys)
         mutable std::vector<PlatformString> _platformStringsByKey; // Reverse mapping, int->platform key
         ConcurrentMap _table;                             // Hash table mapping slice->int
         std::array<slice, kMaxCount> _byKey;      // Reverse mapping, int->slice
+        KeyTree _keyTree;                               // Image of keys [0.._imageCount)
     };
 
 
@@ -166,6 +189,9 @@ namespace fleece { namespace impl {
         bool loadFrom(const Value *state) override;
         bool loadFrom(slice stateData)              {return SharedKeys::loadFrom(stateData);}
 
+        bool loadFromKeyTree(slice image) override;
+        bool loadFromKeyTree(alloc_slice image) override;
+
         /** Updates state from persistent storage. Not usually necessary. */
         virtual bool refresh() override;
 
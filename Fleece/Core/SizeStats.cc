@@ -0,0 +1,133 @@
+//
+// SizeStats.cc
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#include "SizeStats.hh"
+#include "Value.hh"
+#include "Pointer.hh"
+#include "Internal.hh"
+#include "varint.hh"
+
+namespace fleece { namespace impl {
+    using namespace internal;
+
+
+    bool SizeStats::addDocument(slice data) {
+        if (!Value::fromData(data))
+            return false;
+        ++documents;
+        totalBytes += data.size;
+        // The root is the narrow slot in the last two bytes:
+        _visited.clear();
+        addSlot((const Value*)offsetby(data.end(), -2), false);
+        _visited.clear();
+        return true;
+    }
+
+
+    // Adds a value stored in a slot of a collection (or the root slot), following pointers.
+    // If `keyBucket` is given, the slot is a Dict key and its bytes are counted there instead.
+    void SizeStats::addSlot(const Value *slot, bool wide, Bucket *keyBucket) {
+        size_t width = wide ? kWide : kNarrow;
+        if (!slot->isPointer()) {
+            if (keyBucket) {
+                keyBucket->add(width);
+                return;
+            }
+            switch (slot->tag()) {
+                case kShortIntTag:
+                case kIntTag:       ints.add(width); break;
+                case kFloatTag:     floats.add(width); break;
+                case kSpecialTag:   specials.add(width); break;
+                case kStringTag:    strings.add(width); break;
+                case kBinaryTag:    data.add(width); break;
+                default:            addValue(slot); break;     // (an inline empty root collection)
+            }
+            return;
+        }
+
+        auto ptr = slot->_asPointer();
+        if (keyBucket)
+            keyBucket->add(width);
+        else if (ptr->isExternal())
+            externPointers.add(width);
+        else
+            (wide ? widePointers : narrowPointers).add(width);
+        if (ptr->isExternal())
+            return;
+        const Value *dst = ptr->deref(wide);
+        if (dst->isPointer())
+            addSlot(dst, true);             // pointer to a pointer; the second one is always wide
+        else if (_visited.insert(dst).second)
+            addValue(dst);
+    }
+
+
+    // Adds an out-of-line value, and the contents of collections.
+    void SizeStats::addValue(const Value *value) {
+        size_t size = value->dataSize();
+        switch (value->tag()) {
+            case kShortIntTag:
+            case kIntTag:       ints.add(size); break;
+            case kFloatTag:     floats.add(size); break;
+            case kSpecialTag:   specials.add(size); break;
+            case kStringTag:    strings.add(size); break;
+            case kBinaryTag:    data.add(size); break;
+            case kArrayTag:
+            case kDictTag: {
+                bool isDict = (value->tag() == kDictTag);
+                bool wide = value->isWideArray();
+                (isDict ? (wide ? wideDicts : narrowDicts)
+                        : (wide ? wideArrays : narrowArrays)).add(size);
+                uint32_t count = value->countValue();
+                if (count == kLongArrayCount) {
+                    uint32_t extraCount;
+                    GetUVarInt32(slice(&value->_byte[2], 10), &extraCount);
+                    count += extraCount;
+                }
+                const Value *slot = offsetby(value, size);
+                size_t width = wide ? kWide : kNarrow;
+                for (uint32_t i = 0; i < count; ++i) {
+                    if (isDict) {
+                        addSlot(slot, wide, (slot->tag() == kShortIntTag) ? &sharedKeys
+                                                                          : &stringKeys);
+                        slot = offsetby(slot, width);
+                    }
+                    addSlot(slot, wide);
+                    slot = offsetby(slot, width);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+
+    SizeStats& SizeStats::operator+= (const SizeStats &s) {
+        specials += s.specials; ints += s.ints; floats += s.floats;
+        strings += s.strings; data += s.data;
+        narrowPointers += s.narrowPointers; widePointers += s.widePointers;
+        externPointers += s.externPointers;
+        narrowArrays += s.narrowArrays; wideArrays += s.wideArrays;
+        narrowDicts += s.narrowDicts; wideDicts += s.wideDicts;
+        sharedKeys += s.sharedKeys; stringKeys += s.stringKeys;
+        documents += s.documents;
+        totalBytes += s.totalBytes;
+        return *this;
+    }
+
+
+    size_t SizeStats::paddingBytes() const {
+        size_t used = 0;
+        for (auto b : {specials, ints, floats, strings, data,
+                       narrowPointers, widePointers, externPointers,
+                       narrowArrays, wideArrays, narrowDicts, wideDicts,
+                       sharedKeys, stringKeys})
+            used += b.bytes;
+        return totalBytes > used ? totalBytes - used : 0;
+    }
+
+} }
@@ -0,0 +1,49 @@
+//
+// SizeStats.hh
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "fleece/slice.hh"
+#include <unordered_set>
+
+namespace fleece { namespace impl {
+    class Value;
+
+
+    /** A breakdown of the bytes of encoded Fleece data by the kind of value they belong to.
+        Values in collections are counted at the width of their slot; out-of-line values are
+        counted once each, however many pointers refer to them, so deduplicated strings don't
+        inflate the totals. Collection buckets count only the collection headers. */
+    class SizeStats {
+    public:
+        struct Bucket {
+            size_t count {0}, bytes {0};
+            void add(size_t size)                   {++count; bytes += size;}
+            Bucket& operator+= (const Bucket &b)    {count += b.count; bytes += b.bytes; return *this;}
+        };
+
+        Bucket specials, ints, floats, strings, data;
+        Bucket narrowPointers, widePointers, externPointers;
+        Bucket narrowArrays, wideArrays, narrowDicts, wideDicts;
+        Bucket sharedKeys, stringKeys;      // Dict key slots; key strings' bytes are in `strings`
+        size_t documents {0}, totalBytes {0};
+
+        /** Adds the contents of a Fleece document. Returns false (and adds nothing) if the data
+            isn't valid Fleece. */
+        bool addDocument(slice fleeceData);
+
+        SizeStats& operator+= (const SizeStats&);
+
+        /** Bytes not belonging to any value: the padding after odd-sized values. */
+        size_t paddingBytes() const;
+
+    private:
+        void addSlot(const Value* NONNULL, bool wide, Bucket *keyBucket =nullptr);
+        void addValue(const Value* NONNULL);
+
+        std::unordered_set<const void*> _visited;
+    };
+
+} }
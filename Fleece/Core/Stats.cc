@@ -0,0 +1,89 @@
+//
+// Stats.cc
+//
+// Copyright © 2020 Couchbase. All rights reserved.
+//
+
+#include "Stats.hh"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace fleece { namespace impl {
+    using namespace std;
+
+    namespace stats {
+
+        thread_local ThreadCounters tCounters;
+        std::atomic<bool> gEnabled {false};
+
+
+        // Keeps track of every thread's counters, plus the totals of threads that have exited.
+        struct Registry {
+            mutex                    _mutex;
+            vector<ThreadCounters*>  _threads;
+            uint64_t                 _exited[kNumCounters] {};
+            uint64_t                 _baseline[kNumCounters] {};
+
+            void sum(uint64_t totals[kNumCounters]) {
+                copy(begin(_exited), end(_exited), totals);
+                for (ThreadCounters *t : _threads)
+                    for (unsigned c = 0; c < kNumCounters; ++c)
+                        totals[c] += t->value[c].load(memory_order_relaxed);
+            }
+        };
+
+        // Deliberately leaked, since threads may exit after static destructors have run.
+        static Registry& registry() {
+            static Registry *sRegistry = new Registry;
+            return *sRegistry;
+        }
+
+
+        // A thread-local object whose destructor removes the thread's counters at thread exit.
+        struct ThreadExit {
+            ~ThreadExit() {
+                Registry &reg = registry();
+                lock_guard<mutex> lock(reg._mutex);
+                for (unsigned c = 0; c < kNumCounters; ++c)
+                    reg._exited[c] += tCounters.value[c].load(memory_order_relaxed);
+                reg._threads.erase(find(reg._threads.begin(), reg._threads.end(), &tCounters));
+            }
+        };
+
+
+        void registerThread() noexcept {
+            static thread_local ThreadExit sThreadExit;
+            (void)sThreadExit;
+            Registry &reg = registry();
+            lock_guard<mutex> lock(reg._mutex);
+            reg._threads.push_back(&tCounters);
+            tCounters.registered = true;
+        }
+
+    }
+
+
+    Stats Stats::get() noexcept {
+        Stats s;
+        auto &reg = stats::registry();
+        lock_guard<mutex> lock(reg._mutex);
+        reg.sum(s.value);
+        for (unsigned c = 0; c < stats::kNumCounters; ++c)
+            s.value[c] -= reg._baseline[c];
+        return s;
+    }
+
+
+    void Stats::reset() noexcept {
+        auto &reg = stats::registry();
+        lock_guard<mutex> lock(reg._mutex);
+        reg.sum(reg._baseline);
+    }
+
+
+    void Stats::setEnabled(bool enabled) noexcept {
+        stats::gEnabled.store(enabled, memory_order_relaxed);
+    }
+
+} }
@@ -0,0 +1,86 @@
+//
+// Stats.hh
+//
+// Copyright © 2020 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "PlatformCompat.hh"
+#include <atomic>
+#include <stdint.h>
+
+namespace fleece { namespace impl {
+
+    /** Runtime statistics about the encoder and lookup hot paths. Unlike the debug-only counters
+        in Encoder and Dict, these are kept in release builds.
+
+        They're off by default, so the hot paths pay only for a predictable branch; call
+        `Stats::setEnabled(true)` to start collecting. To stay cheap, each thread increments its
+        own counters with plain (relaxed, non-locked) stores; `Stats::get()` sums them all up
+        under a mutex. */
+    namespace stats {
+
+        enum Counter : unsigned {
+            kBytesEncoded,          // Fleece bytes written by Encoders
+            kStringsDeduplicated,   // Strings written as pointers to an earlier copy
+            kNarrowCollections,     // Arrays/dicts encoded with 2-byte items
+            kWideCollections,       // Arrays/dicts encoded with 4-byte items
+            kDictLookups,           // Binary searches of a Dict's keys
+            kDictComparisons,       // Key comparisons made during those searches
+            kSharedKeyLookups,      // SharedKeys::encode calls
+            kSharedKeyHits,         // ... that found the string
+            kScopesRegistered,      // Scopes/Docs registered in the global memory map
+            kValidations,           // Untrusted data validated by Value::fromData
+            kValidatedBytes,        // ... total size of that data
+            kValidateNanos,         // ... total time spent validating it
+
+            kNumCounters
+        };
+
+        struct ThreadCounters {
+            std::atomic<uint64_t> value[kNumCounters];
+            bool registered;
+        };
+
+        extern thread_local ThreadCounters tCounters;
+        extern std::atomic<bool> gEnabled;
+
+        void registerThread() noexcept;
+
+        /** True if statistics are being collected. Code that does extra work to compute a
+            statistic, like timing something, should check this first. */
+        static inline bool enabled() noexcept {
+            return gEnabled.load(std::memory_order_relaxed);
+        }
+
+        /** Adds `n` to a counter of the current thread, if statistics are enabled. */
+        static inline void add(Counter c, uint64_t n =1) noexcept {
+            if (_usuallyTrue(!enabled()))
+                return;
+            ThreadCounters &t = tCounters;
+            if (_usuallyFalse(!t.registered))
+                registerThread();
+            t.value[c].store(t.value[c].load(std::memory_order_relaxed) + n,
+                             std::memory_order_relaxed);
+        }
+    }
+
+
+    /** A snapshot of the runtime statistics, summed over all threads. */
+    struct Stats {
+        uint64_t value[stats::kNumCounters] {};
+
+        uint64_t operator[] (stats::Counter c) const FLPURE     {return value[c];}
+
+        /** Returns the totals since the process started or `reset()` was last called. */
+        static Stats get() noexcept;
+
+        /** Makes the current totals the new zero point. */
+        static void reset() noexcept;
+
+        /** Turns collection of statistics on or off. It's off by default. */
+        static void setEnabled(bool enabled) noexcept;
+        static bool isEnabled() noexcept                        {return stats::enabled();}
+    };
+
+} }
@@ -142,6 +142,10 @@ namespace fleece { namespace impl {
                     break;
                 }
                 case kBinaryTag:
+                    if (value->isTypedArray()) {
+                        _out << "TypedArray[" << value->asArray()->count() << "]";
+                        break;
+                    }
                     // TODO: show data
                     _out << "Binary[0x";
                     _out << value->asData().hexString();
@@ -22,6 +22,7 @@
 #include "Dict.hh"
 #include "Internal.hh"
 #include "Doc.hh"
+#include "BlobStore.hh"
 #include "HeapValue.hh"
 #include "Endian.hh"
 #include "FleeceException.hh"
@@ -29,6 +30,8 @@
 #include "PlatformCompat.hh"
 #include "JSONEncoder.hh"
 #include "ParseDate.hh"
+#include "Stats.hh"
+#include <chrono>
 #include <math.h>
 #include "betterassert.hh"
 
@@ -83,6 +86,8 @@ namespace fleece { namespace impl {
                 default:
                     return kNull;
             }
+        } else if (_usuallyFalse(t == kBinaryTag)) {
+            return _usuallyFalse(isTypedArray()) ? kArray : kData;
         } else {
             return kValueTypes[t];
         }
@@ -170,7 +175,7 @@ namespace fleece { namespace impl {
     }
 
     alloc_slice Value::toString() const {
-        char buf[32], *str = buf;
+        char buf[kFormattedISO8601DateMaxSize], *str = buf;
         switch (tag()) {
             case kShortIntTag:
             case kIntTag: {
@@ -202,7 +207,9 @@ namespace fleece { namespace impl {
                 break;
             }
             case kFloatTag: {
-                if (_byte[0] & 0x8)
+                if (isTimestamp())
+                    return alloc_slice(FormatISO8601Date(str, asTimestamp(), true));
+                else if (_byte[0] & 0x8)
                     WriteDouble(asDouble(), str, 32);
                 else
                     WriteFloat(asFloat(), str, 32);
@@ -219,7 +226,24 @@ namespace fleece { namespace impl {
     }
 
     slice Value::asData() const noexcept {
-        return _usuallyTrue(tag() == kBinaryTag) ? getStringBytes() : slice();
+        if (_usuallyFalse(tag() != kBinaryTag) || _usuallyFalse(isTypedArray()))
+            return slice();
+        return getStringBytes();
+    }
+
+    slice Value::resolveBlob(bool *outIsString) const noexcept {
+        bool isString = (tag() == kStringTag);
+        slice content = isString ? getStringBytes() : asData();
+        if (BlobRef ref; !isString && _usuallyFalse(BlobRef::decode(content, ref))) {
+            // A Data value is only a reference if the BlobStore has content that matches it:
+            if (slice blob = ref.resolve(this); blob.buf) {
+                content = blob;
+                isString = ref.isString;
+            }
+        }
+        if (outIsString)
+            *outIsString = isString;
+        return content;
     }
 
     int64_t Value::asTimestamp() const noexcept {
@@ -236,11 +260,29 @@ namespace fleece { namespace impl {
     }
 
     const Array* Value::asArray() const noexcept {
-        if (_usuallyFalse(tag() != kArrayTag))
+        if (_usuallyFalse(tag() != kArrayTag) && !isTypedArray())
             return nullptr;
         return (const Array*)this;
     }
 
+    // A typed array is binary data whose length is a varint padded with a redundant 0 byte, which
+    // Encoder::writeData never writes. The padding also puts the items at an even address.
+    bool Value::isTypedArray() const noexcept {
+        if (_usuallyTrue(_byte[0] != ((kBinaryTag << 4) | 0x0F)))
+            return false;
+        auto size = &_byte[1];
+        size_t n = 1;
+        while (size[n - 1] & 0x80) {
+            if (++n > kMaxVarintLen32 + 2)
+                return false;
+        }
+        if (n == 1 || size[n - 1] != 0 || (n & 1) == 0)
+            return false;
+        uint32_t length;
+        return GetUVarInt32(slice(size, n), &length) == n
+            && length >= 6 && typedArrayItemSize(size[n]) > 0;
+    }
+
     const Dict* Value::asDict() const noexcept {
         if (_usuallyFalse(tag() != kDictTag))
             return nullptr;
@@ -274,11 +316,39 @@ namespace fleece { namespace impl {
     }
 
 
+    // Compares Arrays item by item.
+    static bool isEqualArray(const Array *a, const Array *b) {
+        Array::iterator i(a);
+        Array::iterator j(b);
+        if (i.count() != j.count())
+            return false;
+        for (; i; ++i, ++j)
+            if (!i.value()->isEqual(j.value()))
+                return false;
+        return true;
+    }
+
     bool Value::isEqual(const Value *v) const {
-        if (!v || _byte[0] != v->_byte[0])
+        if (!v)
             return false;
         if (_usuallyFalse(this == v))
             return true;
+        if (_byte[0] != v->_byte[0] || _usuallyFalse(isTypedArray() || v->isTypedArray())) {
+            // A typed array stores every item at full size, so the same numbers or array can
+            // have different encodings:
+            auto t = type();
+            if (_usuallyTrue(t != v->type()))
+                return false;
+            else if (t == kArray)
+                return isEqualArray((const Array*)this, (const Array*)v);
+            else if (t != kNumber || isInteger() != v->isInteger()
+                                  || isTimestamp() != v->isTimestamp())
+                return false;
+            else if (isInteger())
+                return asInt() == v->asInt() && (isUnsigned() == v->isUnsigned() || asInt() >= 0);
+            else
+                return asDouble() == v->asDouble();
+        }
         switch (tag()) {
             case kShortIntTag:
             case kIntTag:
@@ -293,16 +363,8 @@ namespace fleece { namespace impl {
             case kStringTag:
             case kBinaryTag:
                 return getStringBytes() == v->getStringBytes();
-            case kArrayTag: {
-                Array::iterator i((const Array*)this);
-                Array::iterator j((const Array*)v);
-                if (i.count() != j.count())
-                    return false;
-                for (; i; ++i, ++j)
-                    if (!i.value()->isEqual(j.value()))
-                        return false;
-                return true;
-            }
+            case kArrayTag:
+                return isEqualArray((const Array*)this, (const Array*)v);
             case kDictTag:
                 return ((const Dict*)this)->isEqualToDict((const Dict*)v);
             default:
@@ -322,12 +384,27 @@ namespace fleece { namespace impl {
     }
 
     const Value* Value::fromData(slice s) noexcept {
+        if (_usuallyFalse(stats::enabled()))
+            return fromDataWithStats(s);
         auto root = findRoot(s);
         if (root && _usuallyFalse(!root->validate(s.buf, s.end())))
             root = nullptr;
         return root;
     }
 
+    const Value* Value::fromDataWithStats(slice s) noexcept {
+        using clock = std::chrono::steady_clock;
+        auto start = clock::now();
+        auto root = findRoot(s);
+        if (root && _usuallyFalse(!root->validate(s.buf, s.end())))
+            root = nullptr;
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+        stats::add(stats::kValidations);
+        stats::add(stats::kValidatedBytes, s.size);
+        stats::add(stats::kValidateNanos, nanos.count());
+        return root;
+    }
+
     const Value* Value::findRoot(slice s) noexcept {
         precondition(((size_t)s.buf & 1) == 0);  // Values must be 2-byte aligned
 
@@ -378,6 +455,18 @@ namespace fleece { namespace impl {
                 }
                 return true;
             }
+        } else if (_usuallyFalse(t == kBinaryTag) && isTypedArray()) {
+            // Check that the data holds whole items, all of the same kind:
+            slice items = getStringBytes();
+            if (_usuallyFalse(items.end() > dataEnd))
+                return false;
+            size_t itemSize = typedArrayItemSize(items[0]);
+            if (_usuallyFalse(items.size % itemSize != 0))
+                return false;
+            for (size_t i = itemSize; i < items.size; i += itemSize)
+                if (_usuallyFalse(items[i] != items[0]))
+                    return false;
+            return true;
         }
         // Default: just check that size fits:
         return offsetby(this, dataSize()) <= dataEnd;
@@ -77,7 +77,7 @@ namespace fleece { namespace impl {
             This is a lot faster, but "undefined behavior" occurs if the data is corrupt... */
         static const Value* fromTrustedData(slice s) noexcept;
 
-        /** The overall type of a value (JSON types plus Data) */
+        /** The overall type of a value (JSON types plus Data.) */
         valueType type() const noexcept FLPURE;
 
         /** Compares two Values for equality. */
@@ -112,6 +112,11 @@ namespace fleece { namespace impl {
         /** Is this a 64-bit floating-point value? */
         bool isDouble() const noexcept FLPURE      {return tag() == internal::kFloatTag && (_byte[0] & 0x8);}
 
+        /** Is this a binary timestamp, as written by Encoder::writeTimestamp? It's a double
+            (so its type is still kNumber) whose value is milliseconds since 1/1/1970. */
+        bool isTimestamp() const noexcept FLPURE   {return _byte[0] == ((internal::kFloatTag << 4) | 0x08 |
+                                                                internal::kFloatTimestampFlag);}
+
         /** "undefined" is a special subtype of kNull */
         bool isUndefined() const noexcept FLPURE   {return _byte[0] == ((internal::kSpecialTag << 4) |
                                                                 internal::kSpecialValueUndefined);}
@@ -121,17 +126,30 @@ namespace fleece { namespace impl {
         /** Returns the exact contents of a string. Other types return a null slice. */
         slice asString() const noexcept FLPURE;
 
-        /** Returns the exact contents of a binary data value. Other types return a null slice. */
+        /** Returns the exact contents of a binary data value. Other types return a null slice.
+            (A reference to a blob in a BlobStore is just data; see resolveBlob.) */
         slice asData() const noexcept FLPURE;
 
+        /** Returns the contents of a string or binary data value, like asString or asData.
+            But if it's a reference to a string or data in a BlobStore (see BlobStore.hh), and
+            this Value's Scope has a BlobStore containing it, returns that content instead.
+            Sets `*outIsString` to whether the result is a string.
+            This is the only Value method that looks in a BlobStore. */
+        slice resolveBlob(bool *outIsString =nullptr) const noexcept;
+
         typedef int64_t FLTimestamp;
         #define FLTimestampNone INT64_MIN
 
         /** Converts a value to a timestamp, in milliseconds since Unix epoch, or INT64_MIN on failure.
              - A string is parsed as ISO-8601 (standard JSON date format).
-             - A number is interpreted as a timestamp and returned as-is. */
+             - A number (including a binary timestamp) is interpreted as a timestamp and
+               returned as-is. */
         FLTimestamp asTimestamp() const noexcept FLPURE;
 
+        /** Is this a typed array, as written by Encoder::writeTypedArray? It's stored as a packed
+            run of numbers, but otherwise behaves like any other Array; its type is kArray. */
+        bool isTypedArray() const noexcept FLPURE;
+
         /** If this value is an array, returns it cast to 'const Array*', else returns nullptr. */
         const Array* asArray() const noexcept FLPURE;
 
@@ -212,6 +230,7 @@ namespace fleece { namespace impl {
         { }
 
         static const Value* findRoot(slice) noexcept FLPURE;
+        static const Value* fromDataWithStats(slice) noexcept;
         bool validate(const void* dataStart, const void *dataEnd) const noexcept FLPURE;
 
         internal::tags tag() const noexcept FLPURE   {return (internal::tags)(_byte[0] >> 4);}
@@ -256,10 +275,12 @@ namespace fleece { namespace impl {
         friend class internal::HeapValue;
         friend class Array;
         friend class Dict;
+        friend class CompressedDoc;
         friend class Encoder;
         friend class ValueTests;
         friend class EncoderTests;
         friend class ValueDumper;
+        friend class SizeStats;
         template <bool WIDE> friend struct dictImpl;
     };
 
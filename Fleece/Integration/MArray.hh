@@ -18,17 +18,26 @@
 
 #pragma once
 #include "MCollection.hh"
+#include <algorithm>
+#include <array>
+#include <new>
 #include <vector>
 #include <assert.h>
 
 namespace fleece {
 
-    /** A mutable array of MValues. */
+    /** A mutable array of MValues.
+
+        To keep large arrays cheap to open, MValues are stored in fixed-size pages that are only
+        allocated when one of their items is first read or modified, and an item's MValue is only
+        loaded from the base Fleece Array when it's first accessed. Since pages never move, reading
+        never invalidates MValue references, and iterating the whole array allocates one page per
+        kPageSize items. Inserting or removing items shifts the MValues after them. */
     template <class Native>
     class MArray : public MCollection<Native> {
     public:
-        using MValue = MValue<Native>;
-        using MCollection = MCollection<Native>;
+        using MValue = fleece::MValue<Native>;
+        using MCollection = fleece::MCollection<Native>;
 
         /** Constructs an empty MArray not connected to any existing Fleece Array. */
         MArray() :MCollection() { }
@@ -39,6 +48,10 @@ namespace fleece {
             initInSlot(mv, parent);
         }
 
+        ~MArray() {
+            freePages(0);
+        }
+
         /** Initializes a brand-new MArray created with the empty constructor, as though it had
             been created with the existing-Array constructor. Useful in situations where you can't
             pass parameters to the constructor (i.e. when embedding an MArray in an Objective-C++
@@ -47,7 +60,7 @@ namespace fleece {
             MCollection::initInSlot(mv, parent, isMutable);
             assert(!_array);
             _array = mv->value().asArray();
-            _vec.resize(_array.count());
+            _count = _baseCount = _array.count();
         }
 
         void initInSlot(MValue *mv, MCollection *parent) {
@@ -58,7 +71,14 @@ namespace fleece {
         void initAsCopyOf(const MArray &a, bool isMutable) {
             MCollection::initAsCopyOf(a, isMutable);
             _array = a._array;
-            _vec = a._vec;
+            freePages(0);
+            _pages.reserve(a._pages.size());
+            for (Page *page : a._pages)
+                _pages.push_back(page ? new Page(*page) : nullptr);
+            for (_nLoose = 0; _nLoose < a._nLoose; ++_nLoose)
+                _loose[_nLoose] = {a._loose[_nLoose].index, new Page(*a._loose[_nLoose].page)};
+            _count = a._count;
+            _baseCount = a._baseCount;
         }
 
         Array baseArray() const {
@@ -67,18 +87,16 @@ namespace fleece {
 
         /** Returns the number of items in the array. */
         uint32_t count() const {
-            return (uint32_t)_vec.size();
+            return _count;
         }
 
         /** Returns a reference to the MValue of the item at the given index.
-            If the index is out of range, returns an empty MValue. */
+            If the index is out of range, returns an empty MValue.
+            The reference is only valid until the next call that modifies the array. */
         const MValue& get(size_t i) const {
-            if (_usuallyFalse(i >= _vec.size()))
+            if (_usuallyFalse(i >= _count))
                 return MValue::empty;
-            const MValue &val = _vec[i];
-            if (_usuallyTrue(val.isEmpty()))
-                const_cast<MValue&>(val) = _array[(uint32_t)i];
-            return val;
+            return const_cast<MArray*>(this)->slot((uint32_t)i);
         }
 
         /** Stores a Native value into the array.
@@ -89,7 +107,7 @@ namespace fleece {
             if (_usuallyFalse(i >= count() || val == nullptr))
                 return false;
             MCollection::mutate();
-            _vec[i] = val;
+            slot((uint32_t)i) = val;
             return true;
         }
 
@@ -98,13 +116,19 @@ namespace fleece {
         bool insert(size_t i, Native val) {
             if (_usuallyFalse(!MCollection::isMutable()))
                 return false;
-            size_t cnt = count();
+            uint32_t cnt = count();
             if (_usuallyFalse(i > cnt || val == nullptr))
                 return false;
-            else if (i < cnt)
-                populateVec();
             MCollection::mutate();
-            _vec.emplace(_vec.begin() + i, val);
+            ++_count;
+            // Shift the following items up. (Accessing an item loads it from _array, so it's
+            // loaded before being moved, and before anything is moved into its place.)
+            for (uint32_t j = cnt; j > i; --j) {
+                MValue &dst = slot(j);
+                moveSlot(dst, slot(j - 1));
+            }
+            _baseCount = std::min(_baseCount, (uint32_t)i);
+            slot((uint32_t)i) = val;
             return true;
         }
 
@@ -122,10 +146,14 @@ namespace fleece {
             size_t cnt = count();
             if (_usuallyFalse(end > cnt))
                 return false;
-            if (end < cnt)
-                populateVec();
             MCollection::mutate();
-            _vec.erase(_vec.begin() + i, _vec.begin() + end);
+            // Shift the following items down, then drop the leftovers at the end:
+            for (size_t j = i; j + n < cnt; ++j) {
+                MValue &dst = slot((uint32_t)j);
+                moveSlot(dst, slot((uint32_t)(j + n)));
+            }
+            _baseCount = std::min(_baseCount, (uint32_t)i);
+            truncate((uint32_t)(cnt - n));
             return true;
         }
 
@@ -133,10 +161,11 @@ namespace fleece {
         bool clear() {
             if (_usuallyFalse(!MCollection::isMutable()))
                 return false;
-            if (_vec.empty())
+            if (_count == 0)
                 return true;
             MCollection::mutate();
-            _vec.clear();
+            freePages(0);
+            _count = _baseCount = 0;      // nothing may be loaded from _array anymore
             return true;
         }
 
@@ -146,31 +175,137 @@ namespace fleece {
                 enc << _array;
             } else {
                 enc.beginArray(count());
-                uint32_t i = 0;
-                for (auto &v : _vec) {
-                    if (v.isEmpty())
-                        enc.writeValue(_array[i]);
+                for (uint32_t i = 0; i < _count; ++i) {
+                    const Page *page = pageFor(i);
+                    if (page && !(*page)[i & kPageMask].isEmpty())
+                        (*page)[i & kPageMask].encodeTo(enc);
                     else
-                        v.encodeTo(enc);
-                    ++i;
+                        enc.writeValue(_array[i]);      // not loaded yet
                 }
                 enc.endArray();
             }
         }
 
     private:
-        /** Loads the Fleece Values of all items into _array.
-            Called by insert() and remove() before they perturb the array indexing. */
-        void populateVec() {
-            uint32_t i = 0;
-            for (auto &v : _vec) {
-                if (_usuallyTrue(v.isEmpty()))
-                    v = _array[i++];
+        // Items are stored in pages of this many MValues:
+        static constexpr uint32_t kPageShift = 6;
+        static constexpr uint32_t kPageSize = 1u << kPageShift;
+        static constexpr uint32_t kPageMask = kPageSize - 1;
+
+        // Up to this many pages are kept in _loose, before a table of all pages is allocated:
+        static constexpr uint8_t kMaxLoosePages = 4;
+
+        using Page = std::array<MValue, kPageSize>;
+
+        struct LoosePage {
+            size_t index;
+            Page *page;
+        };
+
+        static size_t pagesFor(uint32_t count) {
+            return (count + kPageMask) >> kPageShift;
+        }
+
+        /** Returns the page holding index `i`, or null if it hasn't been allocated. */
+        const Page* pageFor(uint32_t i) const {
+            return findPage(i >> kPageShift);
+        }
+
+        /** Returns page number `p`, or null if it hasn't been allocated. */
+        Page* findPage(size_t p) const {
+            if (!_pages.empty())
+                return p < _pages.size() ? _pages[p] : nullptr;
+            for (uint8_t j = 0; j < _nLoose; ++j)
+                if (_loose[j].index == p)
+                    return _loose[j].page;
+            return nullptr;
+        }
+
+        /** Allocates page number `p`. Once there are too many to keep in _loose, moves them to
+            _pages, a table indexed by page number. (The pages themselves never move.) */
+        Page* addPage(size_t p) {
+            auto page = new Page();
+            if (_pages.empty()) {
+                if (_nLoose < kMaxLoosePages) {
+                    _loose[_nLoose++] = {p, page};
+                    return page;
+                }
+                _pages.resize(std::max(pagesFor(_count), p + 1));
+                for (uint8_t j = 0; j < _nLoose; ++j)
+                    _pages[_loose[j].index] = _loose[j].page;
+                _nLoose = 0;
+            } else if (p >= _pages.size()) {
+                _pages.resize(std::max(pagesFor(_count), p + 1));
+            }
+            _pages[p] = page;
+            return page;
+        }
+
+        /** Returns the MValue for index `i`, first allocating its page and loading its Fleece
+            Value from _array if necessary. (An item's MValue is never empty once loaded, so an
+            empty one below _baseCount hasn't been loaded yet.) */
+        MValue& slot(uint32_t i) {
+            assert(i < _count);
+            size_t p = i >> kPageShift;
+            Page *page;
+            if (_usuallyTrue(p < _pages.size() && _pages[p] != nullptr))
+                page = _pages[p];
+            else if (page = findPage(p); !page)
+                page = addPage(p);
+            MValue &mv = (*page)[i & kPageMask];
+            if (mv.isEmpty() && i < _baseCount)
+                mv = MValue(_array[i]);
+            return mv;
+        }
+
+        /** Moves `src` into `dst`, destroying dst's old value. Unlike move-assignment, this
+            keeps a collection's Native pointing at the slot it's now in. */
+        static void moveSlot(MValue &dst, MValue &src) {
+            dst.~MValue();
+            new (&dst) MValue(std::move(src));
+        }
+
+        /** Deletes the pages numbered `p` and up. */
+        void freePages(size_t p) {
+            if (p < _pages.size()) {
+                for (size_t i = p; i < _pages.size(); ++i)
+                    delete _pages[i];
+                _pages.resize(p);
+                if (p == 0)
+                    _pages.shrink_to_fit();
+            }
+            for (uint8_t j = 0; j < _nLoose; ) {
+                if (_loose[j].index >= p) {
+                    delete _loose[j].page;
+                    _loose[j] = _loose[--_nLoose];
+                } else {
+                    ++j;
+                }
+            }
+        }
+
+        /** Reduces the count, freeing the MValues past the new end. */
+        void truncate(uint32_t count) {
+            assert(count <= _count);
+            freePages(pagesFor(count));
+            if (count & kPageMask) {
+                if (Page *page = findPage(count >> kPageShift)) {
+                    for (uint32_t j = count & kPageMask; j < kPageSize; ++j) {
+                        (*page)[j].~MValue();
+                        new (&(*page)[j]) MValue();
+                    }
+                }
             }
+            _count = count;
+            _baseCount = std::min(_baseCount, count);
         }
 
-        Array               _array;     // Base Fleece Array (if any)
-        std::vector<MValue> _vec;       // Current array; empty MValues are unmodified
+        Array                               _array;         // Base Fleece Array (if any)
+        std::vector<Page*>                  _pages;         // All pages by number (null if none)
+        LoosePage                           _loose[kMaxLoosePages]; // Pages, until _pages is used
+        uint8_t                             _nLoose {0};    // Number of pages in _loose
+        uint32_t                            _count {0};     // Current count
+        uint32_t                            _baseCount {0}; // Unloaded items below this are in _array
     };
 
 }
@@ -45,7 +45,7 @@ namespace fleece {
         MCollection* parent() const         {return _parent;}
 
     protected:
-        using MValue = MValue<Native>;
+        using MValue = fleece::MValue<Native>;
 
         MCollection()
         :MCollection(MContext::gNullContext, true)
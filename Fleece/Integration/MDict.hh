@@ -26,12 +26,14 @@ namespace fleece {
     template <class Native>
     class MDictIterator;
 
-    /** A mutable dictionary of MValues. */
+    /** A mutable dictionary of MValues.
+        Only keys that have been read or modified have entries in the map; all others are looked
+        up in the base Fleece Dict on demand. */
     template <class Native>
     class MDict : public MCollection<Native> {
     public:
-        using MValue = MValue<Native>;
-        using MCollection = MCollection<Native>;
+        using MValue = fleece::MValue<Native>;
+        using MCollection = fleece::MCollection<Native>;
         using MapType = std::unordered_map<slice, MValue, fleece::sliceHash>;
 
         /** Constructs an empty MDict not connected to any existing Fleece Dict. */
@@ -52,7 +54,6 @@ namespace fleece {
             assert(!_dict);
             _dict = mv->value().asDict();
             _count = _dict.count();
-            _map.reserve(5);
         }
 
         void initInSlot(MValue *mv, MCollection *parent) {
@@ -136,27 +137,48 @@ namespace fleece {
             if (_count == 0)
                 return true;
             MCollection::mutate();
+            // Detach from the base Dict instead of adding a tombstone for each of its keys:
             _map.clear();
-            for (Dict::iterator i(_dict); i; ++i)
-                _map.emplace(i.keyString(), MValue::empty);
+            _newKeys.clear();
+            _dict = Dict();
             _count = 0;
             return true;
         }
 
         using iterator = MDictIterator<Native>;     // defined in MDictIterator.hh
 
-        /** Writes the dictionary to an Encoder as a single Value. */
+        /** Writes the dictionary to an Encoder as a single Value.
+            Keys inherited from the base Dict are written as Values, so that an Encoder that's
+            amending the base data writes them as pointers instead of copying the strings. */
         void encodeTo(Encoder &enc) const {
             if (!MCollection::isMutated()) {
                 enc << _dict;
             } else {
                 enc.beginDict(count());
-                for (iterator i(*this); i; ++i) {
-                    enc.writeKey(i.key());
-                    if (i.value())
-                        enc.writeValue(i.value());
+                for (Dict::iterator i(_dict); i; ++i) {
+                    slice key = i.keyString();
+                    const MValue *mv = nullptr;
+                    auto found = _map.find(key);
+                    if (found != _map.end()) {
+                        if (found->second.isEmpty())
+                            continue;       // removed
+                        mv = &found->second;
+                    }
+                    Value keyValue = i.key();
+                    if (keyValue.type() == kFLString)
+                        enc.writeKey(keyValue);
+                    else
+                        enc.writeKey(key);  // shared (int) key; Encoder may not know the SharedKeys
+                    if (mv)
+                        mv->encodeTo(enc);
                     else
-                        i.mvalue().encodeTo(enc);
+                        enc.writeValue(i.value());
+                }
+                for (auto &entry : _map) {
+                    if (!entry.second.isEmpty() && !_dict.get(entry.first)) {
+                        enc.writeKey(entry.first);
+                        entry.second.encodeTo(enc);
+                    }
                 }
                 enc.endDict();
             }
@@ -24,8 +24,8 @@ namespace fleece {
     template <class Native>
         class MDictIterator {
         public:
-            using MDict = MDict<Native>;
-            using MValue = MValue<Native>;
+            using MDict = fleece::MDict<Native>;
+            using MValue = fleece::MValue<Native>;
 
             MDictIterator(const MDict &dict)
             :_dict(dict)
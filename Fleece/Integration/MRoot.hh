@@ -24,7 +24,7 @@ namespace fleece {
     template <class Native>
     class MRoot : private MCollection<Native> {
     public:
-        using MCollection = MCollection<Native>;
+        using MCollection = fleece::MCollection<Native>;
 
         MRoot() =default;
 
@@ -68,6 +68,21 @@ namespace fleece {
         void encodeTo(Encoder &enc) const   {_slot.encodeTo(enc);}
         alloc_slice encode() const          {Encoder enc; encodeTo(enc); return enc.finish();}
 
+        /** Encodes only the changes made since the root was loaded, as Fleece data meant to be
+            appended to the original data (`context()->data()`). Only mutated collections are
+            written; everything unchanged, including keys of the original dicts, is referenced by
+            pointers back into the original data. Unlike `amend(true)` this doesn't have to scan
+            the original data for strings first, so its cost is proportional to the changes.
+            Returns null if nothing has been mutated. */
+        alloc_slice encodeDelta(bool externPointers =false) const {
+            if (!isMutated())
+                return nullslice;
+            Encoder enc;
+            enc.amend(context()->data(), false, externPointers);
+            encodeTo(enc);
+            return enc.finish();
+        }
+
         alloc_slice amend(bool reuseStrings =false, bool externPointers =false) const {
             Encoder enc;
             enc.amend(context()->data(), reuseStrings, externPointers);
@@ -252,3 +252,98 @@ TEST_CASE("Adding mutable collections", "[Mutable]") {
     CHECK(MContext::gInstanceCount == 0);
 #endif
 }
+
+
+TEST_CASE("MArray sparse access performance", "[Mutable][.Perf]") {
+    // Bindings typically open a big array and read just a few items; that should cost
+    // nothing proportional to the array's size.
+    static constexpr NSUInteger kCount = 50000;
+    static constexpr int kSamples = 1000;
+    alloc_slice data;
+    @autoreleasepool {
+        NSMutableArray *orig = [NSMutableArray arrayWithCapacity: kCount];
+        for (NSUInteger i = 0; i < kCount; i++)
+            [orig addObject: @{@"id": @(i), @"name": [NSString stringWithFormat: @"item %zu", i]}];
+        data = encode(orig);
+    }
+    Benchmark bench;
+    for (int i = 0; i < kSamples; i++) {
+        @autoreleasepool {
+            bench.start();
+            MRoot<id> root(data);
+            NSMutableArray* array = root.asNative();
+            NSDictionary *first = array[0], *last = array[kCount - 1];
+            CHECK([first[@"id"] isEqual: @0]);
+            CHECK([last[@"id"] isEqual: @(kCount - 1)]);
+            bench.stop();
+        }
+    }
+    fprintf(stderr, "Reading 2 items of a %zu-item array: ", kCount);
+    bench.printReport();
+}
+
+
+TEST_CASE("MRoot encodeDelta", "[Mutable]") {
+    @autoreleasepool {
+        auto data = encode(@{@"greeting": @"hi",
+                             @"array":    @[@"boo", @NO],
+                             @"dict":     @{@"melt": @32, @"boil": @212}});
+        MRoot<id> root(data);
+        CHECK(!root.encodeDelta());     // nothing changed yet
+
+        NSMutableDictionary* dict = root.asNative();
+        NSMutableDictionary* nested = dict[@"dict"];
+        nested[@"freeze"] = @[@32, @"Fahrenheit"];
+        [nested removeObjectForKey: @"melt"];
+
+        alloc_slice delta = root.encodeDelta();
+        REQUIRE(delta);
+        CHECK(delta.size < root.encode().size);
+
+        alloc_slice combinedData(data);
+        combinedData.append(delta);
+        CHECK(fleece2JSON(combinedData) == "{array:[\"boo\",false],dict:{boil:212,freeze:[32,\"Fahrenheit\"]},greeting:\"hi\"}");
+    }
+#if DEBUG
+    CHECK(MContext::gInstanceCount == 0);
+#endif
+}
+
+
+TEST_CASE("MRoot encodeDelta performance", "[Mutable][.Perf]") {
+    // Changing one field of a ~1MB document, then writing it back out.
+    static constexpr NSUInteger kCount = 20000;
+    static constexpr int kSamples = 50;
+    alloc_slice data;
+    @autoreleasepool {
+        NSMutableDictionary *orig = [NSMutableDictionary dictionaryWithCapacity: kCount];
+        for (NSUInteger i = 0; i < kCount; i++) {
+            orig[[NSString stringWithFormat: @"key%zu", i]] =
+                @{@"n": @(i), @"name": [NSString stringWithFormat: @"this is value number %zu", i]};
+        }
+        data = encode(orig);
+    }
+    Benchmark fullBench, deltaBench;
+    size_t fullSize = 0, deltaSize = 0;
+    for (int i = 0; i < kSamples; i++) {
+        @autoreleasepool {
+            MRoot<id> root(data);
+            NSMutableDictionary* dict = root.asNative();
+            NSMutableDictionary* item = dict[@"key1234"];
+            item[@"n"] = @(-1);
+
+            fullBench.start();
+            fullSize = root.encode().size;
+            fullBench.stop();
+
+            deltaBench.start();
+            deltaSize = root.encodeDelta().size;
+            deltaBench.stop();
+        }
+    }
+    fprintf(stderr, "Document is %zu bytes\n", data.size);
+    fprintf(stderr, "Full re-encode, %zu bytes: ", fullSize);
+    fullBench.printReport();
+    fprintf(stderr, "Delta encode,   %zu bytes: ", deltaSize);
+    deltaBench.printReport();
+}
@@ -189,7 +189,7 @@ namespace fleece { namespace impl { namespace internal {
 
 
     Retained<HeapCollection> HeapCollection::mutableCopy(const Value *v, tags ifType) {
-        if (!v || v->tag() != ifType)
+        if (!v || (v->tag() != ifType && !(ifType == kArrayTag && v->isTypedArray())))
             return nullptr;
         if (v->isMutable())
             return (HeapCollection*)asHeapValue(v);
@@ -183,6 +183,17 @@ namespace fleece { namespace impl {
     }
 
 
+    void ValueSlot::setTimestamp(int64_t t) {
+        struct {
+            uint8_t filler = 0;
+            endian::littleEndianDouble le;
+        } data;
+        data.le = double(t);
+        setValue(kFloatTag, 0x08 | kFloatTimestampFlag, {(char*)&data.le - 1, sizeof(data.le) + 1});
+        assert_postcondition(asValue()->asTimestamp() == t);
+    }
+
+
     void ValueSlot::setValue(const Value *v) {
         if (v && v->tag() < kArrayTag) {
             auto size = v->dataSize();
@@ -244,6 +255,12 @@ namespace fleece { namespace impl {
             bool recurse = (flags & kDeepCopy);
             Retained<HeapCollection> copy;
             switch (value->tag()) {
+                case kBinaryTag:
+                    if (!value->isTypedArray()) {
+                        setData(value->asData());
+                        break;
+                    }
+                    [[fallthrough]];    // a typed array is copied like any other array
                 case kArrayTag:
                     copy = new HeapArray((Array*)value);
                     if (recurse)
@@ -260,7 +277,10 @@ namespace fleece { namespace impl {
                     set(value->asString());
                     break;
                 case kFloatTag:
-                    set(value->asDouble());
+                    if (value->isTimestamp())
+                        setTimestamp(value->asTimestamp());
+                    else
+                        set(value->asDouble());
                     break;
                 default:
                     assert(false);
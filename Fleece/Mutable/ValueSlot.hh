@@ -47,6 +47,7 @@ namespace fleece { namespace impl {
         void set(double);
         void set(slice s)           {setStringOrData(internal::kStringTag, s);}
         void setData(slice s)       {setStringOrData(internal::kBinaryTag, s);}
+        void setTimestamp(int64_t);
         void setValue(const Value* v);
 
         // These methods allow set(Value*) to be called, without allowing any other pointer type
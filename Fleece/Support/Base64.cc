@@ -17,24 +17,327 @@
 //
 
 #include "Base64.hh"
-#include "encode.h"
 #include "decode.h"
 #include "betterassert.hh"
 
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+    #define FL_BASE64_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define TARGET(T)
+    #else
+        #define TARGET(T) __attribute__((target(T)))
+    #endif
+#endif
+
 namespace fleece { namespace base64 {
 
+    // The codecs below work on whole blocks of input: 3 bytes -> 4 characters when encoding,
+    // 4 characters -> 3 bytes when decoding. The vectorized (SSSE3 / AVX2) versions handle as
+    // many blocks as they can, then the scalar code handles the rest. The vector algorithms are
+    // from Wojciech Muła and Daniel Lemire, "Faster Base64 Encoding and Decoding Using AVX2
+    // Instructions" <https://arxiv.org/abs/1704.00605>.
+    //
+    // Decoding has to match libb64's behavior of skipping any characters not in the alphabet
+    // (like whitespace or '=' padding.) So the fast decoders stop at the first block containing
+    // such a character, and libb64 decodes the remainder.
+
+
+    static constexpr char kEncodeTable[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // Maps a character to its 6-bit value, or to 0xFF if it's not in the alphabet.
+    static const struct DecodeTable {
+        uint8_t value[256];
+        constexpr DecodeTable() :value() {
+            for (int i = 0; i < 256; ++i)
+                value[i] = 0xFF;
+            for (int i = 0; i < 64; ++i)
+                value[uint8_t(kEncodeTable[i])] = uint8_t(i);
+        }
+    } kDecodeTable;
+
+
+#pragma mark - SCALAR:
+
+
+    static size_t encodeScalar(const uint8_t *src, size_t srcLen, char *dst) noexcept {
+        char *start = dst;
+        for (; srcLen >= 3; srcLen -= 3, src += 3) {
+            uint32_t n = (src[0] << 16) | (src[1] << 8) | src[2];
+            dst[0] = kEncodeTable[n >> 18];
+            dst[1] = kEncodeTable[(n >> 12) & 0x3F];
+            dst[2] = kEncodeTable[(n >> 6) & 0x3F];
+            dst[3] = kEncodeTable[n & 0x3F];
+            dst += 4;
+        }
+        if (srcLen > 0) {
+            uint32_t n = (src[0] << 16) | (srcLen > 1 ? (src[1] << 8) : 0);
+            dst[0] = kEncodeTable[n >> 18];
+            dst[1] = kEncodeTable[(n >> 12) & 0x3F];
+            dst[2] = (srcLen > 1) ? kEncodeTable[(n >> 6) & 0x3F] : '=';
+            dst[3] = '=';
+            dst += 4;
+        }
+        return dst - start;
+    }
+
+
+    // Decodes 4-character blocks until the input ends or a block contains a character outside
+    // the alphabet. Updates `src` and `dst` to the ends of what was decoded.
+    static void decodeScalarBlocks(const uint8_t* &src, const uint8_t *srcEnd,
+                                   uint8_t* &dst) noexcept
+    {
+        while (srcEnd - src >= 4) {
+            uint32_t a = kDecodeTable.value[src[0]], b = kDecodeTable.value[src[1]],
+                     c = kDecodeTable.value[src[2]], d = kDecodeTable.value[src[3]];
+            if (_usuallyFalse((a | b | c | d) & 0x80))
+                break;
+            uint32_t n = (a << 18) | (b << 12) | (c << 6) | d;
+            dst[0] = uint8_t(n >> 16);
+            dst[1] = uint8_t(n >> 8);
+            dst[2] = uint8_t(n);
+            src += 4;
+            dst += 3;
+        }
+    }
+
+
+#pragma mark - SSSE3 / AVX2:
+
+
+#ifdef FL_BASE64_X86
+
+    enum { kSSSE3 = 1, kAVX2 = 2 };
+
+
+    // ---- SSSE3, 16 characters at a time:
+
+    TARGET("ssse3")
+    static inline __m128i encodeLookup128(__m128i indices) {
+        // Maps 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12, then looks up the
+        // offset to add to get the ASCII character.
+        __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+        const __m128i shiftLUT = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        result = _mm_shuffle_epi8(shiftLUT, result);
+        return _mm_add_epi8(result, indices);
+    }
+
+    TARGET("ssse3")
+    static size_t encodeSSSE3(const uint8_t* &src, size_t srcLen, char* &dst) noexcept {
+        size_t blocks = 0;
+        for (; srcLen >= 16; srcLen -= 12, ++blocks) {       // reads 16 bytes, uses 12
+            __m128i in = _mm_loadu_si128((const __m128i*)src);
+            in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11,  9, 10,  7,  8,  6,  7,
+                                                    4,  5,  3,  4,  1,  2,  0,  1));
+            __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+            __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+            __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+            __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+            _mm_storeu_si128((__m128i*)dst, encodeLookup128(_mm_or_si128(t1, t3)));
+            src += 12;
+            dst += 16;
+        }
+        return blocks;
+    }
+
+
+    // Returns a mask of the bytes in the range [lo, hi].
+    static inline __m128i inRange128(__m128i in, char lo, char hi) {
+        return _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8(lo - 1)),
+                             _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), in));
+    }
+
+    // Converts 16 characters to 6-bit values; returns false if any isn't in the alphabet.
+    TARGET("ssse3")
+    static inline bool decodeLookup128(__m128i &in) {
+        __m128i upper = inRange128(in, 'A', 'Z'), lower = inRange128(in, 'a', 'z'),
+                digit = inRange128(in, '0', '9');
+        __m128i plus  = _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+        __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+        __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                                     _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+        if (_mm_movemask_epi8(valid) != 0xFFFF)
+            return false;
+        __m128i shift = _mm_or_si128(
+                            _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+                                         _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+                            _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+                                         _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(62 - '+')),
+                                                      _mm_and_si128(slash, _mm_set1_epi8(63 - '/')))));
+        in = _mm_add_epi8(in, shift);
+        return true;
+    }
+
+    // Packs each four 6-bit values into 3 bytes, at byte offsets 0-11 of each 128-bit lane.
+    TARGET("ssse3")
+    static inline __m128i decodePack128(__m128i values) {
+        __m128i mergedAB = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i merged = _mm_madd_epi16(mergedAB, _mm_set1_epi32(0x00011000));
+        return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                                      -1, -1, -1, -1));
+    }
+
+    TARGET("ssse3")
+    static void decodeSSSE3(const uint8_t* &src, const uint8_t *srcEnd,
+                            uint8_t* &dst, const uint8_t *dstEnd) noexcept
+    {
+        while (srcEnd - src >= 16 && dstEnd - dst >= 16) {    // writes 16 bytes, uses 12
+            __m128i in = _mm_loadu_si128((const __m128i*)src);
+            if (!decodeLookup128(in))
+                break;
+            _mm_storeu_si128((__m128i*)dst, decodePack128(in));
+            src += 16;
+            dst += 12;
+        }
+    }
+
+
+    // ---- AVX2, 32 characters at a time:
+
+    TARGET("avx2")
+    static size_t encodeAVX2(const uint8_t* &src, size_t srcLen, char* &dst) noexcept {
+        const __m256i shuffle = _mm256_set_epi8(10, 11,  9, 10,  7,  8,  6,  7,
+                                                 4,  5,  3,  4,  1,  2,  0,  1,
+                                                10, 11,  9, 10,  7,  8,  6,  7,
+                                                 4,  5,  3,  4,  1,  2,  0,  1);
+        const __m256i shiftLUT = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                                  '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                  '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                                  '/' - 63, 'A', 0, 0,
+                                                  'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                                  '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                  '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                                  '/' - 63, 'A', 0, 0);
+        size_t blocks = 0;
+        for (; srcLen >= 28; srcLen -= 24, ++blocks) {       // reads 28 bytes, uses 24
+            // Each 128-bit lane gets 12 bytes of input:
+            __m256i in = _mm256_inserti128_si256(
+                                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src)),
+                                _mm_loadu_si128((const __m128i*)(src + 12)), 1);
+            in = _mm256_shuffle_epi8(in, shuffle);
+            __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+            __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+            __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+            __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+            __m256i indices = _mm256_or_si256(t1, t3);
+
+            __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+            result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+            result = _mm256_add_epi8(_mm256_shuffle_epi8(shiftLUT, result), indices);
+            _mm256_storeu_si256((__m256i*)dst, result);
+            src += 24;
+            dst += 32;
+        }
+        return blocks;
+    }
+
+    TARGET("avx2")
+    static inline __m256i inRange256(__m256i in, char lo, char hi) {
+        return _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8(lo - 1)),
+                                _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), in));
+    }
+
+    TARGET("avx2")
+    static void decodeAVX2(const uint8_t* &src, const uint8_t *srcEnd,
+                           uint8_t* &dst, const uint8_t *dstEnd) noexcept
+    {
+        const __m256i packShuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                                     -1, -1, -1, -1,
+                                                     2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                                     -1, -1, -1, -1);
+        while (srcEnd - src >= 32 && dstEnd - dst >= 32) {    // writes 32 bytes, uses 24
+            __m256i in = _mm256_loadu_si256((const __m256i*)src);
+            __m256i upper = inRange256(in, 'A', 'Z'), lower = inRange256(in, 'a', 'z'),
+                    digit = inRange256(in, '0', '9');
+            __m256i plus  = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('+'));
+            __m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+            __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                                            _mm256_or_si256(digit, _mm256_or_si256(plus, slash)));
+            if (_mm256_movemask_epi8(valid) != -1)
+                break;
+            __m256i shift = _mm256_or_si256(
+                        _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-'A')),
+                                        _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a'))),
+                        _mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')),
+                                        _mm256_or_si256(
+                                            _mm256_and_si256(plus, _mm256_set1_epi8(62 - '+')),
+                                            _mm256_and_si256(slash, _mm256_set1_epi8(63 - '/')))));
+            in = _mm256_add_epi8(in, shift);
+
+            __m256i mergedAB = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+            __m256i merged = _mm256_madd_epi16(mergedAB, _mm256_set1_epi32(0x00011000));
+            __m256i packed = _mm256_shuffle_epi8(merged, packShuffle);
+            // Move the two lanes' 12 bytes together:
+            packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+            _mm256_storeu_si256((__m256i*)dst, packed);
+            src += 32;
+            dst += 24;
+        }
+    }
+
+
+    static int detectCPUFeatures() noexcept {
+        int features = 0;
+    #ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+        if (info[2] & (1 << 9))
+            features |= kSSSE3;
+        if (osxsave && avx && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5))
+                features |= kAVX2;
+        }
+    #else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("ssse3"))
+            features |= kSSSE3;
+        if (__builtin_cpu_supports("avx2"))
+            features |= kAVX2;
+    #endif
+        return features;
+    }
+
+    static inline int cpuFeatures() noexcept {
+        static const int sFeatures = detectCPUFeatures();
+        return sFeatures;
+    }
+
+#endif // FL_BASE64_X86
+
+
+#pragma mark - API:
+
+
+    size_t encode(slice data, void *outputBuffer) noexcept {
+        auto src = (const uint8_t*)data.buf;
+        auto dst = (char*)outputBuffer;
+        size_t srcLen = data.size;
+    #ifdef FL_BASE64_X86
+        int features = cpuFeatures();
+        if (features & kAVX2)
+            srcLen -= 24 * encodeAVX2(src, srcLen, dst);
+        if (features & kSSSE3)
+            srcLen -= 12 * encodeSSSE3(src, srcLen, dst);
+    #endif
+        dst += encodeScalar(src, srcLen, dst);
+        assert_postcondition(size_t(dst - (char*)outputBuffer) == encodedSize(data.size));
+        return dst - (char*)outputBuffer;
+    }
+
+
     std::string encode(slice data) {
         std::string str;
-        // 3 bytes -> 4 chars : ceil(data.size / 3) * 4
-        size_t strLen = ((data.size + 2) / 3) * 4;
-        str.resize(strLen);
-        char *dst = &str[0];
-        ::base64::encoder enc;
-        enc.set_chars_per_line(0);
-        size_t written = enc.encode(data.buf, data.size, dst);
-        written += enc.encode_end(dst + written);
-        assert(written == strLen);
-        (void)written;  // avoid compiler warning in release build when 'assert' is a no-op
+        str.resize(encodedSize(data.size));
+        encode(data, &str[0]);
         return str;
     }
 
@@ -56,10 +359,23 @@ namespace fleece { namespace base64 {
         size_t expectedLen = (b64.size + 3) / 4 * 3;
         if (expectedLen > bufferSize)
             return nullslice;
-        ::base64::decoder dec;
-        size_t len = dec.decode(b64.buf, b64.size, outputBuffer);
-        assert(len <= bufferSize);
-        return slice(outputBuffer, len);
+        auto src = (const uint8_t*)b64.buf, srcEnd = src + b64.size;
+        auto dst = (uint8_t*)outputBuffer, dstEnd = dst + bufferSize;
+    #ifdef FL_BASE64_X86
+        int features = cpuFeatures();
+        if (features & kAVX2)
+            decodeAVX2(src, srcEnd, dst, dstEnd);
+        if (features & kSSSE3)
+            decodeSSSE3(src, srcEnd, dst, dstEnd);
+    #endif
+        decodeScalarBlocks(src, srcEnd, dst);
+        if (src < srcEnd) {
+            // Let libb64 handle padding, or any characters it ignores:
+            ::base64::decoder dec;
+            dst += dec.decode(src, srcEnd - src, dst);
+        }
+        assert(dst <= dstEnd);
+        return slice(outputBuffer, dst - (uint8_t*)outputBuffer);
     }
 
 } }
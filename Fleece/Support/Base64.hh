@@ -12,6 +12,13 @@ namespace fleece { namespace base64 {
     /** Encodes the data in the slice as base64. */
     std::string encode(slice);
 
+    /** The length of the base64 encoding of `size` bytes of data. */
+    static inline size_t encodedSize(size_t size)   {return (size + 2) / 3 * 4;}
+
+    /** Encodes the data in the slice as base64 into `outputBuffer`, which must have room for
+        `encodedSize(data.size)` bytes. Returns the number of bytes written. */
+    size_t encode(slice data, void *outputBuffer) noexcept;
+
     /** Decodes Base64 data from a slice into a new alloc_slice.
         On failure returns a null slice. */
     alloc_slice decode(slice);
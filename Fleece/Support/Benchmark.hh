@@ -18,7 +18,9 @@
 
 #pragma once
 #include "Stopwatch.hh"
+#include "PerfCounters.hh"
 #include <algorithm>
+#include <memory>
 #include <utility>
 #include <vector>
 #include "betterassert.hh"
@@ -26,11 +28,37 @@
 
 class Benchmark {
 public:
-    void start()        {_st.reset();}
+    /** If `hwCounters` is true, each sample also records the CPU's hardware performance
+        counters (see PerfCounters), if the system makes them available. */
+    explicit Benchmark(bool hwCounters =false) {
+        if (hwCounters) {
+            _counters.reset(new fleece::PerfCounters);
+            if (!_counters->available())
+                _counters.reset();
+        }
+    }
+
+    void start() {
+        if (_counters)
+            _counters->start();
+        _st.reset();
+    }
+
     double elapsed() const FLPURE    {return _st.elapsed();}
-    double stop()       {double t = elapsed(); _times.push_back(t); return t;}
+
+    double stop() {
+        double t = elapsed();
+        _times.push_back(t);
+        if (_counters)
+            _counts.push_back(_counters->stop());
+        return t;
+    }
+
+    /** True if hardware counters are being recorded. */
+    bool hasCounters() const FLPURE {return _counters != nullptr;}
 
     bool empty() const FLPURE  {return _times.empty();}
+    size_t count() const FLPURE {return _times.size();}
     void sort()         {assert(!empty()); std::sort(_times.begin(), _times.end());}
 
     double median() {
@@ -38,6 +66,16 @@ public:
         return _times[_times.size()/2];
     }
 
+    /** Returns the time at percentile `p` (0...100), interpolating between samples. */
+    double percentile(double p) {
+        sort();
+        double pos = (p / 100.0) * (_times.size() - 1);
+        size_t i = std::min((size_t)pos, _times.size() - 1);
+        if (i + 1 >= _times.size())
+            return _times[i];
+        return _times[i] + (pos - i) * (_times[i+1] - _times[i]);
+    }
+
     double average() {
         sort();
         size_t n = _times.size(), skip = n / 10;
@@ -61,10 +99,24 @@ public:
         return {_times[0], _times[_times.size()-1]};
     }
 
-    void reset()        {_times.clear();}
+    /** Returns the median value of a hardware counter over all samples, or 0 if none. */
+    double counterMedian(fleece::PerfCounters::Counter c) const {
+        if (_counts.empty())
+            return 0;
+        std::vector<uint64_t> values;
+        values.reserve(_counts.size());
+        for (auto &counts : _counts)
+            values.push_back(counts[c]);
+        auto mid = values.begin() + values.size()/2;
+        std::nth_element(values.begin(), mid, values.end());
+        return double(*mid);
+    }
+
+    void reset()        {_times.clear(); _counts.clear();}
 
     void printReport(double scale =1.0, const char *items =nullptr) {
         auto r = range();
+        double perItem = scale;
 
         std::string scaleName;
         const char* kTimeScales[] = {"sec", "ms", "us", "ns"};
@@ -83,9 +135,22 @@ public:
         fprintf(stderr, "Median %7.3f %s; mean %7.3f; std dev %5.3g; range (%7.3f ... %7.3f)\n",
                 median()*scale, scaleName.c_str(), average()*scale, stddev()*scale,
                 r.first*scale, r.second*scale);
+
+        if (!_counts.empty()) {
+            using PC = fleece::PerfCounters;
+            double cycles = counterMedian(PC::kCycles), instrs = counterMedian(PC::kInstructions);
+            fprintf(stderr, "       %.0f cycles, %.0f instructions (IPC %.2f), "
+                            "%.1f cache misses, %.1f branch misses /%s\n",
+                    cycles*perItem, instrs*perItem, (cycles > 0 ? instrs / cycles : 0.0),
+                    counterMedian(PC::kCacheMisses)*perItem,
+                    counterMedian(PC::kBranchMisses)*perItem,
+                    (items ? items : "op"));
+        }
     }
 
 private:
     fleece::Stopwatch _st;
     std::vector<double> _times;
+    std::unique_ptr<fleece::PerfCounters> _counters;
+    std::vector<fleece::PerfCounters::Counts> _counts;
 };
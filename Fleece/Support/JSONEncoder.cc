@@ -146,7 +146,9 @@ namespace fleece { namespace impl {
                 writeBool(v->asBool());
                 break;
             case kNumber:
-                if (v->isInteger()) {
+                if (v->isTimestamp()) {
+                    writeDateString(v->asTimestamp(), true);
+                } else if (v->isInteger()) {
                     auto i = v->asInt();
                     if (v->isUnsigned())
                         writeUInt(i);
@@ -161,9 +163,15 @@ namespace fleece { namespace impl {
             case kString:
                 writeString(v->asString());
                 break;
-            case kData:
-                writeData(v->asData());
+            case kData: {
+                bool isString;
+                slice content = v->resolveBlob(&isString);
+                if (isString)
+                    writeString(content);
+                else
+                    writeData(content);
                 break;
+            }
             case kArray:
                 beginArray();
                 for (auto iter = v->asArray()->begin(); iter; ++iter)
@@ -23,6 +23,7 @@
 #include "FleeceException.hh"
 #include "NumConversion.hh"
 #include <stdio.h>
+#include <type_traits>
 
 
 namespace fleece { namespace impl {
@@ -60,6 +61,7 @@ namespace fleece { namespace impl {
         void writeString(const std::string &s)  {writeString(slice(s));}
         void writeString(slice s);
         void writeDateString(int64_t timestamp, bool asUTC);
+        void writeTimestamp(int64_t timestamp)  {writeDateString(timestamp, true);}
         
         void writeData(slice d)                 {comma(); _out << '"'; _out.writeBase64(d);
                                                           _out << '"';}
@@ -105,6 +107,20 @@ namespace fleece { namespace impl {
         // Just for API compatibility with Encoder class:
         void beginArray(size_t)                       {beginArray();}
         void beginDictionary(size_t)                  {beginDictionary();}
+
+        template <class T>
+        void writeTypedArray(const T *values, size_t count) {
+            beginArray();
+            for (size_t i = 0; i < count; ++i) {
+                if constexpr (std::is_same<T, float>::value)
+                    writeFloat(values[i]);
+                else if constexpr (std::is_floating_point<T>::value)
+                    writeDouble(values[i]);
+                else
+                    writeInt(values[i]);
+            }
+            endArray();
+        }
         void writeUndefined() {
             FleeceException::_throw(JSONError, "Cannot write `undefined` to JSON encoder");
         }
@@ -0,0 +1,282 @@
+//
+// KeyTree.cc
+//
+// Copyright (c) 2016 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "KeyTree.hh"
+#include "Endian.hh"
+#include "FleeceException.hh"
+#include "varint.hh"
+#include "slice_stream.hh"
+#include "PlatformCompat.hh"
+#include <algorithm>
+#include "betterassert.hh"
+
+namespace fleece {
+    using namespace std;
+
+
+    // Data format of a KeyTree image (all fixed-width integers are little-endian):
+    //
+    // magic                    4 bytes: "FlKT"
+    // count                    uint32: number of strings
+    // tree size                uint32: size in bytes of the tree
+    // offsets                  `count` entries of uint16, or uint32 if tree size > 0xFFFF;
+    //                          entry i is the offset in the tree of the node whose id is i+1
+    // [root node]
+    //
+    // Data format of a tree node is:
+    // string length            varint
+    // string                   variable
+    // id                       varint
+    // child info               varint: (size of left subtree << 1) | (1 if right subtree exists)
+    // [left subtree]
+    // [right subtree]
+    //
+    // Nodes are in preorder, so the left child (if any) immediately follows its parent, and the
+    // right child (if any) follows the left subtree.
+
+    static constexpr uint8_t kMagic[4] = {'F', 'l', 'K', 'T'};
+    static constexpr size_t kHeaderSize = 12;
+
+
+    static inline size_t offsetWidthFor(size_t treeSize) {
+        return (treeSize <= 0xFFFF) ? 2 : 4;
+    }
+
+
+#pragma mark - WRITING:
+
+    class keyTreeWriter {
+    public:
+        keyTreeWriter(const vector<slice> &strings)
+        :_strings(strings)
+        ,_sorted(strings.size())
+        ,_sizes(strings.size())
+        ,_offsets(strings.size())
+        {
+            throwIf(strings.size() > UINT32_MAX, InvalidData, "Too many strings for a KeyTree");
+            for (uint32_t i = 0; i < _sorted.size(); ++i)
+                _sorted[i] = i;
+            sort(_sorted.begin(), _sorted.end(), [&](uint32_t a, uint32_t b) {
+                return _strings[a] < _strings[b];
+            });
+            for (size_t i = 1; i < _sorted.size(); ++i)
+                throwIf(_strings[_sorted[i]] == _strings[_sorted[i-1]], InvalidData,
+                        "Duplicate string in KeyTree");
+        }
+
+        alloc_slice writeTree() {
+            auto n = _sorted.size();
+            size_t treeSize = n ? sizeKeyTree(0, n) : 0;
+            throwIf(treeSize > UINT32_MAX, InvalidData, "KeyTree too large");
+            size_t width = offsetWidthFor(treeSize);
+            alloc_slice output(kHeaderSize + n * width + treeSize);
+
+            slice_ostream out(output);
+            out.write(kMagic, sizeof(kMagic));
+            writeUInt32(out, uint32_t(n));
+            writeUInt32(out, uint32_t(treeSize));
+            uint8_t *offsetTable = (uint8_t*)out.next();
+            out.advance(n * width);
+
+            _treeStart = (uint8_t*)out.next();
+            if (n > 0)
+                writeKeyTree(out, 0, n);
+            assert_postcondition(out.next() == output.end());
+
+            for (size_t i = 0; i < n; ++i) {
+                if (width == 2) {
+                    uint16_t o = endian::encLittle16(uint16_t(_offsets[i]));
+                    memcpy(offsetTable + 2*i, &o, 2);
+                } else {
+                    uint32_t o = endian::encLittle32(_offsets[i]);
+                    memcpy(offsetTable + 4*i, &o, 4);
+                }
+            }
+            return output;
+        }
+
+    private:
+        static void writeUInt32(slice_ostream &out, uint32_t n) {
+            n = endian::encLittle32(n);
+            out.write(&n, sizeof(n));
+        }
+
+        size_t nodeHeaderSize(size_t mid, size_t leftSize, bool hasRight) const {
+            slice str = _strings[_sorted[mid]];
+            return SizeOfVarInt(str.size) + str.size
+                 + SizeOfVarInt(_sorted[mid] + 1)
+                 + SizeOfVarInt((leftSize << 1) | hasRight);
+        }
+
+        // Same logic as writeKeyTree, but just returns the size it would write, without writing.
+        size_t sizeKeyTree(size_t begin, size_t end) {
+            size_t mid = (begin + end) / 2;
+            size_t leftSize = (mid > begin) ? sizeKeyTree(begin, mid) : 0;
+            size_t rightSize = (mid + 1 < end) ? sizeKeyTree(mid + 1, end) : 0;
+            size_t size = nodeHeaderSize(mid, leftSize, rightSize > 0) + leftSize + rightSize;
+            _sizes[mid] = size;
+            return size;
+        }
+
+        void writeKeyTree(slice_ostream &out, size_t begin, size_t end) {
+            size_t mid = (begin + end) / 2;
+            uint32_t index = _sorted[mid];
+            slice str = _strings[index];
+            size_t leftSize = (mid > begin) ? _sizes[(begin + mid) / 2] : 0;
+            bool hasRight = (mid + 1 < end);
+
+            _offsets[index] = uint32_t((uint8_t*)out.next() - _treeStart);
+            out.writeUVarInt(str.size);
+            out.write(str);
+            out.writeUVarInt(index + 1);
+            out.writeUVarInt((leftSize << 1) | hasRight);
+            if (mid > begin)
+                writeKeyTree(out, begin, mid);
+            if (hasRight)
+                writeKeyTree(out, mid + 1, end);
+        }
+
+        const vector<slice> &_strings;
+        vector<uint32_t> _sorted;           // Indexes of _strings, in sorted order
+        vector<size_t> _sizes;              // Size of subtree rooted at each sorted index
+        vector<uint32_t> _offsets;          // Tree offset of each string's node, by index
+        const uint8_t* _treeStart {nullptr};
+    };
+    
+
+    alloc_slice KeyTree::encode(const vector<slice> &strings) {
+        return keyTreeWriter(strings).writeTree();
+    }
+
+
+    KeyTree KeyTree::fromStrings(const vector<slice> &strings) {
+        return KeyTree(encode(strings));
+    }
+
+
+#pragma mark - READING:
+
+
+    KeyTree::KeyTree(slice encoded)
+    :_data(encoded)
+    {
+        throwIf(encoded.size < kHeaderSize || memcmp(encoded.buf, kMagic, sizeof(kMagic)) != 0,
+                InvalidData, "Not a KeyTree");
+        uint32_t count, treeSize;
+        memcpy(&count,    encoded.offset(4), 4);
+        memcpy(&treeSize, encoded.offset(8), 4);
+        count = endian::decLittle32(count);
+        treeSize = endian::decLittle32(treeSize);
+        size_t width = offsetWidthFor(treeSize);
+        throwIf(encoded.size != kHeaderSize + uint64_t(count) * width + treeSize,
+                InvalidData, "KeyTree has wrong size");
+        throwIf(count > 0 && treeSize == 0, InvalidData, "KeyTree is missing its tree");
+        _count = count;
+        _offsetWidth = uint8_t(width);
+        _offsets = (const uint8_t*)encoded.offset(kHeaderSize);
+        _tree = _offsets + count * width;
+        _treeSize = treeSize;
+    }
+
+
+    KeyTree::KeyTree(alloc_slice encoded)
+    :KeyTree(slice(encoded))
+    {
+        _ownedData = move(encoded);
+    }
+
+
+    // Reads a varint, returning false if it's invalid or extends past `end`.
+    // (This is inlined, unlike GetUVarInt32's multi-byte case, since ids and subtree sizes are
+    // usually two or three bytes long.)
+    static inline bool readVarInt(const uint8_t* &p, const uint8_t *end, uint32_t &n) {
+        uint32_t result = 0;
+        for (unsigned shift = 0; shift < 32 && p < end; shift += 7) {
+            uint8_t byte = *p++;
+            result |= uint32_t(byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                n = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    // Reads a length-prefixed string, returning nullslice if it's invalid.
+    static inline slice readKey(const uint8_t* &p, const uint8_t *end) {
+        uint32_t len;
+        if (_usuallyFalse(!readVarInt(p, end, len) || len > size_t(end - p)))
+            return nullslice;
+        slice key(p, len);
+        p += len;
+        return key;
+    }
+
+
+    __hot unsigned KeyTree::operator[] (slice str) const noexcept {
+        if (_usuallyFalse(_count == 0))
+            return 0;
+        const uint8_t *node = _tree, *end = _tree + _treeSize;
+        while (true) {
+            slice key = readKey(node, end);
+            uint32_t id, childInfo;
+            if (_usuallyFalse(!key.buf || !readVarInt(node, end, id)
+                                       || !readVarInt(node, end, childInfo)))
+                return 0; // parse error
+            int cmp = str.compare(key);
+            if (cmp == 0)
+                return id;
+            size_t leftSize = childInfo >> 1;
+            if (cmp < 0) {
+                if (leftSize == 0)
+                    return 0;
+            } else {
+                if (!(childInfo & 1) || leftSize >= size_t(end - node))
+                    return 0;
+                node += leftSize;
+            }
+            // (`node` strictly increases, so even a corrupt tree can't cause an infinite loop.)
+        }
+    }
+
+
+    __hot slice KeyTree::operator[] (unsigned id) const noexcept {
+        if (_usuallyFalse(id == 0 || id > _count))
+            return nullslice;
+        size_t offset;
+        if (_offsetWidth == 2) {
+            uint16_t o;
+            memcpy(&o, _offsets + 2*(id-1), 2);
+            offset = endian::decLittle16(o);
+        } else {
+            uint32_t o;
+            memcpy(&o, _offsets + 4*(id-1), 4);
+            offset = endian::decLittle32(o);
+        }
+        if (_usuallyFalse(offset >= _treeSize))
+            return nullslice;
+        const uint8_t *node = _tree + offset, *end = _tree + _treeSize;
+        slice key = readKey(node, end);
+        uint32_t nodeID;
+        if (_usuallyFalse(!key.buf || !readVarInt(node, end, nodeID) || nodeID != id))
+            return nullslice;
+        return key;
+    }
+
+}
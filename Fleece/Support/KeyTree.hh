@@ -0,0 +1,81 @@
+//
+// KeyTree.hh
+//
+// Copyright (c) 2016 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "fleece/slice.hh"
+#include <vector>
+
+namespace fleece {
+
+    /** A compact, immutable dictionary of strings (or arbitrary blobs) that bidirectionally maps
+        each one to an integer id in the range 1...n.
+
+        It's stored as a single contiguous image that can be written to a file and later used in
+        place (e.g. memory-mapped) with no parsing or index-building, so opening one takes
+        constant time regardless of its size. Mapping an id to a string is O(1); mapping a string
+        to an id is O(log n), by descending a balanced binary search tree. The storage overhead
+        beyond the strings themselves is about 6 bytes per string.
+
+        All reads are bounds-checked, so a corrupted image results in failed lookups, never in
+        out-of-bounds accesses. */
+    class KeyTree {
+    public:
+        /** Constructs an empty tree. */
+        KeyTree() =default;
+
+        /** Uses an encoded image in place, without copying it. The memory must remain valid and
+            unchanged as long as this object is in use.
+            Throws InvalidData if the data doesn't have a valid KeyTree header. */
+        explicit KeyTree(slice encodedData);
+
+        /** Uses an encoded image in place, retaining it. */
+        explicit KeyTree(alloc_slice encodedData);
+
+        /** Creates a KeyTree from a list of strings; the id of `strings[i]` will be `i+1`.
+            Throws InvalidData if a string appears twice. */
+        static KeyTree fromStrings(const std::vector<slice> &strings);
+
+        /** Same as `fromStrings`, but just returns the encoded image. */
+        static alloc_slice encode(const std::vector<slice> &strings);
+
+        /** The number of strings; ids run from 1 to this number. */
+        unsigned count() const                  {return _count;}
+
+        /** Returns the id of a string, or 0 if it's not present. */
+        unsigned operator[] (slice str) const noexcept;
+
+        /** Returns the string with the given id, or nullslice if the id is out of range. */
+        slice operator[] (unsigned id) const noexcept;
+
+        /** The encoded image, suitable for writing to a file. */
+        slice encodedData() const               {return _data;}
+
+        explicit operator bool() const          {return _data.buf != nullptr;}
+
+    private:
+        alloc_slice     _ownedData;             // Set if I retain my data
+        slice           _data;                  // The entire image
+        const uint8_t*  _offsets {nullptr};     // Table mapping id-1 to node offset
+        const uint8_t*  _tree {nullptr};        // Start of the root node
+        size_t          _treeSize {0};          // Size of the tree in bytes
+        unsigned        _count {0};             // Number of strings
+        uint8_t         _offsetWidth {0};       // Size of an _offsets entry: 2 or 4 bytes
+    };
+
+}
@@ -0,0 +1,165 @@
+//
+// LZ4.cc
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#include "LZ4.hh"
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+namespace fleece { namespace lz4 {
+
+    static constexpr size_t kMinMatch     = 4;      // Shortest match that can be encoded
+    static constexpr size_t kLastLiterals = 5;      // The last 5 bytes are always literals
+    static constexpr size_t kMFLimit      = 12;     // No match may start in the last 12 bytes
+    static constexpr size_t kMaxOffset    = 65535;
+    static constexpr int    kHashLog      = 12;
+
+
+    static inline uint32_t read32(const uint8_t *p) {
+        uint32_t n;
+        memcpy(&n, p, 4);
+        return n;
+    }
+
+    static inline uint32_t hash(uint32_t seq) {
+        return (seq * 2654435761u) >> (32 - kHashLog);
+    }
+
+    // Writes a length that didn't fit in a token's 4 bits, as a run of 255s plus a remainder.
+    static inline uint8_t* writeLength(uint8_t *out, size_t len) {
+        for (; len >= 255; len -= 255)
+            *out++ = 255;
+        *out++ = uint8_t(len);
+        return out;
+    }
+
+    // Writes one sequence: literals followed by a match (unless `matchLen` is 0.)
+    // Returns null if it won't fit.
+    static uint8_t* writeSequence(uint8_t *out, uint8_t *outEnd,
+                                  const uint8_t *literals, size_t litLen,
+                                  size_t offset, size_t matchLen)
+    {
+        if ((size_t)(outEnd - out) < 1 + litLen / 255 + 1 + litLen + 2 + matchLen / 255 + 1)
+            return nullptr;
+        uint8_t *token = out++;
+        *token = uint8_t(std::min(litLen, size_t(15)) << 4);
+        if (litLen >= 15)
+            out = writeLength(out, litLen - 15);
+        memcpy(out, literals, litLen);
+        out += litLen;
+        if (matchLen > 0) {
+            *out++ = uint8_t(offset);
+            *out++ = uint8_t(offset >> 8);
+            matchLen -= kMinMatch;
+            *token |= uint8_t(std::min(matchLen, size_t(15)));
+            if (matchLen >= 15)
+                out = writeLength(out, matchLen - 15);
+        }
+        return out;
+    }
+
+
+    size_t compress(slice input, void *output, size_t outputSize) noexcept {
+        auto src = (const uint8_t*)input.buf, end = src + input.size;
+        auto out = (uint8_t*)output, outEnd = out + outputSize;
+        const uint8_t *anchor = src;            // Start of the literals not yet written
+
+        if (input.size > kMFLimit) {
+            uint32_t table[1 << kHashLog] = {};   // Maps hash of 4 bytes to their last position
+            const uint8_t *matchLimit = end - kLastLiterals;
+            const uint8_t *lastMatchStart = end - kMFLimit;
+            const uint8_t *ip = src + 1;
+            unsigned misses = 0;
+            while (ip <= lastMatchStart) {
+                uint32_t seq = read32(ip);
+                uint32_t h = hash(seq);
+                const uint8_t *ref = src + table[h];
+                table[h] = uint32_t(ip - src);
+                if (ref >= ip || size_t(ip - ref) > kMaxOffset || read32(ref) != seq) {
+                    // No match; skip ahead faster the longer it's been since the last match:
+                    ip += 1 + (misses++ >> 6);
+                    continue;
+                }
+                misses = 0;
+                // Extend the match backwards over pending literals, then forwards:
+                while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                    --ip;
+                    --ref;
+                }
+                const uint8_t *matchEnd = ip + kMinMatch, *refEnd = ref + kMinMatch;
+                while (matchEnd < matchLimit && *matchEnd == *refEnd) {
+                    ++matchEnd;
+                    ++refEnd;
+                }
+                out = writeSequence(out, outEnd, anchor, ip - anchor, ip - ref, matchEnd - ip);
+                if (!out)
+                    return 0;
+                ip = anchor = matchEnd;
+                if (ip <= lastMatchStart)
+                    table[hash(read32(ip - 2))] = uint32_t(ip - 2 - src);
+            }
+        }
+
+        out = writeSequence(out, outEnd, anchor, end - anchor, 0, 0);
+        return out ? out - (uint8_t*)output : 0;
+    }
+
+
+    bool decompress(slice input, void *output, size_t outputSize) noexcept {
+        auto ip = (const uint8_t*)input.buf, inEnd = ip + input.size;
+        auto out = (uint8_t*)output, outStart = out, outEnd = out + outputSize;
+
+        // Reads an extended length; returns false on overflow or running out of input.
+        auto readLength = [&](size_t &len) {
+            uint8_t b;
+            do {
+                if (ip >= inEnd)
+                    return false;
+                b = *ip++;
+                len += b;
+            } while (b == 255 && len < outputSize);
+            return b != 255;
+        };
+
+        while (ip < inEnd) {
+            uint8_t token = *ip++;
+            size_t litLen = token >> 4;
+            if (litLen == 15 && !readLength(litLen))
+                return false;
+            if (litLen > size_t(inEnd - ip) || litLen > size_t(outEnd - out))
+                return false;
+            memcpy(out, ip, litLen);
+            ip += litLen;
+            out += litLen;
+            if (ip == inEnd)
+                break;                          // The last sequence has no match
+
+            if (inEnd - ip < 2)
+                return false;
+            size_t offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > size_t(out - outStart))
+                return false;
+            size_t matchLen = token & 0x0F;
+            if (matchLen == 15 && !readLength(matchLen))
+                return false;
+            matchLen += kMinMatch;
+            if (matchLen > size_t(outEnd - out))
+                return false;
+            const uint8_t *ref = out - offset;
+            if (offset >= matchLen) {
+                memcpy(out, ref, matchLen);
+                out += matchLen;
+            } else {
+                // Overlapping match, e.g. a repeated byte; copy one byte at a time:
+                for (size_t i = 0; i < matchLen; ++i)
+                    *out++ = ref[i];
+            }
+        }
+        return out == outEnd;
+    }
+
+} }
@@ -0,0 +1,29 @@
+//
+// LZ4.hh
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "fleece/slice.hh"
+
+namespace fleece { namespace lz4 {
+
+    // A compact implementation of the LZ4 block format
+    // <https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md>. Its output can be
+    // decompressed by the reference LZ4 library, and vice versa. It's tuned for speed, not ratio.
+
+    /** The largest possible size of the compressed form of `inputSize` bytes. */
+    static inline size_t maxCompressedSize(size_t inputSize) {
+        return inputSize + inputSize / 255 + 16;
+    }
+
+    /** Compresses `input` into `output`, returning the compressed size, or 0 if it doesn't fit.
+        `output` will always be big enough if its size is `maxCompressedSize(input.size)`. */
+    size_t compress(slice input, void *output, size_t outputSize) noexcept;
+
+    /** Decompresses `input` into `output`, whose size must be exactly the size of the original
+        data. Returns false if the input is invalid or doesn't decompress to exactly that size. */
+    bool decompress(slice input, void *output, size_t outputSize) noexcept;
+
+} }
@@ -17,13 +17,22 @@
 //
 
 #include "NumConversion.hh"
+#include "PowersOf5.hh"
+#include "endianness.h"
 #include "SwiftDtoa.h"
 #include <ctype.h>
+#include <float.h>
 #include <locale.h>
 #include <stdlib.h>
 #if !defined(_MSC_VER) && !defined(__GLIBC__)
 #include <xlocale.h>
 #endif
+#include <string.h>
+#include <algorithm>
+#include <string>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
 
 namespace fleece {
 
@@ -92,7 +101,8 @@ namespace fleece {
     }
 
 
-    double ParseDouble(const char *str) noexcept {
+    // Calls strtod using the C locale. This is the slow-but-always-correct fallback.
+    static double strtodC(const char *str NONNULL) noexcept {
         // strtod is locale-aware, so in some locales it will not interpret '.' as a decimal point.
         // To work around that, use the C locale explicitly.
         #ifdef LC_C_LOCALE          // Apple & BSD
@@ -113,6 +123,291 @@ namespace fleece {
     }
 
 
+    namespace num {
+
+        // A decimal number in the form `mantissa * 10^exponent`, as scanned from a string.
+        struct Decimal {
+            uint64_t mantissa {0};
+            int64_t  exponent {0};
+            bool     negative {false};
+            bool     exact {true};          // false if there were more than 19 significant digits
+        };
+
+
+        static inline bool isDigit(char c)  {return uint8_t(c - '0') < 10;}
+
+
+        // Adds as many runs of 8 digits as possible to `m`, eight at a time, using SWAR
+        // arithmetic on 64-bit words. <https://lemire.me/blog/2022/01/21/swar-explained-parsing-eight-digits/>
+        static inline const char* scan8Digits(const char *p, const char *end, uint64_t &m) {
+        #ifdef __LITTLE_ENDIAN__
+            while (end - p >= 8) {
+                uint64_t val;
+                memcpy(&val, p, 8);
+                if (((val & 0xF0F0F0F0F0F0F0F0)
+                        | (((val + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+                                != 0x3333333333333333)
+                    break;
+                val -= 0x3030303030303030;
+                val = (val * 10) + (val >> 8);
+                val = (((val & 0x000000FF000000FF) * 0x000F424000000064)
+                       + (((val >> 16) & 0x000000FF000000FF) * 0x0000271000000001)) >> 32;
+                m = 100000000 * m + uint32_t(val);
+                p += 8;
+            }
+        #endif
+            return p;
+        }
+
+
+        // Scans a decimal floating-point number: optional sign, digits, optional '.' and digits,
+        // optional exponent. Returns a pointer to the first character after the number, or null
+        // if there is no number (or it's something unusual like "inf", which strtod handles.)
+        static const char* scanDecimal(const char *str, const char *end, Decimal &num) {
+            const char *p = str;
+            if (p < end && (*p == '-' || *p == '+')) {
+                num.negative = (*p == '-');
+                ++p;
+            }
+
+            uint64_t m = 0;
+            const char *digits = p;
+            p = scan8Digits(p, end, m);
+            while (p < end && isDigit(*p))
+                m = 10 * m + (*p++ - '0');           // may overflow; checked below
+            const char *intEnd = p;
+            int64_t nDigits = intEnd - digits;
+            int64_t exponent = 0;
+            if (p < end && *p == '.') {
+                ++p;
+                const char *frac = p;
+                p = scan8Digits(p, end, m);
+                while (p < end && isDigit(*p))
+                    m = 10 * m + (*p++ - '0');
+                exponent = -(p - frac);
+                nDigits += (p - frac);
+            }
+            if (nDigits == 0)
+                return nullptr;
+            if (_usuallyFalse(intEnd - digits == 1 && *digits == '0' && p < end && (*p|0x20) == 'x'))
+                return nullptr;     // hex
+
+            if (p < end && (*p | 0x20) == 'e') {
+                const char *e = p + 1;
+                bool negExp = false;
+                if (e < end && (*e == '-' || *e == '+')) {
+                    negExp = (*e == '-');
+                    ++e;
+                }
+                if (e < end && isDigit(*e)) {
+                    int64_t expNum = 0;
+                    while (e < end && isDigit(*e)) {
+                        if (expNum < 0x10000000)    // clamp; anything this big is 0 or infinity
+                            expNum = 10 * expNum + (*e - '0');
+                        ++e;
+                    }
+                    exponent += negExp ? -expNum : expNum;
+                    p = e;
+                }
+                // else the 'e' isn't part of the number
+            }
+
+            if (_usuallyFalse(nDigits > 19)) {
+                // The mantissa may have overflowed; but leading zeroes don't count:
+                for (const char *d = digits; d < p && (*d == '0' || *d == '.'); ++d)
+                    if (*d == '0')
+                        --nDigits;
+                if (nDigits > 19)
+                    num.exact = false;
+            }
+            num.mantissa = m;
+            num.exponent = exponent;
+            return p;
+        }
+
+
+        // Full 64x64->128 bit multiplication.
+        static inline void multiply128(uint64_t a, uint64_t b, uint64_t &hi, uint64_t &lo) {
+        #if defined(__SIZEOF_INT128__)
+            unsigned __int128 r = (unsigned __int128)a * b;
+            hi = uint64_t(r >> 64);
+            lo = uint64_t(r);
+        #elif defined(_MSC_VER) && defined(_M_X64)
+            lo = _umul128(a, b, &hi);
+        #else
+            uint64_t aLo = uint32_t(a), aHi = a >> 32, bLo = uint32_t(b), bHi = b >> 32;
+            uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+            uint64_t mid = (ll >> 32) + uint32_t(lh) + uint32_t(hl);
+            lo = (mid << 32) | uint32_t(ll);
+            hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+        #endif
+        }
+
+
+        static inline int leadingZeroes(uint64_t n) {
+        #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_clzll(n);
+        #else
+            int count = 0;
+            while (!(n & 0x8000000000000000)) {
+                n <<= 1;
+                ++count;
+            }
+            return count;
+        #endif
+        }
+
+
+        static inline double makeDouble(bool negative, uint64_t mantissa, uint64_t power2) {
+            uint64_t bits = mantissa | (power2 << 52) | (uint64_t(negative) << 63);
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            return d;
+        }
+
+
+        // Powers of ten that are exactly representable as doubles.
+        static constexpr double kExactPowersOf10[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+
+        // Converts a Decimal to the nearest double. Returns false if this can't be done exactly,
+        // in which case the caller needs to fall back to strtod.
+        //
+        // First tries Clinger's fast path: if the mantissa and the power of ten are both exactly
+        // representable, a single IEEE multiply or divide is correctly rounded.
+        // Otherwise uses the Eisel-Lemire algorithm: multiply the mantissa by a 128-bit
+        // approximation of the power of ten, and take the top bits -- which is correctly rounded
+        // except in rare borderline cases that it detects.
+        // <https://arxiv.org/abs/2101.11408>
+        static bool toDouble(const Decimal &num, double &result) {
+            uint64_t w = num.mantissa;
+            int64_t q = num.exponent;
+            if (w == 0 || q < kSmallestPowerOf5) {
+                result = num.negative ? -0.0 : 0.0;
+                return true;
+            } else if (q > kLargestPowerOf5) {
+                result = makeDouble(num.negative, 0, 0x7FF);
+                return true;
+            }
+
+        #if FLT_EVAL_METHOD == 0
+            if (w <= (uint64_t(1) << 53) && q >= -22 && q <= 22) {
+                double d = double(w);
+                if (q < 0)
+                    d /= kExactPowersOf10[-q];
+                else
+                    d *= kExactPowersOf10[q];
+                result = num.negative ? -d : d;
+                return true;
+            }
+        #endif
+
+            int lz = leadingZeroes(w);
+            w <<= lz;
+
+            // Multiply by the 128-bit power of five; only the high 55 bits of the product matter,
+            // and the second multiplication is needed only if the first leaves them uncertain.
+            const uint64_t *pow5 = &kPowersOf5[2 * (q - kSmallestPowerOf5)];
+            uint64_t hi, lo;
+            multiply128(w, pow5[0], hi, lo);
+            constexpr uint64_t kPrecisionMask = UINT64_MAX >> 55;
+            if ((hi & kPrecisionMask) == kPrecisionMask) {
+                uint64_t hi2, lo2;
+                multiply128(w, pow5[1], hi2, lo2);
+                lo += hi2;
+                if (hi2 > lo)
+                    ++hi;
+                if (_usuallyFalse(lo == UINT64_MAX && (hi & kPrecisionMask) == kPrecisionMask))
+                    return false;       // Still ambiguous
+            }
+
+            int upperBit = int(hi >> 63);
+            int shift = upperBit + 64 - 52 - 3;
+            uint64_t mantissa = hi >> shift;
+            int64_t power2 = ((((152170 + 65536) * q) >> 16) + 63) + upperBit - lz + 1023;
+
+            if (power2 <= 0) {
+                // Subnormal:
+                if (-power2 + 1 >= 64) {
+                    result = num.negative ? -0.0 : 0.0;
+                    return true;
+                }
+                mantissa >>= -power2 + 1;
+                mantissa += (mantissa & 1);
+                mantissa >>= 1;
+                power2 = (mantissa < (uint64_t(1) << 52)) ? 0 : 1;
+                result = makeDouble(num.negative, mantissa & ~(uint64_t(1) << 52), power2);
+                return true;
+            }
+
+            // If we're exactly halfway between two doubles, round to even:
+            if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1) {
+                if ((mantissa << shift) == hi)
+                    mantissa &= ~uint64_t(1);
+            }
+            mantissa += (mantissa & 1);
+            mantissa >>= 1;
+            if (mantissa >= (uint64_t(2) << 52)) {
+                mantissa = (uint64_t(1) << 52);
+                ++power2;
+            }
+            mantissa &= ~(uint64_t(1) << 52);
+            if (power2 >= 0x7FF) {
+                power2 = 0x7FF;
+                mantissa = 0;
+            }
+            result = makeDouble(num.negative, mantissa, uint64_t(power2));
+            return true;
+        }
+
+    }
+
+
+    // Parses a number with the fast path, returning false if it can't. `numEnd` is set to the
+    // end of the number, or null if the input doesn't look like a decimal number.
+    static inline bool fastParseDouble(const char* &str, const char *end,
+                                       double &result, const char* &numEnd)
+    {
+        while (_usuallyFalse(str < end && isspace(*str)))
+            ++str;
+        num::Decimal decimal;
+        numEnd = num::scanDecimal(str, end, decimal);
+        return _usuallyTrue(numEnd != nullptr) && _usuallyTrue(decimal.exact)
+            && num::toDouble(decimal, result);
+    }
+
+
+    double ParseDouble(const char *str) noexcept {
+        const char *numEnd;
+        double result;
+        if (fastParseDouble(str, str + strlen(str), result, numEnd))
+            return result;
+        return strtodC(str);
+    }
+
+
+    double ParseDouble(const char *str, size_t length) noexcept {
+        const char *end = str + length, *numEnd;
+        double result;
+        if (fastParseDouble(str, end, result, numEnd))
+            return result;
+
+        // Fall back to strtod, which needs a NUL-terminated copy:
+        size_t numLength = numEnd ? (numEnd - str) : std::min(size_t(end - str), size_t(63));
+        if (numLength < 64) {
+            char buf[64];
+            memcpy(buf, str, numLength);
+            buf[numLength] = '\0';
+            return strtodC(buf);
+        } else {
+            return strtodC(std::string(str, numLength).c_str());
+        }
+    }
+
+
     size_t WriteFloat(float n, char *dst, size_t capacity) {
         return swift_format_float(n, dst, capacity);
     }
@@ -45,6 +45,11 @@ namespace fleece {
     /// (I.e. non-numeric characters after the digits are not treated as an error.)
     double ParseDouble(const char *str NONNULL) noexcept;
 
+    /// Parse a floating-point number from the first `length` bytes at `str`, which don't need to
+    /// be NUL-terminated; reading stops at the first character that isn't part of the number.
+    /// Most numbers are converted exactly without calling `strtod`.
+    double ParseDouble(const char *str NONNULL, size_t length) noexcept;
+
 
     /// Format a 64-bit-floating point number to a string.
     size_t WriteFloat(double n, char *dst, size_t capacity);
@@ -391,7 +391,7 @@ static int parseYyyyMmDd(const char *zDate, DateTime *p){
 
 namespace fleece {
 
-    int64_t ParseISO8601Date(const char* zDate) {
+    int64_t ParseISO8601DateGeneral(const char* zDate) {
         DateTime x;
         if (parseYyyyMmDd(zDate,&x))
             return kInvalidDate;
@@ -399,11 +399,36 @@ namespace fleece {
         return x.iJD - 210866760000000;
     }
 
+    int64_t ParseISO8601Date(const char* zDate) {
+        int64_t t = ParseISO8601DateFixed(slice(zDate));
+        if (_usuallyTrue(t != kInvalidDate))
+            return t;
+        return ParseISO8601DateGeneral(zDate);
+    }
+
     int64_t ParseISO8601Date(fleece::slice date) {
-        return ParseISO8601Date(string(date).c_str());
+        int64_t t = ParseISO8601DateFixed(date);
+        if (_usuallyTrue(t != kInvalidDate))
+            return t;
+        // The general parser wants a C string; avoid the heap for anything date-sized.
+        char buf[kFormattedISO8601DateMaxSize * 2];
+        if (date.size < sizeof(buf)) {
+            date.copyTo(buf);
+            buf[date.size] = 0;
+            return ParseISO8601DateGeneral(buf);
+        }
+        return ParseISO8601DateGeneral(string(date).c_str());
     }
 
     slice FormatISO8601Date(char buf[], int64_t time, bool asUTC) {
+        if (asUTC) {
+            if (slice result = FormatISO8601DateUTC(buf, time); result)
+                return result;
+        }
+        return FormatISO8601DateGeneral(buf, time, asUTC);
+    }
+
+    slice FormatISO8601DateGeneral(char buf[], int64_t time, bool asUTC) {
         if (time == kInvalidDate) {
             *buf = 0;
             return nullslice;
@@ -440,6 +465,161 @@ namespace fleece {
         return {buf, timestream.str().length()};
     }
 
+#pragma mark - FIXED-FORMAT FAST PATHS:
+
+
+    static constexpr int64_t kMillisPerDay = 86400 * 1000;
+
+    // Days since 1970-01-01 of a proleptic Gregorian date (Howard Hinnant's days_from_civil.)
+    static inline int64_t daysFromCivil(int y, unsigned m, unsigned d) noexcept {
+        y -= (m <= 2);
+        const int era = (y >= 0 ? y : y - 399) / 400;
+        const unsigned yoe = unsigned(y - era * 400);
+        const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return int64_t(era) * 146097 + int64_t(doe) - 719468;
+    }
+
+    // Inverse of daysFromCivil (Howard Hinnant's civil_from_days.)
+    static inline void civilFromDays(int64_t z, int &y, unsigned &m, unsigned &d) noexcept {
+        z += 719468;
+        const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        const unsigned doe = unsigned(z - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        d = doy - (153 * mp + 2) / 5 + 1;
+        m = mp < 10 ? mp + 3 : mp - 9;
+        y = int(int64_t(yoe) + era * 400 + (m <= 2));
+    }
+
+    static inline unsigned daysInMonth(int y, unsigned m) noexcept {
+        if (m == 2)
+            return (y % 4 != 0 || (y % 100 == 0 && y % 400 != 0)) ? 28 : 29;
+        return (LONG_MONTHS & (1 << m)) ? 31 : 30;
+    }
+
+    // Parses two ASCII digits, returning a value > 99 if either isn't a digit.
+    static inline unsigned digits2(const uint8_t *s) noexcept {
+        unsigned a = unsigned(s[0] - '0'), b = unsigned(s[1] - '0');
+        return (a > 9 || b > 9) ? 100 : a * 10 + b;
+    }
+
+    static inline void putDigits2(char *s, unsigned n) noexcept {
+        s[0] = char('0' + n / 10);
+        s[1] = char('0' + n % 10);
+    }
+
+
+    int64_t ParseISO8601DateFixed(slice str) noexcept {
+        // Shortest accepted form is "YYYY-MM-DDTHH:MM:SSZ":
+        auto s = (const uint8_t*)str.buf;
+        const size_t n = str.size;
+        if (n < 20 || s[4] != '-' || s[7] != '-' || (s[10] != 'T' && s[10] != ' ')
+                   || s[13] != ':' || s[16] != ':')
+            return kInvalidDate;
+        unsigned yHi = digits2(&s[0]), yLo = digits2(&s[2]), mon = digits2(&s[5]),
+                 day = digits2(&s[8]), hour = digits2(&s[11]), min = digits2(&s[14]),
+                 sec = digits2(&s[17]);
+        if (yHi > 99 || yLo > 99 || mon < 1 || mon > 12 || day < 1 || hour > 23 || min > 59
+                     || sec > 59)
+            return kInvalidDate;
+        int year = int(yHi * 100 + yLo);
+        if (day > 28 && day > daysInMonth(year, mon))
+            return kInvalidDate;
+
+        size_t pos = 19;
+        unsigned millis = 0;
+        if (s[pos] == '.') {
+            unsigned nDigits = 0;
+            while (++pos < n && unsigned(s[pos] - '0') <= 9) {
+                if (++nDigits > 3)
+                    return kInvalidDate;        // More precision than we round; not fixed format
+                millis = millis * 10 + (s[pos] - '0');
+            }
+            if (nDigits == 0)
+                return kInvalidDate;
+            for (; nDigits < 3; ++nDigits)
+                millis *= 10;
+        }
+
+        // Time zone is mandatory; without one the string is local time, which needs mktime.
+        if (pos >= n)
+            return kInvalidDate;
+        int tzMinutes = 0;
+        uint8_t c = s[pos];
+        if (c == 'Z' || c == 'z') {
+            ++pos;
+        } else if (c == '+' || c == '-') {
+            if (pos + 5 > n)
+                return kInvalidDate;
+            unsigned tzHour = digits2(&s[pos + 1]);
+            pos += 3;
+            if (s[pos] == ':' && pos + 3 <= n)
+                ++pos;
+            unsigned tzMin = digits2(&s[pos]);
+            pos += 2;
+            if (tzHour > 14 || tzMin > 59)
+                return kInvalidDate;
+            tzMinutes = int(tzHour * 60 + tzMin);
+            if (c == '-')
+                tzMinutes = -tzMinutes;
+        } else {
+            return kInvalidDate;
+        }
+        if (pos != n)
+            return kInvalidDate;
+
+        return daysFromCivil(year, mon, day) * kMillisPerDay
+             + ((hour * 60 + min) * 60 + sec) * int64_t(1000) + millis
+             - tzMinutes * int64_t(60000);
+    }
+
+
+    slice FormatISO8601DateUTC(char buf[], int64_t time) noexcept {
+        // Range of years 0000...9999, outside which the general formatter's output differs:
+        static constexpr int64_t kMinTime = -62167219200000, kMaxTime = 253402300799999;
+        if (time < kMinTime || time > kMaxTime)
+            return nullslice;
+        int64_t days = time / kMillisPerDay, msOfDay = time % kMillisPerDay;
+        if (msOfDay < 0) {
+            msOfDay += kMillisPerDay;
+            --days;
+        }
+        int year;
+        unsigned mon, day;
+        civilFromDays(days, year, mon, day);
+        unsigned secOfDay = unsigned(msOfDay / 1000), millis = unsigned(msOfDay % 1000);
+
+        char *s = buf;
+        putDigits2(&s[0], unsigned(year) / 100);
+        putDigits2(&s[2], unsigned(year) % 100);
+        s[4] = '-';
+        putDigits2(&s[5], mon);
+        s[7] = '-';
+        putDigits2(&s[8], day);
+        s[10] = 'T';
+        putDigits2(&s[11], secOfDay / 3600);
+        s[13] = ':';
+        putDigits2(&s[14], secOfDay / 60 % 60);
+        s[16] = ':';
+        putDigits2(&s[17], secOfDay % 60);
+        s += 19;
+        if (millis) {
+            *s++ = '.';
+            *s++ = char('0' + millis / 100);
+            putDigits2(s, millis % 100);
+            s += 2;
+        }
+        *s++ = 'Z';
+        *s = 0;
+        return {buf, size_t(s - buf)};
+    }
+
+
+#pragma mark - UTILITIES:
+
+
     struct tm FromTimestamp(seconds timestamp) {
         local_seconds tp { timestamp };
         auto dp = floor<days>(tp);
@@ -46,6 +46,20 @@ namespace fleece {
         @return  The formatted string (points to `buf`). */
     slice FormatISO8601Date(char buf[], int64_t timestamp, bool asUTC);
 
+    /** Allocation-free parser for the fixed layout `YYYY-MM-DDTHH:MM:SS[.fff](Z|±HH:MM|±HHMM)`,
+        which is what FormatISO8601Date produces. Returns kInvalidDate for anything else,
+        including strings that ParseISO8601Date would accept; ParseISO8601Date tries this first. */
+    int64_t ParseISO8601DateFixed(slice dateStr) noexcept;
+
+    /** Allocation-free formatter for UTC timestamps in years 0000-9999. Produces exactly the same
+        output as FormatISO8601Date with `asUTC` true, or returns nullslice if out of range. */
+    slice FormatISO8601DateUTC(char buf[], int64_t timestamp) noexcept;
+
+    /** The general-purpose parser and formatter, bypassing the fast paths above.
+        Exposed for tests and benchmarks. */
+    int64_t ParseISO8601DateGeneral(const char* dateStr);
+    slice FormatISO8601DateGeneral(char buf[], int64_t timestamp, bool asUTC);
+
     /** Creates a tm out of a timestamp, but it will not be fully valid until
         passed through mktime.
         @param timestamp  The timestamp to use
@@ -0,0 +1,137 @@
+//
+// PerfCounters.hh
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fleece {
+
+/** Hardware performance counters of the current thread -- CPU cycles, instructions retired,
+    cache misses and branch mispredictions -- read as a single group using Linux's
+    `perf_event_open`, so they all cover exactly the same interval.
+
+    On other platforms, or if the kernel won't allow access (common in containers and VMs, or
+    when `/proc/sys/kernel/perf_event_paranoid` is too high), `available()` returns false and
+    all counts read as zero. Individual counters the CPU doesn't support also read as zero. */
+class PerfCounters {
+public:
+    enum Counter {
+        kCycles,
+        kInstructions,
+        kCacheMisses,
+        kBranchMisses,
+        kNumCounters
+    };
+
+    static constexpr const char* kCounterNames[kNumCounters] = {
+        "cycles", "instructions", "cache-misses", "branch-misses"};
+
+    struct Counts {
+        uint64_t value[kNumCounters] = {};
+        uint64_t operator[] (Counter c) const       {return value[c];}
+    };
+
+    PerfCounters() {
+#ifdef __linux__
+        static constexpr uint64_t kConfigs[kNumCounters] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int c = 0; c < kNumCounters; ++c) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = kConfigs[c];
+            attr.disabled = (_leader < 0);          // only the leader starts disabled
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                                                 | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, _leader, 0);
+            if (fd < 0) {
+                if (_leader < 0)
+                    return;                         // no cycle counter; give up
+                continue;
+            }
+            if (_leader < 0)
+                _leader = fd;
+            _fds[_numOpen] = fd;
+            _counterAt[_numOpen++] = Counter(c);
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int i = 0; i < _numOpen; ++i)
+            close(_fds[i]);
+#endif
+    }
+
+    /** True if the counters can be read on this system. */
+    bool available() const                          {return _leader >= 0;}
+
+    /** Resets the counters to zero and starts counting. */
+    void start() {
+#ifdef __linux__
+        if (_leader >= 0) {
+            ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    /** Stops counting and returns the counts since `start()`. */
+    Counts stop() {
+        Counts counts;
+#ifdef __linux__
+        if (_leader >= 0) {
+            ioctl(_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            // Layout of a group read: {nr, time_enabled, time_running, value[nr]}
+            uint64_t buf[3 + kNumCounters];
+            if (read(_leader, buf, sizeof(buf)) >= ssize_t(3 * sizeof(uint64_t))) {
+                uint64_t nr = buf[0], enabled = buf[1], running = buf[2];
+                // If the kernel had to multiplex the counters, extrapolate:
+                double scale = (running > 0 && running < enabled) ? double(enabled) / running
+                                                                   : 1.0;
+                for (uint64_t i = 0; i < nr && i < uint64_t(_numOpen); ++i)
+                    counts.value[_counterAt[i]] = uint64_t(buf[3 + i] * scale);
+            }
+        }
+#endif
+        return counts;
+    }
+
+private:
+    PerfCounters(const PerfCounters&) =delete;
+    PerfCounters& operator=(const PerfCounters&) =delete;
+
+    int _leader {-1};                               // Group leader fd (cycles), or -1
+    int _fds[kNumCounters];                         // Open counter fds
+    Counter _counterAt[kNumCounters];               // Counter read at each group position
+    int _numOpen {0};                               // Number of open fds
+};
+
+}
@@ -39,6 +39,8 @@
 
     #define __printflike(A, B)
 
+    #define PREFETCH(addr)                  ((void)(addr))
+
     #define cbl_strdup _strdup
     #define cbl_getcwd _getcwd
 
@@ -79,6 +81,9 @@
     #define __printflike(fmtarg, firstvararg) __attribute__((__format__ (__printf__, fmtarg, firstvararg)))
     #endif
 
+    // Hints that the memory at `addr` will be read soon, so it can be loaded into the cache.
+    #define PREFETCH(addr)                  __builtin_prefetch(addr)
+
     // Windows has underscore prefixes before these function names, so define a common name
     #define cbl_strdup strdup
     #define cbl_getcwd getcwd
@@ -30,7 +30,14 @@ namespace fleece {
 
 #if !DEBUG
     __hot void RefCounted::_release() const noexcept {
-        if (--_refCount <= 0)
+        int32_t newRef;
+        if (_threadConfined) {
+            newRef = _refCount.load(std::memory_order_relaxed) - 1;
+            _refCount.store(newRef, std::memory_order_relaxed);
+        } else {
+            newRef = --_refCount;
+        }
+        if (newRef <= 0)
             delete this;
     }
 #endif
@@ -24,19 +24,35 @@
 
 namespace fleece {
 
+    // True while the current thread is in thread-confined mode (see ThreadConfinedScope);
+    // RefCounted objects and alloc_slice buffers created then use non-atomic ref-counting.
+    inline thread_local bool tThreadConfined = false;
+
+
     /** Simple thread-safe ref-counting implementation.
         `RefCounted` objects should be managed by \ref Retained smart-pointers:
         `Retained<Foo> foo = new Foo(...)` or `auto foo = make_retained<Foo>(...)`.
         \note The ref-count starts at 0, so you must call retain() on an instance, or assign it
-        to a Retained, right after constructing it. */
+        to a Retained, right after constructing it.
+        \note An object created while its thread is in thread-confined mode (see
+        \ref ThreadConfinedScope) uses cheaper non-atomic ref-counting, and must never be
+        retained or released by any other thread. The mode is captured by the constructor;
+        a class whose instances are meant to be shared between threads should construct its
+        RefCounted base with `RefCounted(false)` so they never are confined. */
     class RefCounted {
     public:
-        RefCounted()                            =default;
+        RefCounted()                            :_threadConfined(tThreadConfined) { }
         
         int refCount() const FLPURE             {return _refCount;}
 
+        /** True if this object was created in thread-confined mode. */
+        bool isThreadConfined() const FLPURE    {return _threadConfined;}
+
     protected:
-        RefCounted(const RefCounted &)          { }
+        /** Constructs an object that's thread-confined or not regardless of the current mode. */
+        explicit RefCounted(bool threadConfined) :_threadConfined(threadConfined) { }
+
+        RefCounted(const RefCounted &)          :_threadConfined(tThreadConfined) { }
 
         /** Destructor is accessible only so that it can be overridden.
             **Never call `delete`**, only `release`! Overrides should be made protected or private. */
@@ -52,7 +68,13 @@ namespace fleece {
         void _retain() const noexcept           {_careful_retain();}
         void _release() const noexcept          {_careful_release();}
 #else
-        ALWAYS_INLINE void _retain() const noexcept   { ++_refCount; }
+        ALWAYS_INLINE void _retain() const noexcept {
+            if (_threadConfined)
+                _refCount.store(_refCount.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_relaxed);
+            else
+                ++_refCount;
+        }
         void _release() const noexcept;
 #endif
 
@@ -60,6 +82,8 @@ namespace fleece {
         void _careful_retain() const noexcept;
         void _careful_release() const noexcept;
 
+        // (_threadConfined comes first so it fills padding instead of adding to the size.)
+        bool _threadConfined;                  // If true, _refCount is only touched by 1 thread
         mutable std::atomic<int32_t> _refCount
 #if DEBUG
                                                {kCarefulInitialRefCount};
@@ -69,6 +93,28 @@ namespace fleece {
     };
 
 
+    /** While an instance exists, the current thread is in _thread-confined mode_: RefCounted
+        objects and alloc_slice buffers created on it use non-atomic ref-counting, which makes
+        retaining and releasing them much cheaper. Such objects must stay on the thread that
+        created them for their entire lifetime. Objects created outside the scope (like a
+        long-lived SharedKeys) are unaffected and can still be used from inside it.
+        Scopes can be nested; see also FL_SetThreadConfined. */
+    class ThreadConfinedScope {
+    public:
+        ThreadConfinedScope(bool confined =true)
+        :_prev(tThreadConfined)
+        {tThreadConfined = confined;}
+
+        ~ThreadConfinedScope()                  {tThreadConfined = _prev;}
+
+        ThreadConfinedScope(const ThreadConfinedScope&) = delete;
+        ThreadConfinedScope& operator=(const ThreadConfinedScope&) = delete;
+
+    private:
+        bool const _prev;
+    };
+
+
     /** Retains a RefCounted object and returns the object. Does nothing given a null pointer.
         (See also `retain(Retained&&)`, below.)
         \warning Manual retain/release is error prone. This function is intended mostly for interfacing
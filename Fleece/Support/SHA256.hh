@@ -0,0 +1,45 @@
+//
+// SHA256.hh
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "fleece/slice.hh"
+#include <stdint.h>
+
+namespace fleece {
+
+    /** Incrementally computes a SHA-256 digest. */
+    class SHA256 {
+    public:
+        static constexpr size_t kDigestSize = 32;
+
+        struct Digest {
+            uint8_t bytes[kDigestSize];
+
+            slice asSlice() const                       {return {bytes, kDigestSize};}
+            bool operator== (const Digest &d) const     {return asSlice() == d.asSlice();}
+            bool operator!= (const Digest &d) const     {return !(*this == d);}
+        };
+
+        SHA256() noexcept;
+
+        /** Adds data to the digest. */
+        SHA256& operator<< (slice) noexcept;
+
+        /** Returns the digest of all the data added. Don't add any more data afterwards. */
+        Digest finish() noexcept;
+
+        /** Computes the digest of a single slice. */
+        static Digest compute(slice s) noexcept         {return (SHA256() << s).finish();}
+
+    private:
+        void processBlock(const uint8_t *block) noexcept;
+
+        uint32_t _state[8];
+        uint64_t _length {0};           // Total bytes added
+        uint8_t  _buffer[64];           // Partial block
+    };
+
+}
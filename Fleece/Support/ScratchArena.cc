@@ -0,0 +1,53 @@
+//
+// ScratchArena.cc
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#include "ScratchArena.hh"
+#include <algorithm>
+
+namespace fleece {
+    using namespace std;
+
+
+    void* ScratchArena::allocInNewChunk(size_t size) {
+        // Move to the next chunk; the ones after the current one are all unused. If there isn't
+        // one, or it's too small, allocate one, doubling the chunk size as the arena grows.
+        if (_cur == _chunks.size() || _chunks[_cur].size() < size) {
+            size_t chunkSize = _cur ? 2 * _chunks[_cur - 1].size() : _chunkSize;
+            chunkSize = max(chunkSize, size);
+            Chunk chunk;
+            chunk.start.reset(new uint8_t[chunkSize]);
+            chunk.end = chunk.start.get() + chunkSize;
+            if (_cur == _chunks.size())
+                _chunks.push_back(move(chunk));
+            else
+                _chunks[_cur] = move(chunk);
+            ++_chunkAllocations;
+        }
+        Chunk &chunk = _chunks[_cur++];
+        _next = chunk.start.get() + size;
+        _end = chunk.end;
+        return chunk.start.get();
+    }
+
+
+    void ScratchArena::trim(size_t maxBytes) noexcept {
+        assert_precondition(_cur == 0);
+        size_t total = capacity();
+        while (!_chunks.empty() && total > maxBytes) {
+            total -= _chunks.back().size();
+            _chunks.pop_back();
+        }
+    }
+
+
+    size_t ScratchArena::capacity() const noexcept {
+        size_t total = 0;
+        for (auto &chunk : _chunks)
+            total += chunk.size();
+        return total;
+    }
+
+}
@@ -0,0 +1,178 @@
+//
+// ScratchArena.hh
+//
+// Copyright © 2021 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "PlatformCompat.hh"
+#include "betterassert.hh"
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+namespace fleece {
+
+    /** A growable bump allocator for short-lived scratch memory, used in a stack-like fashion.
+
+        Unlike ConcurrentArena it's not thread-safe, so allocating is just a pointer bump with no
+        atomic operations; and it grows by adding chunks instead of failing when it's full.
+        Blocks aren't freed individually. Instead, `mark` records the current position and
+        `rewind` frees every block allocated since then. `reset` frees everything.
+
+        Rewinding and resetting keep the chunks for reuse. After the first few uses, a
+        workload that allocates the same amount each time doesn't touch the heap at all. */
+    class ScratchArena {
+    public:
+        static constexpr size_t kDefaultChunkSize = 1024;
+
+        explicit ScratchArena(size_t chunkSize =kDefaultChunkSize) noexcept
+        :_chunkSize(chunkSize) { }
+
+        ScratchArena(const ScratchArena&) =delete;
+        ScratchArena& operator=(const ScratchArena&) =delete;
+
+        /** Allocates a block, aligned to 8 bytes. Never returns nullptr. */
+        void* alloc(size_t size) {
+            size = roundUp(size);
+            if (_usuallyFalse(size > size_t(_end - _next)))
+                return allocInNewChunk(size);
+            void *block = _next;
+            _next += size;
+            return block;
+        }
+
+        template <class T>
+        T* alloc(size_t count)              {return (T*)alloc(count * sizeof(T));}
+
+        /** Grows a block in place to `newSize`, if it's the most recently allocated one and there's
+            room left in its chunk. Returns false (and does nothing) otherwise. */
+        bool grow(void *block, size_t oldSize, size_t newSize) noexcept {
+            auto start = (uint8_t*)block;
+            if (start + roundUp(oldSize) != _next || roundUp(newSize) > size_t(_end - start))
+                return false;
+            _next = start + roundUp(newSize);
+            return true;
+        }
+
+        /** An opaque record of the arena's position. */
+        struct Mark {
+            size_t   chunk;
+            uint8_t* next;
+        };
+
+        /** Returns the current position, for a later `rewind`. */
+        Mark mark() const noexcept          {return {_cur, _next};}
+
+        /** Frees all blocks allocated since `mark` was called. Marks must be rewound in
+            last-in-first-out order. */
+        void rewind(Mark m) noexcept {
+            assert_precondition(m.chunk <= _cur);
+            _cur = m.chunk;
+            _next = m.next;
+            _end = _cur ? _chunks[_cur - 1].end : nullptr;
+        }
+
+        /** Frees all allocated blocks (but keeps the chunks for reuse.) */
+        void reset() noexcept               {rewind({0, nullptr});}
+
+        /** Frees chunks until no more than `maxBytes` are retained. Only call this right after
+            `reset`, when no blocks are allocated. */
+        void trim(size_t maxBytes) noexcept;
+
+        /** The total size of the chunks. */
+        size_t capacity() const noexcept;
+
+        /** The number of times a chunk has been allocated from the heap. */
+        size_t chunkAllocations() const noexcept {return _chunkAllocations;}
+
+    private:
+        struct Chunk {
+            std::unique_ptr<uint8_t[]> start;
+            uint8_t* end;
+            size_t size() const     {return end - start.get();}
+        };
+
+        static size_t roundUp(size_t size)  {return (size + 7) & ~size_t(7);}
+
+        void* allocInNewChunk(size_t size);
+
+        std::vector<Chunk> _chunks;             // All chunks, including ones not in use
+        size_t   _cur {0};                      // 1 + index of current chunk, or 0 if none
+        uint8_t* _next {nullptr};               // Next free byte in current chunk
+        uint8_t* _end {nullptr};                // End of current chunk
+        size_t   _chunkSize;                    // Size of the first chunk
+        size_t   _chunkAllocations {0};         // Number of chunks ever allocated
+    };
+
+
+    /** A minimal vector of trivially-copyable items, whose storage comes from a ScratchArena.
+        Its storage isn't freed; that happens when the arena is rewound or reset, after which
+        the vector must be `reset` before reuse.
+        Growing a vector that's at the top of the arena usually happens in place. */
+    template <class T>
+    class scratchVector {
+    public:
+        static_assert(std::is_trivially_copyable<T>::value, "scratchVector item must be trivial");
+
+        size_t size() const FLPURE              {return _size;}
+        size_t capacity() const FLPURE          {return _capacity;}
+        bool empty() const FLPURE               {return _size == 0;}
+
+        T& operator[] (size_t i) FLPURE         {assert_precondition(i < _size); return _items[i];}
+        const T& operator[] (size_t i) const FLPURE {assert_precondition(i < _size); return _items[i];}
+        T& back() FLPURE                        {return (*this)[_size - 1];}
+
+        T* begin() FLPURE                       {return _items;}
+        T* end() FLPURE                         {return _items + _size;}
+
+        /** Removes all items, but keeps the storage. */
+        void clear()                            {_size = 0;}
+
+        /** Forgets the storage; call this after the arena it came from is rewound or reset. */
+        void reset()                            {_items = nullptr; _size = _capacity = 0;}
+
+        void reserve(ScratchArena &arena, size_t cap) {
+            if (cap > _capacity)
+                setCapacity(arena, cap);
+        }
+
+        /** Makes sure there's room to append `n` more items without allocating. */
+        void reserveMore(ScratchArena &arena, size_t n =1) {
+            if (_usuallyFalse(_size + n > _capacity))
+                setCapacity(arena, std::max(_size + n, _capacity ? 2 * size_t(_capacity)
+                                                                  : size_t(kMinCapacity)));
+        }
+
+        /** Appends space for a new item but doesn't initialize it. */
+        T* push_back_new(ScratchArena &arena) {
+            reserveMore(arena);
+            return &_items[_size++];
+        }
+
+        void push_back(ScratchArena &arena, const T &item) {
+            *push_back_new(arena) = item;
+        }
+
+    private:
+        static constexpr uint32_t kMinCapacity = 16;
+
+        void setCapacity(ScratchArena &arena, size_t cap) {
+            if (!_items || !arena.grow(_items, _capacity * sizeof(T), cap * sizeof(T))) {
+                T *items = arena.alloc<T>(cap);
+                if (_size > 0)
+                    ::memcpy((void*)items, _items, _size * sizeof(T));
+                _items = items;
+            }
+            _capacity = uint32_t(cap);
+        }
+
+        T*       _items {nullptr};
+        uint32_t _size {0};
+        uint32_t _capacity {0};
+    };
+
+}
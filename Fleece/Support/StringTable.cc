@@ -18,19 +18,124 @@
 
 #include "StringTable.hh"
 #include "PlatformCompat.hh"
+#include "endianness.h"
 #include <algorithm>
 #include <stdlib.h>
 #include <vector>
 #include "betterassert.hh"
 
+#ifdef FL_STRINGTABLE_SSE2
+    #include <emmintrin.h>
+#elif defined(FL_STRINGTABLE_NEON)
+    #include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
 namespace fleece {
 
     // Minimum size [not capacity] of table to create initially
     static constexpr size_t kMinInitialSize = 16;
 
     // How full the table is allowed to get before it grows.
-    // (Robin Hood hashing allows higher loads than regular hashing...)
-    static const float kMaxLoad = 0.9f;
+    static constexpr size_t kMaxLoadNumerator = 7, kMaxLoadDenominator = 8;
+
+    static inline size_t capacityForSize(size_t size) {
+        return size * kMaxLoadNumerator / kMaxLoadDenominator;
+    }
+
+
+#pragma mark - PROBING:
+
+
+    static inline unsigned countTrailingZeros(uint64_t bits) {
+#ifdef _MSC_VER
+        unsigned long index;
+    #if defined(_M_X64) || defined(_M_ARM64)
+        _BitScanForward64(&index, bits);
+    #else
+        if (!_BitScanForward(&index, uint32_t(bits))) {
+            _BitScanForward(&index, uint32_t(bits >> 32));
+            index += 32;
+        }
+    #endif
+        return unsigned(index);
+#else
+        return unsigned(__builtin_ctzll(bits));
+#endif
+    }
+
+
+    namespace {
+        // The set of slots in a Group that matched, as a bitmask with `1 << SHIFT` bits per slot.
+        template <class BITS, int SHIFT>
+        class BitMask {
+        public:
+            explicit BitMask(BITS bits)         :_bits(bits) { }
+            explicit operator bool() const      {return _bits != 0;}
+            unsigned lowest() const             {return countTrailingZeros(_bits) >> SHIFT;}
+            void removeLowest()                 {_bits &= (_bits - 1);}
+        private:
+            BITS _bits;
+        };
+
+
+        // A group of `kGroupWidth` control bytes, loaded from any slot of the table.
+        class Group {
+        public:
+#ifdef FL_STRINGTABLE_SSE2
+            using Mask = BitMask<uint32_t, 0>;
+
+            explicit Group(const uint8_t *ctrl)
+            :_ctrl(_mm_loadu_si128((const __m128i*)ctrl))
+            { }
+
+            Mask match(uint8_t h2) const {
+                auto eq = _mm_cmpeq_epi8(_mm_set1_epi8(char(h2)), _ctrl);
+                return Mask(uint32_t(_mm_movemask_epi8(eq)));
+            }
+
+            // kEmpty is the only control byte with its high bit set:
+            Mask matchEmpty() const             {return Mask(uint32_t(_mm_movemask_epi8(_ctrl)));}
+
+        private:
+            __m128i _ctrl;
+#else
+            // One byte per slot, but only the high bit of each is set in a match:
+            using Mask = BitMask<uint64_t, 3>;
+
+            explicit Group(const uint8_t *ctrl) {
+                memcpy(&_ctrl, ctrl, 8);
+#ifdef __BIG_ENDIAN__
+                _ctrl = bswap64(_ctrl);         // so lower slots are in lower bits
+#endif
+            }
+
+            Mask match(uint8_t h2) const {
+#ifdef FL_STRINGTABLE_NEON
+                uint8x8_t eq = vceq_u8(vcreate_u8(_ctrl), vdup_n_u8(h2));
+                return Mask(vget_lane_u64(vreinterpret_u64_u8(eq), 0) & kMSBs);
+#else
+                // Classic "find a zero byte" trick. It can give a false positive for a byte
+                // after a real match, which is harmless since the caller compares keys anyway.
+                uint64_t x = _ctrl ^ (kLSBs * h2);
+                return Mask((x - kLSBs) & ~x & kMSBs);
+#endif
+            }
+
+            Mask matchEmpty() const             {return Mask(_ctrl & kMSBs);}
+
+        private:
+            static constexpr uint64_t kLSBs = 0x0101010101010101ull;
+            static constexpr uint64_t kMSBs = 0x8080808080808080ull;
+            uint64_t _ctrl;
+#endif
+        };
+    }
+
+
+#pragma mark - STRINGTABLE:
 
 
     StringTable::StringTable(size_t capacity)
@@ -39,13 +144,13 @@ namespace fleece {
 
 
     StringTable::StringTable(size_t capacity,
-                             size_t initialSize, hash_t *initialHashes, entry_t *initialEntries)
+                             size_t initialSize, entry_t *initialEntries, ctrl_t *initialCtrl)
     {
         size_t size;
-        for (size = initialSize; size * kMaxLoad < capacity; size *= 2)
+        for (size = initialSize; capacityForSize(size) < capacity; size *= 2)
             ;
-        if (initialHashes && size <= initialSize)
-            initTable(size, initialHashes, initialEntries);
+        if (initialCtrl && size <= initialSize)
+            initTable(size, initialEntries, initialCtrl);
         else
             allocTable(size);
     }
@@ -57,201 +162,183 @@ namespace fleece {
 
 
     StringTable& StringTable::operator=(const StringTable &s) {
-        if (_allocated) {
-            free(_hashes);
-            _hashes = nullptr;
-        }
-        _entries = nullptr;
-        _allocated = false;
-
+        freeTable();
         allocTable(s._size);
-        
         _count = s._count;
-        _maxDistance = s._maxDistance;
-        memcpy(_hashes, s._hashes, _count * sizeof(hash_t));
-        memcpy(_entries, s._entries, _count * sizeof(entry_t));
-
+        memcpy(_ctrl, s._ctrl, _size + kGroupWidth);
+        memcpy((void*)_entries, s._entries, _size * sizeof(entry_t));
         return *this;
     }
 
 
     StringTable::~StringTable() {
-        if (_allocated)
-            free(_hashes);
+        freeTable();
     }
 
 
     void StringTable::clear() noexcept {
-        ::memset(_hashes, 0, _size * sizeof(hash_t));
+        ::memset(_ctrl, kEmpty, _size + kGroupWidth);
         _count = 0;
-        _maxDistance = 0;
     }
 
 
+    // Sets a control byte, and its copy at the end if it's one of the first kGroupWidth.
+    inline void StringTable::setCtrl(size_t i, ctrl_t c) {
+        _ctrl[i] = c;
+        if (i < kGroupWidth)
+            _ctrl[_size + i] = c;
+    }
+
+
+    // The probe sequence visits groups at triangular-number offsets from the starting slot,
+    // i.e. +0, +1, +3, +6... groups; with a power-of-2 number of groups this visits each once.
+    // Since entries are never removed, a group with an empty slot ends the search.
+
+
     __hot const StringTable::entry_t* StringTable::find(key_t key, hash_t hash) const noexcept {
         assert_precondition(key.buf != nullptr);
-        assert_precondition(hash != hash_t::Empty);
-        size_t end = wrap(size_t(hash) + _maxDistance + 1);
-        for (size_t i = indexOfHash(hash); i != end; i = wrap(i + 1)) {
-            if (_hashes[i] == hash_t::Empty)
-                break;
-            else if (_hashes[i] == hash && _entries[i].first == key)
-                return &_entries[i];
+        size_t pos = wrap(h1(hash));
+        for (size_t step = kGroupWidth; true; pos = wrap(pos + step), step += kGroupWidth) {
+            Group group(&_ctrl[pos]);
+            for (auto m = group.match(h2(hash)); m; m.removeLowest()) {
+                size_t i = wrap(pos + m.lowest());
+                if (_usuallyTrue(_entries[i].first == key))
+                    return &_entries[i];
+            }
+            if (_usuallyTrue(bool(group.matchEmpty())))
+                return nullptr;
         }
-        return nullptr;
     }
 
 
     __hot StringTable::insertResult StringTable::insert(key_t key, value_t value, hash_t hash) {
         assert_precondition(key);
-        assert_precondition(hash != hash_t::Empty);
-
-        if (_usuallyFalse(_count > _capacity))
-            grow();
-
-        ssize_t distance = 0;
-        auto maxDistance = _maxDistance;
-        hash_t curHash = hash;
-        entry_t curEntry = {key, value};
-        entry_t *result = nullptr;
-        // Walk along the table looking for an empty space:
-        size_t i;
-        for (i = indexOfHash(hash); _hashes[i] != hash_t::Empty; i = wrap(i + 1)) {
-            assert(distance < _count);
-            if (_hashes[i] == hash && _entries[i].first == key) {
-                // Found the key in the table already:
-                if (!result)
+        size_t pos = wrap(h1(hash));
+        for (size_t step = kGroupWidth; true; pos = wrap(pos + step), step += kGroupWidth) {
+            Group group(&_ctrl[pos]);
+            for (auto m = group.match(h2(hash)); m; m.removeLowest()) {
+                size_t i = wrap(pos + m.lowest());
+                if (_usuallyTrue(_entries[i].first == key))
                     return {&_entries[i], false};   // Return existing entry
-                else
-                    break;
             }
-            ssize_t itsDistance = wrap(i - indexOfHash(_hashes[i]) + _size);
-            if (itsDistance < distance) {
-                // Robin Hood hashing: Put new item where a less-distant existing item was:
-                std::swap(curHash,  _hashes[i]);
-                std::swap(curEntry, _entries[i]);
-                maxDistance = std::max(distance, maxDistance);
-                distance = itsDistance;
-                if (!result)
-                    result = &_entries[i];
-                // Then continue, to find a new spot for the existing item we removed...
+            if (auto empty = group.matchEmpty(); _usuallyTrue(bool(empty))) {
+                // Key isn't in the table; add it in the first empty slot:
+                size_t i;
+                if (_usuallyFalse(_count >= _capacity)) {
+                    grow();
+                    i = findEmptySlot(hash);
+                } else {
+                    i = wrap(pos + empty.lowest());
+                }
+                setCtrl(i, h2(hash));
+                _entries[i] = {key, value};
+                ++_count;
+                return {&_entries[i], true};        // Return new entry
             }
-            ++distance;
         }
-
-        // Now place the final item in the empty space:
-        _hashes[i]  = curHash;
-        _entries[i] = std::move(curEntry);
-        _maxDistance = std::max(distance, maxDistance);
-        ++_count;
-
-        if (!result)
-            result = &_entries[i];
-        return {result, true};                      // Return new entry
     }
 
 
     __hot void StringTable::insertOnly(key_t key, value_t value, hash_t hash) {
         assert_precondition(!find(key, hash));
-        if (_usuallyFalse(++_count > _capacity))
+        if (_usuallyFalse(_count >= _capacity))
             grow();
-        _insertOnly(hash, {key, value});
+        size_t i = findEmptySlot(hash);
+        setCtrl(i, h2(hash));
+        _entries[i] = {key, value};
+        ++_count;
     }
 
 
-    // Subroutine of insertOnly() and grow() that doesn't bump count or grow table.
-    // This repeats a lot of the logic of insert(), but I decided performance trumps DRY.
-    __hot void StringTable::_insertOnly(hash_t hash, entry_t entry) noexcept {
-        assert_precondition(entry.first);
-        assert_precondition(hash != hash_t::Empty);
-        ssize_t distance = 0;
-        auto maxDistance = _maxDistance;
-        // Walk along the table looking for an empty space:
-        size_t i;
-        for (i = indexOfHash(hash); _hashes[i] != hash_t::Empty; i = wrap(i + 1)) {
-            assert(distance < _count);
-            ssize_t itsDistance = wrap(i - indexOfHash(_hashes[i]) + _size);
-            if (itsDistance < distance) {
-                // Robin Hood hashing: Put new item where a less-distant existing item was:
-                std::swap(hash,  _hashes[i]);
-                std::swap(entry, _entries[i]);
-                maxDistance = std::max(distance, maxDistance);
-                distance = itsDistance;
-                // Then continue, to find a new spot for the existing item we removed...
-            }
-            ++distance;
+    // Returns the index of the first empty slot in the hash's probe sequence.
+    __hot size_t StringTable::findEmptySlot(hash_t hash) const noexcept {
+        size_t pos = wrap(h1(hash));
+        for (size_t step = kGroupWidth; true; pos = wrap(pos + step), step += kGroupWidth) {
+            if (auto empty = Group(&_ctrl[pos]).matchEmpty(); empty)
+                return wrap(pos + empty.lowest());
         }
-
-        // Now place the final item in the empty space:
-        _hashes[i]  = hash;
-        _entries[i] = std::move(entry);
-        _maxDistance = std::max(distance, maxDistance);
     }
 
 
 #pragma mark - TABLE ALLOCATION:
 
 
-    void StringTable::initTable(size_t size, hash_t *hashes, entry_t *entries) {
+    void StringTable::initTable(size_t size, entry_t *entries, ctrl_t *ctrl) {
+        assert_precondition(size >= kGroupWidth && (size & (size - 1)) == 0);
         _size = size;
         _sizeMask = size - 1;
-        _maxDistance = 0;
-        _capacity = (size_t)(size * kMaxLoad);
-        _hashes = hashes;
+        _capacity = capacityForSize(size);
         _entries = entries;
-        memset(_hashes, 0, size * sizeof(hash_t));
+        _ctrl = ctrl;
+        memset(_ctrl, kEmpty, size + kGroupWidth);
     }
 
 
     void StringTable::allocTable(size_t size) {
-        size_t hashesSize  = size * sizeof(hash_t), entriesSize = size * sizeof(entry_t);
-        void *memory = ::malloc(hashesSize + entriesSize);
+        // Entries and control bytes share one heap block:
+        size_t entriesSize = size * sizeof(entry_t), ctrlSize = size + kGroupWidth;
+        void *memory = ::malloc(entriesSize + ctrlSize);
         if (!memory)
             throw std::bad_alloc();
-        initTable(size, (hash_t*)memory, (entry_t*)offsetby(memory, hashesSize));
+        initTable(size, (entry_t*)memory, (ctrl_t*)offsetby(memory, entriesSize));
         _allocated = true;
     }
 
 
+    void StringTable::freeTable() noexcept {
+        if (_allocated) {
+            free(_entries);
+            _entries = nullptr;
+            _ctrl = nullptr;
+            _allocated = false;
+        }
+    }
+
+
     __hot void StringTable::grow() {
         auto oldSize = _size;
-        auto oldHashes = _hashes;
         auto oldEntries = _entries;
+        auto oldCtrl = _ctrl;
         auto wasAllocated = _allocated;
 
         allocTable(2 * oldSize);
 
         for (size_t i = 0; i < oldSize; ++i) {
-            if (oldHashes[i] != hash_t::Empty)
-                _insertOnly(oldHashes[i], oldEntries[i]);
+            if (oldCtrl[i] != kEmpty) {
+                hash_t hash = hashCode(oldEntries[i].first);
+                size_t j = findEmptySlot(hash);
+                setCtrl(j, h2(hash));
+                _entries[j] = oldEntries[i];
+            }
         }
         if (wasAllocated)
-            free(oldHashes);
+            free(oldEntries);
     }
 
 
     void StringTable::dump() const noexcept {
-        ssize_t totalDistance = 0;
-        std::vector<size_t> distanceCounts(_maxDistance+1);
+        size_t totalProbes = 0, maxProbes = 0;
         for (size_t i = 0; i < _size; ++i) {
             printf("%4zd: ", i);
-            if (_hashes[i] != hash_t::Empty) {
+            if (_ctrl[i] != kEmpty) {
                 key_t key = _entries[i].first;
-                size_t index = indexOfHash(hashCode(key));
-                ssize_t distance = (i - (int)index + _size) & _sizeMask;
-                totalDistance += distance;
-                ++distanceCounts[distance];
-                printf("(%2zd) '%.*s'\n", distance, FMTSLICE(key));
+                // Count the groups probed to find this entry:
+                size_t pos = wrap(h1(hashCode(key))), probes = 1;
+                for (size_t step = kGroupWidth; wrap(i - pos) >= kGroupWidth; step += kGroupWidth) {
+                    pos = wrap(pos + step);
+                    ++probes;
+                }
+                totalProbes += probes;
+                maxProbes = std::max(maxProbes, probes);
+                printf("(%2zd) '%.*s'\n", probes, FMTSLICE(key));
             } else {
                 printf("--\n");
             }
         }
         printf(">> Capacity %zd, using %zu (%.0f%%)\n",
                _size, _count,  _count/(double)_size*100.0);
-        printf(">> Average key distance = %.2f, max = %zd\n",
-               totalDistance/(double)count(), _maxDistance);
-        for (size_t i = 0; i <= _maxDistance; ++i)
-            printf("\t%2zd: %zd\n", i, distanceCounts[i]);
+        printf(">> Average groups probed = %.2f, max = %zd\n",
+               totalProbes/(double)count(), maxProbes);
     }
 
 }
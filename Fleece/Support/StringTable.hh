@@ -21,11 +21,27 @@
 #include "PlatformCompat.hh"
 #include "fleece/slice.hh"
 #include <algorithm>
+#include <string.h>
 #include <utility>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define FL_STRINGTABLE_SSE2 1       // Probe 16 slots at a time with SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #define FL_STRINGTABLE_NEON 1       // Probe 8 slots at a time with NEON
+#endif
+
+#if defined(__SIZEOF_INT128__)
+    #define FL_STRINGTABLE_INT128 1     // Can use 64x64->128 bit multiply for hashing
+#endif
+
 namespace fleece {
 
-    /** Internal hash table mapping strings (slices) to integers (uint32_t). */
+    /** Internal hash table mapping strings (slices) to integers (uint32_t).
+
+        This is a "Swiss table": alongside the array of entries is an array of control bytes,
+        each of which is either `kEmpty` or holds 7 bits of the hash code of the entry in that
+        slot. A lookup scans the control bytes a group at a time (16 with SSE2, else 8) looking
+        for matching hash bits, and only compares keys in slots that match. */
     class StringTable {
     public:
         StringTable(size_t capacity =0);
@@ -41,7 +57,14 @@ namespace fleece {
         enum class hash_t : uint32_t { Empty = 0 };
 
         static inline hash_t hashCode(key_t key) FLPURE {
-            return hash_t( std::max(key.hash(), 1u) ); // hashCode must never be zero
+            uint32_t h;
+#ifdef FL_STRINGTABLE_INT128
+            if (_usuallyTrue(key.size <= 16))
+                h = shortHash(key);
+            else
+#endif
+                h = key.hash();
+            return hash_t( std::max(h, 1u) ); // hashCode must never be zero
         }
 
         size_t count() const FLPURE                            {return _count;}
@@ -68,23 +91,60 @@ namespace fleece {
         void dump() const noexcept;
 
     protected:
+        using ctrl_t = uint8_t;
+
+#ifdef FL_STRINGTABLE_SSE2
+        static constexpr size_t kGroupWidth = 16;
+#else
+        static constexpr size_t kGroupWidth = 8;
+#endif
+        static constexpr ctrl_t kEmpty = 0x80;  // Control byte of an empty slot
+
         StringTable(size_t capacity,
-                    size_t initialSize, hash_t *initialHashes, entry_t *initialEntries);
+                    size_t initialSize, entry_t *initialEntries, ctrl_t *initialCtrl);
+
+#ifdef FL_STRINGTABLE_INT128
+        // A fast hash for strings up to 16 bytes (like wyhash's, but inline.)
+        static inline uint32_t shortHash(key_t key) FLPURE {
+            auto p = (const uint8_t*)key.buf;
+            size_t n = key.size;
+            uint64_t a, b;
+            if (n >= 8) {
+                a = read64(p);  b = read64(p + n - 8);
+            } else if (n >= 4) {
+                a = read32(p);  b = read32(p + n - 4);
+            } else if (n > 0) {
+                a = (uint64_t(p[0]) << 16) | (uint64_t(p[n >> 1]) << 8) | p[n - 1];
+                b = 0;
+            } else {
+                a = b = 0;
+            }
+            __uint128_t m = __uint128_t(a ^ 0xe7037ed1a0b428dbull)
+                          * (b ^ n ^ 0xa0761d6478bd642full);
+            uint64_t h = uint64_t(m) ^ uint64_t(m >> 64);
+            return uint32_t(h ^ (h >> 32));
+        }
+        static inline uint64_t read64(const uint8_t *p)  {uint64_t v; memcpy(&v, p, 8); return v;}
+        static inline uint64_t read32(const uint8_t *p)  {uint32_t v; memcpy(&v, p, 4); return v;}
+#endif
+
         inline size_t wrap(size_t i) const              {return i & _sizeMask;}
-        inline size_t indexOfHash(hash_t h) const       {return wrap(size_t(h));}
-        insertResult _insert(hash_t, entry_t) noexcept;
-        void _insertOnly(hash_t, entry_t) noexcept;
+        static inline size_t h1(hash_t h)               {return size_t(h) >> 7;}
+        static inline ctrl_t h2(hash_t h)               {return ctrl_t(size_t(h) & 0x7F);}
+        inline void setCtrl(size_t i, ctrl_t c);
+        size_t findEmptySlot(hash_t) const noexcept;
         void allocTable(size_t size);
+        void freeTable() noexcept;
         void grow();
-        void initTable(size_t size, hash_t *hashes, entry_t *entries);
+        void initTable(size_t size, entry_t *entries, ctrl_t *ctrl);
 
-        size_t _size;           // Size of the arrays
+        size_t _size;           // Number of slots (a power of 2)
         size_t _sizeMask;       // Used for quick modulo: (i & _sizeMask) == (i % _size)
         size_t _count {0};      // Number of entries
         size_t _capacity;       // Grow the table when it exceeds this count
-        ssize_t _maxDistance;   // Maximum distance of any entry from its ideal position
-        hash_t*  _hashes;       // Array of hash codes, zero meaning empty
-        entry_t* _entries;      // Array of keys/values, paralleling _hashes
+        entry_t* _entries;      // Array of keys/values
+        ctrl_t*  _ctrl;         // Control bytes, paralleling _entries, plus a copy of the first
+                                //   kGroupWidth, so a group can be loaded at any slot
         bool _allocated {false};// Was table allocated by allocTable?
     };
 
@@ -96,12 +156,26 @@ namespace fleece {
     class PreallocatedStringTable : public StringTable {
     public:
         PreallocatedStringTable(size_t capacity =0)
-        :StringTable(capacity, INITIAL_SIZE, _initialHashes, _initialEntries)
+        :StringTable(capacity, INITIAL_SIZE, _initialEntries, _initialCtrl)
         { }
 
+        /// Clears the table, and if it's grown to hold more than `maxCapacity` entries, shrinks
+        /// it back to its initial size. (A big table costs memory, and time to clear.)
+        void clearAndShrink(size_t maxCapacity) noexcept {
+            if (_allocated && _capacity > maxCapacity) {
+                freeTable();
+                initTable(INITIAL_SIZE, _initialEntries, _initialCtrl);
+                _count = 0;
+            } else {
+                clear();
+            }
+        }
+
     private:
-        hash_t  _initialHashes[INITIAL_SIZE];
+        static_assert(INITIAL_SIZE >= kGroupWidth && (INITIAL_SIZE & (INITIAL_SIZE - 1)) == 0,
+                      "INITIAL_SIZE must be a power of 2, at least kGroupWidth");
         entry_t _initialEntries[INITIAL_SIZE];
+        ctrl_t  _initialCtrl[INITIAL_SIZE + kGroupWidth];
     };
 
 }
@@ -19,16 +19,104 @@
 #include "Writer.hh"
 #include "PlatformCompat.hh"
 #include "FleeceException.hh"
-#include "decode.h"
-#include "encode.h"
+#include "Base64.hh"
 #include <algorithm>
+#include <stddef.h>
 #include "betterassert.hh"
 
+#ifndef _MSC_VER
+#include <sys/uio.h>
+#endif
+
 
 namespace fleece {
 
+#pragma mark - CHUNK ALLOCATOR:
+
+
+    slice ChunkAllocator::allocateChunk(size_t minSize, size_t preferredSize) {
+        size_t size = std::max(minSize, preferredSize);
+        return slice(slice::newBytes(size), size);
+    }
+
+
+    void ChunkAllocator::freeChunk(slice chunk) noexcept {
+        ::free((void*)chunk.buf);
+    }
+
+
+    ChunkAllocator& ChunkAllocator::defaultAllocator() {
+        static ChunkAllocator sDefault;
+        return sDefault;
+    }
+
+
+#pragma mark - WRITER CHUNKS:
+
+
+#ifndef _MSC_VER
+    static_assert(sizeof(slice) == sizeof(iovec)
+                  && offsetof(slice, buf) == offsetof(iovec, iov_base)
+                  && offsetof(slice, size) == offsetof(iovec, iov_len),
+                  "slice and iovec have different layouts");
+#endif
+
+
+    WriterChunks::WriterChunks(WriterChunks &&other) noexcept
+    :_chunks(std::move(other._chunks))
+    ,_allocator(other._allocator)
+    {
+        other._chunks.clear();
+    }
+
+
+    WriterChunks& WriterChunks::operator= (WriterChunks &&other) noexcept {
+        clear();
+        _chunks = std::move(other._chunks);
+        _allocator = other._allocator;
+        other._chunks.clear();
+        return *this;
+    }
+
+
+    WriterChunks::~WriterChunks() {
+        clear();
+    }
+
+
+    void WriterChunks::clear() noexcept {
+        for (auto &chunk : _chunks)
+            _allocator->freeChunk(chunk);
+        _chunks.clear();
+    }
+
+
+    size_t WriterChunks::totalSize() const {
+        size_t size = 0;
+        for (auto &chunk : _chunks)
+            size += chunk.size;
+        return size;
+    }
+
+
+    alloc_slice WriterChunks::join() const {
+        alloc_slice result(totalSize());
+        void *dst = (void*)result.buf;
+        for (auto &chunk : _chunks) {
+            chunk.copyTo(dst);
+            dst = offsetby(dst, chunk.size);
+        }
+        return result;
+    }
+
+
+#pragma mark - WRITER:
+
+
     Writer::Writer(size_t initialCapacity)
     :_chunkSize(initialCapacity)
+    ,_initialCapacity(initialCapacity)
+    ,_allocator(&ChunkAllocator::defaultAllocator())
     ,_outputFile(nullptr)
     {
         addChunk(initialCapacity);
@@ -47,6 +135,9 @@ namespace fleece {
     :_available(std::move(w._available))
     ,_chunks(std::move(w._chunks))
     ,_chunkSize(w._chunkSize)
+    ,_initialCapacity(w._initialCapacity)
+    ,_allocator(w._allocator)
+    ,_maxRetainedCapacity(w._maxRetainedCapacity)
     ,_length(w._length)
     ,_outputFile(w._outputFile)
     {
@@ -68,6 +159,10 @@ namespace fleece {
         _available = std::move(w._available);
         _length = w._length;
         _chunks = std::move(w._chunks);
+        _chunkSize = w._chunkSize;
+        _initialCapacity = w._initialCapacity;
+        _allocator = w._allocator;
+        _maxRetainedCapacity = w._maxRetainedCapacity;
         migrateInitialBuf(w);
         _outputFile = w._outputFile;
         memcpy(_initialBuf, w._initialBuf, sizeof(_initialBuf));
@@ -81,7 +176,17 @@ namespace fleece {
             return;
 
         size_t nChunks = _chunks.size();
-        if (nChunks > 1) {
+        size_t maxRetained = std::max(_maxRetainedCapacity, _initialCapacity);
+        if (_usuallyFalse(_chunks.back().size > maxRetained)) {
+            // The last chunk is too big to hang onto, so go back to the initial state:
+            for (auto &chunk : _chunks)
+                freeChunk(chunk);
+            _chunks.clear();
+            _available = nullslice;
+            _length = 0;
+            _chunkSize = _initialCapacity;
+            addChunk(_initialCapacity);
+        } else if (nChunks > 1) {
             for (size_t i = 0; i < nChunks-1; i++)
                 freeChunk(_chunks[i]);
             _chunks.erase(_chunks.begin(), _chunks.end() - 1);
@@ -142,9 +247,9 @@ namespace fleece {
             _available = _chunks[0];
             _length += _available.size;
         } else {
-            if (_usuallyTrue(_chunkSize <= 64*1024))
-                _chunkSize *= 2;
-            addChunk(std::max(length, _chunkSize));
+            if (_chunkSize < kMaxChunkSize)
+                _chunkSize = std::min(2 * _chunkSize, kMaxChunkSize);
+            addChunk(length, std::max(length, _chunkSize));
         }
 
         // Now that we have room, write:
@@ -172,24 +277,43 @@ namespace fleece {
     }
 
 
-    void Writer::addChunk(size_t capacity) {
+    void Writer::addChunk(size_t capacity, size_t preferredCapacity) {
         _length -= _available.size;
         if (!_chunks.empty()) {
             auto &last = _chunks.back();
             // (should I realloc() it?)
             last.setSize(last.size - _available.size);
         }
-        if (_chunks.empty() && capacity <= kDefaultInitialCapacity)
+        if (_chunks.empty() && capacity <= kDefaultInitialCapacity) {
             _available = _chunks.emplace_back(_initialBuf, sizeof(_initialBuf));
-        else
-            _available = _chunks.emplace_back(slice::newBytes(capacity), capacity);
+        } else {
+            slice chunk = _allocator->allocateChunk(capacity, std::max(capacity, preferredCapacity));
+            assert_postcondition(chunk.buf && chunk.size >= capacity);
+            _available = _chunks.emplace_back(chunk);
+        }
         _length += _available.size;
     }
 
 
     void Writer::freeChunk(slice chunk) {
         if (chunk.buf != &_initialBuf)
-            ::free((void*)chunk.buf);
+            _allocator->freeChunk(chunk);
+    }
+
+
+    void Writer::setChunkAllocator(ChunkAllocator *allocator) {
+        assert_precondition(allocator);
+        assert_precondition(length() == 0 && _chunks.size() == 1);
+        if (allocator == _allocator)
+            return;
+        // The initial chunk may have come from the old allocator:
+        slice first = _chunks[0];
+        _chunks.clear();
+        _available = nullslice;
+        _length = 0;
+        freeChunk(first);
+        _allocator = allocator;
+        addChunk(_initialCapacity);
     }
 
     void Writer::migrateInitialBuf(const Writer& other) {
@@ -253,6 +377,34 @@ namespace fleece {
     }
 
 
+    WriterChunks Writer::finishAsIOVecs() {
+        assert_precondition(!_outputFile);
+        WriterChunks result;
+        result._allocator = _allocator;
+        result._chunks.reserve(_chunks.size());
+        forEachChunk([&](slice chunk) {
+            if (chunk.buf == _initialBuf) {
+                // The inline buffer can't be handed over, so copy it to a real chunk:
+                slice copy = _allocator->allocateChunk(chunk.size, chunk.size);
+                memcpy((void*)copy.buf, chunk.buf, chunk.size);
+                result._chunks.emplace_back(copy.buf, chunk.size);
+            } else {
+                result._chunks.push_back(chunk);
+            }
+        });
+        // forEachChunk skips the last chunk if it's empty; then it has to be freed here:
+        slice last = _chunks.back();
+        if (result.empty() || result._chunks.back().buf != last.buf)
+            freeChunk(last);
+        _chunks.clear();
+        _available = nullslice;
+        _length = 0;
+        _chunkSize = _initialCapacity;
+        addChunk(_initialCapacity);
+        return result;
+    }
+
+
     bool Writer::writeOutputToFile(FILE *f) {
         assert_precondition(!_outputFile);
         bool result = true;
@@ -273,30 +425,34 @@ namespace fleece {
 
 
     void Writer::writeBase64(slice data) {
-        size_t base64size = ((data.size + 2) / 3) * 4;
+        size_t base64size = base64::encodedSize(data.size);
         char *dst;
         if (_outputFile)
             dst = (char*)slice::newBytes(base64size);
         else
             dst = (char*)reserveSpace(base64size);
-        base64::encoder enc;
-        enc.set_chars_per_line(0);
-        size_t written = enc.encode(data.buf, data.size, dst);
-        written += enc.encode_end(dst + written);
+        size_t written = base64::encode(data, dst);
         if (_outputFile) {
             write(dst, written);
             free(dst);
         }
-        assert_postcondition((size_t)written == base64size);
+        assert_postcondition(written == base64size);
         (void)written;      // suppresses 'unused value' warning in release builds
     }
 
 
     void Writer::writeDecodedBase64(slice base64) {
-        base64::decoder dec;
-        std::vector<char> buf((base64.size + 3) / 4 * 3);
-        size_t len = dec.decode(base64.buf, base64.size, buf.data());
-        write(buf.data(), len);
+        size_t maxSize = (base64.size + 3) / 4 * 3;
+        if (!_outputFile) {
+            // Decode directly into the output:
+            write(maxSize, [&](void *dst) {
+                return base64::decode(base64, dst, maxSize).size;
+            });
+        } else {
+            std::vector<char> buf(maxSize);
+            slice decoded = base64::decode(base64, buf.data(), buf.size());
+            write(decoded.buf, decoded.size);
+        }
     }
 
 }
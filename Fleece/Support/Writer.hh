@@ -24,14 +24,76 @@
 #include <vector>
 #include "betterassert.hh"
 
+struct iovec;
+
 namespace fleece {
 
+    /// Allocates the chunks of memory a Writer writes its output into. The default implementation
+    /// uses `malloc`; a subclass can instead hand out pooled buffers that get reused.
+    class ChunkAllocator {
+    public:
+        virtual ~ChunkAllocator() =default;
+
+        /// Returns a new chunk of at least `minSize` bytes. `preferredSize` is the size the
+        /// Writer's growth policy asks for; the allocator may return a different size, as long
+        /// as it's at least `minSize`.
+        virtual slice allocateChunk(size_t minSize, size_t preferredSize);
+
+        /// Frees a chunk returned by `allocateChunk`. (The slice has the same `buf`, but its
+        /// `size` may be smaller than was allocated.)
+        virtual void freeChunk(slice chunk) noexcept;
+
+        /// The default allocator, using `malloc` and `free`.
+        static ChunkAllocator& defaultAllocator();
+    };
+
+
+    /// The output of a Writer as a list of separate chunks of memory, as returned by
+    /// `Writer::finishAsIOVecs`. It owns the chunks, and frees them when destructed.
+    class WriterChunks {
+    public:
+        WriterChunks() =default;
+        WriterChunks(WriterChunks&&) noexcept;
+        WriterChunks& operator= (WriterChunks&&) noexcept;
+        ~WriterChunks();
+
+        size_t count() const                        {return _chunks.size();}
+        bool empty() const                          {return _chunks.empty();}
+        const slice& operator[] (size_t i) const    {return _chunks[i];}
+        const slice* begin() const                  {return _chunks.data();}
+        const slice* end() const                    {return _chunks.data() + _chunks.size();}
+
+        /// The total size of all the chunks.
+        size_t totalSize() const;
+
+        /// Copies all the chunks into one contiguous slice.
+        alloc_slice join() const;
+
+        /// The chunks as an array of `count()` POSIX `iovec`s, as used by `writev` or `sendmsg`.
+        /// (A slice has the same memory layout as an iovec.)
+        const struct iovec* iovecs() const          {return (const struct iovec*)_chunks.data();}
+
+    private:
+        friend class Writer;
+        void clear() noexcept;
+
+        std::vector<slice> _chunks;
+        ChunkAllocator*    _allocator {nullptr};
+    };
+
+
     /// A simple write-only stream that buffers its output into a slice.
     ///  (Used instead of C++ ostreams because those have too much overhead.)
     class Writer {
     public:
         static constexpr size_t kDefaultInitialCapacity = 256;
 
+        /// Chunks grow geometrically (each twice as big as the last) up to this size. Bigger
+        /// chunks mean fewer iovecs from `finishAsIOVecs` (a 100MB document takes 100, well under
+        /// IOV_MAX), but a Writer keeps its last chunk when reset, so this also bounds what an
+        /// idle Writer or pooled Encoder holds onto.
+        static constexpr size_t kMaxChunkSize = 1 << 20;
+
         explicit Writer(size_t initialCapacity =kDefaultInitialCapacity);
         ~Writer();
 
@@ -111,6 +173,18 @@ namespace fleece {
         /// Writes the output to a file. (Must not already be writing to a file.)
         bool writeOutputToFile(FILE *);
 
+        //-------- Chunk allocation:
+
+        /// Sets the allocator for the Writer's chunks. Must be called before anything's written.
+        void setChunkAllocator(ChunkAllocator* NONNULL);
+
+        ChunkAllocator& chunkAllocator() const  {return *_allocator;}
+
+        /// Sets the largest chunk that `reset` (and `finish`) will keep for reuse. Normally the
+        /// last chunk is kept however big it is; with a limit, a Writer that once wrote a huge
+        /// output goes back to its initial capacity instead of holding onto that memory.
+        void setMaxRetainedCapacity(size_t capacity)    {_maxRetainedCapacity = capacity;}
+
         //-------- Finishing:
 
         /// Clears the Writer, discarding the data written. It can then be reused.
@@ -119,6 +193,11 @@ namespace fleece {
         /// Returns a copy of the data written, and resets.
         alloc_slice finish();
 
+        /// Returns the data written as a list of chunks, without copying it, and resets.
+        /// The caller takes ownership of the chunks, which are freed by the ChunkAllocator when
+        /// the WriterChunks object is destructed.
+        WriterChunks finishAsIOVecs();
+
         /// Passes the output as a slice (not alloc_slice) to the callback, and resets.
         /// Unlike the regular `finish`, this avoids heap allocation if there's only one chunk.
         template <class T>
@@ -155,7 +234,7 @@ namespace fleece {
         void _reset();
         void* _write(const void* dataOrNull, size_t length);
         void* writeToNewChunk(const void* dataOrNull, size_t length);
-        void addChunk(size_t capacity);
+        void addChunk(size_t capacity, size_t preferredCapacity =0);
         void freeChunk(slice);
         void migrateInitialBuf(const Writer& other);
 
@@ -172,7 +251,8 @@ namespace fleece {
            The output is stored in a vector of "chunks", each a slice.
            The first chunk usually points to `_initialBuf`, if the `initialCapacity` permits;
            This avoids a `malloc` in the common case of writing short output (256 bytes or less.)
-           All subsequent chunks are heap-allocated, each twice as big as the last.
+           All subsequent chunks are allocated by the ChunkAllocator (by default on the heap),
+           each twice as big as the last, up to kMaxChunkSize.
 
            The last chunk is usually partially empty. `_available` points to its empty space,
            so `_available.buf` is the first free byte, and `_available.size` is the free size.
@@ -188,6 +268,9 @@ namespace fleece {
         slice _available;               // Available range of current chunk
         smallVector<slice, 4> _chunks;  // Chunks in consecutive order. Last is written to.
         size_t _chunkSize;              // Size of next chunk to allocate
+        size_t _initialCapacity;        // Size of first chunk
+        ChunkAllocator* _allocator;     // Allocates chunks
+        size_t _maxRetainedCapacity {SIZE_MAX}; // Max size of chunk to keep on reset
         size_t _length {0};             // Output length, offset by _available.size
         FILE* _outputFile;              // File writing to, or NULL
         uint8_t _initialBuf[kDefaultInitialCapacity];   // Inline buffer to avoid a malloc
@@ -83,6 +83,16 @@ static inline size_t GetUVarInt32(slice buf, uint32_t *n NONNULL) {
 }
 
 
+/** Decodes `count` consecutive varints from the bytes in buf, storing them into `out`.
+    Returns the total number of bytes read, or 0 if any of them is invalid. */
+size_t GetUVarInts(slice buf, uint64_t *out NONNULL, size_t count);
+
+/** Decodes `count` consecutive varints from the bytes in buf, storing them into `out`.
+    Returns the total number of bytes read, or 0 if any of them is invalid or doesn't fit in 32
+    bits. */
+size_t GetUVarInts32(slice buf, uint32_t *out NONNULL, size_t count);
+
+
 /** Skips a pointer past a varint without decoding it. */
 __hot
 static inline const void* SkipVarInt(const void *buf NONNULL) {
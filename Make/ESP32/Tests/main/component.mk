@@ -7,12 +7,11 @@ COMPONENT_OBJS := Tests/FleeceTestsMain.o Tests/FleeceTests.o \
 	Tests/SupportTests.o \
 	Tests/ValueTests.o \
 	Tests/MutableTests.o \
-	Tests/HashTreeTests.o \
-	Experimental/KeyTree.o
+	Tests/HashTreeTests.o
 
-COMPONENT_SRCDIRS 			:= ../../../../Tests  ../../../../Experimental
+COMPONENT_SRCDIRS 			:= ../../../../Tests
 
-COMPONENT_PRIV_INCLUDEDIRS 	:= ../../../../vendor/catch  ../../../../vendor/jsonsl  ../../../../Experimental
+COMPONENT_PRIV_INCLUDEDIRS 	:= ../../../../vendor/catch  ../../../../vendor/jsonsl
 
 COMPONENT_EMBED_FILES := 1000people.fleece
 
@@ -18,6 +18,7 @@
 
 #include "fleece/Fleece.hh"
 #include <iostream>
+#include <thread>
 
 namespace fleece {
     static inline std::ostream& operator<<(std::ostream &out, const fleece::Doc &doc) {
@@ -232,3 +233,230 @@ TEST_CASE("API MutableDict", "[API]") {
     REQUIRE(d.get("x"_sl));
     CHECK(d.get("x"_sl).asInt() == 1234);
 }
+
+TEST_CASE("API Stats", "[API]") {
+    CHECK(!Stats::isEnabled());
+    Stats::setEnabled(true);
+    Stats::reset();
+    Stats before;
+    CHECK(before.bytesEncoded == 0);
+    CHECK(before.dictLookups == 0);
+
+    Encoder enc;
+    enc.beginArray();
+    for (int i = 0; i < 10; ++i) {
+        enc.beginDict();
+        enc["name"_sl] = "Alice";
+        enc["age"_sl] = 30 + i;
+        enc.endDict();
+    }
+    enc.endArray();
+    alloc_slice data = enc.finish();
+    REQUIRE(data);
+
+    Doc doc(data, kFLUntrusted);
+    REQUIRE(doc.root());
+    Array people = doc.root().asArray();
+    // Look up keys on another thread, too, to make sure its counts survive after it exits:
+    std::thread([&]{
+        for (Array::iterator i(people); i; ++i)
+            CHECK(i->asDict()["age"_sl].asInt() >= 30);
+    }).join();
+    for (Array::iterator i(people); i; ++i)
+        CHECK(i->asDict()["name"_sl].asString() == "Alice"_sl);
+
+    Stats stats;
+    CHECK(stats.bytesEncoded == data.size);
+    CHECK(stats.stringsDeduplicated >= 9);
+    CHECK(stats.narrowCollections == 11);
+    CHECK(stats.wideCollections == 0);
+    CHECK(stats.dictLookups == 20);
+    CHECK(stats.comparisonsPerLookup() >= 1.0);
+    CHECK(stats.docRegistrations == 1);
+    CHECK(stats.validations == 1);
+    CHECK(stats.validatedBytes == data.size);
+
+    Stats::reset();
+    CHECK(Stats().dictLookups == 0);
+
+    // Lookups that hit a Dict::Key's cached index are counted too:
+    Dict::Key nameKey("name"_sl);
+    for (Array::iterator i(people); i; ++i)
+        CHECK(i->asDict().get(nameKey).asString() == "Alice"_sl);
+    stats = Stats();
+    CHECK(stats.dictLookups == 10);
+    CHECK(stats.dictComparisons >= 10);
+
+    Stats::reset();
+    // Nothing is counted while disabled:
+    Stats::setEnabled(false);
+    for (Array::iterator i(people); i; ++i)
+        CHECK(i->asDict()["name"_sl].asString() == "Alice"_sl);
+    CHECK(Doc(data, kFLUntrusted).root());
+    CHECK(Stats().dictLookups == 0);
+    CHECK(Stats().validations == 0);
+}
+
+TEST_CASE("API GatherColumns", "[API]") {
+    SharedKeys sk = SharedKeys::create();
+    Encoder enc;
+    enc.setSharedKeys(sk);
+    enc.beginArray();
+    for (int i = 0; i < 100; ++i) {
+        if (i == 50) {
+            enc.writeString("not a dict");
+            continue;
+        }
+        enc.beginDict();
+        enc["id"_sl] = i;
+        if (i % 10 != 3)
+            enc["score"_sl] = i * 1.5;
+        if (i % 7 == 0)
+            enc["name"_sl] = 1234;          // wrong type
+        else
+            enc["name"_sl] = "Row " + to_string(i);
+        enc.endDict();
+    }
+    enc.endArray();
+    Doc doc(enc.finish(), kFLTrusted, sk);
+    Array rows = doc.asArray();
+    REQUIRE(rows.count() == 100);
+
+    Dict::Key idKey("id"_sl), scoreKey("score"_sl), nameKey("name"_sl);
+    int64_t ids[100];
+    double scores[100];
+    slice names[100];
+    uint8_t idValid[13], scoreValid[13], nameValid[13];
+    Column columns[3] = {{idKey, kFLColumnInt, ids, idValid},
+                         {scoreKey, kFLColumnDouble, scores, scoreValid},
+                         {nameKey, kFLColumnString, names, nameValid}};
+    CHECK(rows.gatherColumns(0, 1000, columns, 3) == 100);
+
+    auto isValid = [](const uint8_t *bits, int i) {return (bits[i / 8] & (1 << (i % 8))) != 0;};
+    for (int i = 0; i < 100; ++i) {
+        if (i == 50) {
+            CHECK(!isValid(idValid, i));
+            CHECK(!isValid(scoreValid, i));
+            CHECK(!isValid(nameValid, i));
+            CHECK(ids[i] == 0);
+            CHECK(names[i] == nullslice);
+            continue;
+        }
+        CHECK(isValid(idValid, i));
+        CHECK(ids[i] == i);
+        CHECK(isValid(scoreValid, i) == (i % 10 != 3));
+        CHECK(scores[i] == ((i % 10 != 3) ? i * 1.5 : 0.0));
+        CHECK(isValid(nameValid, i) == (i % 7 != 0));
+        if (i % 7 != 0)
+            CHECK(names[i] == slice("Row " + to_string(i)));
+        else
+            CHECK(names[i] == nullslice);
+    }
+
+    // A sub-range:
+    CHECK(rows.gatherColumns(95, 10, columns, 1) == 5);
+    CHECK(ids[0] == 95);
+    CHECK(ids[4] == 99);
+    CHECK(rows.gatherColumns(100, 10, columns, 1) == 0);
+}
+
+TEST_CASE("API Pooled Encoder", "[API]") {
+    auto encodeDoc = [](Encoder &enc) {
+        enc.beginDict();
+        enc["name"_sl] = "Alice";
+        enc["nickname"_sl] = "Alice";
+        enc["age"_sl] = 30;
+        enc.endDict();
+        return enc.finish();
+    };
+    Encoder fresh;
+    alloc_slice expected = encodeDoc(fresh);
+
+    FLEncoder reused;
+    {
+        Encoder enc = Encoder::pooled();
+        reused = enc;
+        // Leave it with non-default options, an error, and an unfinished document:
+        enc.setSharedKeys(SharedKeys::create());
+        enc.suppressTrailer();
+        enc.beginArray();
+        enc.writeString("oops");
+        CHECK(!enc.endDict());
+        CHECK(enc.error() != kFLNoError);
+    }
+    {
+        Encoder enc = Encoder::pooled();
+        CHECK((FLEncoder)enc == reused);
+        CHECK(enc.error() == kFLNoError);
+        CHECK(enc.bytesWritten() == 0);
+        CHECK(encodeDoc(enc) == expected);
+        CHECK(encodeDoc(enc) == expected);
+    }
+
+    // Each thread has its own pool:
+    std::thread([&]{
+        Encoder enc = Encoder::pooled();
+        CHECK((FLEncoder)enc != reused);
+        CHECK(encodeDoc(enc) == expected);
+    }).join();
+
+    // Pooled encoders can still be created and freed after the pool is gone at thread exit:
+    struct FreeAtExit {
+        FLEncoder enc = nullptr;
+        ~FreeAtExit() {
+            FLEncoder_Free(enc);
+            FLEncoder_Free(FLEncoder_NewPooled());
+        }
+    };
+    std::thread([&]{
+        thread_local FreeAtExit holder;     // constructed before the pool, so destructed after
+        holder.enc = FLEncoder_NewPooled();
+    }).join();
+}
+
+
+TEST_CASE("API Extract", "[API]") {
+    Doc doc = Doc::fromJSON(R"({"people":[{"name":"Alice","tags":["x","y"]},{"name":"Bob"}],"n":1})"_sl);
+    Value alice = doc["people"].asArray()[0];
+    alloc_slice data = alice.extract();
+    REQUIRE(data);
+    Value extracted = Value::fromData(data, kFLUntrusted);
+    REQUIRE(extracted);
+    CHECK(extracted.toJSONString() == alice.toJSONString());
+    CHECK(data.size < doc.data().size);
+
+    CHECK(!Value().extract());
+}
+
+
+TEST_CASE("API DocCache", "[API]") {
+    FLDocCache cache = FLDocCache_New(100000, 100);
+    alloc_slice data = readTestFile("1person.fleece");
+    FLSliceResult result = FLSlice_Copy(data);
+    FLDoc doc1 = FLDocCache_FromResultData(cache, result, kFLUntrusted, nullptr);
+    FLDoc doc2 = FLDocCache_FromResultData(cache, result, kFLUntrusted, nullptr);
+    REQUIRE(doc1);
+    CHECK(doc2 == doc1);
+
+    CHECK(FLDocCache_Find(cache, "key"_sl) == nullptr);
+    FLDoc keyed = FLDocCache_Add(cache, "key"_sl, result, kFLTrusted, nullptr);
+    FLSliceResult_Release(result);
+    FLDoc found = FLDocCache_Find(cache, "key"_sl);
+    CHECK(found == keyed);
+
+    FLDocCacheStats stats;
+    FLDocCache_GetStats(cache, &stats);
+    CHECK(stats.hits == 2);
+    CHECK(stats.misses == 3);
+    CHECK(stats.count == 2);
+    CHECK(stats.maxBytes == 100000);
+
+    FLDocCache_SetMaxBytes(cache, 0);
+    FLDocCache_GetStats(cache, &stats);
+    CHECK(stats.count == 0);
+    CHECK(stats.evictions == 2);
+
+    for (FLDoc doc : {doc1, doc2, keyed, found})
+        FLDoc_Release(doc);
+    FLDocCache_Release(cache);
+}
@@ -19,6 +19,7 @@
 #include "FleeceTests.hh"
 #include "FleeceImpl.hh"
 #include "JSONDelta.hh"
+#include "JSON5Converter.hh"
 #include <iostream>
 
 namespace fleece { namespace impl {
@@ -218,8 +219,8 @@ static void checkDelta(const Value *left, const Value *right, const Value *expec
 TEST_CASE("JSONDiffPatch test suite", "[delta]") {
     Encoder enc;
     auto input = readTestFile("DeltaTests.json5");
-    JSONConverter jr(enc);
-    jr.encodeJSON(ConvertJSON5(std::string(input)));
+    JSON5Converter jr(enc);
+    REQUIRE(jr.encodeJSON5(input));
     enc.end();
     alloc_slice encoded = enc.finish();
     const Dict *testSuites = Value::fromData(encoded)->asDict();
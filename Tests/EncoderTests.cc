@@ -25,12 +25,20 @@
 #include "jsonsl.h"
 #include "mn_wordlist.h"
 #include "NumConversion.hh"
+#include "JSONEncoder.hh"
+#include "MutableArray.hh"
+#include "MutableDict.hh"
+#include "SharedKeys.hh"
+#include "BlobStore.hh"
+#include "SizeStats.hh"
 #include <iostream>
+#include <map>
 #include "fleece/Fleece.hh"
 #include <float.h>
 
 #ifndef _MSC_VER
 #include <unistd.h>
+#include <sys/uio.h>
 #endif
 
 namespace fleece { namespace impl {
@@ -422,6 +430,593 @@ public:
 #endif
     }
 
+    // A ChunkAllocator that keeps freed chunks for reuse.
+    class PooledChunkAllocator : public ChunkAllocator {
+    public:
+        static constexpr size_t kSize = 128 * 1024;
+        ~PooledChunkAllocator() {
+            for (void *chunk : pool)
+                ::free(chunk);
+        }
+        slice allocateChunk(size_t minSize, size_t) override {
+            REQUIRE(minSize <= kSize);
+            if (pool.empty()) {
+                ++allocated;
+                return slice(::malloc(kSize), kSize);
+            }
+            void *chunk = pool.back();
+            pool.pop_back();
+            return slice(chunk, kSize);
+        }
+        void freeChunk(slice chunk) noexcept override {
+            pool.push_back((void*)chunk.buf);
+        }
+        std::vector<void*> pool;
+        size_t allocated = 0;
+    };
+
+    TEST_CASE("Encoder finishChunks", "[Encoder]") {
+        PooledChunkAllocator pool;
+        Encoder enc;
+        enc.setChunkAllocator(&pool);
+        size_t allocatedInFirstRound = 0;
+        for (int round = 0; round < 3; ++round) {
+            enc.beginArray();
+            for (int i = 0; i < 20000; ++i)
+                enc.writeString(std::to_string(i * 1000 + round));
+            enc.endArray();
+            WriterChunks chunks = enc.finishChunks();
+            enc.reset();
+            CHECK(chunks.count() > 1);
+            for (auto &chunk : chunks)
+                CHECK(chunk.size <= PooledChunkAllocator::kSize);
+#ifndef _MSC_VER
+            CHECK(chunks.iovecs()[1].iov_base == chunks[1].buf);
+            CHECK(chunks.iovecs()[1].iov_len == chunks[1].size);
+#endif
+            alloc_slice data = chunks.join();
+            CHECK(data.size == chunks.totalSize());
+            const Array *array = Value::fromData(data)->asArray();
+            REQUIRE(array);
+            CHECK(array->count() == 20000);
+            CHECK(array->get(19999)->asString() == slice(std::to_string(19999000 + round)));
+            if (round == 0)
+                allocatedInFirstRound = pool.allocated;
+        }
+        // Later rounds reused the buffers from the first:
+        CHECK(pool.allocated == allocatedInFirstRound);
+
+        // A short output that fits in the Writer's inline buffer:
+        enc.writeInt(17);
+        WriterChunks chunks = enc.finishChunks();
+        REQUIRE(chunks.count() == 1);
+        CHECK(Value::fromData(chunks[0])->asInt() == 17);
+
+        Writer w;
+        w << slice("hello");
+        WriterChunks written = w.finishAsIOVecs();
+        REQUIRE(written.count() == 1);
+        CHECK(written[0] == "hello"_sl);
+        CHECK(w.length() == 0);
+    }
+
+    // A ChunkAllocator that keeps track of how much memory is allocated.
+    class CountingChunkAllocator : public ChunkAllocator {
+    public:
+        slice allocateChunk(size_t minSize, size_t preferredSize) override {
+            slice chunk = defaultAllocator().allocateChunk(minSize, preferredSize);
+            sizes[chunk.buf] = chunk.size;
+            live += chunk.size;
+            ++allocations;
+            return chunk;
+        }
+        void freeChunk(slice chunk) noexcept override {
+            live -= sizes[chunk.buf];
+            sizes.erase(chunk.buf);
+            defaultAllocator().freeChunk(chunk);
+        }
+        std::map<const void*, size_t> sizes;
+        size_t live = 0, allocations = 0;
+    };
+
+    TEST_CASE("Encoder limitRetainedMemory", "[Encoder]") {
+        CountingChunkAllocator counter;
+        Encoder enc;
+        enc.setChunkAllocator(&counter);
+        enc.limitRetainedMemory(64 * 1024);
+        auto encode = [&](int nStrings) {
+            enc.beginArray();
+            for (int i = 0; i < nStrings; ++i)
+                enc.writeString("string number " + std::to_string(i));
+            enc.endArray();
+            alloc_slice data = enc.finish();
+            const Array *array = Value::fromData(data)->asArray();
+            REQUIRE(array);
+            CHECK(array->count() == uint32_t(nStrings));
+            CHECK(array->get(nStrings - 1)->asString()
+                    == slice("string number " + std::to_string(nStrings - 1)));
+        };
+
+        // Small documents reuse the same buffer, and the same scratch memory for the stack's
+        // value arrays:
+        encode(100);
+        size_t allocations = counter.allocations;
+#ifndef NDEBUG
+        size_t scratchAllocations = enc.scratchChunkAllocations();
+#endif
+        for (int i = 0; i < 10; ++i)
+            encode(100);
+        CHECK(counter.allocations == allocations);
+        CHECK(counter.live > 0);
+#ifndef NDEBUG
+        CHECK(enc.scratchChunkAllocations() == scratchAllocations);
+#endif
+
+        // A huge document's buffers aren't kept afterwards:
+        encode(100000);
+        CHECK(counter.live <= 64 * 1024);
+
+        // ...and the encoder settles back down to reusing a buffer for small documents:
+        for (int i = 0; i < 10; ++i)
+            encode(100);
+        allocations = counter.allocations;
+        for (int i = 0; i < 10; ++i)
+            encode(100);
+        CHECK(counter.allocations == allocations);
+
+        // resetToDefaults gives the same output as a new Encoder:
+        enc.uniqueStrings(false);
+        enc.suppressTrailer();
+        enc.beginArray();
+        enc.writeString("abandoned");
+        enc.resetToDefaults();
+        Encoder fresh;
+        for (Encoder *e : {&enc, &fresh}) {
+            e->beginArray();
+            e->writeString("dup");
+            e->writeString("dup");
+            e->endArray();
+        }
+        CHECK(enc.finish() == fresh.finish());
+    }
+
+    TEST_CASE("Encoder extract", "[Encoder]") {
+        Retained<SharedKeys> sk;
+        SECTION("String keys") { }
+        SECTION("Shared keys") {sk = new SharedKeys(); }
+        Encoder enc;
+        enc.setSharedKeys(sk);
+        enc.beginDictionary();
+        enc.writeKey("a");
+        enc.beginArray();
+        for (int i = 0; i < 10; ++i)
+            enc.writeString("shared #" + std::to_string(i));
+        enc.endArray();
+        enc.writeKey("b");
+        enc.beginDictionary();
+        enc.writeKey("shared");
+        enc.writeString("shared #3");        // points back into "a"
+        enc.writeKey("own");
+        enc.writeString("only in b");
+        enc.writeKey("nested");
+        enc.beginArray();
+        enc.writeDouble(3.14159);
+        enc.writeString("shared #7");
+        enc.writeInt(1234567890123);
+        enc.endArray();
+        enc.endDictionary();
+        enc.writeKey("c");
+        enc.beginArray();
+        for (int i = 0; i < 20000; ++i)             // big enough to need a wide root pointer
+            enc.writeInt(i);
+        enc.endArray();
+        enc.writeKey("d");
+        enc.writeString("just a string");
+        enc.endDictionary();
+        Retained<Doc> doc = new Doc(enc.finish(), Doc::kTrusted, sk);
+        const Dict *root = doc->asDict();
+        REQUIRE(root);
+
+        for (Dict::iterator i(root); i; ++i) {
+            alloc_slice extracted = Encoder::extract(i.value());
+            Retained<Doc> extractedDoc = new Doc(extracted, Doc::kUntrusted, sk);
+            REQUIRE(extractedDoc->root());
+            CHECK(extractedDoc->root()->toJSON() == i.value()->toJSON());
+        }
+
+        // Only "b" and its strings were copied, not the rest of "a":
+        alloc_slice b = Encoder::extract(root->get("b"));
+        CHECK(b.size < 100);
+        CHECK(slice(b).find("only in b"_sl));
+        CHECK(slice(b).find("shared #3"_sl));
+        CHECK(!slice(b).find("shared #0"_sl));
+
+        // Extracting the whole document copies it (except for a shorter trailer):
+        alloc_slice all = Encoder::extract(root);
+        CHECK(all.size <= doc->data().size);
+        CHECK(all.upTo(all.size - 2) == doc->data().upTo(all.size - 2));
+
+        // A mutable Dict has to be encoded:
+        Retained<MutableDict> md = MutableDict::newDict(root->get("b")->asDict());
+        md->set("own"_sl, "changed"_sl);
+        alloc_slice mutated = Encoder::extract(md);
+        Retained<Doc> mutatedDoc = new Doc(mutated, Doc::kUntrusted, sk);
+        CHECK(mutatedDoc->asDict()->get("own")->asString() == "changed"_sl);
+        CHECK(mutatedDoc->asDict()->get("shared")->asString() == "shared #3"_sl);
+    }
+
+
+    TEST_CASE("Encoder BlobStore", "[Encoder]") {
+        std::string big1(300, 'x'), big2(200, 'y');
+        std::string bigData(500, '\x7F');
+        auto encode = [&](Encoder &enc) {
+            enc.beginDictionary();
+            enc.writeKey("a");
+            enc.writeString(big1);
+            enc.writeKey("b");
+            enc.writeString(big1);
+            enc.writeKey("c");
+            enc.writeString(big2);
+            enc.writeKey("d");
+            enc.writeData(slice(bigData));
+            enc.writeKey("e");
+            enc.writeString("small");
+            enc.endDictionary();
+            return enc.finish();
+        };
+        Encoder plainEnc;
+        alloc_slice plain = encode(plainEnc);
+
+        Retained<MemoryBlobStore> store = new MemoryBlobStore();
+        Encoder enc;
+        enc.setBlobStore(store, 100);
+        alloc_slice data = encode(enc);
+        CHECK(data.size < 250);
+        CHECK(store->count() == 3);
+        CHECK(store->bytesStored() == big1.size() + big2.size() + bigData.size());
+
+        // With the store, resolveBlob returns the blobs' contents; the references are still data:
+        Retained<Doc> doc = new Doc(data, Doc::kUntrusted);
+        doc->setBlobStore(store);
+        const Dict *root = doc->asDict();
+        REQUIRE(root);
+        bool isString = false;
+        CHECK(root->get("a")->type() == kData);
+        CHECK(root->get("a")->asString() == nullslice);
+        CHECK(root->get("a")->asData().size < BlobRef::kMaxEncodedSize);
+        CHECK(root->get("a")->resolveBlob(&isString) == slice(big1));
+        CHECK(isString);
+        CHECK(root->get("c")->resolveBlob() == slice(big2));
+        CHECK(root->get("d")->type() == kData);
+        CHECK(root->get("d")->resolveBlob(&isString) == slice(bigData));
+        CHECK(!isString);
+        CHECK(root->get("e")->asString() == "small"_sl);
+        CHECK(root->get("e")->resolveBlob(&isString) == "small"_sl);
+        CHECK(isString);
+        CHECK(root->toJSON() == Value::fromData(plain)->toJSON());
+
+        // Without it, references don't resolve:
+        Retained<Doc> bare = new Doc(alloc_slice(slice(data)), Doc::kUntrusted);
+        const Value *bareRef = bare->asDict()->get("a");
+        CHECK(bareRef->resolveBlob(&isString) == bareRef->asData());
+        CHECK(!isString);
+
+        // Copying to an encoder without the store writes the content inline:
+        Encoder copier;
+        copier.writeValue(root);
+        alloc_slice copied = copier.finish();
+        CHECK(copied.size > big1.size() + big2.size() + bigData.size());
+        CHECK(Value::fromData(copied)->toJSON() == Value::fromData(plain)->toJSON());
+
+        // Copying to an encoder with the store copies just the references:
+        Encoder refCopier;
+        refCopier.setBlobStore(store, 100);
+        refCopier.writeValue(root);
+        alloc_slice refCopied = refCopier.finish();
+        CHECK(refCopied.size < 250);
+        CHECK(store->count() == 3);
+    }
+
+
+    TEST_CASE("Encoder BlobStore fake references", "[Encoder]") {
+        // Ordinary data that's a valid reference -- to content that's even in the store -- must
+        // still read as that data:
+        std::string big(300, 'x');
+        Retained<MemoryBlobStore> store = new MemoryBlobStore();
+        BlobRef ref {true, big.size(), SHA256::compute(slice(big))};
+        store->put(ref.digest, slice(big));
+        uint8_t buf[BlobRef::kMaxEncodedSize];
+        slice fake(buf, ref.encode(buf));
+        BlobRef decoded;
+        REQUIRE(BlobRef::decode(fake, decoded));
+
+        auto encode = [&](BlobStore *encStore) {
+            Encoder enc;
+            if (encStore)
+                enc.setBlobStore(encStore, 100);
+            enc.beginArray();
+            enc.writeData(fake);
+            enc.endArray();
+            return enc.finish();
+        };
+        auto check = [&](const alloc_slice &data, BlobStore *docStore) {
+            Retained<Doc> doc = new Doc(data, Doc::kUntrusted);
+            if (docStore)
+                doc->setBlobStore(docStore);
+            const Value *item = doc->asArray()->get(0);
+            bool isString = true;
+            CHECK(item->type() == kData);
+            CHECK(item->resolveBlob(&isString) == fake);
+            CHECK(!isString);
+            CHECK(item->asString() == nullslice);
+            if (!docStore)
+                CHECK(item->asData() == fake);
+        };
+
+        // Written without a store, it's data, also to a Doc whose store doesn't have the content:
+        alloc_slice plain = encode(nullptr);
+        check(plain, nullptr);
+        check(alloc_slice(slice(plain)), new MemoryBlobStore());
+
+        // Written with a store, the data goes in the store, so it reads back exactly with it:
+        alloc_slice escaped = encode(store);
+        CHECK(store->count() == 2);
+        check(escaped, store);
+
+        // Copying it keeps it data:
+        Retained<Doc> doc = new Doc(escaped, Doc::kUntrusted);
+        doc->setBlobStore(store);
+        Encoder copier;
+        copier.writeValue(doc->root());
+        check(copier.finish(), nullptr);
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "Typed Arrays", "[Encoder][Numeric]") {
+        {
+            const int32_t ints[3] = {0x1000000, -70000000, 0x12345678};
+            enc.writeTypedArray(ints, 3);
+            checkOutput("5F92 8000 1300 0000 0100 1380 E2D3 FB00 1378 5634 1200 800B");
+            auto a = checkArray(3);
+            CHECK(a->isTypedArray());
+            CHECK(a->asData() == nullslice);
+            // Generic readers see ordinary numbers:
+            CHECK(a->get(0)->asInt() == 0x1000000);
+            CHECK(a->get(1)->asInt() == -70000000);
+            CHECK(a->get(2)->asInt() == 0x12345678);
+            CHECK(a->get(3) == nullptr);
+            CHECK(a->toJSONString() == "[16777216,-70000000,305419896]");
+            int64_t out[5];
+            CHECK(a->getInts(0, 5, out) == 3);
+            CHECK(out[0] == 0x1000000);
+            CHECK(out[1] == -70000000);
+            CHECK(out[2] == 0x12345678);
+            CHECK(a->getInts(1, 5, out) == 2);
+            CHECK(out[0] == -70000000);
+            CHECK(a->getInts(3, 5, out) == 0);
+            double dout[3];
+            CHECK(a->getDoubles(0, 3, dout) == 3);
+            CHECK(dout[1] == -70000000.0);
+        }
+        {
+            // Small numbers are stored at full size too, and 64-bit ints that fit in 32 bits
+            // are stored as 32-bit:
+            const int64_t ints[3] = {1, -70000, 12};
+            enc.writeTypedArray(ints, 3);
+            checkOutput("5F92 8000 1301 0000 0000 1390 EEFE FF00 130C 0000 0000 800B");
+            auto a = checkArray(3);
+            int64_t out[3];
+            CHECK(a->getInts(0, 3, out) == 3);
+            CHECK(out[0] == 1);
+            CHECK(out[1] == -70000);
+            CHECK(out[2] == 12);
+            Array::iterator i(a);
+            CHECK(i.value()->asInt() == 1);
+            CHECK((++i).value()->asInt() == -70000);
+            CHECK(i[1]->asInt() == 12);
+
+            // It's equal to an ordinary array of the same numbers:
+            Encoder plain;
+            plain.beginArray();
+            for (auto n : ints)
+                plain.writeInt(n);
+            plain.endArray();
+            alloc_slice plainData = plain.finish();
+            CHECK(a->isEqual(Value::fromData(plainData)));
+            CHECK(Value::fromData(plainData)->isEqual(a));
+            CHECK(!a->isEqual(Value::fromData(plainData)->asArray()->get(0)));
+        }
+        {
+            // Large arrays, nested in an ordinary one:
+            const size_t kCount = 100000;
+            std::vector<int64_t> ints(kCount);
+            std::vector<double> doubles(kCount);
+            std::vector<float> floats(kCount);
+            for (size_t i = 0; i < kCount; ++i) {
+                ints[i] = int64_t(i * i) - 1000000;
+                doubles[i] = i * 0.5 + M_PI;
+                floats[i] = float(i) * 0.25f;
+            }
+            enc.beginArray();
+            enc.writeTypedArray(ints.data(), kCount);
+            enc.writeTypedArray(doubles.data(), kCount);
+            enc.writeTypedArray(floats.data(), kCount);
+            enc.endArray();
+            endEncoding();
+            CHECK(result.size < kCount * (10 + 10 + 6) + 100);
+            auto root = checkArray(3);
+
+            auto a = root->get(0)->asArray();
+            REQUIRE(a);
+            CHECK(a->isTypedArray());
+            REQUIRE(a->count() == kCount);
+            CHECK(a->get(12345)->asInt() == ints[12345]);
+            std::vector<int64_t> intOut(kCount);
+            CHECK(a->getInts(0, kCount, intOut.data()) == kCount);
+            CHECK(intOut == ints);
+
+            a = root->get(1)->asArray();
+            REQUIRE(a);
+            CHECK(a->get(7)->isDouble());
+            CHECK(a->get(7)->asDouble() == doubles[7]);
+            std::vector<double> doubleOut(kCount);
+            CHECK(a->getDoubles(0, kCount, doubleOut.data()) == kCount);
+            CHECK(doubleOut == doubles);
+            CHECK(a->getDoubles(kCount - 10, 100, doubleOut.data()) == 10);
+            CHECK(doubleOut[9] == doubles[kCount - 1]);
+
+            a = root->get(2)->asArray();
+            REQUIRE(a);
+            CHECK(!a->get(5)->isDouble());
+            CHECK(a->get(5)->asFloat() == floats[5]);
+            CHECK(a->getDoubles(0, kCount, doubleOut.data()) == kCount);
+            for (size_t i = 0; i < kCount; ++i)
+                REQUIRE(doubleOut[i] == floats[i]);
+            // Floats aren't converted to ints in bulk, but are still converted:
+            CHECK(a->getInts(10, 2, intOut.data()) == 2);
+            CHECK(intOut[0] == 2);
+            CHECK(intOut[1] == 2);
+        }
+        {
+            // Copying a typed array keeps it typed; a mutable copy sees the same numbers:
+            const double doubles[4] = {M_PI, -1.0e100, 0.1, 12345678.9};
+            enc.beginDictionary();
+            enc.writeKey("d");
+            enc.writeTypedArray(doubles, 4);
+            enc.endDictionary();
+            endEncoding();
+            Retained<Doc> doc = Doc::fromFleece(result);
+            auto a = doc->asDict()->get("d"_sl)->asArray();
+            REQUIRE(a);
+
+            Encoder copier;
+            copier.writeValue(a);
+            alloc_slice copy = copier.finish();
+            auto copied = Value::fromData(copy);
+            REQUIRE(copied);
+            CHECK(copied->isTypedArray());
+            CHECK(copied->isEqual(a));
+
+            auto m = MutableArray::newArray(a, kCopyImmutables);
+            REQUIRE(m->count() == 4);
+            CHECK(m->get(0)->asDouble() == M_PI);
+            m->set(1, 2.5);
+            double dout[4];
+            CHECK(m->getDoubles(0, 4, dout) == 4);
+            CHECK(dout[1] == 2.5);
+            CHECK(dout[3] == 12345678.9);
+            CHECK(m->isEqual(a) == false);
+
+            auto md = MutableDict::newDict(doc->asDict());
+            auto ma = md->getMutableArray("d"_sl);
+            REQUIRE(ma);
+            CHECK(ma->count() == 4);
+            CHECK(ma->get(2)->asDouble() == 0.1);
+        }
+        {
+            // Ordinary arrays are read one item at a time:
+            enc.beginArray();
+            enc.writeInt(7);
+            enc.writeDouble(2.5);
+            enc.writeString("x");
+            enc.writeInt(123456789012);
+            enc.endArray();
+            endEncoding();
+            auto a = checkArray(4);
+            CHECK(!a->isTypedArray());
+            double dout[4];
+            CHECK(a->getDoubles(0, 4, dout) == 4);
+            CHECK(dout[0] == 7.0);
+            CHECK(dout[1] == 2.5);
+            CHECK(dout[2] == 0.0);
+            CHECK(dout[3] == 123456789012.0);
+            int64_t iout[4];
+            CHECK(a->getInts(0, 4, iout) == 4);
+            CHECK(iout[0] == 7);
+            CHECK(iout[3] == 123456789012);
+
+            Retained<Doc> doc = Doc::fromFleece(result);
+            auto m = MutableArray::newArray(doc->asArray());
+            m->set(0, 99);
+            CHECK(m->getDoubles(0, 4, dout) == 4);
+            CHECK(dout[0] == 99.0);
+            CHECK(dout[1] == 2.5);
+        }
+        {
+            // Data that isn't a typed array, even if it looks like one, is still data:
+            const uint8_t bytes[10] = {0x13, 0x01, 0, 0, 0, 0, 0x13, 0x02, 0, 0};
+            enc.writeData(slice(bytes, sizeof(bytes)));
+            endEncoding();
+            auto v = Value::fromData(result);
+            REQUIRE(v);
+            CHECK(v->type() == kData);
+            CHECK(!v->isTypedArray());
+            CHECK(v->asArray() == nullptr);
+        }
+        {
+            // Validation rejects a typed array whose items aren't all the same kind:
+            const int32_t ints[3] = {1, 2, 3};
+            enc.writeTypedArray(ints, 3);
+            endEncoding();
+            CHECK(Value::fromData(result) != nullptr);
+            alloc_slice bad(result);
+            ((uint8_t*)bad.buf)[4 + 6] = 0x17;
+            CHECK(Value::fromData(bad) == nullptr);
+        }
+        {
+            // JSON encoders write typed arrays as ordinary JSON arrays:
+            const float floats[3] = {0.5f, -1.25f, 3.0f};
+            JSONEncoder json;
+            json.writeTypedArray(floats, 3);
+            CHECK(json.finish() == "[0.5,-1.25,3.0]"_sl);
+        }
+    }
+
+    TEST_CASE("Typed Array sizes", "[Encoder][Numeric]") {
+        // Returns the sizes of a typed array and of an ordinary array of the same numbers:
+        auto sizes = [](const auto &values) {
+            Encoder typed, plain;
+            typed.writeTypedArray(values.data(), values.size());
+            plain.beginArray();
+            for (auto n : values) {
+                if constexpr (std::is_same<decltype(n), float>::value)
+                    plain.writeFloat(n);
+                else if constexpr (std::is_same<decltype(n), double>::value)
+                    plain.writeDouble(n);
+                else
+                    plain.writeInt(n);
+            }
+            plain.endArray();
+            return std::make_pair(typed.finish().size, plain.finish().size);
+        };
+        std::vector<int32_t> smallInts(100), bigInts(100);
+        std::vector<int64_t> longs(100), bigLongs(100);
+        std::vector<double> floatDoubles(100), doubles(100);
+        std::vector<float> floats(100);
+        for (int i = 0; i < 100; ++i) {
+            smallInts[i] = i - 50;
+            bigInts[i] = (i + 1) * 20000000;
+            longs[i] = i * 100000;
+            bigLongs[i] = (int64_t(i) + 1) << 56;
+            floatDoubles[i] = i * 0.5 + 0.25;
+            doubles[i] = i * 0.1 + M_PI;
+            floats[i] = i * 0.1f;
+        }
+        // Each item takes 2 bytes more than the number, plus 4 bytes of header and a root pointer:
+        CHECK(sizes(smallInts).first == 100 * 6 + 6);
+        CHECK(sizes(bigInts).first == 100 * 6 + 6);
+        CHECK(sizes(longs).first == 100 * 6 + 6);           // 32-bit is enough
+        CHECK(sizes(bigLongs).first == 100 * 10 + 6);
+        CHECK(sizes(floatDoubles).first == 100 * 6 + 6);    // float is enough
+        CHECK(sizes(doubles).first == 100 * 10 + 6);
+        CHECK(sizes(floats).first == 100 * 6 + 6);
+
+        // Only small ints are smaller in an ordinary array:
+        CHECK(sizes(smallInts).second < sizes(smallInts).first);
+        for (auto [typed, plain] : {sizes(bigInts), sizes(longs), sizes(bigLongs),
+                                    sizes(floatDoubles), sizes(doubles), sizes(floats)})
+            CHECK(typed < plain);
+    }
+
     TEST_CASE_METHOD(EncoderTests, "Dictionaries", "[Encoder]") {
         {
             enc.beginDictionary();
@@ -503,6 +1098,47 @@ public:
         endEncoding();
     }
 
+    TEST_CASE_METHOD(EncoderTests, "Scratch memory reuse", "[Encoder]") {
+        // Big and deeply nested collections; once the encoder's scratch arena has grown to fit
+        // them, encoding the same kind of document again shouldn't allocate any more chunks.
+        auto encodeDoc = [&] {
+            enc.beginArray();
+            for (int depth = 0; depth < 50; ++depth) {
+                enc.beginDictionary();
+                for (int i = 0; i < 300; ++i) {
+                    char key[20];
+                    sprintf(key, "k%d", (i * 7) % 300);
+                    enc.writeKey(key);
+                    if (i == 150)
+                        break;
+                    enc.writeInt(i);
+                }
+            }
+            enc.writeString("bottom");
+            for (int depth = 0; depth < 50; ++depth)
+                enc.endDictionary();
+            enc.endArray();
+            return enc.finish();
+        };
+        alloc_slice first = encodeDoc();
+#ifndef NDEBUG
+        size_t chunks = enc.scratchChunkAllocations();
+#endif
+        for (int i = 0; i < 3; ++i) {
+            enc.reset();
+            CHECK(encodeDoc() == first);
+        }
+#ifndef NDEBUG
+        CHECK(enc.scratchChunkAllocations() == chunks);
+#endif
+
+        const Dict *dict = Value::fromData(first)->asArray()->get(0)->asDict();
+        REQUIRE(dict);
+        CHECK(dict->count() == 151);
+        CHECK(dict->get("k0"_sl)->asInt() == 0);
+        CHECK(dict->get("k7"_sl)->asInt() == 1);
+    }
+
     TEST_CASE_METHOD(EncoderTests, "SharedStrings", "[Encoder]") {
         enc.beginArray(4);
         enc.writeString("a");
@@ -617,6 +1253,48 @@ public:
         REQUIRE(w.finish() == alloc_slice("not-really-binary"));
     }
 
+    TEST_CASE_METHOD(EncoderTests, "Binary timestamps", "[Encoder]") {
+        static constexpr int64_t kTime = 1492648496123;     // 2017-04-20T00:34:56.123Z
+        enc.beginArray();
+        enc.writeDateString(kTime);
+        enc.binaryTimestamps(true);
+        enc.writeDateString(kTime, false);
+        enc.writeTimestamp(-1);
+        enc.writeDouble(1492648496123.0);
+        enc.endArray();
+        endEncoding();
+
+        auto a = Value::fromData(result)->asArray();
+        REQUIRE(a);
+        CHECK(a->get(0)->type() == kString);
+        CHECK(!a->get(0)->isTimestamp());
+        for (uint32_t i = 1; i <= 2; ++i) {
+            auto v = a->get(i);
+            CHECK(v->isTimestamp());
+            CHECK(v->type() == kNumber);
+            CHECK(v->isDouble());
+        }
+        CHECK(a->get(1)->asTimestamp() == kTime);
+        CHECK(a->get(1)->asInt() == kTime);
+        CHECK(!a->get(1)->isEqual(a->get(3)));       // a date isn't the same as a number
+        CHECK(a->get(2)->asTimestamp() == -1);
+        CHECK(!a->get(3)->isTimestamp());
+        CHECK(a->get(1)->toString() == "2017-04-20T00:34:56.123Z"_sl);
+        CHECK(a->toJSON() == "[\"2017-04-20T00:34:56.123Z\",\"2017-04-20T00:34:56.123Z\","
+                             "\"1969-12-31T23:59:59.999Z\",1492648496123.0]"_sl);
+
+        // Re-encoding and mutable copies keep the timestamp flag:
+        enc.writeValue(a);
+        endEncoding();
+        CHECK(Value::fromData(result)->asArray()->get(1)->isTimestamp());
+        Retained<Doc> doc = new Doc(result);
+        auto m = MutableArray::newArray(doc->asArray(), CopyFlags(kDeepCopy | kCopyImmutables));
+        CHECK(m->get(1)->isTimestamp());
+        CHECK(m->get(1)->asTimestamp() == kTime);
+
+        CHECK_THROWS_AS(enc.writeTimestamp(INT64_MIN), FleeceException);
+    }
+
     TEST_CASE_METHOD(EncoderTests, "Dump", "[Encoder]") {
         std::string json = json5("{'foo':123,"
                                  "'\"ironic\"':[null,false,true,-100,0,100,123.456,6.02e+23],"
@@ -651,6 +1329,37 @@ public:
             " 0050: 80 07       : &Dict @0042\n"));
     }
 
+    TEST_CASE_METHOD(EncoderTests, "SizeStats", "[Encoder]") {
+        // Same data as the "Dump" test above:
+        std::string json = json5("{'foo':123,"
+                                 "'\"ironic\"':[null,false,true,-100,0,100,123.456,6.02e+23],"
+                                 "'':'hello\\nt\\\\here'}");
+        JSONConverter j(enc);
+        j.encodeJSON(slice(json));
+        endEncoding();
+
+        SizeStats stats;
+        REQUIRE(stats.addDocument(result));
+        CHECK(stats.documents == 1);
+        CHECK(stats.totalBytes == 0x52);
+        CHECK(stats.strings.count == 3);
+        CHECK(stats.strings.bytes == 26);
+        CHECK(stats.floats.count == 2);
+        CHECK(stats.floats.bytes == 20);
+        CHECK(stats.ints.count == 4);
+        CHECK(stats.specials.count == 3);
+        CHECK(stats.narrowPointers.count == 5);
+        CHECK(stats.widePointers.count == 0);
+        CHECK(stats.narrowArrays.count == 1);
+        CHECK(stats.narrowDicts.count == 1);
+        CHECK(stats.stringKeys.count == 3);
+        CHECK(stats.sharedKeys.count == 0);
+        CHECK(stats.paddingBytes() == 2);     // after the two odd-sized strings
+
+        CHECK(!stats.addDocument(alloc_slice("nope")));
+        CHECK(stats.documents == 1);
+    }
+
     TEST_CASE_METHOD(EncoderTests, "ConvertPeople", "[Encoder]") {
         auto input = readTestFile(kBigJSONTestFileName);
 
@@ -671,7 +1380,7 @@ public:
 
 #if FL_HAVE_TEST_FILES
         REQUIRE(result.buf);
-        writeToFile(result, kTestFilesDir "1000people.fleece");
+        writeToFile(result, kBigFleeceFilePath);
 #endif
 
         fprintf(stderr, "\nJSON size: %zu bytes; Fleece size: %zu bytes (%.2f%%)\n",
@@ -685,7 +1394,7 @@ public:
 
 #if FL_HAVE_TEST_FILES
     TEST_CASE_METHOD(EncoderTests, "Encode To File", "[Encoder]") {
-    	auto doc = readTestFile("1000people.fleece");
+        auto doc = readBigFleeceFile();
         auto root = Value::fromTrustedData(doc)->asArray();
 
         {
@@ -707,7 +1416,7 @@ public:
 
 #if FL_HAVE_TEST_FILES
     TEST_CASE_METHOD(EncoderTests, "FindPersonByIndexSorted", "[Encoder]") {
-        auto doc = readTestFile("1000people.fleece");
+        auto doc = readBigFleeceFile();
         auto root = Value::fromTrustedData(doc)->asArray();
         auto person = root->get(123)->asDict();
         const Value *name = person->get(slice("name"));
@@ -755,7 +1464,7 @@ public:
             // Now try a wide Dict:
             Dict::key nameKey(slice("name"));
 
-            auto doc = readTestFile("1000people.fleece");
+            auto doc = readBigFleeceFile();
             auto root = Value::fromTrustedData(doc)->asArray();
             auto person = root->get(123)->asDict();
             lookupNameWithKey(person, nameKey, "Concepcion Burns");
@@ -950,6 +1659,74 @@ public:
     }
 
 
+    TEST_CASE_METHOD(EncoderTests, "Hot Paths", "[Encoder]") {
+        Retained<Doc> src = Doc::fromJSON(R"([
+            {"name": "Ann Smith", "about": "A long string nobody reads very often, really",
+             "friends": [{"id": 1, "name": "Bob Jones"}],
+             "address": {"city": "Springfield", "street": "742 Evergreen Terrace"}},
+            {"name": "Carl Carlson", "about": "Another long string nobody reads very often",
+             "friends": [{"id": 2, "name": "Lenny Leonard"}],
+             "address": {"city": "Shelbyville", "street": "1 Cold Storage Avenue"}}
+            ])"_sl);
+        const Value *srcRoot = src->root();
+
+        auto checkLayout = [&](bool hot) {
+            auto root = Value::fromData(result);
+            REQUIRE(root);
+            CHECK(root->toJSONString() == srcRoot->toJSONString());
+            auto offset = [&](const Value *v) {return (const uint8_t*)v - (const uint8_t*)result.buf;};
+            // Every hot value should come after every cold one, if laid out with hot paths:
+            ptrdiff_t maxCold = 0, minHot = PTRDIFF_MAX;
+            for (Array::iterator i(root->asArray()); i; ++i) {
+                auto person = i.value()->asDict();
+                auto address = person->get("address"_sl)->asDict();
+                for (auto v : {person->get("about"_sl), person->get("friends"_sl),
+                               address->get("street"_sl)})
+                    maxCold = std::max(maxCold, offset(v));
+                for (auto v : {(const Value*)person, person->get("name"_sl),
+                               (const Value*)address, address->get("city"_sl)})
+                    minHot = std::min(minHot, offset(v));
+            }
+            CHECK((minHot > maxCold) == hot);
+        };
+
+        SECTION("No hot paths") {
+            enc.writeValue(srcRoot);
+            endEncoding();
+            checkLayout(false);
+        }
+        SECTION("Hot paths") {
+            enc.addHotPath("name"_sl);
+            enc.addHotPath("[0].address.city"_sl);
+            enc.writeValue(srcRoot);
+            endEncoding();
+            checkLayout(true);
+            // reset() keeps the hot paths:
+            enc.writeValue(srcRoot);
+            endEncoding();
+            checkLayout(true);
+        }
+        SECTION("Mutable") {
+            Retained<MutableArray> people = MutableArray::newArray(srcRoot->asArray(),
+                                                       CopyFlags(kDeepCopy | kCopyImmutables));
+            enc.addHotPath("name"_sl);
+            enc.addHotPath("address.city"_sl);
+            enc.writeValue(people);
+            endEncoding();
+            checkLayout(true);
+        }
+        SECTION("Cleared") {
+            enc.addHotPath("name"_sl);
+            enc.clearHotPaths();
+            enc.writeValue(srcRoot);
+            endEncoding();
+            checkLayout(false);
+        }
+
+        CHECK_THROWS_AS(enc.addHotPath("name["_sl), FleeceException);
+    }
+
+
 #pragma mark - KEY TREE:
 
     TEST_CASE_METHOD(EncoderTests, "KeyTree", "[Encoder]") {
@@ -991,7 +1768,7 @@ public:
         for (size_t i = 0; i < n; ++i) {
             INFO( "Checking '" << rawStrings[i] << "' ... ");
             unsigned id = keys[strings[i]];
-            REQUIRE(id);
+            REQUIRE(id == i + 1);
             REQUIRE(!ids[id]);
             ids[id] = true;
 
@@ -1013,6 +1790,59 @@ public:
         REQUIRE(keys[(unsigned)n+2].buf == nullptr);
         REQUIRE(keys[(unsigned)n+28].buf == nullptr);
         REQUIRE(keys[(unsigned)9999].buf == nullptr);
+
+        // Use the image in place, without copying it:
+        KeyTree mapped(output);
+        CHECK(mapped.count() == n);
+        CHECK(mapped[strings[17]] == 18);
+        CHECK(mapped[18u] == strings[17]);
+    }
+
+
+    TEST_CASE("KeyTree sizes", "[Encoder]") {
+        // Every tree shape up to 64 nodes, including the powers of two:
+        std::vector<std::string> storage;
+        for (int i = 0; i < 64; ++i)
+            storage.push_back("key" + std::to_string(i * 7919 % 64));
+        for (size_t n = 0; n <= storage.size(); ++n) {
+            std::vector<slice> strings(storage.begin(), storage.begin() + n);
+            KeyTree keys = KeyTree::fromStrings(strings);
+            INFO("n = " << n);
+            REQUIRE(keys.count() == n);
+            for (size_t i = 0; i < n; ++i) {
+                CHECK(keys[strings[i]] == i + 1);
+                CHECK(keys[unsigned(i + 1)] == strings[i]);
+            }
+            CHECK(keys[slice("key")] == 0);
+            CHECK(keys[slice("key99")] == 0);
+            CHECK(keys[unsigned(n + 1)] == nullslice);
+        }
+    }
+
+
+    TEST_CASE("KeyTree invalid", "[Encoder]") {
+        std::vector<slice> dups = {"foo"_sl, "bar"_sl, "foo"_sl};
+        CHECK_THROWS_AS(KeyTree::fromStrings(dups), FleeceException);
+
+        CHECK_THROWS_AS(KeyTree(slice("FlKT")), FleeceException);
+        CHECK_THROWS_AS(KeyTree(slice("NotAKeyTree!")), FleeceException);
+
+        std::vector<slice> strings = {"foo"_sl, "bar"_sl, "baz"_sl};
+        alloc_slice image = KeyTree::encode(strings);
+        CHECK_THROWS_AS(KeyTree(image.upTo(image.size - 1)), FleeceException);
+
+        // Scribbling on the offsets or tree must never cause bad reads, only failed lookups:
+        for (size_t i = 12; i < image.size; ++i) {
+            alloc_slice corrupt(image.buf, image.size);
+            for (int b = 0; b < 256; b += 37) {
+                ((uint8_t*)corrupt.buf)[i] = uint8_t(b);
+                KeyTree keys(corrupt);
+                for (unsigned id = 0; id <= 4; ++id)
+                    (void)keys[id];
+                for (slice str : strings)
+                    (void)keys[str];
+            }
+        }
     }
 
     TEST_CASE("Locale-free encoding") {
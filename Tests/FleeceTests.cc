@@ -18,6 +18,8 @@
 
 #include "FleeceTests.hh"
 #include "fleece/slice.hh"
+#include "FleeceException.hh"
+#include "JSONConverter.hh"
 #include <fcntl.h>
 
 #if !FL_HAVE_TEST_FILES
@@ -112,4 +114,17 @@ namespace fleece_test {
 #endif
 
 
+#if FL_HAVE_FILESYSTEM
+    alloc_slice readBigFleeceFile() {
+        try {
+            return readFile(kBigFleeceFilePath);
+        } catch (const FleeceException&) {
+            alloc_slice data = impl::JSONConverter::convertJSON(readTestFile(kBigJSONTestFileName));
+            writeToFile(data, kBigFleeceFilePath);
+            return data;
+        }
+    }
+#endif
+
+
 }
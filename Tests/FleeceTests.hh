@@ -43,6 +43,8 @@ using namespace fleece;
     #else
         #define kTempDir "/tmp/"
     #endif
+    // The Fleece encoding of kBigJSONTestFileName. It's generated, so it goes in kTempDir:
+    #define kBigFleeceFilePath kTempDir "1000people.fleece"
 #endif
 
 
@@ -86,6 +88,11 @@ namespace fleece_test {
     slice readTestFile(const char *path);
 #endif
 
+#if FL_HAVE_FILESYSTEM
+    // Reads kBigFleeceFilePath, first creating it from kBigJSONTestFileName if necessary.
+    alloc_slice readBigFleeceFile();
+#endif
+
     // Converts JSON5 to JSON; helps make JSON test input more readable!
     static inline std::string json5(const std::string &s)      {return fleece::ConvertJSON5(s);}
 }
@@ -350,7 +350,7 @@ TEST_CASE("Perf TreeSearch", "[.Perf]") {
     static const int kSamples = 500000;
 
     // Convert JSON array into a dictionary keyed by _id:
-    auto input = readTestFile("1000people.fleece");
+    auto input = readBigFleeceFile();
     if (!input)
         abort();
     std::vector<alloc_slice> names;
@@ -374,7 +374,7 @@ TEST_CASE("Perf TreeSearch", "[.Perf]") {
     alloc_slice treeData = enc.finish();
     const HashTree *imTree = HashTree::fromData(treeData);
 
-    Benchmark bench;
+    Benchmark bench(true);
 
     for (int i = 0; i < kSamples; i++) {
         slice keys[100];
@@ -16,10 +16,14 @@
 // limitations under the License.
 //
 
+#include "FleeceTests.hh"
+#include "FleeceImpl.hh"
 #include "JSON5.hh"
-#include "catch.hpp"
+#include "JSON5Converter.hh"
+#include "JSONConverter.hh"
 
 using namespace fleece;
+using namespace fleece::impl;
 
 
 TEST_CASE("JSON5 Constants") {
@@ -76,3 +80,64 @@ TEST_CASE("JSON5 Objects") {
     CHECK(ConvertJSON5("{key:false,$other:'hey',}") == "{\"key\":false,\"$other\":\"hey\"}");
     CHECK(ConvertJSON5("{_key : false, _Oth3r:null,}") == "{\"_key\":false,\"_Oth3r\":null}");
 }
+
+
+// Parses JSON5 with JSON5Converter, returning the result as (canonical) JSON.
+static std::string directJSON5(slice json5) {
+    Encoder enc;
+    JSON5Converter cvt(enc);
+    INFO("error: " << cvt.errorMessage());
+    REQUIRE(cvt.encodeJSON5(json5));
+    alloc_slice data = enc.finish();
+    return std::string(Value::fromData(data)->toJSON(true));
+}
+
+// Parses JSON5 by converting it to JSON first, returning the result as (canonical) JSON.
+static std::string indirectJSON5(const std::string &json5) {
+    alloc_slice data = JSONConverter::convertJSON(ConvertJSON5(json5));
+    return std::string(Value::fromData(data)->toJSON(true));
+}
+
+
+TEST_CASE("JSON5Converter", "[JSON5]") {
+    // Both ways of parsing should produce the same values:
+    for (const char *json5 : {"null", "false", " true ", "/* c */true // c", "0", "-12340",
+                              "+12340", "92.876", ".7", "6.02E-23", "'hi \\\nthere'",
+                              "'hi \"there\"'", "'can\\'t'", "[1,[2,3],'hi',]",
+                              "{key:false,$other:'hey',}", "{_key : false, _Oth3r:null,}",
+                              "{'a': [1, {b: 'c'}], \"d\": -0.5e2}"}) {
+        INFO("json5 is " << json5);
+        CHECK(directJSON5(slice(json5)) == indirectJSON5(json5));
+    }
+
+    // JSON5 features the JSON-converting path doesn't support:
+    CHECK(directJSON5("[0x1F, -0xff, 0X7FFFFFFFFFFFFFFF, 5.]"_sl) ==
+          "[31,-255,9223372036854775807,5.0]");
+    CHECK(directJSON5("'\\x41\\u00e9\\ud83d\\ude00\\v\\0'"_sl) ==
+          "\"A\u00e9\U0001F600\\u000b\\u0000\"");
+    CHECK(directJSON5("{caf\u00e9: 1, 'quoted key': 2}"_sl) == "{\"caf\u00e9\":1,\"quoted key\":2}");
+    CHECK(directJSON5("\xEF\xBB\xBF [1,\xC2\xA0 2]"_sl) == "[1,2]");
+    CHECK(directJSON5("[18446744073709551615, -9223372036854775808]"_sl) ==
+          "[18446744073709551615,-9223372036854775808]");
+
+    alloc_slice data = JSON5Converter::convertJSON5("[Infinity, -Infinity, 1e400]"_sl);
+    const Array *infinities = Value::fromData(data)->asArray();
+    CHECK(infinities->get(0)->asDouble() == INFINITY);
+    CHECK(infinities->get(1)->asDouble() == -INFINITY);
+    CHECK(infinities->get(2)->asDouble() == INFINITY);
+}
+
+
+TEST_CASE("JSON5Converter errors", "[JSON5]") {
+    for (const char *json5 : {"", "nul", "truth", "[1,2", "[1 2]", "{a 1}", "{a:}", "{1:2}",
+                              "'unterminated", "'new\nline'", "/* unterminated", "[1]]",
+                              "0x", "1e", "-", "12abc", "NaN", "'\\1'", "{'a\\u12':1}"}) {
+        INFO("json5 is " << json5);
+        Encoder enc;
+        JSON5Converter cvt(enc);
+        CHECK(!cvt.encodeJSON5(slice(json5)));
+        CHECK(cvt.errorCode() == JSONError);
+        CHECK(cvt.errorPos() <= strlen(json5));
+    }
+    CHECK_THROWS_AS(JSON5Converter::convertJSON5("[1, 2, oops]"_sl), FleeceException);
+}
@@ -21,10 +21,10 @@
 #include "MutableArray.hh"
 #include "MutableDict.hh"
 #include "Doc.hh"
+#include "MArray.hh"
 #include <iostream>
 
-namespace fleece {
-    using namespace fleece::impl;
+namespace fleece { namespace impl {
 
     TEST_CASE("MutableArray type checking", "[Mutable]") {
         Retained<MutableArray> ma = MutableArray::newArray();
@@ -919,4 +919,173 @@ namespace fleece {
         std::cerr << "(Packed data would be " << packedData.size << " bytes)\n";
     }
 
+} }
+
+
+#pragma mark - MARRAY:
+
+
+namespace fleece {
+
+    // MArray tests use a minimal Native type: a pointer to an int owned by the test, or to
+    // kArrayNative, which stands for the array being tested.
+    using TestNative = const int*;
+    static const int kArrayNative = 0;
+
+    template<> TestNative MValue<TestNative>::toNative(MValue *mv, MCollection<TestNative>*,
+                                                       bool &cacheIt) {
+        if (!mv->value().asArray())
+            return nullptr;
+        cacheIt = true;
+        return &kArrayNative;
+    }
+    template<> MCollection<TestNative>* MValue<TestNative>::collectionFromNative(TestNative) {
+        return nullptr;
+    }
+    template<> void MValue<TestNative>::encodeNative(Encoder &enc, TestNative n) {
+        enc.writeInt(*n);
+    }
+
+
+    // Returns the JSON of a Fleece array of the ints 0..n-1.
+    static std::string intsJSON(int n) {
+        std::string json = "[";
+        for (int i = 0; i < n; ++i)
+            json += (i ? "," : "") + std::to_string(i);
+        return json + "]";
+    }
+
+    static std::string toJSON(const MArray<TestNative> &a) {
+        Encoder enc;
+        a.encodeTo(enc);
+        return Value::fromData(enc.finish()).toJSONString();
+    }
+
+
+    TEST_CASE("MArray sparse reads keep references", "[Mutable]") {
+        static constexpr uint32_t kCount = 1000;
+        auto doc = Doc::fromJSON(slice(intsJSON(kCount)));
+        MArray<TestNative> parent;
+        MValue<TestNative> mv(doc.root());
+        REQUIRE(mv.asNative(&parent) == &kArrayNative);
+        MArray<TestNative> a(&mv, &parent);
+        REQUIRE(a.count() == kCount);
+
+        // Reading items, even all of them, doesn't move earlier slots:
+        const MValue<TestNative> &first = a.get(0);
+        const MValue<TestNative> &last = a.get(kCount - 1);
+        std::vector<const MValue<TestNative>*> slots;
+        for (uint32_t i = 0; i < kCount; ++i) {
+            slots.push_back(&a.get(i));
+            CHECK(slots.back()->value().asInt() == i);
+        }
+        CHECK(&a.get(0) == &first);
+        CHECK(&a.get(kCount - 1) == &last);
+        for (uint32_t i = 0; i < kCount; ++i)
+            CHECK(&a.get(i) == slots[i]);
+        CHECK(a.get(kCount).isEmpty());
+        CHECK(!a.isMutated());
+        CHECK(toJSON(a) == intsJSON(kCount));
+    }
+
+
+    TEST_CASE("MArray mutations", "[Mutable]") {
+        static constexpr int kCount = 300;
+        auto doc = Doc::fromJSON(slice(intsJSON(kCount)));
+        MArray<TestNative> parent;
+        MValue<TestNative> mv(doc.root());
+        REQUIRE(mv.asNative(&parent) == &kArrayNative);
+        MArray<TestNative> a(&mv, &parent);
+        static const int kMinus1 = -1, kMinus2 = -2, kMinus3 = -3;
+        std::vector<int> expected(kCount);
+        for (int i = 0; i < kCount; ++i)
+            expected[i] = i;
+        auto check = [&] {
+            REQUIRE(a.count() == expected.size());
+            for (uint32_t i = 0; i < a.count(); ++i) {
+                const MValue<TestNative> &v = a.get(i);
+                int n = v.hasNative() ? *v.asNative(&a) : int(v.value().asInt());
+                CHECK(n == expected[i]);
+            }
+            std::string json = "[";
+            for (size_t i = 0; i < expected.size(); ++i)
+                json += (i ? "," : "") + std::to_string(expected[i]);
+            CHECK(toJSON(a) == json + "]");
+        };
+
+        SECTION("Set many items") {
+            for (uint32_t i = 0; i < 30; ++i)
+                REQUIRE(a.set(i * 3, &kMinus1));
+            for (uint32_t i = 0; i < 30; ++i)
+                expected[i * 3] = -1;
+            CHECK(a.isMutated());
+            check();
+        }
+        SECTION("Append and truncate") {
+            REQUIRE(a.append(&kMinus1));
+            REQUIRE(a.append(&kMinus2));
+            REQUIRE(a.remove(50, kCount + 2 - 50));
+            expected.resize(50);
+            check();
+            REQUIRE(a.append(&kMinus3));
+            expected.push_back(-3);
+            check();
+        }
+        SECTION("Insert and remove") {
+            REQUIRE(a.set(20, &kMinus1));
+            REQUIRE(a.insert(10, &kMinus2));
+            expected[20] = -1;
+            expected.insert(expected.begin() + 10, -2);
+            check();
+            REQUIRE(a.remove(5, 2));
+            expected.erase(expected.begin() + 5, expected.begin() + 7);
+            check();
+            CHECK(!a.remove(expected.size() - 5, 10));
+            CHECK(!a.insert(expected.size() + 1, &kMinus3));
+        }
+        SECTION("Truncate and append past the base array") {
+            (void)a.get(70);
+            REQUIRE(a.remove(10, kCount - 10));
+            expected.resize(10);
+            check();
+            for (int i = 0; i < 70; ++i)
+                REQUIRE(a.append(&kMinus1));
+            expected.resize(80, -1);
+            check();
+        }
+        SECTION("Get after shifting") {
+            const MValue<TestNative> &before = a.get(99);
+            REQUIRE(a.insert(0, &kMinus1));      // shifts every item; `before` is now invalid
+            expected.insert(expected.begin(), -1);
+            const MValue<TestNative> &after = a.get(100);
+            CHECK(after.value().asInt() == 99);
+            for (uint32_t i = 0; i < a.count(); ++i)
+                (void)a.get(i);
+            CHECK(&a.get(100) == &after);
+            (void)before;
+            check();
+        }
+        SECTION("Clear") {
+            (void)a.get(3);
+            REQUIRE(a.clear());
+            expected.clear();
+            check();
+            REQUIRE(a.append(&kMinus1));
+            expected.push_back(-1);
+            check();
+        }
+        SECTION("Copy") {
+            (void)a.get(3);
+            REQUIRE(a.set(200, &kMinus1));
+            expected[200] = -1;
+            MArray<TestNative> copy;
+            copy.initAsCopyOf(a, true);
+            REQUIRE(copy.count() == a.count());
+            CHECK(&copy.get(200) != &a.get(200));
+            CHECK(*copy.get(200).asNative(&copy) == -1);
+            CHECK(toJSON(copy) == toJSON(a));
+            check();
+        }
+    }
+
 }
@@ -22,8 +22,11 @@
 
 #include "FleeceTests.hh"
 #include "NumConversion.hh"
+#include "JSONConverter.hh"
+#include "Benchmark.hh"
 #include <cmath>
 #include <limits>
+#include <random>
 #include <string>
 
 using namespace std;
@@ -168,3 +171,176 @@ TEST_CASE("WriteDouble","[Numeric]") {
     expectDescription("1.25e-16", 0.000000000000000125);
     expectDescription("1.25e-17", 0.0000000000000000125);
 }
+
+
+// Parses `str` with ParseDouble, with and without a NUL terminator, and checks that the result is
+// bit-for-bit identical to strtod's.
+static void checkParse(const string &str) {
+    double expected = strtod(str.c_str(), nullptr);
+    double actual = ParseDouble(str.c_str());
+    INFO("Parsing " << str);
+    CHECK(memcmp(&actual, &expected, sizeof(double)) == 0);
+    string unterminated = str + "9999";     // must not be read
+    actual = ParseDouble(unterminated.data(), str.size());
+    CHECK(memcmp(&actual, &expected, sizeof(double)) == 0);
+}
+
+
+TEST_CASE("ParseDouble","[Numeric]") {
+    for (const char *str : {"0", "-0", "0.0", "-0.0", "1", "-1", "1.5", "+2.25", "  3.5",
+                            "0.1", "0.2", "0.3", "3.141592653589793", "1e10", "1E10", "1e+10",
+                            "1e-10", "123.456e-7", ".5", "5.", "1e", "1e+", "12abc", "7.0e2x",
+                            "9007199254740992", "9007199254740993", "9007199254740995",
+                            "18446744073709551615", "18446744073709551616",
+                            "1e22", "1e23", "8.98846567431158e307", "1.7976931348623157e308",
+                            "1.7976931348623158e308", "1.7976931348623159e308", "1e309", "-1e400",
+                            "2.2250738585072011e-308", "2.2250738585072014e-308",
+                            "4.9406564584124654e-324", "2.4703282292062327e-324",
+                            "2.4703282292062328e-324", "1e-324", "1e-400", "1e-99999999999",
+                            "1e99999999999", "0e99999999999",
+                            "0.000000000000000000000000000001234567890123456789",
+                            "1234567890123456789012345678901234567890",
+                            "3.14159265358979323846264338327950288419716939937510",
+                            "2.22507385850720113605740979670913197593481954635164564e-308",
+                            "9.5e-5", "7.2057594037927933e+16", "1448997445238699",
+                            "inf", "-Infinity", "nan", "0x1p4", "", "-", ".", "abc"}) {
+        checkParse(str);
+    }
+}
+
+
+TEST_CASE("ParseDouble random","[Numeric]") {
+    mt19937_64 rng(12345);
+
+    SECTION("Round-trip random doubles") {
+        // Shortest round-trip output of random bit patterns must parse back exactly:
+        for (int i = 0; i < 1000000; ++i) {
+            uint64_t bits = rng();
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            if (std::isnan(d))
+                continue;
+            char str[32];
+            size_t len = WriteFloat(d, str, sizeof(str));
+            double parsed = ParseDouble(str, len);
+            if (memcmp(&parsed, &d, sizeof(d)) != 0) {
+                FAIL("Round-trip failed: " << str);
+            }
+        }
+    }
+
+    SECTION("Random decimal strings") {
+        // Compare against strtod on random mantissas and exponents, with up to 25 digits:
+        char str[64];
+        for (int i = 0; i < 1000000; ++i) {
+            int nDigits = 1 + int(rng() % 25);
+            char *p = str;
+            if (rng() & 1)
+                *p++ = '-';
+            int point = int(rng() % (nDigits + 1));
+            for (int d = 0; d < nDigits; ++d) {
+                if (d == point)
+                    *p++ = '.';
+                *p++ = char('0' + rng() % 10);
+            }
+            sprintf(p, "e%d", int(rng() % 700) - 350);
+            double expected = strtod(str, nullptr);
+            double actual = ParseDouble(str);
+            if (memcmp(&actual, &expected, sizeof(double)) != 0) {
+                FAIL("Parse mismatch: " << str << " -> " << actual << ", expected " << expected);
+            }
+        }
+    }
+}
+
+
+// Checks every finite float: its shortest form must parse to the same double as with strtod,
+// and must round-trip through strtof. (Not through ParseDouble + a cast to float, since the double
+// rounding can differ, e.g. for 7.038531e-26.) Takes ~20 minutes, so it's not run by default.
+TEST_CASE("Float round-trip exhaustive","[.Slow]") {
+    uint64_t failures = 0;
+    for (uint64_t bits = 0; bits <= UINT32_MAX; ++bits) {
+        uint32_t bits32 = uint32_t(bits);
+        float f;
+        memcpy(&f, &bits32, sizeof(f));
+        if (!std::isfinite(f))
+            continue;
+        char str[32];
+        size_t len = WriteFloat(f, str, sizeof(str));
+        double parsed = ParseDouble(str, len), expected = strtod(str, nullptr);
+        float parsedf = strtof(str, nullptr);
+        if (_usuallyFalse(memcmp(&parsed, &expected, sizeof(double)) != 0
+                          || memcmp(&parsedf, &f, sizeof(f)) != 0)) {
+            if (++failures < 10)
+                FAIL_CHECK("Round-trip failed: " << str);
+        }
+    }
+    CHECK(failures == 0);
+}
+
+
+TEST_CASE("Perf ParseDouble", "[.Perf]") {
+    static constexpr int kCount = 1000000;
+    mt19937_64 rng(4321);
+    vector<string> strings;
+    strings.reserve(kCount);
+    string json = "[";
+    for (int i = 0; i < kCount; ++i) {
+        // Typical metric / geo coordinate values:
+        char str[32];
+        double d = (rng() % 36000000) / 100000.0 - 180.0;
+        WriteFloat(d, str, sizeof(str));
+        strings.emplace_back(str);
+        if (i > 0)
+            json += ',';
+        json += str;
+    }
+    json += "]";
+
+    Benchmark bench(true);
+    double total = 0;
+    for (int rep = 0; rep < 10; ++rep) {
+        bench.start();
+        for (auto &str : strings)
+            total += strtod(str.c_str(), nullptr);
+        bench.stop();
+    }
+    CHECK(total != 0.0);
+    fprintf(stderr, "strtod:      ");
+    bench.printReport(1.0/kCount, "number");
+
+    bench.reset();
+    total = 0;
+    for (int rep = 0; rep < 10; ++rep) {
+        bench.start();
+        for (auto &str : strings)
+            total += ParseDouble(str.data(), str.size());
+        bench.stop();
+    }
+    CHECK(total != 0.0);
+    fprintf(stderr, "ParseDouble: ");
+    bench.printReport(1.0/kCount, "number");
+
+    bench.reset();
+    size_t written = 0;
+    for (int rep = 0; rep < 10; ++rep) {
+        char str[32];
+        bench.start();
+        for (int i = 0; i < kCount; ++i)
+            written += WriteFloat(total / (i + 1), str, sizeof(str));
+        bench.stop();
+    }
+    CHECK(written > 0);
+    fprintf(stderr, "WriteFloat:  ");
+    bench.printReport(1.0/kCount, "number");
+
+    bench.reset();
+    for (int rep = 0; rep < 10; ++rep) {
+        bench.start();
+        alloc_slice fleece = impl::JSONConverter::convertJSON(slice(json));
+        bench.stop();
+        CHECK(fleece);
+    }
+    fprintf(stderr, "JSON->Fleece:");
+    bench.printReport(1.0/kCount, "number");
+}
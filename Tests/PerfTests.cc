@@ -19,12 +19,25 @@
 #include "FleeceTests.hh"
 #include "FleeceImpl.hh"
 #include "JSONConverter.hh"
+#include "JSON5Converter.hh"
 #include "Doc.hh"
+#include "DocCache.hh"
+#include "Columns.hh"
+#include "MutableDict.hh"
+#include "Base64.hh"
+#include "ParseDate.hh"
+#include "fleece/Fleece.h"
+#include "slice_stream.hh"
 #include "varint.hh"
 #include <chrono>
+#include <memory>
+#include <set>
 #include <stdlib.h>
 #include <thread>
+#include <vector>
 #ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #endif
 #include "betterassert.hh"
@@ -53,7 +66,7 @@ using namespace fleece::impl;
 TEST_CASE("GetUVarint performance", "[.Perf]") {
     assert(false); // This test should not be run with a debug build!
     static constexpr int kNRounds = 10000000;
-    Benchmark bench;
+    Benchmark bench(true);
     uint8_t buf[100];
     fprintf(stderr, "buf = %p\n", &buf);
     double d = 1.0;
@@ -77,6 +90,69 @@ TEST_CASE("GetUVarint performance", "[.Perf]") {
     bench.printReport(1.0/kNRounds);
 }
 
+TEST_CASE("Perf VarInt decoding", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    // Decodes a stream of varints all of the same length, one at a time and in bulk:
+    static constexpr size_t kCount = 4096;
+    static constexpr int kNRounds = 2000;
+    std::vector<uint8_t> buf(kCount * kMaxVarintLen64 + 8);
+    std::vector<uint64_t> out(kCount);
+    fprintf(stderr, "Length   GetUVarInt  GetUVarInt32  GetUVarInts  (ns/varint)\n");
+    for (unsigned len = 1; len <= kMaxVarintLen64; ++len) {
+        // Random numbers that encode to exactly `len` bytes:
+        uint64_t minN = (len == 1) ? 0 : (1ull << (7 * (len - 1)));
+        uint64_t range = (len >= kMaxVarintLen64) ? 1 : ((len == 9) ? (1ull << 63) - minN
+                                                                    : (1ull << (7 * len)) - minN);
+        size_t size = 0;
+        for (size_t i = 0; i < kCount; ++i) {
+            uint64_t r = (uint64_t(random()) << 32) ^ uint64_t(random());
+            size_t n = PutUVarInt(&buf[size], (len >= kMaxVarintLen64) ? UINT64_MAX - r % 1000
+                                                                       : minN + r % range);
+            CHECK(n == len);
+            size += n;
+        }
+        slice data(buf.data(), size);
+
+        double times[3] = {};
+        for (int mode = 0; mode < 3; ++mode) {
+            if (mode == 1 && len > kMaxVarintLen32)
+                continue;
+            Benchmark bench;
+            uint64_t total = 0;
+            for (int round = 0; round < kNRounds; ++round) {
+                bench.start();
+                if (mode == 0) {
+                    slice_istream in(data);
+                    for (size_t i = 0; i < kCount; ++i) {
+                        uint64_t n;
+                        size_t nBytes = GetUVarInt(in, &n);
+                        in.skip(nBytes);
+                        total += n;
+                    }
+                } else if (mode == 1) {
+                    slice_istream in(data);
+                    for (size_t i = 0; i < kCount; ++i) {
+                        uint32_t n;
+                        size_t nBytes = GetUVarInt32(in, &n);
+                        in.skip(nBytes);
+                        total += n;
+                    }
+                } else {
+                    CHECK(GetUVarInts(data, out.data(), kCount) == size);
+                    total += out[kCount - 1];
+                }
+                bench.stop();
+            }
+            CHECK(total != 1); // bogus
+            times[mode] = bench.median() / kCount * 1.0e9;
+        }
+        char time32[20] = "       -";
+        if (len <= kMaxVarintLen32)
+            snprintf(time32, sizeof(time32), "%8.3f", times[1]);
+        fprintf(stderr, "%4u     %8.3f     %s     %8.3f\n", len, times[0], time32, times[2]);
+    }
+}
+
 TEST_CASE("Perf Convert1000People", "[.Perf]") {
     assert(false); // This test should not be run with a debug build!
     static const int kSamples = 500;
@@ -84,7 +160,7 @@ TEST_CASE("Perf Convert1000People", "[.Perf]") {
     std::vector<double> elapsedTimes;
     auto input = readTestFile(kBigJSONTestFileName);
 
-    Benchmark bench;
+    Benchmark bench(true);
 
     alloc_slice lastResult;
     fprintf(stderr, "Converting JSON to Fleece...\n");
@@ -109,17 +185,106 @@ TEST_CASE("Perf Convert1000People", "[.Perf]") {
 
     fprintf(stderr, "\nJSON size: %zu bytes; Fleece size: %zu bytes (%.2f%%)\n",
             input.size, lastResult.size, (lastResult.size*100.0/input.size));
-    writeToFile(lastResult, kTestFilesDir "1000people.fleece");
+    writeToFile(lastResult, kBigFleeceFilePath);
+}
+
+TEST_CASE("Perf ConvertJSON5", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kSamples = 200;
+    // Parses JSON5 into Fleece, by converting it to JSON first vs. parsing it directly:
+    Retained<Doc> doc = Doc::fromJSON(readTestFile(kBigJSONTestFileName));
+    alloc_slice input = doc->root()->toJSON<5>();
+
+    alloc_slice indirect, direct;
+    {
+        fprintf(stderr, "Converting JSON5 to JSON, then to Fleece... ");
+        Benchmark bench(true);
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            std::string json = ConvertJSON5(std::string(input));
+            indirect = JSONConverter::convertJSON(slice(json));
+            bench.stop();
+        }
+        bench.printReport();
+    }
+    {
+        fprintf(stderr, "Converting JSON5 to Fleece directly... ");
+        Benchmark bench(true);
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            direct = JSON5Converter::convertJSON5(input);
+            bench.stop();
+        }
+        bench.printReport();
+    }
+    CHECK((direct == indirect));
+}
+
+TEST_CASE("Perf EncodePeople", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kSamples = 500;
+    // Re-encodes already-parsed data, so the time is all spent in the Encoder:
+    Retained<Doc> doc = Doc::fromJSON(readTestFile(kBigJSONTestFileName));
+    const Value *root = doc->root();
+
+    Benchmark bench(true);
+    Encoder enc;
+    size_t size = 0;
+    for (int i = 0; i < kSamples; i++) {
+        bench.start();
+        enc.writeValue(root);
+        size = enc.finish().size;
+        bench.stop();
+    }
+    bench.printReport();
+    CHECK(size > 0);
+}
+
+TEST_CASE("Perf Extract", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kSamples = 500;
+    // Copies each person out of the document, by re-encoding vs. extracting:
+    Retained<Doc> doc = Doc::fromJSON(readTestFile(kBigJSONTestFileName));
+    const Array *people = doc->asArray();
+
+    size_t encodedSize = 0, extractedSize = 0;
+    {
+        fprintf(stderr, "Re-encoding each person... ");
+        Benchmark bench(true);
+        Encoder enc;
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            for (Array::iterator person(people); person; ++person) {
+                enc.writeValue(person.value());
+                encodedSize += enc.finish().size;
+            }
+            bench.stop();
+        }
+        bench.printReport();
+    }
+    {
+        fprintf(stderr, "Extracting each person... ");
+        Benchmark bench(true);
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            for (Array::iterator person(people); person; ++person)
+                extractedSize += Encoder::extract(person.value()).size;
+            bench.stop();
+        }
+        bench.printReport();
+    }
+    CHECK(extractedSize > 0);
+    CHECK(extractedSize <= encodedSize * 5 / 4);
 }
 
 TEST_CASE("Perf LoadFleece", "[.Perf]") {
     assert(false); // This test should not be run with a debug build!
     static const int kIterations = 1000;
-    auto doc = readTestFile("1000people.fleece");
+    auto doc = readBigFleeceFile();
 
     {
         fprintf(stderr, "Scanning untrusted Fleece... ");
-        Benchmark bench;
+        Benchmark bench(true);
         for (int i = 0; i < kIterations; i++) {
             bench.start();
             FLEECE_UNUSED auto root = Value::fromData(doc)->asArray();
@@ -132,7 +297,7 @@ TEST_CASE("Perf LoadFleece", "[.Perf]") {
     {
         fprintf(stderr, "Scanning trusted Fleece... ");
         static const int kIterationsPerSample = 1000000;
-        Benchmark bench;
+        Benchmark bench(true);
         for (int i = 0; i < kIterations; i++) {
             bench.start();
             for (int j = 0; j < kIterationsPerSample; j++) {
@@ -145,13 +310,35 @@ TEST_CASE("Perf LoadFleece", "[.Perf]") {
     }
 }
 
+TEST_CASE("Perf DocCache", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kIterations = 1000;
+    // "Reloading" the same data, as a new untrusted Doc each time vs. through a DocCache:
+    auto data = readBigFleeceFile();
+    Retained<DocCache> cache = new DocCache();
+    for (int cached = 0; cached <= 1; ++cached) {
+        Benchmark bench(true);
+        for (int i = 0; i < kIterations; i++) {
+            bench.start();
+            Retained<Doc> doc = cached ? cache->get(data) : Doc::fromFleece(data);
+            REQUIRE(doc->root() != nullptr);
+            bench.stop();
+        }
+        fprintf(stderr, "%s: ", (cached ? "DocCache" : "New Doc "));
+        bench.printReport(1.0, "load");
+    }
+    auto stats = cache->stats();
+    fprintf(stderr, "Cache: %llu hits, %llu misses\n",
+            (unsigned long long)stats.hits, (unsigned long long)stats.misses);
+}
+
 static void testFindPersonByIndex(int sort) {
     assert(false); // This test should not be run with a debug build!
     int kSamples = 500;
     int kIterations = 10000;
-    Benchmark bench;
+    Benchmark bench(true);
 
-    auto doc = readTestFile("1000people.fleece");
+    auto doc = readBigFleeceFile();
 
     Dict::key nameKey(slice("name"));
 
@@ -187,9 +374,9 @@ TEST_CASE("Perf LoadPeople", "[.Perf]") {
     for (int shareKeys = 0; shareKeys <= 1; ++shareKeys) {
         int kSamples = 50;
         int kIterations = 1000;
-        Benchmark bench;
+        Benchmark bench(true);
 
-        auto data = readTestFile("1000people.fleece");
+        auto data = readBigFleeceFile();
         auto sk = retained(new SharedKeys);
 
         if (shareKeys) {
@@ -242,7 +429,7 @@ TEST_CASE("Perf DictSearch", "[.Perf]") {
     static const int kSamples = 500000;
 
     // Convert JSON array into a dictionary keyed by _id:
-    alloc_slice input = readTestFile("1000people.fleece");
+    alloc_slice input = readBigFleeceFile();
     if (!input)
         abort();
     std::vector<alloc_slice> names;
@@ -262,7 +449,7 @@ TEST_CASE("Perf DictSearch", "[.Perf]") {
     alloc_slice dictData = enc.finish();
     auto people = Value::fromTrustedData(dictData)->asDict();
 
-    Benchmark bench;
+    Benchmark bench(true);
 
     for (int i = 0; i < kSamples; i++) {
         slice keys[100];
@@ -283,4 +470,564 @@ TEST_CASE("Perf DictSearch", "[.Perf]") {
     bench.printReport();
 }
 
+
+TEST_CASE("Perf TypedArray", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const size_t kCount = 1000000;
+    static const int kSamples = 50;
+    std::vector<double> doubles(kCount);
+    for (size_t i = 0; i < kCount; ++i)
+        doubles[i] = i * 0.001 + 0.1;
+
+    Encoder enc;
+    enc.beginArray();
+    for (double d : doubles)
+        enc.writeDouble(d);
+    enc.endArray();
+    alloc_slice plainData = enc.finish();
+    enc.reset();
+    enc.writeTypedArray(doubles.data(), kCount);
+    alloc_slice typedData = enc.finish();
+    fprintf(stderr, "Plain array: %zu bytes; typed array: %zu bytes\n",
+            plainData.size, typedData.size);
+
+    std::vector<double> out(kCount);
+    for (int pass = 0; pass < 3; ++pass) {
+        auto array = Value::fromTrustedData(pass == 2 ? typedData : plainData)->asArray();
+        Benchmark bench(true);
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            if (pass == 0) {
+                size_t n = 0;
+                for (Array::iterator iter(array); iter; ++iter)
+                    out[n++] = iter->asDouble();
+            } else {
+                array->getDoubles(0, kCount, out.data());
+            }
+            bench.stop();
+            CHECK(out[kCount-1] == doubles[kCount-1]);
+        }
+        static const char* const kNames[3] = {"Iterating plain array", "getDoubles on plain array",
+                                             "getDoubles on typed array"};
+        fprintf(stderr, "%s: ", kNames[pass]);
+        bench.printReport(1.0/kCount, "double");
+    }
+}
+
+
+TEST_CASE("Perf ISO8601 dates", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const size_t kCount = 100000;
+    static const int kSamples = 20;
+    std::vector<int64_t> times(kCount);
+    std::vector<std::string> strings(kCount);
+    Encoder stringEnc, binaryEnc;
+    binaryEnc.binaryTimestamps(true);
+    stringEnc.beginArray();
+    binaryEnc.beginArray();
+    srandom(42);
+    for (size_t i = 0; i < kCount; ++i) {
+        times[i] = 1500000000000 + int64_t(random()) * 1000 + random() % 1000;
+        char buf[kFormattedISO8601DateMaxSize];
+        strings[i] = std::string(FormatISO8601Date(buf, times[i], true));
+        stringEnc.writeDateString(times[i]);
+        binaryEnc.writeDateString(times[i]);
+    }
+    stringEnc.endArray();
+    binaryEnc.endArray();
+    alloc_slice stringData = stringEnc.finish(), binaryData = binaryEnc.finish();
+
+    static const char* const kNames[6] = {"Parse (general)", "Parse (fixed format)",
+                                          "Format (general)", "Format (fast path)",
+                                          "asTimestamp of date strings",
+                                          "asTimestamp of binary timestamps"};
+    for (int pass = 0; pass < 6; ++pass) {
+        auto array = Value::fromTrustedData(pass == 5 ? binaryData : stringData)->asArray();
+        Benchmark bench(true);
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            size_t n = 0;
+            char buf[kFormattedISO8601DateMaxSize];
+            switch (pass) {
+                case 0:
+                    for (auto &str : strings)
+                        n += (ParseISO8601DateGeneral(str.c_str()) == times[n]);
+                    break;
+                case 1:
+                    for (auto &str : strings)
+                        n += (ParseISO8601DateFixed(slice(str)) == times[n]);
+                    break;
+                case 2:
+                    for (auto t : times)
+                        n += (FormatISO8601DateGeneral(buf, t, true).size > 0);
+                    break;
+                case 3:
+                    for (auto t : times)
+                        n += (FormatISO8601DateUTC(buf, t).size > 0);
+                    break;
+                default:
+                    for (Array::iterator iter(array); iter; ++iter)
+                        n += (iter->asTimestamp() == times[n]);
+                    break;
+            }
+            bench.stop();
+            CHECK(n == kCount);
+        }
+        fprintf(stderr, "%s: ", kNames[pass]);
+        bench.printReport(1.0/kCount, "date");
+    }
+}
+
+
+TEST_CASE("Perf ThreadConfined", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kSamples = 200;
+    // A Doc- and mutable-heavy workload that retains and releases a lot, with the default atomic
+    // ref-counting vs. in thread-confined mode:
+    alloc_slice data = JSONConverter::convertJSON(readTestFile(kBigJSONTestFileName));
+    for (int pass = 0; pass < 2; ++pass) {
+        Benchmark bench(true);
+        size_t total = 0;
+        for (int i = 0; i < kSamples; i++) {
+            ThreadConfinedScope scope(pass == 1);
+            bench.start();
+            Retained<Doc> doc = new Doc(data, Doc::kTrusted);
+            for (Array::iterator iter(doc->root()->asArray()); iter; ++iter) {
+                Retained<MutableDict> person = MutableDict::newDict(iter->asDict());
+                person->set("visits"_sl, i);
+                Retained<MutableDict> copy = person->copy();
+                for (int k = 0; k < 10; k++) {
+                    Retained<MutableDict> ref = copy;
+                    RetainedConst<Doc> owner = Doc::containing(iter.value());
+                    alloc_slice name(ref->get("name"_sl)->asString());
+                    alloc_slice nameRef = name;
+                    total += ref->count() + nameRef.size + (owner == doc);
+                }
+            }
+            bench.stop();
+        }
+        CHECK(total > 0);
+        fprintf(stderr, "%s: ", (pass ? "Thread-confined" : "Atomic ref-counts"));
+        bench.printReport(1.0/1000, "person");
+    }
+}
+
+
+TEST_CASE("Perf SharedKeys KeyTree", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kSamples = 200;
+    // Loading and looking up a full SharedKeys table, from its usual state data vs. a KeyTree:
+    Retained<SharedKeys> original = new SharedKeys();
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < SharedKeys::kMaxCount; ++i) {
+        char str[20];
+        sprintf(str, "key_%zx", i * 2654435761u % 0xFFFFFF);
+        keys.emplace_back(str);
+        int key;
+        REQUIRE(original->encodeAndAdd(slice(keys.back()), key));
+    }
+    alloc_slice stateData = original->stateData(), image = original->keyTreeData();
+    fprintf(stderr, "State data is %zu bytes; KeyTree image is %zu bytes\n",
+            stateData.size, image.size);
+
+    static const char* const kNames[6] = {"Load state data", "Load KeyTree",
+                                          "Encode (state data)", "Encode (KeyTree)",
+                                          "Decode (state data)", "Decode (KeyTree)"};
+    for (int pass = 0; pass < 6; ++pass) {
+        bool useTree = (pass % 2 == 1);
+        Retained<SharedKeys> sk = new SharedKeys();
+        if (pass >= 2)
+            useTree ? sk->loadFromKeyTree(image) : sk->loadFrom(stateData);
+        Benchmark bench(true);
+        for (int i = 0; i < kSamples; i++) {
+            size_t n = 0;
+            if (pass < 2) {
+                sk = new SharedKeys();
+                bench.start();
+                useTree ? sk->loadFromKeyTree(image) : sk->loadFrom(stateData);
+                n = sk->count();
+                bench.stop();
+                CHECK(n == SharedKeys::kMaxCount);
+            } else {
+                bench.start();
+                int key;
+                if (pass < 4) {
+                    for (auto &str : keys)
+                        n += sk->encode(slice(str), key);
+                } else {
+                    for (key = 0; key < int(keys.size()); ++key)
+                        n += sk->decode(key).size;
+                }
+                bench.stop();
+                CHECK(n > 0);
+            }
+        }
+        fprintf(stderr, "%s: ", kNames[pass]);
+        if (pass < 2)
+            bench.printReport(1.0, "table");
+        else
+            bench.printReport(1.0/keys.size(), "key");
+    }
+}
+
+
+TEST_CASE("Perf GatherColumns", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kSamples = 500;
+    auto sk = retained(new SharedKeys);
+    auto doc = Doc::fromJSON(readTestFile(kBigJSONTestFileName), sk);
+    auto people = doc->asArray();
+    uint32_t n = people->count();
+    std::vector<int64_t> ages(n);
+    std::vector<double> latitudes(n);
+    std::vector<slice> names(n);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        Benchmark bench(true);
+        for (int i = 0; i < kSamples; i++) {
+            Dict::key ageKey("age"_sl), latKey("latitude"_sl), nameKey("name"_sl);
+            bench.start();
+            if (pass == 0) {
+                uint32_t row = 0;
+                for (Array::iterator iter(people); iter; ++iter, ++row) {
+                    auto person = iter->asDict();
+                    ages[row] = person->get(ageKey)->asInt();
+                    latitudes[row] = person->get(latKey)->asDouble();
+                    names[row] = person->get(nameKey)->asString();
+                }
+            } else {
+                Column columns[3] = {{&ageKey,  Column::kInt,    ages.data(),      nullptr},
+                                     {&latKey,  Column::kDouble, latitudes.data(), nullptr},
+                                     {&nameKey, Column::kString, names.data(),     nullptr}};
+                gatherColumns(people, 0, n, columns, 3);
+            }
+            bench.stop();
+            CHECK(ages[0] == 30);
+        }
+        fprintf(stderr, "%s: ", (pass == 0 ? "Iterate + Dict::get" : "gatherColumns"));
+        bench.printReport(1.0/n, "row");
+    }
+}
+
+
+TEST_CASE("Perf Base64 JSON", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const size_t kBlobSize = 4 << 20, kBlobs = 4;
+    static const int kSamples = 20;
+    std::string blob(kBlobSize, '\0');
+    for (size_t i = 0; i < kBlobSize; ++i)
+        blob[i] = char(random());
+
+    // A document with several large attachments:
+    Encoder enc;
+    enc.beginDictionary();
+    for (size_t i = 0; i < kBlobs; ++i) {
+        enc.writeKey("attachment" + std::to_string(i));
+        enc.writeData(slice(blob));
+    }
+    enc.endDictionary();
+    alloc_slice fleece = enc.finish();
+    auto root = Value::fromTrustedData(fleece)->asDict();
+    const double kMB = kBlobs * kBlobSize / 1.0e6;
+
+    Benchmark bench(true);
+    alloc_slice json;
+    for (int i = 0; i < kSamples; i++) {
+        bench.start();
+        json = root->toJSON();
+        bench.stop();
+    }
+    fprintf(stderr, "Fleece->JSON: ");
+    bench.printReport(1.0/kMB, "MB");
+
+    bench.reset();
+    for (int i = 0; i < kSamples; i++) {
+        bench.start();
+        // Converting back requires decoding the base64 strings:
+        auto doc = Doc::fromJSON(json);
+        Encoder enc2;
+        enc2.beginDictionary();
+        for (Dict::iterator iter(doc->asDict()); iter; ++iter) {
+            enc2.writeKey(iter.keyString());
+            enc2.writeData(base64::decode(iter.value()->asString()));
+        }
+        enc2.endDictionary();
+        alloc_slice result = enc2.finish();
+        bench.stop();
+        CHECK(result.size == fleece.size);
+    }
+    fprintf(stderr, "JSON->Fleece: ");
+    bench.printReport(1.0/kMB, "MB");
+}
+
+TEST_CASE("Perf EncoderPool", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kDocs = 100000, kSamples = 20;
+    // Encodes a small document, like a typical database record:
+    auto encode = [](FLEncoder enc, int i) -> size_t {
+        FLEncoder_BeginDict(enc, 6);
+        FLEncoder_WriteKey(enc, FLSTR("_id"));
+        FLEncoder_WriteInt(enc, i);
+        FLEncoder_WriteKey(enc, FLSTR("name"));
+        FLEncoder_WriteString(enc, FLSTR("Alice Liddell"));
+        FLEncoder_WriteKey(enc, FLSTR("email"));
+        FLEncoder_WriteString(enc, FLSTR("alice@example.com"));
+        FLEncoder_WriteKey(enc, FLSTR("age"));
+        FLEncoder_WriteInt(enc, 7 + i % 50);
+        FLEncoder_WriteKey(enc, FLSTR("tags"));
+        FLEncoder_BeginArray(enc, 3);
+        FLEncoder_WriteString(enc, FLSTR("rabbit"));
+        FLEncoder_WriteString(enc, FLSTR("hatter"));
+        FLEncoder_WriteString(enc, FLSTR("queen"));
+        FLEncoder_EndArray(enc);
+        FLEncoder_WriteKey(enc, FLSTR("score"));
+        FLEncoder_WriteDouble(enc, i * 0.25);
+        FLEncoder_EndDict(enc);
+        FLSliceResult result = FLEncoder_Finish(enc, nullptr);
+        FLSliceResult_Release(result);
+        return result.size;
+    };
+
+    for (int pooled = 0; pooled <= 1; ++pooled) {
+        Benchmark bench;
+        size_t totalSize = 0;
+        for (int s = 0; s < kSamples; ++s) {
+            bench.start();
+            for (int i = 0; i < kDocs; ++i) {
+                FLEncoder enc = pooled ? FLEncoder_NewPooled() : FLEncoder_New();
+                totalSize += encode(enc, i);
+                FLEncoder_Free(enc);
+            }
+            bench.stop();
+        }
+        CHECK(totalSize > 0);
+        fprintf(stderr, "%s: ", (pooled ? "Pooled encoder" : "New encoder   "));
+        bench.printReport(1.0 / kDocs);
+    }
+}
+
+TEST_CASE("Perf BufferPool", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kDocs = 2000, kSamples = 20;
+    // Allocation-heavy work: building mutable dicts (whose keys and strings are kept in
+    // alloc_slices) and writing them as JSON, plus a burst of short-lived small slices.
+    Retained<Doc> people = Doc::fromJSON(readTestFile(kBigJSONTestFileName));
+    const Array *array = people->root()->asArray();
+
+    for (int pooled = 0; pooled <= 1; ++pooled) {
+        FLBufferPool_SetEnabled(pooled);
+        FLBufferPool_Trim();
+        Benchmark bench;
+        size_t totalSize = 0;
+        for (int s = 0; s < kSamples; ++s) {
+            bench.start();
+            for (int i = 0; i < kDocs; ++i) {
+                auto person = array->get(i % array->count())->asDict();
+                Retained<MutableDict> md = MutableDict::newDict(person);
+                std::string serial = "#" + std::to_string(i);
+                md->set("serial"_sl, slice(serial));
+                totalSize += md->toJSON().size;
+                std::vector<alloc_slice> scratch;
+                for (size_t n = 0; n < 50; ++n)
+                    scratch.emplace_back(16 + (n * 37) % 400);
+            }
+            bench.stop();
+        }
+        CHECK(totalSize > 0);
+        FLBufferPoolStats stats;
+        FLBufferPool_GetStats(&stats);
+        fprintf(stderr, "%s: ", (pooled ? "Buffer pool" : "malloc     "));
+        bench.printReport(1.0 / kDocs);
+        if (pooled)
+            fprintf(stderr, "    %llu allocations, %llu from the pool, %llu bytes cached\n",
+                    (unsigned long long)stats.allocations, (unsigned long long)stats.poolHits,
+                    (unsigned long long)stats.bytesCached);
+    }
+    FLBufferPool_SetEnabled(false);
+}
+
+#ifndef _MSC_VER
+TEST_CASE("Perf HotPathLayout", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    static const int kSamples = 200;
+    // Reads a few fields of every person from a memory-mapped file, where the data was encoded
+    // normally vs. with those fields given as hot paths. The CPU caches are flushed (by
+    // scanning a big buffer) and the file is mapped again before each sample.
+    Retained<Doc> people = Doc::fromJSON(readTestFile(kBigJSONTestFileName));
+    static const char* const kHotPaths[3] = {"name", "email", "address"};
+    Dict::key keys[3] = {{"name"_sl}, {"email"_sl}, {"address"_sl}};
+    const char *filePath = kTempDir "hotpaths.fleece";
+    std::vector<uint8_t> flusher(64 << 20);
+
+    for (int hot = 0; hot <= 1; ++hot) {
+        Encoder enc;
+        if (hot) {
+            for (auto path : kHotPaths)
+                enc.addHotPath(slice(path));
+        }
+        enc.writeValue(people->root());
+        alloc_slice data = enc.finish();
+        writeToFile(data, filePath);
+
+        // Count the pages that the hot fields (and the dicts containing them) occupy:
+        std::set<size_t> pages;
+        auto addPages = [&](const void *start, size_t size) {
+            size_t offset = (const uint8_t*)start - (const uint8_t*)data.buf;
+            for (size_t p = offset / 4096; p <= (offset + size - 1) / 4096; ++p)
+                pages.insert(p);
+        };
+        for (Array::iterator i(Value::fromTrustedData(data)->asArray()); i; ++i) {
+            auto person = i.value()->asDict();
+            addPages(person, 2 + 2 * 2 * person->count());
+            for (auto &key : keys) {
+                slice str = person->get(key)->asString();
+                addPages(person->get(key), str.size + 2);
+            }
+        }
+
+        int fd = ::open(filePath, O_RDONLY);
+        REQUIRE(fd >= 0);
+        Benchmark bench(true);
+        size_t total = 0;
+        for (int i = 0; i < kSamples; i++) {
+            for (size_t j = 0; j < flusher.size(); j += 64)
+                flusher[j]++;
+            bench.start();
+            void *mapped = ::mmap(nullptr, data.size, PROT_READ, MAP_PRIVATE, fd, 0);
+            REQUIRE(mapped != MAP_FAILED);
+            auto root = Value::fromTrustedData(slice(mapped, data.size))->asArray();
+            for (Array::iterator iter(root); iter; ++iter) {
+                auto person = iter.value()->asDict();
+                for (auto &key : keys)
+                    total += person->get(key)->asString().hash();
+            }
+            ::munmap(mapped, data.size);
+            bench.stop();
+        }
+        ::close(fd);
+        CHECK(total != 0);
+        fprintf(stderr, "%s: %zu bytes, hot fields span %zu pages\n    ",
+                (hot ? "With hot paths   " : "Without hot paths"), data.size, pages.size());
+        bench.printReport(1.0 / people->root()->asArray()->count(), "person");
+    }
+    ::unlink(filePath);
+}
+#endif
+
+
+#pragma mark - MROOT:
+
+
+// MRoot is built on the public C++ API, whose class names clash with the fleece::impl ones the
+// tests above use unqualified, so it's included only here.
+#include "MRoot.hh"
+#include "MArray.hh"
+#include "MDict.hh"
+
+namespace fleece {
+
+    // A minimal Native type for MRoot, like a binding's: a node wrapping an MArray or MDict.
+    // Scalars have no Native; their Values are read directly.
+    struct PerfNode {
+        bool isArray;
+        MArray<PerfNode*> array;
+        MDict<PerfNode*> dict;
+    };
+
+    // Owns the nodes made by toNative. Freed in creation order, since a collection's MValues
+    // refer to the nodes of its children.
+    static std::vector<std::unique_ptr<PerfNode>> sPerfNodes;
+
+    template<> PerfNode* MValue<PerfNode*>::toNative(MValue *mv, MCollection<PerfNode*> *parent,
+                                                     bool &cacheIt) {
+        auto type = mv->value().type();
+        if (type != kFLArray && type != kFLDict)
+            return nullptr;
+        auto node = std::make_unique<PerfNode>();
+        node->isArray = (type == kFLArray);
+        if (node->isArray)
+            node->array.initInSlot(mv, parent);
+        else
+            node->dict.initInSlot(mv, parent);
+        cacheIt = true;
+        sPerfNodes.push_back(std::move(node));
+        return sPerfNodes.back().get();
+    }
+    template<> MCollection<PerfNode*>* MValue<PerfNode*>::collectionFromNative(PerfNode *node) {
+        if (!node)
+            return nullptr;
+        return node->isArray ? (MCollection<PerfNode*>*)&node->array : &node->dict;
+    }
+    template<> void MValue<PerfNode*>::encodeNative(Encoder &enc, PerfNode *node) {
+        if (node->isArray)
+            node->array.encodeTo(enc);
+        else
+            node->dict.encodeTo(enc);
+    }
+
+}
+
+
+TEST_CASE("Perf MRoot", "[.Perf]") {
+    assert(false); // This test should not be run with a debug build!
+    // Bindings typically open a big array and read just a few items; that should cost nothing
+    // proportional to the array's size. Reading every item shouldn't cost much more than
+    // creating the items' Natives.
+    static constexpr uint32_t kCount = 50000;
+    static constexpr int kSamples = 200;
+    impl::Encoder enc;
+    enc.beginArray(kCount);
+    for (uint32_t i = 0; i < kCount; i++) {
+        enc.beginDictionary(2);
+        enc.writeKey("id");
+        enc.writeUInt(i);
+        enc.writeKey("name");
+        enc.writeString("item " + std::to_string(i));
+        enc.endDictionary();
+    }
+    enc.endArray();
+    alloc_slice data = enc.finish();
+
+    for (int pass = 0; pass < 2; ++pass) {
+        Benchmark bench;
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            {
+                // (The data's trusted, so validating it doesn't swamp the cost of the array.)
+                MRoot<PerfNode*> root(new MContext(data),
+                                      fleece::Value(FLValue_FromData(data, kFLTrusted)), true);
+                PerfNode *array = root.asNative();
+                CHECK(array && array->isArray && array->array.count() == kCount);
+                uint64_t total = 0;
+                auto readID = [&](uint32_t n) {
+                    auto &item = array->array.get(n);
+                    PerfNode *dict = item.asNative(&array->array);
+                    total += dict->dict.get("id"_sl).value().asUnsigned();
+                };
+                if (pass == 0) {
+                    readID(0);
+                    readID(kCount - 1);
+                    CHECK(total == kCount - 1);
+                } else {
+                    for (uint32_t n = 0; n < kCount; n++)
+                        readID(n);
+                    CHECK(total == uint64_t(kCount) * (kCount - 1) / 2);
+                }
+            }
+            for (auto &node : sPerfNodes)
+                node.reset();
+            sPerfNodes.clear();
+            bench.stop();
+        }
+        if (pass == 0) {
+            fprintf(stderr, "Reading 2 items of a %u-item array: ", kCount);
+            bench.printReport();
+        } else {
+            fprintf(stderr, "Reading every item of a %u-item array: ", kCount);
+            bench.printReport(1.0 / kCount, "item");
+        }
+    }
+}
+
+
 #endif // !FL_EMBEDDED
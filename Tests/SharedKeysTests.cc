@@ -157,6 +157,67 @@ TEST_CASE("many keys", "[SharedKeys]") {
 }
 
 
+TEST_CASE("key tree", "[SharedKeys]") {
+    Retained<SharedKeys> original = new SharedKeys();
+    int key;
+    for (slice str : {"zero"_sl, "one"_sl, "two"_sl, "three"_sl, "four"_sl})
+        REQUIRE(original->encodeAndAdd(str, key));
+    alloc_slice image = original->keyTreeData();
+
+    Retained<SharedKeys> sk = new SharedKeys();
+    REQUIRE(sk->loadFromKeyTree(slice(image)));
+    CHECK(sk->count() == 5);
+    CHECK(sk->byKey() == original->byKey());
+    CHECK(sk->stateData() == original->stateData());
+
+    CHECK(sk->encode("three"_sl, key));
+    CHECK(key == 3);
+    CHECK(sk->encode("zero"_sl, key));
+    CHECK(key == 0);
+    CHECK(!sk->encode("five"_sl, key));
+    CHECK(sk->decode(4) == "four"_sl);
+    CHECK(sk->decode(1) == "one"_sl);
+    CHECK(sk->decode(5) == nullslice);
+
+    // New keys go after the image's:
+    CHECK(sk->encodeAndAdd("two"_sl, key));
+    CHECK(key == 2);
+    CHECK(sk->encodeAndAdd("five"_sl, key));
+    CHECK(key == 5);
+    CHECK(sk->decode(5) == "five"_sl);
+    CHECK(sk->count() == 6);
+
+    CHECK_THROWS_AS(sk->loadFromKeyTree(slice(image)), FleeceException);
+
+    // Reverting can remove keys from the image, too:
+    sk->revertToCount(3);
+    CHECK(sk->byKey() == (std::vector<slice>{"zero", "one", "two"}));
+    CHECK(!sk->encode("three"_sl, key));
+    CHECK(sk->decode(3) == nullslice);
+    CHECK(sk->encodeAndAdd("five"_sl, key));
+    CHECK(key == 3);
+    CHECK(sk->decode(3) == "five"_sl);
+
+    // Encode and read a document using keys from the image:
+    Retained<SharedKeys> sk2 = new SharedKeys();
+    REQUIRE(sk2->loadFromKeyTree(image));
+    Encoder enc;
+    enc.setSharedKeys(sk2);
+    enc.beginDictionary();
+    enc.writeKey("two");
+    enc.writeInt(2);
+    enc.writeKey("four");
+    enc.writeInt(4);
+    enc.endDictionary();
+    Retained<Doc> doc = enc.finishDoc();
+    CHECK(sk2->count() == 5);
+    const Dict *root = doc->asDict();
+    REQUIRE(root);
+    CHECK(root->get("four"_sl)->asInt() == 4);
+    CHECK(root->toJSONString() == "{\"two\":2,\"four\":4}");
+}
+
+
 #pragma mark - PERSISTENCE:
 
 
@@ -23,6 +23,11 @@
 #include "TempArray.hh"
 #include "sliceIO.hh"
 #include "Base64.hh"
+#include "StringTable.hh"
+#include "SHA256.hh"
+#include "LZ4.hh"
+#include "ParseDate.hh"
+#include "ScratchArena.hh"
 #include <iostream>
 #include <future>
 
@@ -319,6 +324,118 @@ TEST_CASE("SmallVector, big", "[SmallVector]") {
 }
 
 
+TEST_CASE("ScratchArena", "[ScratchArena]") {
+    ScratchArena arena(64);
+    auto a = (char*)arena.alloc(10);
+    auto b = (char*)arena.alloc(3);
+    CHECK(b == a + 16);                                 // blocks are 8-byte aligned
+    CHECK(arena.grow(b, 3, 40));                        // latest block grows in place
+    CHECK(!arena.grow(a, 10, 12));                      // but earlier ones can't
+    CHECK(!arena.grow(b, 40, 100));                     // ...nor past the end of the chunk
+    CHECK(arena.chunkAllocations() == 1);
+
+    auto mark = arena.mark();
+    auto c = (char*)arena.alloc(100);                   // won't fit; goes in a new chunk
+    memset(c, 'c', 100);
+    CHECK(arena.chunkAllocations() == 2);
+    CHECK(arena.capacity() == 64 + 128);
+    arena.rewind(mark);
+    CHECK(arena.alloc(100) == c);                       // reuses the chunk
+
+    arena.reset();
+    CHECK(arena.alloc(10) == a);
+    CHECK(arena.alloc(500) != nullptr);                 // bigger than the next chunk; replaces it
+    CHECK(arena.chunkAllocations() == 3);
+    arena.reset();
+    arena.trim(100);
+    CHECK(arena.capacity() == 64);
+}
+
+
+TEST_CASE("scratchVector", "[ScratchArena]") {
+    ScratchArena arena(256);
+    scratchVector<int> outer, inner;
+    for (int i = 0; i < 20; ++i)
+        outer.push_back(arena, i);
+    auto mark = arena.mark();
+    for (int i = 0; i < 100; ++i)
+        inner.push_back(arena, -i);
+    CHECK(inner.size() == 100);
+    CHECK(inner.back() == -99);
+    arena.rewind(mark);
+    inner.reset();
+    for (int i = 20; i < 1000; ++i)
+        outer.push_back(arena, i);
+    REQUIRE(outer.size() == 1000);
+    for (int i = 0; i < 1000; ++i)
+        CHECK(outer[i] == i);
+}
+
+
+#pragma mark - STRING TABLE:
+
+
+TEST_CASE("StringTable", "[StringTable]") {
+    // Keys of all lengths, including short ones that use the inline hash:
+    std::vector<std::string> keys;
+    for (int i = 0; i < 5000; ++i)
+        keys.push_back(std::string(i % 40, 'x') + std::to_string(i));
+    keys.push_back("");
+
+    PreallocatedStringTable<32> table;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto [entry, isNew] = table.insert(slice(keys[i]), uint32_t(i));
+        CHECK(isNew);
+        CHECK(entry->first == slice(keys[i]));
+        CHECK(entry->second == i);
+    }
+    CHECK(table.count() == keys.size());
+    CHECK(table.tableSize() >= keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto [entry, isNew] = table.insert(slice(keys[i]), 99999);
+        CHECK(!isNew);
+        CHECK(entry->second == i);
+        auto found = table.find(slice(keys[i]));
+        REQUIRE(found);
+        CHECK(found->second == i);
+    }
+    CHECK(table.find("nope"_sl) == nullptr);
+    CHECK(table.find("xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"_sl) == nullptr);
+
+    StringTable copy(table);
+    CHECK(copy.count() == keys.size());
+    CHECK(copy.find(slice(keys[1234]))->second == 1234);
+
+    table.clearAndShrink(1000);
+    CHECK(table.count() == 0);
+    CHECK(table.tableSize() == 32);
+    CHECK(table.find(slice(keys[1234])) == nullptr);
+    for (size_t i = 0; i < 100; ++i)
+        table.insertOnly(slice(keys[i]), uint32_t(i));
+    for (size_t i = 0; i < 100; ++i)
+        CHECK(table.find(slice(keys[i]))->second == i);
+    CHECK(table.find(slice(keys[100])) == nullptr);
+}
+
+
+TEST_CASE("StringTable hash distribution", "[StringTable]") {
+    // The table uses the hash's upper bits for the slot and the lower 7 bits within a group:
+    static constexpr int kSize = 4096, kNKeys = 2048;
+    int bucket[kSize] = {0}, low[128] = {0};
+    for (int i = 0; i < kNKeys; ++i) {
+        char keybuf[10];
+        sprintf(keybuf, "k-%04d", i);
+        auto hash = uint32_t(StringTable::hashCode(slice(keybuf)));
+        ++bucket[(hash >> 7) & (kSize-1)];
+        ++low[hash & 0x7F];
+    }
+    for (int i = 0; i < kSize; ++i)
+        CHECK(bucket[i] <= 7);
+    for (int i = 0; i < 128; ++i)
+        CHECK(low[i] <= 40);            // average is 16
+}
+
+
 TEST_CASE("Base64 encode and decode", "[Base64]") {
     vector<string> inputs = {"a", "ab", "abc", "abcd", "abcde"};
     vector<string> encodingResults = {"YQ==", "YWI=", "YWJj", "YWJjZA==", "YWJjZGU="};
@@ -330,3 +447,287 @@ TEST_CASE("Base64 encode and decode", "[Base64]") {
         CHECK(decoded == in);
     }
 }
+
+
+// Simple bit-at-a-time base64 encoder, to check the real (optimized) one against.
+static string referenceBase64(const string &data) {
+    static const char* kChars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string result;
+    unsigned bits = 0, nBits = 0;
+    for (char c : data) {
+        bits = (bits << 8) | uint8_t(c);
+        nBits += 8;
+        while (nBits >= 6) {
+            nBits -= 6;
+            result += kChars[(bits >> nBits) & 0x3F];
+        }
+    }
+    if (nBits > 0)
+        result += kChars[(bits << (6 - nBits)) & 0x3F];
+    while (result.size() % 4)
+        result += '=';
+    return result;
+}
+
+
+TEST_CASE("Base64 random data", "[Base64]") {
+    // Checks every length up to 300 bytes, so that every combination of the vectorized and
+    // scalar code paths and of the padding is covered.
+    srandom(12345);
+    for (size_t len = 0; len <= 300; ++len) {
+        string data(len, '\0');
+        for (auto &c : data)
+            c = char(random());
+
+        string expected = referenceBase64(data);
+        REQUIRE(expected.size() == base64::encodedSize(len));
+        string encoded = base64::encode(slice(data));
+        REQUIRE(encoded == expected);
+        alloc_slice decoded = base64::decode(slice(encoded));
+        REQUIRE(decoded == slice(data));
+
+        // Characters outside the alphabet are ignored, wherever they appear:
+        string spaced;
+        for (size_t i = 0; i < encoded.size(); ++i) {
+            spaced += encoded[i];
+            if (random() % 20 == 0)
+                spaced += "\r\n";
+        }
+        decoded = base64::decode(slice(spaced));
+        REQUIRE(decoded == slice(data));
+
+        Writer w;
+        w.writeBase64(slice(data));
+        w.writeDecodedBase64(slice(spaced));
+        CHECK(w.finish() == slice(encoded + data));
+    }
+}
+
+
+TEST_CASE("SHA256", "[SHA256]") {
+    // Test vectors from FIPS 180-4 examples:
+    CHECK(SHA256::compute(""_sl).asSlice().hexString() ==
+          "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    CHECK(SHA256::compute("abc"_sl).asSlice().hexString() ==
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    slice twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"_sl;
+    CHECK(SHA256::compute(twoBlocks).asSlice().hexString() ==
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    // Adding the data in pieces of any size gives the same digest:
+    string million(1000000, 'a');
+    for (size_t piece : {1000000, 1, 63, 64, 65, 1000}) {
+        SHA256 sha;
+        for (size_t i = 0; i < million.size(); i += piece)
+            sha << slice(million).from(i).upTo(std::min(piece, million.size() - i));
+        CHECK(sha.finish().asSlice().hexString() ==
+              "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+}
+
+
+TEST_CASE("LZ4", "[LZ4]") {
+    string repetitive;
+    for (int i = 0; i < 1000; ++i)
+        repetitive += "item #" + to_string(i % 50) + ", ";
+    srandom(12345);
+    string noise(10000, '\0');
+    for (auto &c : noise)
+        c = char(random());
+
+    for (string input : {string(), string("x"), string("hello hello"), repetitive, noise}) {
+        INFO("input size is " << input.size());
+        vector<char> compressed(lz4::maxCompressedSize(input.size()));
+        size_t size = lz4::compress(slice(input), compressed.data(), compressed.size());
+        REQUIRE(size > 0);
+        if (input == repetitive)
+            CHECK(size < input.size() / 4);
+
+        string output(input.size(), '\0');
+        CHECK(lz4::decompress(slice(compressed.data(), size), &output[0], output.size()));
+        CHECK(output == input);
+
+        // Truncated input, or the wrong output size, is detected:
+        if (size > 1)
+            CHECK(!lz4::decompress(slice(compressed.data(), size - 1), &output[0], output.size()));
+        CHECK(!lz4::decompress(slice(compressed.data(), size), &output[0], output.size() + 1));
+    }
+}
+
+
+TEST_CASE("Buffer pool", "[BufferPool]") {
+    FLBufferPool_SetEnabled(true);
+    FLBufferPoolStats before, after;
+    FLBufferPool_GetStats(&before);
+
+    // Freed buffers are reused, and the data in them is intact:
+    const void *firstBuf;
+    {
+        alloc_slice a(100);
+        firstBuf = a.buf;
+        memset((void*)a.buf, 'a', a.size);
+        alloc_slice b = a;
+        CHECK(b.buf == a.buf);
+    }
+    alloc_slice c(100);
+    CHECK(c.buf == firstBuf);
+    alloc_slice d("hello"_sl);
+    CHECK(d == "hello"_sl);
+    CHECK(((size_t)c.buf & 7) == 0);
+
+    // Big buffers bypass the pool:
+    alloc_slice big(100000);
+    memset((void*)big.buf, 'b', big.size);
+
+    FLBufferPool_GetStats(&after);
+    CHECK(after.allocations - before.allocations == 3);
+    CHECK(after.poolHits - before.poolHits >= 1);
+
+    // Buffers freed on other threads go to those threads' caches:
+    std::vector<alloc_slice> slices;
+    for (int i = 0; i < 1000; ++i)
+        slices.emplace_back(size_t(i));
+    std::async(std::launch::async, [&] {slices.clear();}).wait();
+    FLBufferPool_GetStats(&after);
+    CHECK(after.bytesCached > 0);
+
+    FLBufferPool_SetEnabled(false);
+    FLBufferPool_GetStats(&after);
+    CHECK(after.bytesCached == 0);
+    alloc_slice e(100);     // (a pooled buffer from before is freed normally after this)
+}
+
+
+TEST_CASE("Adopt external buffer", "[BufferPool]") {
+    static int sDeallocs = 0;
+    static uint64_t block[64];
+    void *buf = &block[kFLSliceAdoptHeadroom / sizeof(uint64_t)];
+    strcpy((char*)buf, "external");
+
+    FLBufferPoolStats before, after;
+    FLBufferPool_GetStats(&before);
+    {
+        alloc_slice s(FLSliceResult_Adopt(buf, 8, [](void *context, void *b) {
+            CHECK(context == &sDeallocs);
+            ++sDeallocs;
+        }, &sDeallocs));
+        CHECK(s.buf == buf);
+        CHECK(s == "external"_sl);
+        alloc_slice copy = s;
+        CHECK(copy.buf == buf);
+        s = nullslice;
+        CHECK(sDeallocs == 0);
+    }
+    CHECK(sDeallocs == 1);
+    FLBufferPool_GetStats(&after);
+    CHECK(after.adopted == before.adopted + 1);
+}
+
+
+TEST_CASE("ISO-8601 fixed format", "[ParseDate]") {
+    CHECK(ParseISO8601DateFixed("1970-01-01T00:00:00Z"_sl) == 0);
+    CHECK(ParseISO8601DateFixed("2017-04-20T00:34:56.123Z"_sl) == 1492648496123);
+    CHECK(ParseISO8601DateFixed("2017-04-20T00:34:56.1Z"_sl) == 1492648496100);
+    CHECK(ParseISO8601DateFixed("2017-04-19 17:34:56-07:00"_sl) == 1492648496000);
+    CHECK(ParseISO8601DateFixed("2017-04-20T05:04:56+0430"_sl) == 1492648496000);
+    CHECK(ParseISO8601DateFixed("1969-12-31T23:59:59.999Z"_sl) == -1);
+    CHECK(ParseISO8601DateFixed("2000-02-29T00:00:00Z"_sl) == 951782400000);
+
+    // Not the fixed format, or not valid at all:
+    for (const char *str : {"", "2017-04-20", "2017-04-20T00:34:56", "2017-04-20T00:34Z",
+                            "2017-04-20T00:34:56.1234Z", "2017-04-20T00:34:56.Z",
+                            "2017-04-20T00:34:56Zjunk", "2017-04-20T00:34:56+07",
+                            "2017-13-20T00:34:56Z", "2017-04-31T00:34:56Z",
+                            "1900-02-29T00:00:00Z", "2017-04-20T24:00:00Z",
+                            "2017-04-20T00:34:56+15:00", "-2017-04-20T00:34:56Z"}) {
+        INFO("Date string: '" << str << "'");
+        CHECK(ParseISO8601DateFixed(slice(str)) == kInvalidDate);
+    }
+
+    // Strings the fast path declines still go through the general parser:
+    CHECK(ParseISO8601Date("2017-04-20T00:34:56.1234Z") == 1492648496123);
+    CHECK(ParseISO8601Date("2017-04-20T00:34Z") == 1492648440000);
+    CHECK(ParseISO8601Date("2017-04-20T00:34:56Z"_sl) == 1492648496000);
+    CHECK(ParseISO8601Date("2017-04-31T00:34:56Z") == kInvalidDate);
+
+    char buf[kFormattedISO8601DateMaxSize];
+    CHECK(FormatISO8601DateUTC(buf, 0) == "1970-01-01T00:00:00Z"_sl);
+    CHECK(FormatISO8601DateUTC(buf, 1492648496123) == "2017-04-20T00:34:56.123Z"_sl);
+    CHECK(FormatISO8601DateUTC(buf, -1) == "1969-12-31T23:59:59.999Z"_sl);
+    CHECK(FormatISO8601DateUTC(buf, 253402300800000) == nullslice);    // year 10000
+    CHECK(FormatISO8601Date(buf, 1492648496000, true) == "2017-04-20T00:34:56Z"_sl);
+}
+
+
+TEST_CASE("ISO-8601 fast paths match general", "[ParseDate]") {
+    // Random timestamps over years 0000...9999, with and without milliseconds:
+    uint64_t seed = 0x123456789;
+    for (int i = 0; i < 20000; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        int64_t t = int64_t(seed >> 8) % 315569520000000 - 62167219200000;
+        if (i % 2)
+            t -= t % 1000;
+        char fast[kFormattedISO8601DateMaxSize], general[kFormattedISO8601DateMaxSize];
+        slice fastStr = FormatISO8601DateUTC(fast, t);
+        slice generalStr = FormatISO8601DateGeneral(general, t, true);
+        INFO("Timestamp " << t << " = " << string(generalStr));
+        REQUIRE(fastStr == generalStr);
+        REQUIRE(ParseISO8601DateFixed(fastStr) == t);
+        REQUIRE(ParseISO8601DateGeneral(string(fastStr).c_str()) == t);
+    }
+}
+
+
+namespace {
+    struct Counted : public RefCounted {
+        static inline int sLiving = 0;
+        Counted()                           {++sLiving;}
+    protected:
+        ~Counted()                          {--sLiving;}
+    };
+}
+
+TEST_CASE("Thread-confined ref-counting", "[RefCounted]") {
+    Retained<Counted> shared = new Counted;
+    CHECK(!shared->isThreadConfined());
+    {
+        ThreadConfinedScope scope;
+        Retained<Counted> confined = new Counted;
+        CHECK(confined->isThreadConfined());
+        CHECK(confined->refCount() == 1);
+        {
+            Retained<Counted> copy = confined;
+            Retained<Counted> sharedCopy = shared;
+            CHECK(confined->refCount() == 2);
+            CHECK(shared->refCount() == 2);
+        }
+        CHECK(confined->refCount() == 1);
+        CHECK(shared->refCount() == 1);
+        CHECK(Counted::sLiving == 2);
+
+        {
+            ThreadConfinedScope unconfined(false);
+            CHECK(!Retained<Counted>(new Counted)->isThreadConfined());
+        }
+        CHECK(Retained<Counted>(new Counted)->isThreadConfined());
+
+        alloc_slice buf("thread-confined");
+        CHECK(buf.isThreadConfined());
+        CHECK(!alloc_slice().isThreadConfined());
+        {
+            alloc_slice copy = buf;
+            CHECK(copy.buf == buf.buf);
+        }
+        alloc_slice copy = buf;
+        buf = nullslice;
+        CHECK(copy == "thread-confined"_sl);
+    }
+    CHECK(Counted::sLiving == 1);
+    CHECK(!Retained<Counted>(new Counted)->isThreadConfined());
+    CHECK(!alloc_slice("shared").isThreadConfined());
+
+    CHECK(FL_SetThreadConfined(true) == false);
+    CHECK(Retained<Counted>(new Counted)->isThreadConfined());
+    CHECK(FL_SetThreadConfined(false) == true);
+    CHECK(Counted::sLiving == 1);
+}
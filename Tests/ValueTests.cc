@@ -23,12 +23,20 @@
 #include "FleeceTests.hh"
 #include "Value.hh"
 #include "Pointer.hh"
+#include "slice_stream.hh"
 #include "varint.hh"
 #include "DeepIterator.hh"
 #include "SharedKeys.hh"
 #include "Doc.hh"
+#include "CompressedDoc.hh"
+#include "DocCache.hh"
+#include "Encoder.hh"
+#include "JSONConverter.hh"
+#include "Path.hh"
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 #undef NOMINMAX
 
@@ -98,6 +106,78 @@ namespace fleece {
         std::cerr << "\n";
     }
 
+    TEST_CASE("VarInt non-canonical read") {
+        // Redundant high-order zero groups are legal and must decode the same, at any length:
+        uint8_t buf[20];
+        for (size_t len = 2; len <= kMaxVarintLen64; ++len) {
+            memset(buf, 0, sizeof(buf));
+            memset(buf, 0x80, len - 1);
+            buf[0] = 0x85;
+            uint64_t result;
+            CHECK(GetUVarInt(slice(buf, sizeof(buf)), &result) == len);
+            CHECK(result == 5);
+            CHECK(GetUVarInt(slice(buf, len), &result) == len);
+            CHECK(result == 5);
+        }
+        // 10th byte may only contribute the top bit:
+        memset(buf, 0xFF, 9);
+        buf[9] = 0x02;
+        uint64_t result;
+        CHECK(GetUVarInt(slice(buf, sizeof(buf)), &result) == 0);
+        buf[9] = 0x01;
+        CHECK(GetUVarInt(slice(buf, sizeof(buf)), &result) == 10);
+        CHECK(result == UINT64_MAX);
+    }
+
+    TEST_CASE("VarInt bulk read") {
+        // A stream of varints of mixed lengths, including runs of 1-byte ones:
+        std::vector<uint64_t> numbers;
+        for (int i = 0; i < 1000; ++i) {
+            uint64_t n = (uint64_t(random()) << 32) ^ uint64_t(random());
+            switch (i % 7) {
+                case 0: case 1: case 2: n %= 0x80; break;
+                case 3:                 n %= 0x4000; break;
+                case 4:                 n %= 0x100000000; break;
+                case 5:                 n >>= (i % 64); break;
+                default:                break;
+            }
+            if (i >= 500 && i < 540)
+                n %= 0x80;
+            numbers.push_back(n);
+        }
+        std::vector<uint8_t> buf(numbers.size() * kMaxVarintLen64);
+        size_t size = 0;
+        for (uint64_t n : numbers)
+            size += PutUVarInt(&buf[size], n);
+        slice data(buf.data(), size);
+
+        std::vector<uint64_t> out(numbers.size());
+        CHECK(GetUVarInts(data, out.data(), out.size()) == size);
+        CHECK(out == numbers);
+
+        // Decoding fewer than all of them:
+        slice_istream in(data);
+        for (size_t i = 0; i < 100; ++i)
+            in.skip(GetUVarInt(in, &out[i]));
+        CHECK(GetUVarInts(data, out.data(), 100) == size_t(in.buf) - size_t(data.buf));
+
+        // Truncated data:
+        CHECK(GetUVarInts(slice(buf.data(), size - 1), out.data(), out.size()) == 0);
+
+        // 32-bit:
+        std::vector<uint32_t> out32(numbers.size());
+        size = 0;
+        for (size_t i = 0; i < numbers.size(); ++i) {
+            numbers[i] &= UINT32_MAX;
+            size += PutUVarInt(&buf[size], numbers[i]);
+        }
+        CHECK(GetUVarInts32(slice(buf.data(), size), out32.data(), out32.size()) == size);
+        for (size_t i = 0; i < numbers.size(); ++i)
+            CHECK(out32[i] == numbers[i]);
+        PutUVarInt(&buf[0], uint64_t(UINT32_MAX) + 1);
+        CHECK(GetUVarInts32(slice(buf.data(), size), out32.data(), out32.size()) == 0);
+    }
+
     TEST_CASE("Constants") {
         CHECK(Value::kNullValue->type() == kNull);
         CHECK(!Value::kNullValue->isUndefined());
@@ -217,4 +297,274 @@ namespace fleece {
         CHECK(Doc::sharedKeys(root) == nullptr);
     }
 
+
+    TEST_CASE("CompressedDoc", "[Doc]") {
+        Retained<SharedKeys> sk;
+        SECTION("String keys") { }
+        SECTION("Shared keys") {sk = new SharedKeys(); }
+        Encoder enc;
+        enc.setSharedKeys(sk);
+        JSONConverter jc(enc);
+        REQUIRE(jc.encodeJSON(readTestFile(kBigJSONTestFileName)));
+        enc.end();
+        alloc_slice fleece = enc.finish();
+        Retained<Doc> doc = new Doc(fleece, Doc::kTrusted, sk);
+
+        alloc_slice container = CompressedDoc::compress(fleece, 4096);
+        CHECK(CompressedDoc::isCompressed(container));
+        CHECK(!CompressedDoc::isCompressed(fleece));
+        CHECK(container.size < fleece.size);
+
+        Retained<CompressedDoc> cdoc = new CompressedDoc(container, sk);
+        CHECK(cdoc->blockCount() == (fleece.size + 4095) / 4096);
+        CHECK(cdoc->blocksLoaded() <= 2);
+
+        // Looking up a value decompresses only the blocks it needs:
+        for (const char *path : {"[500].name", "[0].friends[1]", "[999]", "[123].age"}) {
+            INFO("path is " << path);
+            const Value *value = cdoc->get(Path(slice(path)));
+            REQUIRE(value);
+            CHECK(value->toJSON() == Path::eval(slice(path), doc->root())->toJSON());
+        }
+        CHECK(cdoc->blocksLoaded() < cdoc->blockCount() / 2);
+        CHECK(cdoc->get(Path("[500].nosuchkey")) == nullptr);
+        CHECK(cdoc->get(Path("[1000]")) == nullptr);
+
+        // Getting the root decompresses everything:
+        const Value *root = cdoc->root();
+        CHECK(cdoc->blocksLoaded() == cdoc->blockCount());
+        CHECK((cdoc->data() == fleece));          // (extra parens avoid dumping huge slices)
+        CHECK((root->toJSON() == doc->root()->toJSON()));
+
+        // The Encoder can write the container directly:
+        Encoder enc2;
+        enc2.setSharedKeys(sk);
+        enc2.writeValue(doc->root());
+        Retained<CompressedDoc> cdoc2 = new CompressedDoc(enc2.finishCompressed(4096), sk);
+        CHECK((cdoc2->root()->toJSON() == doc->root()->toJSON()));
+    }
+
+
+    TEST_CASE("CompressedDoc corrupt", "[Doc]") {
+        Encoder enc;
+        enc.beginArray();
+        for (int i = 0; i < 1000; ++i)
+            enc.writeString("item #" + std::to_string(i));
+        enc.endArray();
+        alloc_slice container = enc.finishCompressed(256);
+        size_t nBlocks;
+        {
+            Retained<CompressedDoc> cdoc = new CompressedDoc(container);
+            CHECK(cdoc->get(Path("[999]"))->asString() == "item #999"_sl);
+            nBlocks = cdoc->blockCount();
+        }
+
+        CHECK_THROWS(new CompressedDoc(alloc_slice(container.upTo(container.size - 1))));
+        CHECK_THROWS(new CompressedDoc(alloc_slice(container.upTo(8))));
+
+        // Make the first block's first sequence copy from before the start of the data:
+        alloc_slice corrupt = alloc_slice(slice(container));
+        ((uint8_t*)corrupt.buf)[12 + 4 * nBlocks] = 0x0F;
+        Retained<CompressedDoc> cdoc = new CompressedDoc(corrupt);
+        CHECK_THROWS(cdoc->root());
+    }
+
+
+    TEST_CASE("DocCache", "[Doc]") {
+        Retained<DocCache> cache = new DocCache(100000, 100);
+        alloc_slice data = readTestFile("1person.fleece");
+
+        // Looking up by data:
+        Retained<Doc> doc1 = cache->get(data);
+        REQUIRE(doc1);
+        CHECK(doc1->data() == data);
+        Retained<Doc> doc2 = cache->get(data);
+        CHECK(doc2 == doc1);
+        Retained<Doc> doc3 = cache->get(alloc_slice(slice(data)));     // equal copy of the data
+        CHECK(doc3 == doc1);
+        CHECK(doc3->data().buf == data.buf);
+        Retained<SharedKeys> sk = new SharedKeys();
+        alloc_slice dataCopy(data.buf, data.size);  // (Docs on one buffer must share SharedKeys)
+        Retained<Doc> doc4 = cache->get(dataCopy, Doc::kUntrusted, sk);  // different SharedKeys
+        CHECK(doc4 != doc1);
+        CHECK(doc4->sharedKeys() == sk);
+
+        alloc_slice garbage("not fleece at all!"_sl);
+        CHECK(!cache->get(garbage));
+
+        DocCache::Stats stats = cache->stats();
+        CHECK(stats.hits == 2);
+        CHECK(stats.misses == 3);
+        CHECK(stats.evictions == 0);
+        CHECK(stats.count == 2);
+        CHECK(stats.bytes == 2 * data.size);
+
+        // Looking up by key:
+        CHECK(!cache->find("person"_sl));
+        Retained<Doc> keyed = cache->add("person"_sl, data);
+        REQUIRE(keyed);
+        CHECK(keyed != doc1);
+        CHECK(cache->find("person"_sl).get() == keyed);
+        CHECK(cache->add("person"_sl, data).get() == keyed);
+        Retained<Doc> other = Doc::fromJSON("{\"name\": \"Other\"}"_sl);
+        Retained<Doc> replaced = cache->add("person"_sl, other->allocedData());
+        CHECK(replaced != keyed);
+        CHECK(cache->find("person"_sl).get() == replaced);
+        CHECK(cache->remove("person"_sl));
+        CHECK(!cache->remove("person"_sl));
+        CHECK(!cache->find("person"_sl));
+
+        // Evicting when over the memory limit:
+        cache->setMaxBytes(0);
+        stats = cache->stats();
+        CHECK(stats.count == 0);
+        CHECK(stats.bytes == 0);
+        CHECK(stats.evictions == 2);
+        CHECK(doc1->root());                // evicted Docs stay alive while retained
+        CHECK(cache->get(data).get() != doc1);    // too big for the cache, so not cached
+        CHECK(cache->stats().count == 0);
+
+        // Evicting when over the count limit:
+        cache->setMaxBytes(100000);
+        for (int i = 0; i < 200; ++i) {
+            Retained<Doc> doc = Doc::fromJSON(slice("[" + std::to_string(i) + "]"));
+            cache->add(slice(std::to_string(i)), doc->allocedData());
+        }
+        stats = cache->stats();
+        CHECK(stats.count <= 100);
+        CHECK(stats.count + stats.evictions == 200 + 2);
+        CHECK(cache->find("199"_sl));
+
+        cache->clear();
+        CHECK(cache->stats().count == 0);
+    }
+
+
+    TEST_CASE("DocCache concurrency", "[Doc]") {
+        static constexpr int kThreads = 4, kDocs = 50, kIterations = 5000;
+        Retained<DocCache> cache = new DocCache(1000000, kDocs / 2);
+        std::vector<alloc_slice> datas;
+        for (int i = 0; i < kDocs; ++i) {
+            Retained<Doc> doc = Doc::fromJSON(slice("{\"i\":" + std::to_string(i) + "}"));
+            datas.push_back(doc->allocedData());
+        }
+
+        std::atomic<int> failures {0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t) {
+            threads.emplace_back([&, t] {
+                for (int n = 0; n < kIterations; ++n) {
+                    int i = (n * 7 + t * 13) % kDocs;
+                    Retained<Doc> doc;
+                    if (n % 2)
+                        doc = cache->get(datas[i]);
+                    else if (!(doc = cache->find(slice(std::to_string(i)))))
+                        doc = cache->add(slice(std::to_string(i)), datas[i]);
+                    if (!doc || doc->asDict()->get("i"_sl)->asInt() != i)
+                        ++failures;
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+        CHECK(failures == 0);
+        DocCache::Stats stats = cache->stats();
+        CHECK(stats.count <= kDocs / 2);
+        CHECK(stats.hits + stats.misses >= kThreads * kIterations);
+    }
+
+
+    TEST_CASE("DocCache with thread-confined data", "[Doc]") {
+        Retained<DocCache> cache = new DocCache(100000, 100);
+        alloc_slice data = readTestFile("1person.fleece");
+        Retained<Doc> doc;
+        {
+            // The cached Doc must not keep the confined buffer, nor be confined itself:
+            ThreadConfinedScope confined;
+            alloc_slice confinedData = alloc_slice(slice(data));
+            REQUIRE(confinedData.isThreadConfined());
+            doc = cache->get(confinedData);
+            REQUIRE(doc);
+            CHECK(!doc->isThreadConfined());
+            CHECK(doc->data().buf != confinedData.buf);
+            CHECK(!doc->allocedData().isThreadConfined());
+            CHECK(cache->add("person"_sl, confinedData)->allocedData().buf != confinedData.buf);
+        }
+        // So it can be used from another thread:
+        std::thread([&] {
+            Retained<Doc> found = cache->get(data);
+            CHECK(found == doc);
+            CHECK(cache->find("person"_sl)->asDict()->get("name"_sl));
+        }).join();
+    }
+
+
+    TEST_CASE("DocCache created in thread-confined mode", "[Doc]") {
+        // Caches and SharedKeys are shared between threads, so they're never confined:
+        alloc_slice data = readTestFile("1person.fleece");
+        alloc_slice keyTree = KeyTree::encode({"name"_sl, "age"_sl});
+        Retained<DocCache> cache;
+        Retained<SharedKeys> sk;
+        Retained<Doc> doc;
+        {
+            ThreadConfinedScope confined;
+            DocCache *shared = DocCache::shared();
+            CHECK(!shared->isThreadConfined());
+            cache = new DocCache(100000, 100);
+            CHECK(!cache->isThreadConfined());
+            sk = new SharedKeys();
+            CHECK(!sk->isThreadConfined());
+            REQUIRE(sk->loadFromKeyTree(alloc_slice(slice(keyTree))));
+            doc = cache->get(data, Doc::kUntrusted, sk);
+            REQUIRE(doc);
+            shared->add("confined-person"_sl, alloc_slice(slice(data)));   // (other SharedKeys)
+        }
+
+        // So another thread can retain and release them, and use them after this one's done:
+        std::thread([&] {
+            for (int i = 0; i < 1000; ++i) {
+                Retained<DocCache> c = cache;
+                Retained<SharedKeys> k = sk;
+                Retained<Doc> d = c->get(data, Doc::kUntrusted, k);
+                CHECK(d == doc);
+                CHECK(DocCache::shared()->find("confined-person"_sl));
+            }
+            CHECK(sk->decode(1) == "age"_sl);
+            sk = nullptr;
+            doc = nullptr;
+            cache = nullptr;
+            DocCache::shared()->remove("confined-person"_sl);
+        }).join();
+    }
+
+
+#ifndef NDEBUG
+    TEST_CASE("DocCache reclaims during overlapping lookups", "[Doc]") {
+        // Some lookup is always in progress, as with steady concurrent use; evicted Docs still
+        // get freed once the lookups that might have seen them are done.
+        static constexpr int kDocs = 200;
+        Retained<DocCache> cache = new DocCache(1000000, 10);
+        std::vector<Retained<Doc>> docs;
+        uint32_t lookup = cache->beginLookup();
+        for (int i = 0; i < kDocs; ++i) {
+            Retained<Doc> doc = Doc::fromJSON(slice("[" + std::to_string(i) + "]"));
+            docs.push_back(cache->add(slice(std::to_string(i)), doc->allocedData()));
+            uint32_t nextLookup = cache->beginLookup();
+            cache->endLookup(lookup);
+            lookup = nextLookup;
+            CHECK(cache->stats().retired <= 2);
+        }
+        CHECK(cache->stats().evictions >= kDocs - 10);
+
+        // Freed evicted Docs are only retained by `docs` now:
+        unsigned freed = 0;
+        for (auto &doc : docs)
+            freed += (doc->refCount() == 1);
+        CHECK(freed >= kDocs - 10 - 2);
+
+        cache->endLookup(lookup);
+        CHECK(cache->stats().retired == 0);
+    }
+#endif
+
 }
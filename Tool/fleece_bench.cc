@@ -0,0 +1,562 @@
+//
+// fleece_bench.cc
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "fleece/Fleece.hh"
+#include "fleece/Mutable.hh"
+#include "MutableHashTree.hh"
+#include "HashTree.hh"
+#include "Benchmark.hh"
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace fleece;
+using namespace std;
+
+
+static void usage(void) {
+    fprintf(stderr, "usage: fleeceBench [options]\n");
+    fprintf(stderr, "       fleeceBench --compare BASELINE.json CURRENT.json [--threshold PERCENT]\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --sizes N,N,...     Dataset sizes (number of records); default 10,1000,100000\n");
+    fprintf(stderr, "  --samples N         Samples per benchmark; default 50\n");
+    fprintf(stderr, "  --filter STRING     Only run benchmarks whose name contains STRING\n");
+    fprintf(stderr, "  --format FORMAT     text, json or csv; default text\n");
+    fprintf(stderr, "  --output FILE       Write results to FILE instead of stdout\n");
+    fprintf(stderr, "  --counters          Also record hardware performance counters (Linux only)\n");
+    fprintf(stderr, "  --list              List benchmark names and exit\n");
+    fprintf(stderr, "Compare mode exits with status 2 if any benchmark's median regressed by more\n");
+    fprintf(stderr, "than the threshold (default 10%%.)\n");
+}
+
+
+#pragma mark - DATASETS:
+
+
+// Deterministic pseudo-random generator, so every run sees the same data.
+class Random {
+public:
+    explicit Random(uint64_t seed)          :_state(seed) { }
+    uint32_t next() {
+        _state = _state * 6364136223846793005ull + 1442695040888963407ull;
+        return uint32_t(_state >> 33);
+    }
+    uint32_t below(uint32_t n)              {return next() % n;}
+    double unit()                           {return next() / double(UINT32_MAX);}
+private:
+    uint64_t _state;
+};
+
+
+static const char* const kWords[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do",
+    "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore", "magna", "aliqua", "enim"};
+static const char* const kNames[] = {
+    "Concepcion Burns", "Hodges Mullen", "Mae Walsh", "Tessa Hess", "Alvarado Hurst",
+    "Kerr Bond", "Lily Phelps", "Ayers Santana", "Goff Raymond", "Shannon Cardenas"};
+
+
+/** A synthetic document resembling Tests/1000people.json: an array of `count` "person" dicts. */
+struct Dataset {
+    size_t          count;
+    alloc_slice     json;
+    Doc             doc;
+
+    explicit Dataset(size_t n)
+    :count(n)
+    {
+        Random rnd(n);
+        Encoder enc(kFLEncodeJSON);
+        enc.beginArray(n);
+        for (size_t i = 0; i < n; i++) {
+            char buf[64];
+            enc.beginDict();
+            sprintf(buf, "%08x-%04x-%04x", rnd.next(), rnd.below(0x10000), rnd.below(0x10000));
+            enc["guid"_sl] = buf;
+            enc["index"_sl] = (int64_t)i;
+            enc["isActive"_sl] = (rnd.below(2) == 1);
+            enc["age"_sl] = (int)(18 + rnd.below(60));
+            enc["balance"_sl] = rnd.unit() * 10000.0;
+            enc["name"_sl] = kNames[rnd.below(10)];
+            string about;
+            for (int w = 0; w < 20; w++) {
+                about += kWords[rnd.below(20)];
+                about += ' ';
+            }
+            enc["about"_sl] = about;
+            enc["latitude"_sl] = rnd.unit() * 180.0 - 90.0;
+            enc["longitude"_sl] = rnd.unit() * 360.0 - 180.0;
+            enc.writeKey("tags"_sl);
+            enc.beginArray();
+            for (int t = 0; t < 5; t++)
+                enc.writeString(kWords[rnd.below(20)]);
+            enc.endArray();
+            enc.writeKey("friends"_sl);
+            enc.beginArray();
+            for (int f = 0; f < 3; f++) {
+                enc.beginDict();
+                enc["id"_sl] = f;
+                enc["name"_sl] = kNames[rnd.below(10)];
+                enc.endDict();
+            }
+            enc.endArray();
+            enc.endDict();
+        }
+        enc.endArray();
+        json = enc.finish();
+        doc = Doc::fromJSON(json);
+        if (!doc)
+            throw "Couldn't generate dataset";
+    }
+
+    Array people() const                    {return doc.asArray();}
+};
+
+
+#pragma mark - RUNNING BENCHMARKS:
+
+
+struct Result {
+    string  name;
+    size_t  size;               // dataset size
+    size_t  ops;                // operations per sample
+    size_t  samples;
+    double  median, mean, stddev, min, p90, p99, max;     // nanoseconds per operation
+    double  counters[PerfCounters::kNumCounters];           // median counts per operation
+};
+
+
+static unsigned            gSamples = 50;
+static string              gFilter;
+static bool                gListOnly = false;
+static bool                gCounters = false;
+static vector<Result>      gResults;
+
+
+/** Runs `fn` (which performs `ops` operations) `gSamples` times, and records the timing. */
+template <class FN>
+static void run(const char *name, const Dataset &ds, size_t ops, FN fn) {
+    if (gListOnly) {
+        printf("%s\n", name);
+        return;
+    }
+    if (!gFilter.empty() && !strstr(name, gFilter.c_str()))
+        return;
+    fprintf(stderr, "%-24s (n=%zu)...\n", name, ds.count);
+    fn();                                           // warm-up
+    Benchmark bench(gCounters);
+    for (unsigned i = 0; i < gSamples; i++) {
+        bench.start();
+        fn();
+        bench.stop();
+    }
+    double scale = 1.0e9 / max(ops, size_t(1));
+    Result r {name, ds.count, ops, bench.count(),
+              bench.median() * scale, bench.average() * scale, bench.stddev() * scale,
+              bench.range().first * scale, bench.percentile(90) * scale,
+              bench.percentile(99) * scale, bench.range().second * scale, {}};
+    for (int c = 0; c < PerfCounters::kNumCounters; ++c)
+        r.counters[c] = bench.counterMedian(PerfCounters::Counter(c)) / max(ops, size_t(1));
+    gResults.push_back(r);
+}
+
+
+static void check(bool ok, const char *what) {
+    if (!ok)
+        throw what;
+}
+
+
+static void runAll(const Dataset &ds) {
+    const size_t n = ds.count;
+    Array people = ds.people();
+    alloc_slice data(ds.doc.data());
+
+    // Encoding & JSON:
+    run("json/parse", ds, 1, [&]{
+        check(Doc::fromJSON(ds.json).root() != nullptr, "JSON parse failed");
+    });
+    run("json/output", ds, 1, [&]{
+        check(people.toJSON().size > 0, "JSON output failed");
+    });
+    run("encode/value", ds, 1, [&]{
+        Encoder enc;
+        enc.writeValue(people);
+        check(enc.finish().size > 0, "encode failed");
+    });
+    run("encode/build", ds, n, [&]{
+        Encoder enc;
+        enc.beginArray(n);
+        for (size_t i = 0; i < n; i++) {
+            enc.beginDict(3);
+            enc["index"_sl] = (int64_t)i;
+            enc["name"_sl] = kNames[i % 10];
+            enc["balance"_sl] = i * 1.5;
+            enc.endDict();
+        }
+        enc.endArray();
+        check(enc.finish().size > 0, "encode failed");
+    });
+    run("doc/validate", ds, 1, [&]{
+        check(Doc(data, kFLUntrusted).root() != nullptr, "validation failed");
+    });
+
+    // Lookup:
+    vector<uint32_t> indexes(1000);
+    Random rnd(1);
+    for (auto &i : indexes)
+        i = rnd.below(uint32_t(n));
+    run("array/get", ds, indexes.size(), [&]{
+        for (auto i : indexes)
+            check(people[i] != nullptr, "array/get failed");
+    });
+    run("array/iterate", ds, n, [&]{
+        size_t count = 0;
+        for (Array::iterator i(people); i; ++i)
+            ++count;
+        check(count == n, "array/iterate failed");
+    });
+    run("dict/get", ds, indexes.size(), [&]{
+        for (auto i : indexes)
+            check(people[i].asDict()["name"] != nullptr, "dict/get failed");
+    });
+    Dict::Key nameKey("name"_sl);
+    run("dict/get_key", ds, indexes.size(), [&]{
+        for (auto i : indexes)
+            check(people[i].asDict()[nameKey] != nullptr, "dict/get_key failed");
+    });
+    run("dict/get_missing", ds, indexes.size(), [&]{
+        for (auto i : indexes)
+            check(people[i].asDict()["nonexistent"] == nullptr, "dict/get_missing failed");
+    });
+    run("dict/iterate", ds, n, [&]{
+        size_t count = 0;
+        for (Array::iterator i(people); i; ++i)
+            for (Dict::iterator j(i.value().asDict()); j; ++j)
+                ++count;
+        check(count > 0, "dict/iterate failed");
+    });
+    KeyPath path("[-1].friends[1].name"_sl, nullptr);
+    run("path/eval", ds, 1000, [&]{
+        for (int i = 0; i < 1000; i++)
+            check(path.eval(people) != nullptr, "path/eval failed");
+    });
+
+    // Mutation:
+    run("mutable/update", ds, indexes.size(), [&]{
+        MutableArray m = people.mutableCopy();
+        for (auto i : indexes)
+            m.getMutableDict(i)["age"_sl] = 99;
+        Encoder enc;
+        enc.writeValue(m);
+        check(enc.finish().size > 0, "mutable/update failed");
+    });
+    run("mutable/deep_copy", ds, 1, [&]{
+        check(people.mutableCopy(kFLDeepCopyImmutables) != nullptr, "mutable/deep_copy failed");
+    });
+
+    // HashTree:
+    vector<alloc_slice> keys;
+    keys.reserve(n);
+    for (Array::iterator i(people); i; ++i)
+        keys.emplace_back(i.value().asDict()["guid"].asString());
+    run("hashtree/insert", ds, n, [&]{
+        MutableHashTree tree;
+        uint32_t i = 0;
+        for (auto &key : keys)
+            tree.set(key, people[i++]);
+        check(tree.count() > 0, "hashtree/insert failed");
+    });
+    MutableHashTree mtree;
+    for (uint32_t i = 0; i < n; i++)
+        mtree.set(keys[i], people[i]);
+    alloc_slice treeData;
+    run("hashtree/encode", ds, 1, [&]{
+        Encoder enc;
+        enc.suppressTrailer();
+        mtree.writeTo(enc);
+        treeData = enc.finish();
+    });
+    if (treeData) {
+        const HashTree *tree = HashTree::fromData(treeData);
+        run("hashtree/get", ds, indexes.size(), [&]{
+            for (auto i : indexes)
+                check(tree->get(keys[i]) != nullptr, "hashtree/get failed");
+        });
+    }
+
+    // Deltas:
+    MutableArray changed = people.mutableCopy(kFLDeepCopyImmutables);
+    for (auto i : indexes)
+        changed.getMutableDict(i)["age"_sl] = 99;
+    Doc changedDoc;
+    {
+        Encoder enc;
+        enc.writeValue(changed);
+        changedDoc = enc.finishDoc();
+    }
+    alloc_slice delta;
+    run("delta/create", ds, 1, [&]{
+        delta = alloc_slice(FLCreateJSONDelta(people, changedDoc.root()));
+        check(delta.size > 0, "delta/create failed");
+    });
+    run("delta/apply", ds, 1, [&]{
+        check(alloc_slice(FLApplyJSONDelta(people, delta, nullptr)).size > 0,
+              "delta/apply failed");
+    });
+}
+
+
+#pragma mark - OUTPUT:
+
+
+static void writeResults(FILE *out, const string &format) {
+    if (format == "json") {
+        Encoder enc(kFLEncodeJSON);
+        enc.beginDict();
+#ifdef NDEBUG
+        enc["optimized"_sl] = true;
+#else
+        enc["optimized"_sl] = false;
+#endif
+        enc["unit"_sl] = "ns/op";
+        enc.writeKey("benchmarks"_sl);
+        enc.beginArray();
+        for (auto &r : gResults) {
+            enc.beginDict();
+            enc["name"_sl] = r.name;
+            enc["size"_sl] = (uint64_t)r.size;
+            enc["ops"_sl] = (uint64_t)r.ops;
+            enc["samples"_sl] = (uint64_t)r.samples;
+            enc["median"_sl] = r.median;
+            enc["mean"_sl] = r.mean;
+            enc["stddev"_sl] = r.stddev;
+            enc["min"_sl] = r.min;
+            enc["p90"_sl] = r.p90;
+            enc["p99"_sl] = r.p99;
+            enc["max"_sl] = r.max;
+            if (gCounters) {
+                for (int c = 0; c < PerfCounters::kNumCounters; ++c)
+                    enc[slice(PerfCounters::kCounterNames[c])] = r.counters[c];
+            }
+            enc.endDict();
+        }
+        enc.endArray();
+        enc.endDict();
+        alloc_slice json = enc.finish();
+        fwrite(json.buf, 1, json.size, out);
+        fputc('\n', out);
+    } else if (format == "csv") {
+        fprintf(out, "name,size,ops,samples,median_ns,mean_ns,stddev_ns,min_ns,p90_ns,p99_ns,max_ns");
+        if (gCounters) {
+            for (auto counterName : PerfCounters::kCounterNames)
+                fprintf(out, ",%s", counterName);
+        }
+        fputc('\n', out);
+        for (auto &r : gResults) {
+            fprintf(out, "%s,%zu,%zu,%zu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f",
+                    r.name.c_str(), r.size, r.ops, r.samples,
+                    r.median, r.mean, r.stddev, r.min, r.p90, r.p99, r.max);
+            if (gCounters) {
+                for (double count : r.counters)
+                    fprintf(out, ",%.1f", count);
+            }
+            fputc('\n', out);
+        }
+    } else {
+        fprintf(out, "%-20s %8s %12s %12s %10s %12s %12s",
+                "name", "size", "median", "mean", "stddev", "p90", "p99");
+        if (gCounters)
+            fprintf(out, " %12s %12s %6s %10s %10s", "cycles", "instrs", "IPC", "cache-miss", "br-miss");
+        fprintf(out, "  (per op; times in ns)\n");
+        for (auto &r : gResults) {
+            fprintf(out, "%-20s %8zu %12.1f %12.1f %10.1f %12.1f %12.1f",
+                    r.name.c_str(), r.size, r.median, r.mean, r.stddev, r.p90, r.p99);
+            if (gCounters) {
+                double cycles = r.counters[PerfCounters::kCycles];
+                double instrs = r.counters[PerfCounters::kInstructions];
+                fprintf(out, " %12.0f %12.0f %6.2f %10.1f %10.1f", cycles, instrs,
+                        (cycles > 0 ? instrs / cycles : 0.0),
+                        r.counters[PerfCounters::kCacheMisses],
+                        r.counters[PerfCounters::kBranchMisses]);
+            }
+            fputc('\n', out);
+        }
+    }
+}
+
+
+#pragma mark - COMPARISON:
+
+
+static Doc readResultFile(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (!in)
+        throw "Couldn't open results file";
+    string json;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        json.append(buf, n);
+    fclose(in);
+    Doc doc = Doc::fromJSON(slice(json));
+    if (!doc || !doc.asDict()["benchmarks"].asArray())
+        throw "Invalid results file (expected JSON output of fleeceBench)";
+    return doc;
+}
+
+
+static int compare(const char *baselinePath, const char *currentPath, double threshold) {
+    Doc baseline = readResultFile(baselinePath), current = readResultFile(currentPath);
+
+    auto keyOf = [](Dict r) {
+        return string(r["name"].asString()) + "/" + to_string(r["size"].asUnsigned());
+    };
+    map<string,double> oldMedians;
+    for (Array::iterator i(baseline.asDict()["benchmarks"].asArray()); i; ++i)
+        oldMedians[keyOf(i.value().asDict())] = i.value().asDict()["median"].asDouble();
+
+    int regressions = 0;
+    printf("%-32s %12s %12s %9s\n", "benchmark", "baseline", "current", "change");
+    for (Array::iterator i(current.asDict()["benchmarks"].asArray()); i; ++i) {
+        Dict r = i.value().asDict();
+        string key = keyOf(r);
+        double nuu = r["median"].asDouble();
+        auto old = oldMedians.find(key);
+        if (old == oldMedians.end()) {
+            printf("%-32s %12s %12.1f %9s\n", key.c_str(), "-", nuu, "new");
+            continue;
+        }
+        double change = (old->second > 0) ? (nuu - old->second) / old->second * 100.0 : 0.0;
+        const char *flag = "";
+        if (change > threshold) {
+            flag = "  REGRESSION";
+            ++regressions;
+        } else if (change < -threshold) {
+            flag = "  improved";
+        }
+        printf("%-32s %12.1f %12.1f %+8.1f%%%s\n", key.c_str(), old->second, nuu, change, flag);
+    }
+    if (regressions > 0)
+        printf("\n%d benchmark(s) regressed by more than %.1f%%\n", regressions, threshold);
+    return regressions ? 2 : 0;
+}
+
+
+#pragma mark - MAIN:
+
+
+int main(int argc, const char * argv[]) {
+    try {
+        vector<size_t> sizes = {10, 1000, 100000};
+        string format = "text";
+        const char *outputPath = nullptr;
+        const char *comparePaths[2] = {nullptr, nullptr};
+        double threshold = 10.0;
+
+        for (int i = 1; i < argc; ++i) {
+            const char *arg = argv[i];
+            auto nextArg = [&]() -> const char* {
+                if (++i >= argc)
+                    throw "Missing argument value";
+                return argv[i];
+            };
+            if (strcmp(arg, "--sizes") == 0) {
+                sizes.clear();
+                for (const char *s = nextArg(); *s; ) {
+                    char *end;
+                    sizes.push_back(strtoul(s, &end, 10));
+                    if (end == s || sizes.back() == 0)
+                        throw "Invalid --sizes";
+                    s = (*end == ',') ? end + 1 : end;
+                }
+            } else if (strcmp(arg, "--samples") == 0) {
+                gSamples = (unsigned)atoi(nextArg());
+                if (gSamples == 0)
+                    throw "Invalid --samples";
+            } else if (strcmp(arg, "--filter") == 0) {
+                gFilter = nextArg();
+            } else if (strcmp(arg, "--format") == 0) {
+                format = nextArg();
+                if (format != "text" && format != "json" && format != "csv")
+                    throw "Unknown --format";
+            } else if (strcmp(arg, "--output") == 0) {
+                outputPath = nextArg();
+            } else if (strcmp(arg, "--counters") == 0) {
+                gCounters = true;
+            } else if (strcmp(arg, "--list") == 0) {
+                gListOnly = true;
+            } else if (strcmp(arg, "--compare") == 0) {
+                comparePaths[0] = nextArg();
+                comparePaths[1] = nextArg();
+            } else if (strcmp(arg, "--threshold") == 0) {
+                threshold = atof(nextArg());
+            } else if (strcmp(arg, "--help") == 0) {
+                usage();
+                return 0;
+            } else {
+                fprintf(stderr, "Unknown argument '%s'\n", arg);
+                usage();
+                return 1;
+            }
+        }
+
+        if (comparePaths[0])
+            return compare(comparePaths[0], comparePaths[1], threshold);
+
+#ifndef NDEBUG
+        fprintf(stderr, "*** WARNING: This is an unoptimized build; results are meaningless! ***\n");
+#endif
+        if (gCounters && !PerfCounters().available()) {
+            fprintf(stderr, "Hardware performance counters are unavailable; reporting times only\n");
+            gCounters = false;
+        }
+        if (gListOnly) {
+            runAll(Dataset(1));
+            return 0;
+        }
+
+        for (size_t size : sizes) {
+            Dataset ds(size);
+            runAll(ds);
+        }
+
+        FILE *out = stdout;
+        if (outputPath) {
+            out = fopen(outputPath, "w");
+            if (!out)
+                throw "Couldn't open output file";
+        }
+        writeResults(out, format);
+        if (out != stdout)
+            fclose(out);
+        return 0;
+
+    } catch (const char *err) {
+        fprintf(stderr, "%s\n", err);
+        return 1;
+    } catch (const std::exception &x) {
+        fprintf(stderr, "%s\n", x.what());
+        return 1;
+    } catch (...) {
+        fprintf(stderr, "Uncaught exception!\n");
+        return 1;
+    }
+}
@@ -17,10 +17,26 @@
 //
 
 #include "fleece/Fleece.hh"
+#include "SizeStats.hh"
+#include "Stopwatch.hh"
+#include "function_ref.hh"
+#include "sliceIO.hh"
+#include "varint.hh"
 #include <stdio.h>
-#include <iostream>
-#include <sstream>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 #ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #define _isatty isatty
 #else
@@ -32,16 +48,42 @@
 
 using namespace fleece;
 using namespace std;
+namespace fs = std::filesystem;
 
 
 static void usage(void) {
-    fprintf(stderr, "usage: fleece [--hex] encode [JSON file]\n");
-    fprintf(stderr, "       fleece [--hex] decode [Fleece file]\n");
-    fprintf(stderr, "       fleece dump [Fleece file]\n");
-    fprintf(stderr, "  Reads stdin unless a file is given; always writes to stdout.\n");
+    fprintf(stderr, "usage: fleece [options] encode [JSON files/dirs...]\n");
+    fprintf(stderr, "       fleece [options] decode [Fleece files/dirs...]\n");
+    fprintf(stderr, "       fleece [options] dump [Fleece files/dirs...]\n");
+    fprintf(stderr, "       fleece [options] validate [files/dirs...]\n");
+    fprintf(stderr, "       fleece [options] stats [Fleece files/dirs...]\n");
+    fprintf(stderr, "  Reads stdin unless files are given. Directories are searched recursively for\n");
+    fprintf(stderr, "  files with the input extension (.json, .ndjson/.jsonl, or .fleece.)\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --hex          Fleece data is written (encode) or read (decode) as hex\n");
+    fprintf(stderr, "  --ndjson       JSON has one document per line; the Fleece equivalent is a\n");
+    fprintf(stderr, "                 stream of documents, each prefixed with its varint length\n");
+    fprintf(stderr, "                 (padded with a 0 byte to an even length)\n");
+    fprintf(stderr, "  --json         validate: inputs are JSON instead of Fleece\n");
+    fprintf(stderr, "  --out DIR      encode/decode: write each output to a file in DIR\n");
+    fprintf(stderr, "  -j, --jobs N   Number of threads; default is the number of CPU cores\n");
+    fprintf(stderr, "  Otherwise writes to stdout; decoded documents are written one per line.\n");
 }
 
 
+enum class Mode {none, encode, decode, dump, validate, stats};
+
+static struct {
+    Mode mode = Mode::none;
+    bool hex = false, ndjson = false, json = false;
+    unsigned jobs = 0;
+    string outDir;
+} gOptions;
+
+
+#pragma mark - INPUT:
+
+
 #if defined(__ANDROID__) || defined(__GLIBC__) || defined(_MSC_VER)
 // digittoint is a BSD function, not available on Android, Linux, etc.
 static int digittoint(char ch) {
@@ -63,8 +105,6 @@ static int digittoint(char ch) {
 
 
 static size_t decodeHex(uint8_t buf[], size_t n) {
-    if (n & 1)
-        return 0;
     size_t size = 0;
     const uint8_t *cp = buf, *end = buf + n;
     unsigned byte = 0;
@@ -88,40 +128,382 @@ static size_t decodeHex(uint8_t buf[], size_t n) {
 }
 
 
-static alloc_slice readInput(FILE *in, bool asHex) {
-    stringstream out;
-    uint8_t buf[1024];
+static alloc_slice readInput(FILE *in) {
+    alloc_slice data(64 * 1024);
+    size_t size = 0;
     while (true) {
-        size_t n = ::fread(buf, 1, sizeof(buf), in);
+        if (size == data.size)
+            data.resize(2 * data.size);
+        size_t n = ::fread((char*)data.buf + size, 1, data.size - size, in);
         if (n == 0)
             break;
-        if (asHex) {
-            n = decodeHex(buf, n);
+        size += n;
+    }
+    if (ferror(in))
+        throw "Error reading input";
+    data.resize(size);
+    return data;
+}
+
+
+/** The contents of an input file (memory-mapped where possible), or of stdin if the path is
+    empty. */
+class InputFile {
+public:
+    explicit InputFile(const string &path) {
+        if (path.empty()) {
+            _data = readInput(stdin);
+            return;
+        }
+#ifndef _MSC_VER
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw "Couldn't open file";
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            if (st.st_size == 0) {
+                ::close(fd);
+                return;
+            }
+            void *mapped = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED)
+                _mapped = slice(mapped, size_t(st.st_size));
+        }
+        ::close(fd);
+        if (_mapped)
+            return;
+#endif
+        _data = readFile(path.c_str());
+    }
+
+    ~InputFile() {
+#ifndef _MSC_VER
+        if (_mapped)
+            ::munmap((void*)_mapped.buf, _mapped.size);
+#endif
+    }
+
+    InputFile(const InputFile&) = delete;
+
+    slice data() const          {return _mapped ? _mapped : slice(_data);}
+
+    /** The data with hex decoding applied, if `hex` is true. */
+    alloc_slice decoded(bool hex) const {
+        alloc_slice data(this->data());
+        if (hex && data.size > 0) {
+            size_t n = decodeHex((uint8_t*)data.buf, data.size);
             if (n == 0)
                 throw "Invalid hex input";
+            data.resize(n);
         }
-        out.write((char*)buf, n);
+        return data;
     }
-    if (ferror(in))
-        throw "Error reading input";
-    return alloc_slice(out.str());
+
+private:
+    slice _mapped;
+    alloc_slice _data;
+};
+
+
+// Calls `fn` with each document in `input`: the entire input, or if --ndjson was given, each
+// line of JSON or each length-prefixed Fleece document.
+static void forEachDocument(slice input, bool isJSON, function_ref<void(slice)> fn) {
+    if (!gOptions.ndjson) {
+        fn(input);
+    } else if (isJSON) {
+        while (input.size > 0) {
+            const void *eol = input.findByte('\n');
+            slice line(input.buf, eol ? eol : input.end());
+            input.setStart(eol ? offsetby(eol, 1) : input.end());
+            if (line.size > 0 && line[line.size - 1] == '\r')
+                line.setSize(line.size - 1);
+            if (line.size > 0)
+                fn(line);
+        }
+    } else {
+        while (input.size > 0) {
+            uint64_t size;
+            size_t n = GetUVarInt(input, &size);
+            if (n == 0)
+                throw "Invalid Fleece document stream";
+            n += (n & 1);                       // prefix is padded to keep the data aligned
+            if (n > input.size || size > input.size - n)
+                throw "Invalid Fleece document stream";
+            slice doc(offsetby(input.buf, n), size_t(size));
+            if (size_t(doc.buf) & 1)
+                fn(alloc_slice(doc));           // Fleece data must be 2-byte aligned
+            else
+                fn(doc);
+            input.moveStart(n + size_t(size));
+        }
+    }
+}
+
+
+#pragma mark - PROCESSING:
+
+
+struct Input {
+    string path;                    // empty for stdin
+    string outPath;                 // empty to write to stdout
+};
+
+
+struct Result {
+    alloc_slice output;             // data to write to stdout
+    string error;
+    size_t bytes {0};
+    size_t documents {0};
+    impl::SizeStats stats;
+};
+
+
+// Appends a Fleece document to a document stream, prefixed by its length as a varint. The prefix
+// is padded to an even length so the document stays 2-byte aligned, as Fleece data must be.
+static void appendDocument(string &out, slice fleece) {
+    uint8_t prefix[kMaxVarintLen64 + 1];
+    size_t n = PutUVarInt(prefix, fleece.size);
+    if (n & 1)
+        prefix[n++] = 0;
+    out.append((const char*)prefix, n);
+    out.append((const char*)fleece.buf, fleece.size);
+}
+
+
+static Result process(const Input &input, bool labelOutput) {
+    Result result;
+    try {
+        InputFile file(input.path);
+        result.bytes = file.data().size;
+        string out;
+        switch (gOptions.mode) {
+            case Mode::encode: {
+                forEachDocument(file.data(), true, [&](slice json) {
+                    Doc doc = Doc::fromJSON(json);
+                    if (!doc)
+                        throw "Invalid JSON input";
+                    if (gOptions.ndjson)
+                        appendDocument(out, doc.data());
+                    else
+                        result.output = doc.allocedData();
+                    ++result.documents;
+                });
+                if (gOptions.ndjson)
+                    result.output = alloc_slice(out);
+                if (gOptions.hex)
+                    result.output = alloc_slice(result.output.hexString());
+                break;
+            }
+            case Mode::decode: {
+                alloc_slice data = file.decoded(gOptions.hex);
+                forEachDocument(data, false, [&](slice fleece) {
+                    Value root = Value::fromData(fleece);
+                    if (!root)
+                        throw "Couldn't parse input as Fleece";
+                    alloc_slice json = root.toJSON();
+                    out.append((const char*)json.buf, json.size);
+                    out += '\n';
+                    ++result.documents;
+                });
+                result.output = alloc_slice(out);
+                break;
+            }
+            case Mode::dump: {
+                if (labelOutput)
+                    out += "== " + input.path + "\n";
+                forEachDocument(file.data(), false, [&](slice fleece) {
+                    alloc_slice dump = Doc::dump(fleece);
+                    if (dump.size == 0)
+                        throw "Couldn't parse input as Fleece";
+                    out.append((const char*)dump.buf, dump.size);
+                    ++result.documents;
+                });
+                result.output = alloc_slice(out);
+                break;
+            }
+            case Mode::validate: {
+                forEachDocument(file.data(), gOptions.json, [&](slice doc) {
+                    if (gOptions.json ? !Doc::fromJSON(doc) : !Value::fromData(doc))
+                        throw gOptions.json ? "Invalid JSON" : "Invalid Fleece";
+                    ++result.documents;
+                });
+                break;
+            }
+            case Mode::stats: {
+                forEachDocument(file.data(), false, [&](slice fleece) {
+                    if (!result.stats.addDocument(fleece))
+                        throw "Invalid Fleece";
+                    ++result.documents;
+                });
+                break;
+            }
+            case Mode::none:
+                break;
+        }
+
+        if (!input.outPath.empty()) {
+            fs::path outPath(input.outPath);
+            if (outPath.has_parent_path())
+                fs::create_directories(outPath.parent_path());
+            writeToFile(result.output, input.outPath.c_str());
+            result.output = nullslice;
+        }
+    } catch (const char *err) {
+        result.error = err;
+    } catch (const std::exception &x) {
+        result.error = x.what();
+    }
+    if (!result.error.empty())
+        result.output = nullslice;
+    return result;
+}
+
+
+/** Calls `process(i)` for each i in [0, n) on up to `nThreads` threads, and `output(i, result)`
+    on the calling thread for each i in order, as soon as that result is ready. Workers don't run
+    more than `kMaxPending` jobs ahead of the output, to bound memory use. */
+static void processInParallel(size_t n, unsigned nThreads,
+                              function_ref<Result(size_t)> process,
+                              function_ref<void(size_t, Result&)> output)
+{
+    static constexpr size_t kMaxPending = 256;
+    if (nThreads <= 1 || n <= 1) {
+        for (size_t i = 0; i < n; ++i) {
+            Result result = process(i);
+            output(i, result);
+        }
+        return;
+    }
+
+    vector<unique_ptr<Result>> results(n);
+    mutex m;
+    condition_variable cond;
+    size_t nextJob = 0, nextOutput = 0;
+
+    auto worker = [&] {
+        unique_lock<mutex> lock(m);
+        while (true) {
+            cond.wait(lock, [&] {return nextJob >= n || nextJob < nextOutput + kMaxPending;});
+            if (nextJob >= n)
+                return;
+            size_t i = nextJob++;
+            lock.unlock();
+            auto result = make_unique<Result>(process(i));
+            lock.lock();
+            results[i] = move(result);
+            cond.notify_all();
+        }
+    };
+    vector<thread> threads;
+    for (unsigned t = 0; t < min(size_t(nThreads), n); ++t)
+        threads.emplace_back(worker);
+
+    unique_lock<mutex> lock(m);
+    while (nextOutput < n) {
+        cond.wait(lock, [&] {return results[nextOutput] != nullptr;});
+        auto result = move(results[nextOutput]);
+        lock.unlock();
+        output(nextOutput, *result);
+        lock.lock();
+        ++nextOutput;
+        cond.notify_all();
+    }
+    lock.unlock();
+    for (auto &t : threads)
+        t.join();
+}
+
+
+#pragma mark - INPUT FILES:
+
+
+static bool inputIsJSON() {
+    return gOptions.mode == Mode::encode || (gOptions.mode == Mode::validate && gOptions.json);
+}
+
+
+static bool hasInputExtension(const fs::path &path) {
+    auto ext = path.extension().string();
+    if (!inputIsJSON())
+        return ext == ".fleece";
+    else if (gOptions.ndjson)
+        return ext == ".ndjson" || ext == ".jsonl";
+    else
+        return ext == ".json";
 }
 
 
-static void writeOutput(slice output, bool asHex =false) {
-    if (asHex) {
-        string hex = output.hexString();
-        fputs(hex.c_str(), stdout);
+static string outputPath(fs::path relativePath) {
+    if (gOptions.outDir.empty())
+        return "";
+    if (gOptions.mode == Mode::encode)
+        relativePath.replace_extension(".fleece");
+    else
+        relativePath.replace_extension(gOptions.ndjson ? ".ndjson" : ".json");
+    return (fs::path(gOptions.outDir) / relativePath).string();
+}
+
+
+static void addInputs(const char *arg, vector<Input> &inputs) {
+    fs::path path(arg);
+    if (fs::is_directory(path)) {
+        vector<fs::path> files;
+        for (auto &entry : fs::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file() && hasInputExtension(entry.path()))
+                files.push_back(entry.path());
+        }
+        sort(files.begin(), files.end());
+        for (auto &file : files)
+            inputs.push_back({file.string(), outputPath(fs::relative(file, path))});
     } else {
-        fwrite(output.buf, 1, output.size, stdout);
+        inputs.push_back({arg, outputPath(path.filename())});
     }
 }
 
 
+#pragma mark - OUTPUT:
+
+
+static void writeOutput(slice output) {
+    fwrite(output.buf, 1, output.size, stdout);
+}
+
+
+static void printStats(const impl::SizeStats &s) {
+    double total = double(max(s.totalBytes, size_t(1)));
+    auto row = [&](const char *name, const impl::SizeStats::Bucket &b) {
+        printf("%-24s %12zu %14zu %6.1f%%\n", name, b.count, b.bytes, 100.0 * b.bytes / total);
+    };
+    printf("%zu documents, %zu bytes\n\n", s.documents, s.totalBytes);
+    printf("%-24s %12s %14s %7s\n", "", "count", "bytes", "size");
+    row("Strings",               s.strings);
+    row("Binary data",           s.data);
+    row("Integers",              s.ints);
+    row("Floats",                s.floats);
+    row("null/true/false",       s.specials);
+    row("Narrow pointers",       s.narrowPointers);
+    row("Wide pointers",         s.widePointers);
+    row("Extern pointers",       s.externPointers);
+    row("Narrow array headers",  s.narrowArrays);
+    row("Wide array headers",    s.wideArrays);
+    row("Narrow dict headers",   s.narrowDicts);
+    row("Wide dict headers",     s.wideDicts);
+    row("Shared keys",           s.sharedKeys);
+    row("String keys",           s.stringKeys);
+    printf("%-24s %12s %14zu %6.1f%%\n", "Padding", "", s.paddingBytes(),
+           100.0 * s.paddingBytes() / total);
+    size_t keys = s.sharedKeys.count + s.stringKeys.count;
+    printf("\nShared keys are used for %.1f%% of %zu dict keys\n",
+           100.0 * s.sharedKeys.count / double(max(keys, size_t(1))), keys);
+}
+
+
+#pragma mark - MAIN:
+
+
 int main(int argc, const char * argv[]) {
     try {
-        bool encode = false, decode = false, dump = false, hex = false;
-
+        vector<const char*> paths;
         int i;
         for (i = 1; i < argc; ++i) {
             const char *arg = argv[i];
@@ -130,13 +512,21 @@ int main(int argc, const char * argv[]) {
                     i++;
                     break;
                 } else if (strcmp(arg, "--encode") == 0) {
-                    encode = true;
+                    gOptions.mode = Mode::encode;
                 } else if (strcmp(arg, "--decode") == 0) {
-                    decode = true;
+                    gOptions.mode = Mode::decode;
                 } else if (strcmp(arg, "--dump") == 0) {
-                    dump = true;
+                    gOptions.mode = Mode::dump;
                 } else if (strcmp(arg, "--hex") == 0) {
-                    hex = true;
+                    gOptions.hex = true;
+                } else if (strcmp(arg, "--ndjson") == 0) {
+                    gOptions.ndjson = true;
+                } else if (strcmp(arg, "--json") == 0) {
+                    gOptions.json = true;
+                } else if (strcmp(arg, "--out") == 0 && i + 1 < argc) {
+                    gOptions.outDir = argv[++i];
+                } else if ((strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0) && i + 1 < argc) {
+                    gOptions.jobs = unsigned(atoi(argv[++i]));
                 } else if (strcmp(arg, "--help") == 0) {
                     usage();
                     return 0;
@@ -145,76 +535,96 @@ int main(int argc, const char * argv[]) {
                     usage();
                     return 1;
                 }
-            } else if (encode+decode+dump == 0) {
+            } else if (gOptions.mode == Mode::none) {
                 // Also allow mode without '--' prefix, if none was chosen yet:
                 if (strcmp(arg, "encode") == 0) {
-                    encode = true;
+                    gOptions.mode = Mode::encode;
                 } else if (strcmp(arg, "decode") == 0) {
-                    decode = true;
+                    gOptions.mode = Mode::decode;
                 } else if (strcmp(arg, "dump") == 0) {
-                    dump = true;
+                    gOptions.mode = Mode::dump;
+                } else if (strcmp(arg, "validate") == 0) {
+                    gOptions.mode = Mode::validate;
+                } else if (strcmp(arg, "stats") == 0) {
+                    gOptions.mode = Mode::stats;
                 } else {
                     break;
                 }
             } else {
-                break;
+                paths.push_back(arg);
             }
         }
+        for (; i < argc; ++i)
+            paths.push_back(argv[i]);
 
-        if (encode + decode + dump != 1) {
-            fprintf(stderr, "Choose one of --encode, --decode, or --dump\n");
+        if (gOptions.mode == Mode::none) {
+            fprintf(stderr, "Choose one of encode, decode, dump, validate or stats\n");
             usage();
             return 1;
         }
-
-        FILE *in = stdin;
-        if (i < argc) {
-            in = fopen(argv[i], "r");
-            if (!in) {
-                fprintf(stderr, "Couldn't open file %s\n", argv[i]);
-                return 1;
-            }
-            ++i;
-        }
-
-        if (i < argc) {
-            fprintf(stderr, "Unknown argument '%s'\n", argv[i]);
-            usage();
+        if (!gOptions.outDir.empty() && gOptions.mode != Mode::encode
+                                     && gOptions.mode != Mode::decode) {
+            fprintf(stderr, "--out only applies to encode and decode\n");
             return 1;
         }
 
-        if (encode && !hex && _isatty(STDOUT_FILENO))
-            throw "Let's not spew binary Fleece data to a terminal! Please redirect stdout.";
-
-        auto input = readInput(in, (decode && hex));
-
-        if (encode) {
-            Doc doc = Doc::fromJSON(input);
-            if (!doc)
-                throw "Invalid JSON input";
-            slice output = doc.data();
-            writeOutput(output, hex);
-        } else if (decode) {
-            Doc doc(input);
-            if (!doc)
-                throw "Couldn't parse input as Fleece";
-            auto json = doc.root().toJSON();
-            writeOutput(json);
-            fprintf(stdout, "\n");
-        } else if (dump) {
-            alloc_slice output = Doc::dump(input);
-            if (!output)
-                throw "Couldn't parse input as Fleece";
-            writeOutput(output);
+        vector<Input> inputs;
+        for (const char *path : paths)
+            addInputs(path, inputs);
+        if (!paths.empty() && inputs.empty())
+            throw "No input files found";
+        else if (inputs.empty())
+            inputs.push_back({"", gOptions.outDir.empty() ? "" : outputPath("stdin")});
+
+        if (gOptions.mode == Mode::encode && gOptions.outDir.empty()) {
+            if (inputs.size() > 1 && !gOptions.ndjson)
+                throw "Encoding multiple files requires --out or --ndjson";
+            if (!gOptions.hex && _isatty(STDOUT_FILENO))
+                throw "Let's not spew binary Fleece data to a terminal! Please redirect stdout.";
         }
 
-        return 0;
+        unsigned nThreads = gOptions.jobs ? gOptions.jobs : max(1u, thread::hardware_concurrency());
+        bool labelOutput = (inputs.size() > 1);
+        int status = 0;
+        size_t nBytes = 0, nDocuments = 0, nFailed = 0;
+        impl::SizeStats stats;
+        Stopwatch st;
+
+        processInParallel(inputs.size(), nThreads,
+            [&](size_t i) {
+                return process(inputs[i], labelOutput);
+            },
+            [&](size_t i, Result &result) {
+                if (!result.error.empty()) {
+                    const char *path = inputs[i].path.empty() ? "stdin" : inputs[i].path.c_str();
+                    fprintf(stderr, "%s: %s\n", path, result.error.c_str());
+                    ++nFailed;
+                    status = 1;
+                    return;
+                }
+                writeOutput(result.output);
+                nBytes += result.bytes;
+                nDocuments += result.documents;
+                stats += result.stats;
+            });
+        double elapsed = st.elapsed();
+
+        if (gOptions.mode == Mode::validate) {
+            printf("Validated %zu files (%zu documents, %.1f MB) in %.3f sec: "
+                   "%.0f files/sec, %.1f MB/sec; %zu invalid\n",
+                   inputs.size(), nDocuments, nBytes / 1.0e6, elapsed,
+                   inputs.size() / elapsed, nBytes / 1.0e6 / elapsed, nFailed);
+        } else if (gOptions.mode == Mode::stats) {
+            printStats(stats);
+        }
+        return status;
 
     } catch (const char *err) {
         fprintf(stderr, "%s\n", err);
         return 1;
     } catch (const std::exception &x) {
         fprintf(stderr, "%s\n", x.what());
+        return 1;
     } catch (...) {
         fprintf(stderr, "Uncaught exception!\n");
         return 1;
@@ -10,15 +10,22 @@ function(set_source_files_base)
         Fleece/API_Impl/Fleece.cc
         Fleece/API_Impl/FLSlice.cc
         Fleece/Core/Array.cc
+        Fleece/Core/BlobStore.cc
+        Fleece/Core/Columns.cc
+        Fleece/Core/CompressedDoc.cc
         Fleece/Core/DeepIterator.cc
         Fleece/Core/Dict.cc
         Fleece/Core/Doc.cc
+        Fleece/Core/DocCache.cc
         Fleece/Core/Encoder.cc
+        Fleece/Core/JSON5Converter.cc
         Fleece/Core/JSONConverter.cc
         Fleece/Core/JSONDelta.cc
         Fleece/Core/Path.cc
         Fleece/Core/Pointer.cc
         Fleece/Core/SharedKeys.cc
+        Fleece/Core/SizeStats.cc
+        Fleece/Core/Stats.cc
         Fleece/Core/Value+Dump.cc
         Fleece/Core/Value.cc
         Fleece/Integration/MContext.cc
@@ -38,9 +45,13 @@ function(set_source_files_base)
         Fleece/Support/NumConversion.cc
         Fleece/Support/JSON5.cc
         Fleece/Support/JSONEncoder.cc
+        Fleece/Support/KeyTree.cc
         Fleece/Support/LibC++Debug.cc
+        Fleece/Support/LZ4.cc
         Fleece/Support/ParseDate.cc
         Fleece/Support/RefCounted.cc
+        Fleece/Support/ScratchArena.cc
+        Fleece/Support/SHA256.cc
         Fleece/Support/slice_stream.cc
         Fleece/Support/sliceIO.cc
         Fleece/Support/StringTable.cc
@@ -74,11 +85,11 @@ function(set_test_source_files_base)
         Tests/HashTreeTests.cc
         Tests/JSON5Tests.cc
         Tests/MutableTests.cc
+        Tests/NumericTests.cc
         Tests/PerfTests.cc
         Tests/SharedKeysTests.cc
         Tests/SupportTests.cc
         Tests/ValueTests.cc
-        Experimental/KeyTree.cc
         PARENT_SCOPE
     )
 endfunction()